@@ -20,7 +20,9 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "dlna_internals.h"
 #include "profiles.h"
@@ -60,29 +62,68 @@ audio_profile_guess_lpcm (AVCodecContext *ac)
   return AUDIO_PROFILE_LPCM;
 }
 
+/* mime types carry the rate and channels: one profile for each, kept
+   as long as the items pointing to it */
+typedef struct lpcm_profile_s {
+  dlna_profile_t profile;
+  struct lpcm_profile_s *next;
+} lpcm_profile_t;
+
+static lpcm_profile_t *lpcm_profiles = NULL;
+static pthread_mutex_t lpcm_profiles_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static dlna_profile_t *
+lpcm_profile (dlna_profile_t *base, int rate, int channels)
+{
+  lpcm_profile_t *p;
+  char mime[128];
+
+  snprintf (mime, sizeof (mime), "%s;rate=%d;channels=%d",
+            MIME_AUDIO_LPCM, rate, channels);
+
+  /* items are probed from several threads */
+  pthread_mutex_lock (&lpcm_profiles_lock);
+  for (p = lpcm_profiles; p; p = p->next)
+    if (!strcmp (p->profile.id, base->id) && !strcmp (p->profile.mime, mime))
+      break;
+
+  if (!p)
+  {
+    p = malloc (sizeof (lpcm_profile_t));
+    if (p)
+    {
+      memcpy (&p->profile, base, sizeof (dlna_profile_t));
+      p->profile.mime = strdup (mime);
+      if (p->profile.mime)
+      {
+        p->next = lpcm_profiles;
+        lpcm_profiles = p;
+      }
+      else
+      {
+        free (p);
+        p = NULL;
+      }
+    }
+  }
+  pthread_mutex_unlock (&lpcm_profiles_lock);
+
+  return p ? &p->profile : NULL;
+}
+
 static dlna_profile_t *
 probe_lpcm (AVFormatContext *ctx dlna_unused,
             dlna_container_type_t st dlna_unused,
             av_codecs_t *codecs)
 {
-  static dlna_profile_t p;
-  char mime[128];
-
   if (!stream_ctx_is_audio (codecs))
     return NULL;
 
   if (audio_profile_guess_lpcm (codecs->ac) != AUDIO_PROFILE_LPCM)
     return NULL;
 
-  if (codecs->ac->sample_rate <= 32000)
-    memcpy (&p, &lpcm_low, sizeof (lpcm_low));
-  else
-    memcpy (&p, &lpcm, sizeof (lpcm));
-  sprintf (mime, "%s;rate=%d;channels=%d",
-           MIME_AUDIO_LPCM, codecs->ac->sample_rate, codecs->ac->channels);
-  p.mime = strdup (mime);
-  
-  return &p;
+  return lpcm_profile (codecs->ac->sample_rate <= 32000 ? &lpcm_low : &lpcm,
+                       codecs->ac->sample_rate, codecs->ac->channels);
 }
 
 dlna_registered_profile_t dlna_profile_audio_lpcm = {
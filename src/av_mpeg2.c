@@ -606,6 +606,43 @@ probe_mpeg_ts (AVFormatContext *ctx,
   return NULL;
 }
 
+/* the same TS profiles in CT_MPEG_TRANSPORT_STREAM,
+   CT_MPEG_TRANSPORT_STREAM_DLNA and CT_MPEG_TRANSPORT_STREAM_DLNA_NO_TS */
+static dlna_profile_t *mpeg_ts_variants[][3] = {
+  { &mpeg_ts_mp_ll_aac_iso, &mpeg_ts_mp_ll_aac_t, &mpeg_ts_mp_ll_aac },
+  { &mpeg_ts_sd_eu_iso, &mpeg_ts_sd_eu_t, &mpeg_ts_sd_eu },
+  { &mpeg_ts_sd_na_iso, &mpeg_ts_sd_na_t, &mpeg_ts_sd_na },
+  { &mpeg_ts_sd_na_xac3_iso, &mpeg_ts_sd_na_xac3_t, &mpeg_ts_sd_na_xac3 },
+  { &mpeg_ts_hd_na_iso, &mpeg_ts_hd_na_t, &mpeg_ts_hd_na },
+  { &mpeg_ts_hd_na_xac3_iso, &mpeg_ts_hd_na_xac3_t, &mpeg_ts_hd_na_xac3 },
+};
+
+static dlna_profile_t *
+variant_mpeg2 (dlna_profile_t *profile, dlna_container_type_t st)
+{
+  int i, j;
+
+  for (i = 0; i < (int) (sizeof (mpeg_ts_variants)
+                         / sizeof (mpeg_ts_variants[0])); i++)
+    for (j = 0; j < 3; j++)
+      if (mpeg_ts_variants[i][j] == profile)
+      {
+        switch (st)
+        {
+        case CT_MPEG_TRANSPORT_STREAM:
+          return mpeg_ts_variants[i][0];
+        case CT_MPEG_TRANSPORT_STREAM_DLNA:
+          return mpeg_ts_variants[i][1];
+        case CT_MPEG_TRANSPORT_STREAM_DLNA_NO_TS:
+          return mpeg_ts_variants[i][2];
+        default:
+          return NULL;
+        }
+      }
+
+  return NULL;
+}
+
 static dlna_profile_t *
 probe_mpeg2 (AVFormatContext *ctx,
              dlna_container_type_t st,
@@ -640,5 +677,6 @@ dlna_registered_profile_t dlna_profile_av_mpeg2 = {
   .class = DLNA_CLASS_AV,
   .extensions = "mpg,mpeg,mpe,m2v,mp2p,mp2t,ts,ps,pes",
   .probe = probe_mpeg2,
+  .variant = variant_mpeg2,
   .next = NULL
 };
@@ -1263,10 +1263,28 @@ probe_avc (AVFormatContext *ctx,
   return NULL;
 }
 
+static dlna_profile_t *
+variant_avc (dlna_profile_t *profile, dlna_container_type_t st)
+{
+  int i, j;
+
+  /* same video and audio profiles in another container */
+  for (i = 0; avc_profiles_mapping[i].profile; i++)
+    if (avc_profiles_mapping[i].profile == profile)
+      for (j = 0; avc_profiles_mapping[j].profile; j++)
+        if (avc_profiles_mapping[j].st == st &&
+            avc_profiles_mapping[j].vp == avc_profiles_mapping[i].vp &&
+            avc_profiles_mapping[j].ap == avc_profiles_mapping[i].ap)
+          return avc_profiles_mapping[j].profile;
+
+  return NULL;
+}
+
 dlna_registered_profile_t dlna_profile_av_mpeg4_part10 = {
   .id = DLNA_PROFILE_AV_MPEG4_PART10,
   .class = DLNA_CLASS_AV,
   .extensions = "mov,hdmov,mp4,3gp,3gpp,mpg,mpeg,mpe,mp2t,ts",
   .probe = probe_avc,
+  .variant = variant_avc,
   .next = NULL
 };
@@ -920,10 +920,28 @@ probe_mpeg4_part2 (AVFormatContext *ctx,
   return NULL;
 }
 
+static dlna_profile_t *
+variant_mpeg4_part2 (dlna_profile_t *profile, dlna_container_type_t st)
+{
+  int i, j;
+
+  /* same video and audio profiles in another container */
+  for (i = 0; mpeg4_profiles_mapping[i].profile; i++)
+    if (mpeg4_profiles_mapping[i].profile == profile)
+      for (j = 0; mpeg4_profiles_mapping[j].profile; j++)
+        if (mpeg4_profiles_mapping[j].st == st &&
+            mpeg4_profiles_mapping[j].vp == mpeg4_profiles_mapping[i].vp &&
+            mpeg4_profiles_mapping[j].ap == mpeg4_profiles_mapping[i].ap)
+          return mpeg4_profiles_mapping[j].profile;
+
+  return NULL;
+}
+
 dlna_registered_profile_t dlna_profile_av_mpeg4_part2 = {
   .id = DLNA_PROFILE_AV_MPEG4_PART2,
   .class = DLNA_CLASS_AV,
   .extensions = "mov,hdmov,mp4,3gp,3gpp,asf,mpg,mpeg,mpe,mp2t,ts",
   .probe = probe_mpeg4_part2,
+  .variant = variant_mpeg4_part2,
   .next = NULL
 };
@@ -24,6 +24,8 @@
 #include <stdarg.h>
 #include <string.h>
 
+#include "ixml.h"
+
 #include "buffer.h"
 #include "minmax.h"
 
@@ -42,14 +44,11 @@ buffer_new (void)
   return buffer;
 }
 
-void
-buffer_append (buffer_t *buffer, const char *str)
+static void
+buffer_append_len (buffer_t *buffer, const char *str, size_t n)
 {
   size_t len;
 
-  if (!buffer || !str)
-    return;
-
   if (!buffer->buf)
   {
     buffer->capacity = BUFFER_DEFAULT_CAPACITY;
@@ -57,15 +56,49 @@ buffer_append (buffer_t *buffer, const char *str)
     memset (buffer->buf, '\0', buffer->capacity);
   }
 
-  len = buffer->len + strlen (str);
+  len = buffer->len + n;
   if (len >= buffer->capacity)
   {
     buffer->capacity = MAX (len + 1, 2 * buffer->capacity);
     buffer->buf = realloc (buffer->buf, buffer->capacity);
   }
 
-  strcat (buffer->buf, str);
-  buffer->len += strlen (str);
+  memcpy (buffer->buf + buffer->len, str, n);
+  buffer->len = len;
+  buffer->buf[len] = '\0';
+}
+
+void
+buffer_append (buffer_t *buffer, const char *str)
+{
+  if (!buffer || !str)
+    return;
+
+  buffer_append_len (buffer, str, strlen (str));
+}
+
+void
+buffer_append_escaped (buffer_t *buffer, const char *str)
+{
+  size_t len, span;
+
+  if (!buffer || !str)
+    return;
+
+  len = strlen (str);
+  while (len > 0)
+  {
+    /* copy clean runs in bulk, only special characters are replaced */
+    span = ixmlEscapeSpan (str, len);
+    if (span)
+      buffer_append_len (buffer, str, span);
+    if (span == len)
+      break;
+
+    buffer_append (buffer, ixmlEscapeEntity (str[span]));
+    str += span + 1;
+    len -= span + 1;
+  }
 }
 
 void
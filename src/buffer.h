@@ -32,6 +32,7 @@ buffer_t *buffer_new (void) __attribute__ ((malloc));
 void buffer_free (buffer_t *buffer);
 
 void buffer_append (buffer_t *buffer, const char *str);
+void buffer_append_escaped (buffer_t *buffer, const char *str);
 void buffer_appendf (buffer_t *buffer, const char *format, ...)
     __attribute__ ((format (printf , 2, 3)));
 
@@ -0,0 +1,358 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Block cache shared by the HTTP readers of local resources: renderers
+ * streaming the same file at once read each block from the disk once.
+ * Blocks are aligned on their size and keyed by VFS item ID and index
+ * in the file; they are evicted in CLOCK order, skipping the ones being
+ * read from.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "dlna_internals.h"
+#include "minmax.h"
+
+#define BLOCK_CACHE_BLOCK_SIZE (256 * 1024)
+#define BLOCK_CACHE_ALIGN      4096
+
+typedef struct block_key_s {
+  uint32_t id;
+  uint32_t pad;                 /* keeps the hashed key fully set */
+  uint64_t index;
+} block_key_t;
+
+typedef struct block_s {
+  block_key_t key;
+  char *data;
+  size_t len;                   /* less than a block at end of file */
+  int refs;                     /* readers using the block */
+  int loading;                  /* being read from the file */
+  int error;                    /* could not be read */
+  int referenced;               /* CLOCK bit, set on every use */
+  int hashed;                   /* can be found in the index */
+  UT_hash_handle hh;
+} block_t;
+
+struct block_cache_s {
+  pthread_mutex_t lock;
+  pthread_cond_t loaded;
+  block_t *index;
+  block_t *blocks;
+  int count;
+  int hand;
+  size_t allocated;
+  size_t cached;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  unsigned long bypasses;
+};
+
+block_cache_t *
+block_cache_new (size_t size)
+{
+  block_cache_t *cache;
+
+  if (size < BLOCK_CACHE_BLOCK_SIZE)
+    return NULL;
+
+  cache = calloc (1, sizeof (block_cache_t));
+  if (!cache)
+    return NULL;
+
+  cache->count = size / BLOCK_CACHE_BLOCK_SIZE;
+  cache->blocks = calloc (cache->count, sizeof (block_t));
+  if (!cache->blocks)
+  {
+    free (cache);
+    return NULL;
+  }
+
+  pthread_mutex_init (&cache->lock, NULL);
+  pthread_cond_init (&cache->loaded, NULL);
+
+  return cache;
+}
+
+void
+block_cache_free (block_cache_t *cache)
+{
+  int i;
+
+  if (!cache)
+    return;
+
+  for (i = 0; i < cache->count; i++)
+    free (cache->blocks[i].data);
+  free (cache->blocks);
+  pthread_cond_destroy (&cache->loaded);
+  pthread_mutex_destroy (&cache->lock);
+  free (cache);
+}
+
+static void
+block_cache_unhash (block_cache_t *cache, block_t *b)
+{
+  HASH_DELETE (hh, cache->index, b);
+  b->hashed = 0;
+  b->referenced = 0;
+  cache->cached -= b->len;
+  b->len = 0;
+}
+
+/* next block to reuse, NULL if all of them are in use */
+static block_t *
+block_cache_victim (block_cache_t *cache)
+{
+  block_t *b;
+  int i;
+
+  /* the first round may only clear CLOCK bits */
+  for (i = 0; i < 2 * cache->count; i++)
+  {
+    b = &cache->blocks[cache->hand];
+    cache->hand = (cache->hand + 1) % cache->count;
+
+    if (b->refs)
+      continue;
+    if (b->referenced)
+    {
+      b->referenced = 0;
+      continue;
+    }
+
+    if (b->hashed)
+    {
+      block_cache_unhash (cache, b);
+      cache->evictions++;
+    }
+    if (!b->data)
+    {
+      if (posix_memalign ((void **) &b->data,
+                          BLOCK_CACHE_ALIGN, BLOCK_CACHE_BLOCK_SIZE))
+      {
+        b->data = NULL;
+        return NULL;
+      }
+      cache->allocated += BLOCK_CACHE_BLOCK_SIZE;
+    }
+    return b;
+  }
+
+  return NULL;
+}
+
+static ssize_t
+block_cache_load (int fd, char *data, off_t offset)
+{
+  size_t len = 0;
+  ssize_t n;
+
+  while (len < BLOCK_CACHE_BLOCK_SIZE)
+  {
+    n = pread (fd, data + len, BLOCK_CACHE_BLOCK_SIZE - len, offset + len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0)
+      break;
+    len += n;
+  }
+
+  return len;
+}
+
+/* read what a single block holds of the requested range */
+static ssize_t
+block_cache_read_block (block_cache_t *cache, uint32_t id, int fd,
+                        char *buf, size_t len, off_t offset)
+{
+  block_key_t key;
+  block_t *b = NULL;
+  size_t skip;
+  ssize_t n;
+
+  memset (&key, 0, sizeof (key));
+  key.id = id;
+  key.index = offset / BLOCK_CACHE_BLOCK_SIZE;
+  skip = offset % BLOCK_CACHE_BLOCK_SIZE;
+
+  pthread_mutex_lock (&cache->lock);
+  HASH_FIND (hh, cache->index, &key, sizeof (block_key_t), b);
+  if (b)
+  {
+    /* a block being loaded is shared as well: wait for it */
+    cache->hits++;
+    b->refs++;
+    b->referenced = 1;
+    while (b->loading)
+      pthread_cond_wait (&cache->loaded, &cache->lock);
+  }
+  else
+  {
+    cache->misses++;
+    b = block_cache_victim (cache);
+    if (!b)
+    {
+      cache->bypasses++;
+      pthread_mutex_unlock (&cache->lock);
+      return pread (fd, buf, MIN (len, BLOCK_CACHE_BLOCK_SIZE - skip),
+                    offset);
+    }
+
+    b->key = key;
+    b->refs = 1;
+    b->loading = 1;
+    b->error = 0;
+    b->referenced = 1;
+    b->hashed = 1;
+    HASH_ADD (hh, cache->index, key, sizeof (block_key_t), b);
+    pthread_mutex_unlock (&cache->lock);
+
+    n = block_cache_load (fd, b->data,
+                          (off_t) key.index * BLOCK_CACHE_BLOCK_SIZE);
+
+    pthread_mutex_lock (&cache->lock);
+    b->loading = 0;
+    if (n < 0)
+    {
+      b->error = 1;
+      if (b->hashed)
+        block_cache_unhash (cache, b);
+    }
+    else
+    {
+      b->len = n;
+      if (b->hashed)
+        cache->cached += n;
+    }
+    pthread_cond_broadcast (&cache->loaded);
+  }
+
+  if (b->error)
+    n = -1;
+  else if (skip >= b->len)
+    n = 0;
+  else
+    n = MIN (len, b->len - skip);
+  pthread_mutex_unlock (&cache->lock);
+
+  /* the block cannot be reused while referenced */
+  if (n > 0)
+    memcpy (buf, b->data + skip, n);
+
+  pthread_mutex_lock (&cache->lock);
+  b->refs--;
+  pthread_mutex_unlock (&cache->lock);
+
+  return n;
+}
+
+ssize_t
+block_cache_read (block_cache_t *cache, uint32_t id, int fd,
+                  char *buf, size_t len, off_t offset)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  if (!cache || !buf)
+    return -1;
+
+  while (done < len)
+  {
+    n = block_cache_read_block (cache, id, fd,
+                                buf + done, len - done, offset + done);
+    if (n < 0)
+      return done ? (ssize_t) done : -1;
+    if (n == 0)
+      break;
+    done += n;
+  }
+
+  return done;
+}
+
+void
+block_cache_invalidate (block_cache_t *cache, uint32_t id)
+{
+  int i;
+
+  if (!cache)
+    return;
+
+  /* blocks in use stay valid for their readers, only unreachable */
+  pthread_mutex_lock (&cache->lock);
+  for (i = 0; i < cache->count; i++)
+    if (cache->blocks[i].hashed && cache->blocks[i].key.id == id)
+      block_cache_unhash (cache, &cache->blocks[i]);
+  pthread_mutex_unlock (&cache->lock);
+}
+
+int
+dlna_set_block_cache (dlna_t *dlna, size_t size)
+{
+  block_cache_t *cache = NULL;
+
+  if (!dlna)
+    return DLNA_ST_ERROR;
+
+  if (size)
+  {
+    cache = block_cache_new (size);
+    if (!cache)
+      return DLNA_ST_ERROR;
+  }
+
+  block_cache_free (dlna->cache);
+  dlna->cache = cache;
+
+  return DLNA_ST_OK;
+}
+
+int
+dlna_get_block_cache_stats (dlna_t *dlna, dlna_cache_stats_t *stats)
+{
+  block_cache_t *cache;
+
+  if (!dlna || !dlna->cache || !stats)
+    return DLNA_ST_ERROR;
+
+  cache = dlna->cache;
+  pthread_mutex_lock (&cache->lock);
+  stats->hits       = cache->hits;
+  stats->misses     = cache->misses;
+  stats->evictions  = cache->evictions;
+  stats->bypasses   = cache->bypasses;
+  stats->block_size = BLOCK_CACHE_BLOCK_SIZE;
+  stats->capacity   = (size_t) cache->count * BLOCK_CACHE_BLOCK_SIZE;
+  stats->allocated  = cache->allocated;
+  stats->cached     = cache->cached;
+  pthread_mutex_unlock (&cache->lock);
+
+  return DLNA_ST_OK;
+}
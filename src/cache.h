@@ -0,0 +1,37 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+typedef struct block_cache_s block_cache_t;
+
+block_cache_t *block_cache_new (size_t size);
+void block_cache_free (block_cache_t *cache);
+
+ssize_t block_cache_read (block_cache_t *cache, uint32_t id, int fd,
+                          char *buf, size_t len, off_t offset);
+void block_cache_invalidate (block_cache_t *cache, uint32_t id);
+
+#endif /* CACHE_H */
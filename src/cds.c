@@ -253,15 +253,23 @@ didl_add_footer (buffer_t *out)
 static void
 didl_add_tag (buffer_t *out, char *tag, char *value)
 {
-  if (value)
-    buffer_appendf (out, "<%s>%s</%s>", tag, value, tag);
+  if (!value)
+    return;
+
+  buffer_appendf (out, "<%s>", tag);
+  buffer_append_escaped (out, value);
+  buffer_appendf (out, "</%s>", tag);
 }
 
 static void
 didl_add_param (buffer_t *out, char *param, char *value)
 {
-  if (value)
-    buffer_appendf (out, " %s=\"%s\"", param, value);
+  if (!value)
+    return;
+
+  buffer_appendf (out, " %s=\"", param);
+  buffer_append_escaped (out, value);
+  buffer_append (out, "\"");
 }
 
 static void
@@ -270,6 +278,60 @@ didl_add_value (buffer_t *out, char *param, off_t value)
   buffer_appendf (out, " %s=\"%lld\"", param, value);
 }
 
+/* as the duration of dlna_properties_t */
+static void
+didl_format_duration (char *buf, off_t duration)
+{
+  int hours, min, sec;
+
+  hours = (int) (duration / 3600);
+  min = (int) ((duration - (hours * 3600)) / 60);
+  sec = (int) (duration - (hours * 3600) - (min * 60));
+  if (hours)
+    sprintf (buf, "%d:%.2d:%.2d.", hours, min, sec);
+  else
+    sprintf (buf, ":%.2d:%.2d.", min, sec);
+}
+
+static void
+didl_add_res (dlna_t *dlna, buffer_t *out, vfs_item_t *item, char *filter,
+              dlna_profile_t *profile, dlna_org_conversion_t cnv,
+              int flags, off_t size, char *duration, const char *ext)
+{
+  char *protocol_info;
+
+  protocol_info =
+    dlna_write_protocol_info (DLNA_PROTOCOL_INFO_TYPE_HTTP,
+                              DLNA_ORG_PLAY_SPEED_NORMAL,
+                              cnv,
+                              vfs_resource_operations (item),
+                              flags, profile);
+
+  buffer_appendf (out, "<%s", DIDL_RES);
+  didl_add_param (out, DIDL_RES_INFO, protocol_info);
+  free (protocol_info);
+
+  if (filter_has_val (filter, "@"DIDL_RES_SIZE))
+    didl_add_value (out, DIDL_RES_SIZE, size);
+
+  didl_add_param (out, DIDL_RES_DURATION, duration);
+  didl_add_value (out, DIDL_RES_BITRATE,
+                  item->u.resource.item->properties->bitrate);
+  didl_add_value (out, DIDL_RES_BPS,
+                  item->u.resource.item->properties->bps);
+  didl_add_value (out, DIDL_RES_AUDIO_CHANNELS,
+                  item->u.resource.item->properties->channels);
+  if (strlen (item->u.resource.item->properties->resolution) > 1)
+    didl_add_param (out, DIDL_RES_RESOLUTION,
+                    item->u.resource.item->properties->resolution);
+
+  buffer_append (out, ">");
+  buffer_appendf (out, "http://%s:%d%s/%d%s",
+                  dlnaGetServerIpAddress (),
+                  dlna->port, VIRTUAL_DIR, item->id, ext);
+  buffer_appendf (out, "</%s>", DIDL_RES);
+}
+
 static void
 didl_add_item (dlna_t *dlna, buffer_t *out, vfs_item_t *item,
                char *restricted, char *filter)
@@ -316,39 +378,38 @@ didl_add_item (dlna_t *dlna, buffer_t *out, vfs_item_t *item,
   
   if (filter_has_val (filter, DIDL_RES))
   {
-    char *protocol_info;
+    dlna_properties_t *prop = item->u.resource.item->properties;
+    char *duration = prop->duration;
+    int flags = dlna->flags;
+    char live_duration[64];
+    vfs_attr_t attr;
+    off_t size;
+
+    /* a recording has what was written so far */
+    if (dlna->live_timeout && vfs_resource_get_attr (dlna, item, &attr) == 0
+        && vfs_resource_is_live (dlna, item, &attr))
+    {
+      flags |= DLNA_ORG_FLAG_SN_INCREASE;
+      if (prop->bitrate)
+      {
+        didl_format_duration (live_duration, attr.size / prop->bitrate);
+        duration = live_duration;
+      }
+    }
 
-    protocol_info =
-      dlna_write_protocol_info (DLNA_PROTOCOL_INFO_TYPE_HTTP,
-                                DLNA_ORG_PLAY_SPEED_NORMAL,
-                                item->u.resource.cnv,
-                                DLNA_ORG_OPERATION_RANGE,
-                                dlna->flags, item->u.resource.item->profile);
-    
-    buffer_appendf (out, "<%s", DIDL_RES);
-    didl_add_param (out, DIDL_RES_INFO, protocol_info);
-    free (protocol_info);
-    
-    if (filter_has_val (filter, "@"DIDL_RES_SIZE))
-      didl_add_value (out, DIDL_RES_SIZE, item->u.resource.size);
-    
-    didl_add_param (out, DIDL_RES_DURATION,
-                    item->u.resource.item->properties->duration);
-    didl_add_value (out, DIDL_RES_BITRATE,
-                    item->u.resource.item->properties->bitrate);
-    didl_add_value (out, DIDL_RES_BPS,
-                    item->u.resource.item->properties->bps);
-    didl_add_value (out, DIDL_RES_AUDIO_CHANNELS,
-                    item->u.resource.item->properties->channels);
-    if (strlen (item->u.resource.item->properties->resolution) > 1)
-      didl_add_param (out, DIDL_RES_RESOLUTION,
-                      item->u.resource.item->properties->resolution);
-
-    buffer_append (out, ">");
-    buffer_appendf (out, "http://%s:%d%s/%d",
-                    dlnaGetServerIpAddress (),
-                    dlna->port, VIRTUAL_DIR, item->id);
-    buffer_appendf (out, "</%s>", DIDL_RES);
+    size = item->u.resource.size;
+    if (item->u.resource.pcm_length)
+      size = item->u.resource.pcm_length;
+
+    didl_add_res (dlna, out, item, filter, item->u.resource.item->profile,
+                  item->u.resource.cnv, flags, size, duration, "");
+    /* same content with the other MPEG-TS packet size */
+    if (item->u.resource.ts_profile)
+      didl_add_res (dlna, out, item, filter, item->u.resource.ts_profile,
+                    DLNA_ORG_CONVERSION_TRANSCODED, flags,
+                    ts_conv_length (item->u.resource.ts_packet,
+                                    item->u.resource.size),
+                    duration, TS_CONV_URL_EXT (item->u.resource.ts_packet));
   }
   buffer_appendf (out, "</%s>", DIDL_ITEM);
 }
@@ -389,6 +450,8 @@ cds_browse_metadata (dlna_t *dlna, upnp_action_event_t *ev,
   switch (item->type)
   {
   case DLNA_RESOURCE:
+    /* likely to be played next */
+    prefetch_resource (dlna, item->id);
     didl_add_item (dlna, out, item, "false", filter);
     break;
 
@@ -616,7 +679,7 @@ cds_search_match (dlna_t *dlna, vfs_item_t *item, char *search_criteria)
     dlna_write_protocol_info (DLNA_PROTOCOL_INFO_TYPE_HTTP,
                               DLNA_ORG_PLAY_SPEED_NORMAL,
                               item->u.resource.cnv,
-                              DLNA_ORG_OPERATION_RANGE,
+                              vfs_resource_operations (item),
                               dlna->flags, item->u.resource.item->profile);
 
   object_type = dlna_profile_upnp_object_item (item->u.resource.item->profile);
@@ -626,6 +689,19 @@ cds_search_match (dlna_t *dlna, vfs_item_t *item, char *search_criteria)
     result = 1;
   else if (protocol_contains && strstr (protocol_info, keyword))
     result = 1;
+  else if (protocol_contains && item->u.resource.ts_profile)
+  {
+    /* the converted MPEG-TS resource may match instead */
+    free (protocol_info);
+    protocol_info =
+      dlna_write_protocol_info (DLNA_PROTOCOL_INFO_TYPE_HTTP,
+                                DLNA_ORG_PLAY_SPEED_NORMAL,
+                                DLNA_ORG_CONVERSION_TRANSCODED,
+                                vfs_resource_operations (item),
+                                dlna->flags, item->u.resource.ts_profile);
+    if (strstr (protocol_info, keyword))
+      result = 1;
+  }
   else if (object_type && !strcmp (object_type, keyword))
     result = 1;
   free (protocol_info);
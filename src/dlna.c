@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -63,12 +64,31 @@ dlna_init (void)
 
   /* Internal HTTP Server */
   dlna->http_callback = NULL;
+  memset (&dlna->http_io_callback, 0, sizeof (dlna_http_io_callback_t));
+  dlna->cache = NULL;
+  dlna->pace_ratio = 0;
+  dlna->pace_burst = 0;
+  dlna->pace_max_rate = 0;
+  dlna->background_share = -1;
+  dlna->pool_limit = 0;
+  dlna->live_timeout = 0;
+  dlna->live = NULL;
+  dlna->prefetch_head = 0;
+  dlna->prefetch_rate = 0;
+  dlna->prefetch = NULL;
 
   dlna->services = NULL;
 
   dlna->storage_type = DLNA_DMS_STORAGE_MEMORY;
   dlna->vfs_root = NULL;
   dlna->vfs_items = 0;
+  pthread_mutex_init (&dlna->vfs_lock, NULL);
+  pthread_mutex_init (&dlna->vfs_fd_lock, NULL);
+  dlna->vfs_fd_first = NULL;
+  dlna->vfs_fd_last = NULL;
+  dlna->vfs_fd_count = 0;
+  pthread_mutex_init (&dlna->vfs_seek_lock, NULL);
+  pthread_mutex_init (&dlna->vfs_io_lock, NULL);
 #ifdef HAVE_SQLITE
   dlna->db = NULL;
 #endif /* HAVE_SQLITE */
@@ -106,7 +126,14 @@ dlna_uninit (dlna_t *dlna)
   dlna->inited = 0;
   dlna_log (dlna, DLNA_MSG_INFO, "DLNA: uninit\n");
   dlna->first_profile = NULL;
+  /* reads ahead the items about to be freed */
+  prefetch_free (dlna->prefetch);
   vfs_item_free (dlna, dlna->vfs_root);
+  pthread_mutex_destroy (&dlna->vfs_lock);
+  pthread_mutex_destroy (&dlna->vfs_fd_lock);
+  pthread_mutex_destroy (&dlna->vfs_seek_lock);
+  pthread_mutex_destroy (&dlna->vfs_io_lock);
+  live_watch_free (dlna->live);
   free (dlna->interface);
 
 #ifdef HAVE_SQLITE
@@ -116,6 +143,7 @@ dlna_uninit (dlna_t *dlna)
   /* Internal HTTP Server */
   if (dlna->http_callback)
     free (dlna->http_callback);
+  block_cache_free (dlna->cache);
 
   dlna_service_unregister_all (dlna);
   
@@ -312,6 +340,103 @@ dlna_set_port (dlna_t *dlna, int port)
   dlna->port = port;
 }
 
+void
+dlna_set_stream_pacing (dlna_t *dlna, unsigned int ratio,
+                        size_t burst, size_t max_rate)
+{
+  if (!dlna)
+    return;
+
+  dlna->pace_ratio = ratio;
+  dlna->pace_burst = burst;
+  dlna->pace_max_rate = max_rate;
+
+  /* applied when the UPnP subsystem starts otherwise */
+  dlnaSetStreamPacing (burst, max_rate);
+}
+
+void
+dlna_set_background_share (dlna_t *dlna, unsigned int percent)
+{
+  if (!dlna)
+    return;
+
+  dlna->background_share = percent > 100 ? 100 : (int) percent;
+
+  /* applied when the UPnP subsystem starts otherwise */
+  dlnaSetBackgroundShare (percent);
+}
+
+void
+dlna_set_buffer_pool_limit (dlna_t *dlna, size_t size)
+{
+  if (!dlna || !size)
+    return;
+
+  dlna->pool_limit = size;
+
+  /* applied when the UPnP subsystem starts otherwise */
+  dlnaSetBufferPoolLimit (size);
+}
+
+int
+dlna_get_buffer_pool_stats (dlna_t *dlna, dlna_buffer_pool_stats_t *stats)
+{
+  struct dlnaBufferPoolStats st;
+
+  if (!dlna || !stats)
+    return DLNA_ST_ERROR;
+
+  if (dlnaGetBufferPoolStats (&st) != DLNA_E_SUCCESS)
+    return DLNA_ST_ERROR;
+
+  stats->hits      = st.hits;
+  stats->allocs    = st.allocs;
+  stats->waits     = st.waits;
+  stats->failures  = st.failures;
+  stats->in_use    = st.inUse;
+  stats->peak_used = st.peakUsed;
+  stats->allocated = st.allocated;
+  stats->capacity  = st.maxMemory;
+
+  return DLNA_ST_OK;
+}
+
+void
+dlna_set_prefetch (dlna_t *dlna, size_t head, size_t rate)
+{
+  if (!dlna)
+    return;
+
+  /* kept once created, as the live watcher */
+  if (head && !dlna->prefetch)
+  {
+    dlna->prefetch = prefetch_new (dlna);
+    if (!dlna->prefetch)
+      return;
+  }
+
+  dlna->prefetch_rate = rate;
+  dlna->prefetch_head = head;
+}
+
+void
+dlna_set_live_timeout (dlna_t *dlna, unsigned int seconds)
+{
+  if (!dlna)
+    return;
+
+  /* kept once created: streams may be waiting on it */
+  if (seconds && !dlna->live)
+  {
+    dlna->live = live_watch_new ();
+    if (!dlna->live)
+      return;
+  }
+
+  dlna->live_timeout = seconds;
+}
+
 void
 dlna_device_set_friendly_name (dlna_t *dlna, char *str)
 {
@@ -432,6 +557,31 @@ dlna_set_http_callback (dlna_t *dlna, dlna_http_callback_t *cb)
   dlna->http_callback = cb;
 }
 
+int
+dlna_set_http_io_callback (dlna_t *dlna, dlna_http_io_callback_t *cb)
+{
+  size_t size;
+
+  if (!dlna)
+    return DLNA_ST_ERROR;
+
+  memset (&dlna->http_io_callback, 0, sizeof (dlna_http_io_callback_t));
+  if (!cb)
+    return DLNA_ST_OK;
+
+  if (cb->size <= offsetof (dlna_http_io_callback_t, get_fd))
+    return DLNA_ST_ERROR;
+
+  /* a structure from an older header lacks the callbacks added since */
+  size = cb->size;
+  if (size > sizeof (dlna_http_io_callback_t))
+    size = sizeof (dlna_http_io_callback_t);
+  memcpy (&dlna->http_io_callback, cb, size);
+  dlna->http_io_callback.size = sizeof (dlna_http_io_callback_t);
+
+  return DLNA_ST_OK;
+}
+
 char *
 dlna_write_protocol_info (dlna_protocol_info_type_t type,
                           dlna_org_play_speed_t speed,
@@ -217,6 +217,69 @@ void dlna_set_interface (dlna_t *dlna, char *itf);
  */
 void dlna_set_port (dlna_t *dlna, int port);
 
+/**
+ * Pace the streaming of resources to a multiple of their bitrate, so
+ *   that a fast renderer does not take all the bandwidth from the
+ *   others. A stream first sends a burst for the renderer to fill its
+ *   buffer, then no faster than its rate. Resources of unknown bitrate
+ *   are not paced, but all streams share the global cap fairly. Takes
+ *   effect on the streams started afterwards, with the cap applying to
+ *   all of them.
+ *
+ * @param[in] dlna      The DLNA library's controller.
+ * @param[in] ratio     Rate of a stream in percent of the bitrate of
+ *                      its resource (e.g. 150), 0 for no pacing.
+ * @param[in] burst     Bytes a paced stream may send at once when it
+ *                      starts.
+ * @param[in] max_rate  Cap on the rate of all streams together, in
+ *                      bytes per second, 0 for none.
+ */
+void dlna_set_stream_pacing (dlna_t *dlna, unsigned int ratio,
+                             size_t burst, size_t max_rate);
+
+/**
+ * Set the part of the global cap of dlna_set_stream_pacing() kept for
+ *   background transfers (transferMode.dlna.org: Background, e.g. a
+ *   device copying media for later) while other streams run. They get
+ *   what the other streams leave too, are not paced to their bitrate,
+ *   and read from disk after them whatever the cap.
+ *
+ * @param[in] dlna     The DLNA library's controller.
+ * @param[in] percent  Part of the cap, in percent (10 by default).
+ */
+void dlna_set_background_share (dlna_t *dlna, unsigned int percent);
+
+/**
+ * Read ahead the head of the audio and video items a renderer asks the
+ *   metadata of (BrowseMetadata), as it usually plays them right after:
+ *   the first GET then does not wait for the disk to seek or spin up.
+ *   MP4 files also get their moov box read. The reads go to the block
+ *   cache if set, to the page cache otherwise, in the background, the
+ *   last item asked for first; an item is not read again within a
+ *   minute.
+ *
+ * @param[in] dlna  The DLNA library's controller.
+ * @param[in] head  Bytes read from the start of an item, 0 for no read
+ *                  ahead (default).
+ * @param[in] rate  Cap on the bytes read ahead per second, so that
+ *                  browsing large folders does not keep the disk busy,
+ *                  0 for none.
+ */
+void dlna_set_prefetch (dlna_t *dlna, size_t head, size_t rate);
+
+/**
+ * Serve the files written to within the last seconds as live
+ *   recordings: their streams follow them as they grow, until they have
+ *   not grown for that long, and their size and duration are updated as
+ *   they are browsed.
+ *
+ * @param[in] dlna     The DLNA library's controller.
+ * @param[in] seconds  Time since its last write a file is still
+ *                     followed for, 0 to serve files as they are when
+ *                     asked for (default).
+ */
+void dlna_set_live_timeout (dlna_t *dlna, unsigned int seconds);
+
 /***************************************************************************/
 /*                                                                         */
 /* DLNA Media Profiles Handling                                            */
@@ -653,6 +716,140 @@ typedef struct dlna_http_callback_s {
  */
 void dlna_set_http_callback (dlna_t *dlna, dlna_http_callback_t *cb);
 
+/* Returned by the read_async HTTP callback for a read finishing later */
+#define DLNA_HTTP_READ_PENDING (-2)
+
+/**
+ * DLNA Internal WebServer I/O Callbacks
+ *  All optional (NULL), for the handles opened by the open HTTP
+ *  callback.
+ *
+ * get_fd and map let the content of a handle go out without being
+ * copied into the server's buffers:
+ *  - get_fd returns a descriptor the content can be sent from with
+ *    sendfile() and stores the current position in offset, or returns
+ *    -1. The descriptor stays owned by the handle.
+ *  - map works like read but points data at up to len bytes of the
+ *    content at the current position, kept in memory by the application
+ *    until the handle is closed, and moves past them. It returns the
+ *    length, 0 at end of file or a negative value on error.
+ *
+ * read_async is used instead of read when the response is streamed by
+ *  the server's event-driven engine, so that a slow source does not
+ *  hold a server thread. It may return DLNA_HTTP_READ_PENDING and
+ *  report the result later, from any thread, with
+ *  dlna_http_read_complete(); buf stays reserved until then. A handle
+ *  has one read pending at most. Closing the handle cancels the read,
+ *  and buf must not be written to once close returns.
+ *
+ * size is to be set to sizeof (dlna_http_io_callback_t): callbacks added
+ *  later are only used when the application's structure has them.
+ */
+typedef struct dlna_http_io_callback_s {
+  size_t size;
+  int (*get_fd) (void *hdl, off_t *offset);
+  ssize_t (*map) (void *hdl, size_t len, const char **data);
+  int (*read_async) (void *hdl, char *buf, size_t len);
+} dlna_http_io_callback_t;
+
+/**
+ * Set library's WebServer I/O Callback routines, used along with the
+ *   ones of dlna_set_http_callback().
+ *
+ * @param[in] dlna  The DLNA library's controller.
+ * @param[in] cb    Structure with I/O callbacks, its size set.
+ * @return   DLNA_ST_OK in case of success, DLNA_ST_ERROR if size is
+ *           too small for the structure to have any callback.
+ */
+int dlna_set_http_io_callback (dlna_t *dlna, dlna_http_io_callback_t *cb);
+
+/**
+ * Report the result of a read the read_async HTTP callback left pending.
+ *
+ * @param[in] dlna  The DLNA library's controller.
+ * @param[in] hdl   Handle returned by the open HTTP callback.
+ * @param[in] len   Bytes read, 0 at end of file, negative on error.
+ * @return   DLNA_ST_OK in case of success, DLNA_ST_ERROR if no read is
+ *           pending on the handle.
+ */
+int dlna_http_read_complete (dlna_t *dlna,
+                             dlna_http_file_handler_t *hdl, int len);
+
+/**
+ * DLNA Internal WebServer Block Cache Statistics
+ *  The hit ratio is hits / (hits + misses).
+ */
+typedef struct dlna_cache_stats_s {
+  unsigned long hits;             /* reads served by a cached block */
+  unsigned long misses;           /* reads that had to load a block */
+  unsigned long evictions;        /* blocks dropped to make room */
+  unsigned long bypasses;         /* misses read directly, all blocks
+                                     being in use */
+  size_t block_size;              /* size of a block */
+  size_t capacity;                /* maximum memory for blocks */
+  size_t allocated;               /* memory allocated for blocks */
+  size_t cached;                  /* file content held in blocks */
+} dlna_cache_stats_t;
+
+/**
+ * Set up a block cache shared by all readers of local resources,
+ *   so that renderers streaming the same file at once share its reads.
+ *   Local resources are then read through the cache instead of being
+ *   sent from the file with sendfile. Must be called before the
+ *   DMS is started.
+ *
+ * @param[in] dlna  The DLNA library's controller.
+ * @param[in] size  Maximum memory for cached blocks, 0 for no cache.
+ * @return   DLNA_ST_OK in case of success, DLNA_ST_ERROR otherwise.
+ */
+int dlna_set_block_cache (dlna_t *dlna, size_t size);
+
+/**
+ * Get the activity and memory usage of the block cache.
+ *
+ * @param[in]  dlna   The DLNA library's controller.
+ * @param[out] stats  Filled with the cache statistics.
+ * @return   DLNA_ST_OK in case of success, DLNA_ST_ERROR if there is no
+ *           block cache.
+ */
+int dlna_get_block_cache_stats (dlna_t *dlna, dlna_cache_stats_t *stats);
+
+/**
+ * DLNA Internal WebServer Buffer Pool Statistics
+ *  Files are streamed with buffers taken from a pool of bounded size.
+ */
+typedef struct dlna_buffer_pool_stats_s {
+  unsigned long hits;             /* requests served with an idle buffer */
+  unsigned long allocs;           /* buffers newly allocated */
+  unsigned long waits;            /* requests that waited for a buffer */
+  unsigned long failures;         /* requests that got no buffer */
+  size_t in_use;                  /* memory handed out to streams */
+  size_t peak_used;               /* highest in_use so far */
+  size_t allocated;               /* memory held, in use or idle */
+  size_t capacity;                /* maximum memory for buffers */
+} dlna_buffer_pool_stats_t;
+
+/**
+ * Set the memory the web server may hold in buffers to stream files
+ *   with (32 MB by default). Past it, streams get smaller buffers or
+ *   wait for one to be returned.
+ *
+ * @param[in] dlna  The DLNA library's controller.
+ * @param[in] size  Maximum memory for buffers, in bytes.
+ */
+void dlna_set_buffer_pool_limit (dlna_t *dlna, size_t size);
+
+/**
+ * Get the activity and memory usage of the web server buffer pool.
+ *
+ * @param[in]  dlna   The DLNA library's controller.
+ * @param[out] stats  Filled with the buffer pool statistics.
+ * @return   DLNA_ST_OK in case of success, DLNA_ST_ERROR if the DMS is
+ *           not started.
+ */
+int dlna_get_buffer_pool_stats (dlna_t *dlna,
+                                dlna_buffer_pool_stats_t *stats);
+
 #ifdef __cplusplus
 #if 0 /* avoid EMACS indent */
 {
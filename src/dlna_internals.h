@@ -33,7 +33,16 @@
 #include "upnp/upnp.h"
 #include "upnp/upnptools.h"
 
+#include <sys/stat.h>
+#include <pthread.h>
+
 #include "uthash.h"
+#include "cache.h"
+#include "seek.h"
+#include "tsconv.h"
+#include "pcmconv.h"
+#include "live.h"
+#include "prefetch.h"
 
 #ifdef HAVE_SQLITE
 #include <sqlite3.h>
@@ -45,6 +54,14 @@ typedef enum {
   DLNA_DEVICE_DMP,      /* Digital Media Player */
 } dlna_device_type_t;
 
+/* attributes of a resource file */
+typedef struct vfs_attr_s {
+  off_t size;
+  time_t mtime;
+  int readable;
+  int directory;
+} vfs_attr_t;
+
 typedef struct vfs_item_s {
   uint32_t id;
   char *title;
@@ -61,7 +78,38 @@ typedef struct vfs_item_s {
       char *fullpath;
       char *url;
       off_t size;
+      /* descriptor shared by the HTTP handles of the resource */
       int fd;
+      int fd_refs;
+      int fd_stale;             /* file replaced, close once unused */
+      /* handles reading it, through the shared descriptor or not */
+      int users;
+      int removed;              /* removed meanwhile, freed once unused */
+      dev_t fd_dev;
+      ino_t fd_ino;
+      struct vfs_item_s *fd_prev;
+      struct vfs_item_s *fd_next;
+      /* last known attributes, trusted until attr_expires */
+      vfs_attr_t attr;
+      time_t attr_expires;
+      /* time to byte index, built on the first time seek */
+      seek_format_t seek_format;
+      seek_index_t *seek;
+      int seek_built;
+      off_t seek_size;
+      time_t seek_mtime;
+      /* MPEG-TS also offered with the other packet size, if any */
+      int ts_packet;
+      dlna_profile_t *ts_profile;
+      /* WAV served as audio/L16: where its samples are, if so */
+      off_t pcm_offset;
+      off_t pcm_length;
+      /* last read ahead for a renderer about to play it */
+      time_t prefetched;
+      /* readahead of its HTTP handles, each range request being one */
+      int io_random;            /* reads seek around: little readahead */
+      int io_seeks;             /* far seeks seen so far */
+      off_t io_pos;             /* where the last read ended in the file */
     } resource;
     struct {
       struct vfs_item_s **children;
@@ -77,6 +125,16 @@ typedef struct vfs_item_s {
 vfs_item_t *vfs_get_item_by_id (dlna_t *dlna, uint32_t id);
 vfs_item_t *vfs_get_item_by_name (dlna_t *dlna, char *name);
 void vfs_item_free (dlna_t *dlna, vfs_item_t *item);
+int vfs_resource_hold (dlna_t *dlna, vfs_item_t *item);
+vfs_item_t *vfs_resource_get (dlna_t *dlna, uint32_t id);
+int vfs_resource_open (dlna_t *dlna, vfs_item_t *item);
+void vfs_resource_close (dlna_t *dlna, vfs_item_t *item, int fd);
+int vfs_resource_get_attr (dlna_t *dlna, vfs_item_t *item, vfs_attr_t *attr);
+int vfs_resource_time_seek (dlna_t *dlna, vfs_item_t *item,
+                            uint32_t start, int64_t end,
+                            off_t *first, off_t *last, uint32_t *duration);
+dlna_org_operation_t vfs_resource_operations (vfs_item_t *item);
+int vfs_resource_is_live (dlna_t *dlna, vfs_item_t *item, vfs_attr_t *attr);
 
 typedef struct upnp_service_s         upnp_service_t;
 typedef struct upnp_action_event_s    upnp_action_event_t;
@@ -127,6 +185,23 @@ struct dlna_s {
 
   /* Internal HTTP Server */
   dlna_http_callback_t *http_callback;
+  dlna_http_io_callback_t http_io_callback;
+  block_cache_t *cache;
+  /* stream pacing, in percent of the resource's bitrate */
+  unsigned int pace_ratio;
+  size_t pace_burst;
+  size_t pace_max_rate;
+  /* part of the cap kept for background transfers, -1 for the default */
+  int background_share;
+  /* memory of the web server buffer pool, 0 for the default */
+  size_t pool_limit;
+  /* files written to within live_timeout seconds are followed */
+  unsigned int live_timeout;
+  live_watch_t *live;
+  /* head of the items browsed read ahead, up to prefetch_rate bytes/s */
+  size_t prefetch_head;
+  size_t prefetch_rate;
+  prefetch_t *prefetch;
 
   /* UPnP Services */
   upnp_service_t *services;
@@ -135,6 +210,18 @@ struct dlna_s {
   dlna_dms_storage_type_t storage_type;
   vfs_item_t *vfs_root;
   uint32_t vfs_items;
+  /* guards the hash of items, looked up from the HTTP threads */
+  pthread_mutex_t vfs_lock;
+  /* guards the descriptors and attributes of resources */
+  pthread_mutex_t vfs_fd_lock;
+  /* resources with an open descriptor, most recently used first */
+  vfs_item_t *vfs_fd_first;
+  vfs_item_t *vfs_fd_last;
+  int vfs_fd_count;
+  /* guards the time seek indexes of resources */
+  pthread_mutex_t vfs_seek_lock;
+  /* guards the readahead state of resources */
+  pthread_mutex_t vfs_io_lock;
 #ifdef HAVE_SQLITE
   sqlite3 *db;
 #endif /* HAVE_SQLITE */
@@ -159,5 +246,9 @@ void dlna_log (dlna_t *dlna,
                dlna_verbosity_level_t level,
                const char *format, ...);
 char **dlna_get_supported_mime_types (dlna_t *dlna);
+/* profile of an MPEG-TS profile's media with packets of the given size:
+   192 for timestamped packets, 188 for plain ones */
+dlna_profile_t *dlna_profile_ts_variant (dlna_t *dlna,
+                                         dlna_profile_t *profile, int packet);
 
 #endif /* DLNA_INTERNALS_H */
@@ -21,6 +21,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
@@ -34,6 +35,14 @@
 #define PROTOCOL_TYPE_PRE_SZ  11   /* for the str length of "http-get:*:" */
 #define PROTOCOL_TYPE_SUFF_SZ 2    /* for the str length of ":*" */
 
+/* readahead policy for local resources */
+#define HTTP_RA_SECONDS       4                 /* media time kept ahead */
+#define HTTP_RA_MIN           (128 * 1024)
+#define HTTP_RA_MAX           (8 * 1024 * 1024)
+#define HTTP_RA_DEFAULT       (1024 * 1024)     /* unknown bitrate */
+#define HTTP_RA_RANDOM        (64 * 1024)
+#define HTTP_RA_RANDOM_SEEKS  2                 /* far seeks before random */
+
 typedef enum {
   HTTP_ERROR = -1,
   HTTP_OK    =  0,
@@ -50,6 +59,18 @@ typedef struct http_file_handler_s {
     struct {
       int fd;
       vfs_item_t *item;
+      dlna_t *dlna;
+      ts_conv_t *conv;          /* serving the other MPEG-TS packet size */
+      /* file followed as it grows, and the read waiting for it to */
+      int live;
+      char *live_buf;
+      size_t live_len;
+      /* the random or sequential policy is the resource's */
+      off_t ra_base;            /* window derived from the item bitrate */
+      off_t ra_window;          /* sequential bytes to keep ahead of pos */
+      off_t ra_next;            /* position triggering the next prefetch */
+      off_t run;                /* bytes read since last seek */
+      struct timeval run_start;
     } local;
     struct {
       char *content;
@@ -70,18 +91,108 @@ set_service_http_info (struct File_Info *info,
   info->content_type  = ixmlCloneDOMString (content_type);
 }
 
+/* resource of an URL: <id> is the file itself, <id>.<ext> its MPEG-TS
+   converted to the other packet size; held until vfs_resource_close */
+static vfs_item_t *
+http_get_resource (dlna_t *dlna, const char *filename, int *converted)
+{
+  const char *name, *ext;
+  vfs_item_t *item;
+
+  name = strrchr (filename, '/');
+  if (!name)
+    return NULL;
+
+  item = vfs_resource_get (dlna, atoi (name + 1));
+  if (!item)
+    return NULL;
+
+  ext = strchr (name, '.');
+  *converted = ext != NULL;
+  if (!ext)
+    return item;
+
+  if (!item->u.resource.ts_profile
+      || strcmp (ext, TS_CONV_URL_EXT (item->u.resource.ts_packet)))
+  {
+    vfs_resource_close (dlna, item, -1);
+    return NULL;
+  }
+
+  return item;
+}
+
+static void
+http_set_resource_info (dlna_t *dlna, vfs_item_t *item, int converted,
+                        vfs_attr_t *attr, struct File_Info *info)
+{
+  dlna_profile_t *profile = item->u.resource.item->profile;
+  dlna_org_conversion_t cnv = item->u.resource.cnv;
+  int flags = dlna->flags;
+  char *content_type;
+  char *protocol_info;
+
+  /* file exist and can be read */
+  info->is_readable = attr->readable;
+  info->file_length = attr->size;
+  info->last_modified = attr->mtime;
+  info->is_directory = attr->directory;
+
+  if (dlna->pace_ratio && item->u.resource.item->properties)
+    info->pace_rate = (size_t) item->u.resource.item->properties->bitrate
+      * dlna->pace_ratio / 100;
+
+  /* sent as it grows, the length being only what there is so far */
+  if (vfs_resource_is_live (dlna, item, attr))
+  {
+    info->is_growing = 1;
+    flags |= DLNA_ORG_FLAG_SN_INCREASE;
+  }
+
+  if (converted)
+  {
+    int in = item->u.resource.ts_packet;
+
+    profile = item->u.resource.ts_profile;
+    cnv = DLNA_ORG_CONVERSION_TRANSCODED;
+    info->file_length = ts_conv_length (in, attr->size);
+    info->pace_rate = info->pace_rate * TS_CONV_OUT (in) / in;
+  }
+  else if (item->u.resource.pcm_length)
+    info->file_length = item->u.resource.pcm_length;
+
+  protocol_info = 
+    dlna_write_protocol_info (DLNA_PROTOCOL_INFO_TYPE_HTTP,
+                              DLNA_ORG_PLAY_SPEED_NORMAL,
+                              cnv,
+                              vfs_resource_operations (item),
+                              flags, profile);
+
+  content_type =
+    strndup ((protocol_info + PROTOCOL_TYPE_PRE_SZ),
+             strlen (protocol_info + PROTOCOL_TYPE_PRE_SZ)
+             - PROTOCOL_TYPE_SUFF_SZ);
+  free (protocol_info);
+
+  if (content_type)
+  {
+    info->content_type = ixmlCloneDOMString (content_type);
+    free (content_type);
+  }
+  else
+    info->content_type = ixmlCloneDOMString ("");
+}
+
 static int
 upnp_http_get_info (void *cookie,
                     const char *filename,
                     struct File_Info *info)
 {
   dlna_t *dlna;
-  uint32_t id;
   vfs_item_t *item;
-  char *content_type;
-  char *protocol_info;
-  struct stat st;
-  
+  vfs_attr_t attr;
+  int converted;
+
   if (!cookie || !filename || !info)
     return HTTP_ERROR;
 
@@ -126,54 +237,20 @@ upnp_http_get_info (void *cookie,
   }
 
   /* ask for anything else ... */
-  id = atoi (strrchr (filename, '/') + 1);
-  item = vfs_get_item_by_id (dlna, id);
+  item = http_get_resource (dlna, filename, &converted);
   if (!item)
     return HTTP_ERROR;
 
-  if (item->type != DLNA_RESOURCE)
-    return HTTP_ERROR;
-
-  if (!item->u.resource.fullpath)
-    return HTTP_ERROR;
-
-  if (stat (item->u.resource.fullpath, &st) < 0)
-    return HTTP_ERROR;
-
-  info->is_readable = 1;
-  if (access (item->u.resource.fullpath, R_OK) < 0)
+  /* cached for a short while, saving a stat() and an access() */
+  if (vfs_resource_get_attr (dlna, item, &attr) < 0)
   {
-    if (errno != EACCES)
-      return HTTP_ERROR;
-    info->is_readable = 0;
+    vfs_resource_close (dlna, item, -1);
+    return HTTP_ERROR;
   }
 
-  /* file exist and can be read */
-  info->file_length = st.st_size;
-  info->last_modified = st.st_mtime;
-  info->is_directory = S_ISDIR (st.st_mode);
+  http_set_resource_info (dlna, item, converted, &attr, info);
+  vfs_resource_close (dlna, item, -1);
 
-  protocol_info = 
-    dlna_write_protocol_info (DLNA_PROTOCOL_INFO_TYPE_HTTP,
-                              DLNA_ORG_PLAY_SPEED_NORMAL,
-                              DLNA_ORG_CONVERSION_NONE,
-                              DLNA_ORG_OPERATION_RANGE,
-                              dlna->flags, item->u.resource.item->profile);
-
-  content_type =
-    strndup ((protocol_info + PROTOCOL_TYPE_PRE_SZ),
-             strlen (protocol_info + PROTOCOL_TYPE_PRE_SZ)
-             - PROTOCOL_TYPE_SUFF_SZ);
-  free (protocol_info);
-
-  if (content_type)
-  {
-    info->content_type = ixmlCloneDOMString (content_type);
-    free (content_type);
-  }
-  else
-    info->content_type = ixmlCloneDOMString ("");
-  
   return HTTP_OK;
 }
 
@@ -202,11 +279,193 @@ http_get_file_from_memory (const char *fullpath,
   return ((dlnaWebFileHandle) dhdl);
 }
 
+static inline off_t
+http_io_clamp (off_t window)
+{
+  if (window < HTTP_RA_MIN)
+    return HTTP_RA_MIN;
+  if (window > HTTP_RA_MAX)
+    return HTTP_RA_MAX;
+  return window;
+}
+
+static inline void
+http_io_advise (int fd, off_t offset, off_t len, int advice)
+{
+#ifdef POSIX_FADV_NORMAL
+  posix_fadvise (fd, offset, len, advice);
+#endif
+}
+
+/* where a position of what the handle serves is in the file */
+static off_t
+http_io_source (http_file_handler_t *hdl, off_t pos)
+{
+  vfs_item_t *item = hdl->detail.local.item;
+
+  if (hdl->detail.local.conv)
+    return ts_conv_to_source (item->u.resource.ts_packet, pos);
+
+  return pos + item->u.resource.pcm_offset;
+}
+
+static inline off_t
+http_io_window (http_file_handler_t *hdl)
+{
+  return hdl->detail.local.item->u.resource.io_random ?
+    HTTP_RA_RANDOM : hdl->detail.local.ra_window;
+}
+
+static void
+http_io_prefetch (http_file_handler_t *hdl)
+{
+  dlna_t *dlna = hdl->detail.local.dlna;
+  off_t window;
+
+  pthread_mutex_lock (&dlna->vfs_io_lock);
+  window = http_io_window (hdl);
+  pthread_mutex_unlock (&dlna->vfs_io_lock);
+
+#ifdef POSIX_FADV_WILLNEED
+  http_io_advise (hdl->detail.local.fd,
+                  http_io_source (hdl, hdl->pos), window, POSIX_FADV_WILLNEED);
+#endif
+  hdl->detail.local.ra_next = hdl->pos + window / 2;
+}
+
+/* switch the resource to reading from offset on, with vfs_io_lock held */
+static void
+http_io_set_policy (http_file_handler_t *hdl, int random, off_t offset)
+{
+  vfs_item_t *item = hdl->detail.local.item;
+
+  item->u.resource.io_random = random;
+
+  /* on the range read next only: the descriptor is shared */
+  if (!random)
+  {
+    hdl->detail.local.ra_window = hdl->detail.local.ra_base;
+    item->u.resource.io_seeks = 0;
+#ifdef POSIX_FADV_SEQUENTIAL
+    http_io_advise (hdl->detail.local.fd, offset,
+                    hdl->detail.local.ra_window, POSIX_FADV_SEQUENTIAL);
+#endif
+  }
+  else
+  {
+#ifdef POSIX_FADV_RANDOM
+    http_io_advise (hdl->detail.local.fd, offset,
+                    HTTP_RA_RANDOM, POSIX_FADV_RANDOM);
+#endif
+  }
+}
+
+static void
+http_io_init (http_file_handler_t *hdl, vfs_item_t *item)
+{
+  dlna_item_t *ditem = item->u.resource.item;
+
+  /* keep a few seconds of media ahead of the reader */
+  if (ditem && ditem->properties && ditem->properties->bitrate)
+    hdl->detail.local.ra_base =
+      http_io_clamp ((off_t) ditem->properties->bitrate * HTTP_RA_SECONDS);
+  else
+    hdl->detail.local.ra_base = HTTP_RA_DEFAULT;
+  hdl->detail.local.ra_window = hdl->detail.local.ra_base;
+
+  hdl->detail.local.run = 0;
+  gettimeofday (&hdl->detail.local.run_start, NULL);
+
+  /* first read issues the initial prefetch, wherever it starts */
+  hdl->detail.local.ra_next = 0;
+}
+
+static void
+http_io_read_done (http_file_handler_t *hdl, size_t len)
+{
+  dlna_t *dlna = hdl->detail.local.dlna;
+  vfs_item_t *item = hdl->detail.local.item;
+  struct timeval now;
+  double elapsed;
+  off_t window, offset;
+  int random;
+
+  hdl->detail.local.run += len;
+  offset = http_io_source (hdl, hdl->pos);
+
+  pthread_mutex_lock (&dlna->vfs_io_lock);
+  item->u.resource.io_pos = offset;
+  /* a long contiguous run after some seeking is streaming again */
+  if (item->u.resource.io_random
+      && hdl->detail.local.run >= 2 * hdl->detail.local.ra_base)
+    http_io_set_policy (hdl, 0, offset);
+  random = item->u.resource.io_random;
+  pthread_mutex_unlock (&dlna->vfs_io_lock);
+
+  if (!random)
+  {
+    /* reads are paced by the socket: follow the observed throughput */
+    gettimeofday (&now, NULL);
+    elapsed = (now.tv_sec - hdl->detail.local.run_start.tv_sec)
+      + (now.tv_usec - hdl->detail.local.run_start.tv_usec) / 1000000.0;
+    if (elapsed >= 1.0)
+    {
+      window = http_io_clamp ((off_t) (hdl->detail.local.run / elapsed)
+                              * HTTP_RA_SECONDS);
+      hdl->detail.local.ra_window = MAX (window, hdl->detail.local.ra_base);
+    }
+  }
+}
+
+/* seeks count from the last read of any handle of the resource, as a
+   renderer seeking opens a range request each time */
+static void
+http_io_seek (http_file_handler_t *hdl, off_t newpos)
+{
+  dlna_t *dlna = hdl->detail.local.dlna;
+  vfs_item_t *item = hdl->detail.local.item;
+  off_t offset, dist;
+
+  if (newpos == hdl->pos)
+    return;
+
+  offset = http_io_source (hdl, newpos);
+
+  pthread_mutex_lock (&dlna->vfs_io_lock);
+  dist = offset > item->u.resource.io_pos ?
+    offset - item->u.resource.io_pos : item->u.resource.io_pos - offset;
+  if (dist > http_io_window (hdl)
+      && ++item->u.resource.io_seeks >= HTTP_RA_RANDOM_SEEKS
+      && !item->u.resource.io_random)
+    http_io_set_policy (hdl, 1, offset);
+  pthread_mutex_unlock (&dlna->vfs_io_lock);
+
+  hdl->detail.local.ra_next = newpos;
+  hdl->detail.local.run = 0;
+  gettimeofday (&hdl->detail.local.run_start, NULL);
+}
+
+/* source of the conversions, through the block cache if any */
+static ssize_t
+http_source_read (void *opaque, char *buf, size_t len, off_t offset)
+{
+  http_file_handler_t *hdl = (http_file_handler_t *) opaque;
+  dlna_t *dlna = hdl->detail.local.dlna;
+
+  /* the short last block of a growing file would be kept cached */
+  if (dlna->cache && !hdl->detail.local.live)
+    return block_cache_read (dlna->cache, hdl->detail.local.item->id,
+                             hdl->detail.local.fd, buf, len, offset);
+
+  return pread (hdl->detail.local.fd, buf, len, offset);
+}
+
 static dlnaWebFileHandle
-http_get_file_local (vfs_item_t *item)
+http_get_file_local (dlna_t *dlna, vfs_item_t *item, int converted)
 {
   dlna_http_file_handler_t *dhdl;
   http_file_handler_t *hdl;
+  vfs_attr_t attr;
   int fd;
   
   if (!item)
@@ -215,8 +474,8 @@ http_get_file_local (vfs_item_t *item)
   if (!item->u.resource.fullpath)
     return NULL;
   
-  fd = open (item->u.resource.fullpath,
-             O_RDONLY | O_NONBLOCK | O_SYNC | O_NDELAY);
+  /* the descriptor is shared: reads give their own position */
+  fd = vfs_resource_open (dlna, item);
   if (fd < 0)
     return NULL;
   
@@ -226,6 +485,29 @@ http_get_file_local (vfs_item_t *item)
   hdl->type                  = HTTP_FILE_LOCAL;
   hdl->detail.local.fd       = fd;
   hdl->detail.local.item     = item;
+  hdl->detail.local.dlna     = dlna;
+  hdl->detail.local.conv     = NULL;
+  hdl->detail.local.live     = !vfs_resource_get_attr (dlna, item, &attr)
+    && vfs_resource_is_live (dlna, item, &attr);
+  hdl->detail.local.live_buf = NULL;
+  hdl->detail.local.live_len = 0;
+  http_io_init (hdl, item);
+
+  if (converted)
+  {
+    uint32_t bitrate = item->u.resource.item->properties ?
+      item->u.resource.item->properties->bitrate : 0;
+
+    hdl->detail.local.conv = ts_conv_new (item->u.resource.ts_packet,
+                                          bitrate, http_source_read, hdl);
+    if (!hdl->detail.local.conv)
+    {
+      vfs_resource_close (dlna, item, fd);
+      free (hdl->fullpath);
+      free (hdl);
+      return NULL;
+    }
+  }
 
   dhdl                       = malloc (sizeof (dlna_http_file_handler_t));
   dhdl->external             = 0;
@@ -240,8 +522,9 @@ upnp_http_open (void *cookie,
                 enum dlnaOpenFileMode mode)
 {
   dlna_t *dlna;
-  uint32_t id;
   vfs_item_t *item;
+  dlnaWebFileHandle fh;
+  int converted;
   
   if (!cookie || !filename)
     return NULL;
@@ -279,12 +562,157 @@ upnp_http_open (void *cookie,
                                       AVTS_DESCRIPTION, AVTS_DESCRIPTION_LEN);
   
   /* ask for anything else ... */
-  id = atoi (strrchr (filename, '/') + 1);
-  item = vfs_get_item_by_id (dlna, id);
+  item = http_get_resource (dlna, filename, &converted);
+  if (!item)
+    return NULL;
+
+  /* the handle holds the resource on its own */
+  fh = http_get_file_local (dlna, item, converted);
+  vfs_resource_close (dlna, item, -1);
+
+  return fh;
+}
+
+static dlnaWebFileHandle
+upnp_http_open_info (void *cookie,
+                     const char *filename,
+                     struct File_Info *info)
+{
+  dlna_t *dlna;
+  vfs_item_t *item;
+  vfs_attr_t attr;
+  dlnaWebFileHandle fh;
+  int converted;
+
+  if (!cookie || !filename || !info)
+    return NULL;
+
+  dlna = (dlna_t *) cookie;
+
+  dlna_log (dlna, DLNA_MSG_INFO,
+            "%s, filename : %s\n", __FUNCTION__, filename);
+
+  /* application-level HTTP callbacks answer through get_info and open */
+  if (dlna->http_callback)
+    return NULL;
+
+  /* ask for Content Directory Service (CDS) */
+  if (!strcmp (filename, CDS_LOCATION))
+  {
+    set_service_http_info (info, CDS_DESCRIPTION_LEN, SERVICE_CONTENT_TYPE);
+    return http_get_file_from_memory (CDS_LOCATION,
+                                      CDS_DESCRIPTION, CDS_DESCRIPTION_LEN);
+  }
+
+  /* ask for Connection Manager Service (CMS) */
+  if (!strcmp (filename, CMS_LOCATION))
+  {
+    set_service_http_info (info, CMS_DESCRIPTION_LEN, SERVICE_CONTENT_TYPE);
+    return http_get_file_from_memory (CMS_LOCATION,
+                                      CMS_DESCRIPTION, CMS_DESCRIPTION_LEN);
+  }
+
+  /* ask for AVTransport Service (AVTS) */
+  if (!strcmp (filename, AVTS_LOCATION))
+  {
+    set_service_http_info (info, AVTS_DESCRIPTION_LEN, SERVICE_CONTENT_TYPE);
+    return http_get_file_from_memory (AVTS_LOCATION,
+                                      AVTS_DESCRIPTION, AVTS_DESCRIPTION_LEN);
+  }
+
+  /* ask for anything else ... */
+  item = http_get_resource (dlna, filename, &converted);
   if (!item)
     return NULL;
 
-  return http_get_file_local (item);
+  /* anything but a readable file is left to get_info for the error */
+  fh = NULL;
+  if (vfs_resource_get_attr (dlna, item, &attr) == 0
+      && !attr.directory && attr.readable)
+    fh = http_get_file_local (dlna, item, converted);
+  if (fh)
+    http_set_resource_info (dlna, item, converted, &attr, info);
+  /* the handle holds the resource on its own */
+  vfs_resource_close (dlna, item, -1);
+
+  return fh;
+}
+
+/* read at the handle's position, not waiting for a growing file */
+static ssize_t
+http_read (dlna_t *dlna, http_file_handler_t *hdl, char *buf, size_t buflen)
+{
+  ssize_t len = -1;
+
+  switch (hdl->type)
+  {
+  case HTTP_FILE_LOCAL:
+    dlna_log (dlna, DLNA_MSG_INFO, "Read local file.\n");
+    if (hdl->pos >= hdl->detail.local.ra_next)
+      http_io_prefetch (hdl);
+    if (hdl->detail.local.conv)
+      len = ts_conv_read (hdl->detail.local.conv, buf, buflen, hdl->pos);
+    else if (hdl->detail.local.item->u.resource.pcm_length)
+      len = pcm_conv_read (http_source_read, hdl,
+                           hdl->detail.local.item->u.resource.pcm_offset,
+                           hdl->detail.local.item->u.resource.pcm_length,
+                           buf, buflen, hdl->pos);
+    else if (dlna->cache && !hdl->detail.local.live)
+      len = block_cache_read (dlna->cache, hdl->detail.local.item->id,
+                              hdl->detail.local.fd, buf, buflen, hdl->pos);
+    else
+      len = pread (hdl->detail.local.fd, buf, buflen, hdl->pos);
+    break;
+  case HTTP_FILE_MEMORY:
+    dlna_log (dlna, DLNA_MSG_INFO, "Read file from memory.\n");
+    len = (ssize_t) MIN (buflen, hdl->detail.memory.len - hdl->pos);
+    memcpy (buf, hdl->detail.memory.content + hdl->pos, (ssize_t) len);
+    break;
+  default:
+    dlna_log (dlna, DLNA_MSG_ERROR, "Unknown HTTP file type.\n");
+    break;
+  }
+
+  if (len > 0)
+  {
+    hdl->pos += len;
+    if (hdl->type == HTTP_FILE_LOCAL)
+      http_io_read_done (hdl, len);
+  }
+
+  dlna_log (dlna, DLNA_MSG_INFO, "Read %zd bytes.\n", len);
+
+  return len;
+}
+
+/* at the end of a file being written, wait for more: with done, the
+   wait is left pending as for live_wait_async, else blocks, 1 telling
+   there is more to read. -1 if the file is not followed. */
+static int
+http_live_wait (http_file_handler_t *hdl, live_done_t done, void *opaque)
+{
+  dlna_t *dlna = hdl->detail.local.dlna;
+  vfs_item_t *item = hdl->detail.local.item;
+  int timeout;
+  off_t size;
+
+  if (!hdl->detail.local.live || !dlna->live)
+    return -1;
+
+  /* until it has not grown for that long */
+  timeout = dlna->live_timeout * 1000;
+
+  /* the converted stream only has whole packets */
+  size = hdl->pos;
+  if (hdl->detail.local.conv)
+    size = ts_conv_to_source (item->u.resource.ts_packet, hdl->pos)
+      + item->u.resource.ts_packet - 1;
+
+  if (done)
+    return live_wait_async (dlna->live, hdl->fullpath, size,
+                            timeout, done, opaque);
+
+  return live_wait (dlna->live, hdl->fullpath, size, timeout);
 }
 
 static int
@@ -296,7 +724,7 @@ upnp_http_read (void *cookie,
   dlna_t *dlna;
   dlna_http_file_handler_t *dhdl;
   http_file_handler_t *hdl;
-  ssize_t len = -1;
+  ssize_t len;
 
   if (!cookie || !fh)
     return HTTP_ERROR;
@@ -317,26 +745,10 @@ upnp_http_read (void *cookie,
 
   hdl = (http_file_handler_t *) dhdl->priv;
   
-  switch (hdl->type)
-  {
-  case HTTP_FILE_LOCAL:
-    dlna_log (dlna, DLNA_MSG_INFO, "Read local file.\n");
-    len = read (hdl->detail.local.fd, buf, buflen);
-    break;
-  case HTTP_FILE_MEMORY:
-    dlna_log (dlna, DLNA_MSG_INFO, "Read file from memory.\n");
-    len = (ssize_t) MIN (buflen, hdl->detail.memory.len - hdl->pos);
-    memcpy (buf, hdl->detail.memory.content + hdl->pos, (ssize_t) len);
-    break;
-  default:
-    dlna_log (dlna, DLNA_MSG_ERROR, "Unknown HTTP file type.\n");
-    break;
-  }
-
-  if (len > 0)
-    hdl->pos += len;
-
-  dlna_log (dlna, DLNA_MSG_INFO, "Read %zd bytes.\n", len);
+  len = http_read (dlna, hdl, buf, buflen);
+  while (len == 0 && hdl->type == HTTP_FILE_LOCAL
+         && http_live_wait (hdl, NULL, NULL) > 0)
+    len = http_read (dlna, hdl, buf, buflen);
 
   return len;
 }
@@ -416,14 +828,19 @@ upnp_http_seek (void *cookie,
 
     if (hdl->type == HTTP_FILE_LOCAL)
     {
-      struct stat sb;
-      if (stat (hdl->fullpath, &sb) < 0)
+      vfs_attr_t attr;
+      if (vfs_resource_get_attr (dlna, hdl->detail.local.item, &attr) < 0)
       {
         dlna_log (dlna, DLNA_MSG_ERROR,
                   "%s: cannot stat: %s\n", hdl->fullpath, strerror (errno));
         return HTTP_ERROR;
       }
-      newpos = sb.st_size + offset;
+      newpos = attr.size + offset;
+      if (hdl->detail.local.conv)
+        newpos = ts_conv_length (hdl->detail.local.item->u.resource.ts_packet,
+                                 attr.size) + offset;
+      else if (hdl->detail.local.item->u.resource.pcm_length)
+        newpos = hdl->detail.local.item->u.resource.pcm_length + offset;
     }
     else if (hdl->type == HTTP_FILE_MEMORY)
       newpos = hdl->detail.memory.len + offset;
@@ -441,14 +858,8 @@ upnp_http_seek (void *cookie,
       return HTTP_ERROR;
     }
 
-    /* Don't seek with origin as specified above, as file may have
-       changed in size since our last stat. */
-    if (lseek (hdl->detail.local.fd, newpos, SEEK_SET) == -1)
-    {
-      dlna_log (dlna, DLNA_MSG_ERROR,
-                "%s: cannot seek: %s\n", hdl->fullpath, strerror (errno));
-      return HTTP_ERROR;
-    }
+    /* reads are positioned: nothing to do on the descriptor */
+    http_io_seek (hdl, newpos);
     break;
   case HTTP_FILE_MEMORY:
     if (newpos < 0 || newpos > hdl->detail.memory.len)
@@ -498,7 +909,11 @@ upnp_http_close (void *cookie,
   switch (hdl->type)
   {
   case HTTP_FILE_LOCAL:
-    close (hdl->detail.local.fd);
+    /* a read left pending on the file growing is cancelled */
+    if (hdl->detail.local.live)
+      live_cancel (dlna->live, dhdl);
+    ts_conv_free (hdl->detail.local.conv);
+    vfs_resource_close (dlna, hdl->detail.local.item, hdl->detail.local.fd);
     break;
   case HTTP_FILE_MEMORY:
     /* no close operation is needed, just free file content */
@@ -518,6 +933,230 @@ upnp_http_close (void *cookie,
   return HTTP_OK;
 }
 
+static int
+upnp_http_get_fd (void *cookie,
+                  dlnaWebFileHandle fh,
+                  off_t *offset)
+{
+  dlna_t *dlna;
+  dlna_http_file_handler_t *dhdl;
+  http_file_handler_t *hdl;
+
+  if (!cookie || !fh || !offset)
+    return -1;
+
+  dlna = (dlna_t *) cookie;
+  dhdl = (dlna_http_file_handler_t *) fh;
+
+  /* trap application-level HTTP callback */
+  if (dhdl->external)
+  {
+    if (dlna->http_io_callback.get_fd)
+      return dlna->http_io_callback.get_fd (dhdl->priv, offset);
+    return -1;
+  }
+
+  /* cached files have to go through read() to share their blocks */
+  if (dlna->cache)
+    return -1;
+
+  hdl = (http_file_handler_t *) dhdl->priv;
+  if (hdl->type != HTTP_FILE_LOCAL)
+    return -1;
+
+  /* converted MPEG-TS and L16 samples are not the file's bytes */
+  if (hdl->detail.local.conv || hdl->detail.local.item->u.resource.pcm_length)
+    return -1;
+
+  /* sent from the descriptor, a growing file would end where it is */
+  if (hdl->detail.local.live)
+    return -1;
+
+  *offset = hdl->pos;
+  return hdl->detail.local.fd;
+}
+
+static int
+upnp_http_read_mapped (void *cookie,
+                       dlnaWebFileHandle fh,
+                       char *buf,
+                       size_t buflen,
+                       const char **data)
+{
+  dlna_t *dlna;
+  dlna_http_file_handler_t *dhdl;
+  http_file_handler_t *hdl;
+  ssize_t len;
+
+  if (!cookie || !fh || !data)
+    return HTTP_ERROR;
+
+  dlna = (dlna_t *) cookie;
+  dhdl = (dlna_http_file_handler_t *) fh;
+
+  /* trap application-level HTTP callback */
+  if (dhdl->external && dlna->http_io_callback.map)
+  {
+    len = dlna->http_io_callback.map (dhdl->priv, buflen, data);
+    return len < 0 ? HTTP_ERROR : (int) len;
+  }
+
+  /* descriptions are sent from where they are kept */
+  hdl = dhdl->external ? NULL : (http_file_handler_t *) dhdl->priv;
+  if (hdl && hdl->type == HTTP_FILE_MEMORY)
+  {
+    len = (ssize_t) MIN (buflen, hdl->detail.memory.len - hdl->pos);
+    *data = hdl->detail.memory.content + hdl->pos;
+    hdl->pos += len;
+    return len;
+  }
+
+  *data = buf;
+  return upnp_http_read (cookie, fh, buf, buflen);
+}
+
+/* a file being written grew, or not in time */
+static void
+http_live_done (void *opaque, int grown)
+{
+  dlna_http_file_handler_t *dhdl = (dlna_http_file_handler_t *) opaque;
+  http_file_handler_t *hdl = (http_file_handler_t *) dhdl->priv;
+  dlna_t *dlna = hdl->detail.local.dlna;
+  ssize_t len = 0;
+  int res = grown;
+
+  /* the handle stays open as long as the read is pending */
+  while (res > 0)
+  {
+    len = http_read (dlna, hdl, hdl->detail.local.live_buf,
+                     hdl->detail.local.live_len);
+    if (len != 0)
+      break;
+    res = http_live_wait (hdl, http_live_done, dhdl);
+    if (res == LIVE_PENDING)
+      return;
+  }
+
+  dlna_http_read_complete (dlna, dhdl, len);
+}
+
+static int
+upnp_http_read_async (void *cookie,
+                      dlnaWebFileHandle fh,
+                      char *buf,
+                      size_t buflen,
+                      const char **data)
+{
+  dlna_t *dlna;
+  dlna_http_file_handler_t *dhdl;
+  http_file_handler_t *hdl;
+  ssize_t len;
+  int res;
+
+  if (!cookie || !fh || !data)
+    return HTTP_ERROR;
+
+  dlna = (dlna_t *) cookie;
+  dhdl = (dlna_http_file_handler_t *) fh;
+
+  /* trap application-level HTTP callback */
+  if (dhdl->external && dlna->http_io_callback.read_async)
+  {
+    *data = buf;
+    res = dlna->http_io_callback.read_async (dhdl->priv, buf, buflen);
+    if (res == DLNA_HTTP_READ_PENDING)
+      return DLNA_E_PENDING;
+    return res < 0 ? HTTP_ERROR : res;
+  }
+
+  /* what a file being written is still to get is not waited for */
+  hdl = dhdl->external ? NULL : (http_file_handler_t *) dhdl->priv;
+  if (hdl && hdl->type == HTTP_FILE_LOCAL && hdl->detail.local.live)
+  {
+    *data = buf;
+    for (;;)
+    {
+      len = http_read (dlna, hdl, buf, buflen);
+      if (len != 0)
+        break;
+      hdl->detail.local.live_buf = buf;
+      hdl->detail.local.live_len = buflen;
+      res = http_live_wait (hdl, http_live_done, dhdl);
+      if (res == LIVE_PENDING)
+        return DLNA_E_PENDING;
+      if (res < 0)
+        break;
+    }
+    return len < 0 ? HTTP_ERROR : (int) len;
+  }
+
+  return upnp_http_read_mapped (cookie, fh, buf, buflen, data);
+}
+
+int
+dlna_http_read_complete (dlna_t *dlna,
+                         dlna_http_file_handler_t *hdl, int len)
+{
+  if (!dlna || !hdl)
+    return DLNA_ST_ERROR;
+
+  if (dlnaWebFileReadComplete ((dlnaWebFileHandle) hdl,
+                               len < 0 ? HTTP_ERROR : len) != DLNA_E_SUCCESS)
+    return DLNA_ST_ERROR;
+
+  return DLNA_ST_OK;
+}
+
+static int
+upnp_http_get_time_range (void *cookie,
+                          const char *filename,
+                          long start,
+                          long end,
+                          off_t *first,
+                          off_t *last,
+                          long *duration)
+{
+  dlna_t *dlna;
+  vfs_item_t *item;
+  uint32_t total;
+  int converted;
+
+  if (!cookie || !filename || !first || !last || !duration || start < 0)
+    return HTTP_ERROR;
+
+  dlna = (dlna_t *) cookie;
+
+  /* application-level HTTP files are not indexed */
+  if (dlna->http_callback && dlna->http_callback->get_info)
+  {
+    dlna_http_file_info_t finfo;
+
+    if (!dlna->http_callback->get_info (filename, &finfo))
+      return HTTP_ERROR;
+  }
+
+  item = http_get_resource (dlna, filename, &converted);
+  if (!item)
+    return HTTP_ERROR;
+
+  /* the index is built the first time, later seeks only look it up */
+  if (vfs_resource_time_seek (dlna, item, start, end,
+                              first, last, &total) < 0)
+    return HTTP_ERROR;
+  *duration = total;
+
+  /* the index is on the file: same packets in the converted stream */
+  if (converted)
+  {
+    int in = item->u.resource.ts_packet;
+
+    *first = ts_conv_from_source (in, *first);
+    *last = ts_conv_from_source (in, *last + 1) - 1;
+  }
+
+  return HTTP_OK;
+}
+
 struct dlnaVirtualDirCallbacks virtual_dir_callbacks = {
   NULL,
   upnp_http_get_info,
@@ -525,5 +1164,10 @@ struct dlnaVirtualDirCallbacks virtual_dir_callbacks = {
   upnp_http_read,
   upnp_http_write,
   upnp_http_seek,
-  upnp_http_close
+  upnp_http_close,
+  upnp_http_get_fd,
+  upnp_http_open_info,
+  upnp_http_read_mapped,
+  upnp_http_read_async,
+  upnp_http_get_time_range
 };
@@ -0,0 +1,262 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/************************************************************************
+* Purpose: Check and benchmark of the XML escaping scanners. The
+* source of the scanners is included so that each one can be called
+* directly. They must all return the same span as the scalar one for
+* every byte value, at every position and for every tail length, from
+* aligned and unaligned addresses. Each one then escapes DIDL-Lite
+* metadata, as the content directory renders it, and its rate is
+* printed.
+*
+*     ixml-escape-bench [rounds]
+************************************************************************/
+
+#include "ixmlescape.c"
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_ROUNDS    20000
+#define BENCH_MAX_LEN   100     // longest run checked, past 3 AVX2 vectors
+#define BENCH_OUT_SIZE  ( 64 * 1024 )
+
+typedef struct {
+    const char *name;
+    escape_span_func span;
+} bench_scanner;
+
+/*================================================================
+*   bench_metadata
+*       Values of the DIDL-Lite properties of a few items: titles,
+*       artists and albums, file names and URLs, where few characters
+*       have to be escaped.
+*
+*=================================================================*/
+static const char *bench_metadata[] = {
+    "The Lord of the Rings: The Fellowship of the Ring (Extended Edition)",
+    "Peter Jackson",
+    "object.item.videoItem.movie",
+    "http-get:*:video/mpeg:DLNA.ORG_PN=MPEG_PS_PAL;DLNA.ORG_OP=01;"
+        "DLNA.ORG_CI=0;DLNA.ORG_FLAGS=01700000000000000000000000000000",
+    "http://192.168.1.10:49152/web/1042?format=ts&profile=AVC_TS_HD_50_AC3",
+    "Simon & Garfunkel",
+    "Bridge Over Troubled Water",
+    "The Boxer",
+    "/media/Music/Simon & Garfunkel/Bridge Over Troubled Water/"
+        "03 - Keep the Customer Satisfied.flac",
+    "Guns N' Roses",
+    "Appetite for Destruction",
+    "Sweet Child O' Mine",
+    "object.item.audioItem.musicTrack",
+    "2008-07-14T20:31:00",
+    "0:05:56.000",
+    "Rock'n'Roll <Live at \"Wembley\">",
+    "Holidays 2007 - Beach, Sunset and Friends",
+    "object.item.imageItem.photo",
+    "/media/Pictures/2007/Holidays/IMG_4711.JPG",
+    "Les Misérables - \"I Dreamed a Dream\"",
+};
+
+static double
+BenchNow( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*================================================================
+*   BenchCheck
+*       Compares the span of a scanner with the scalar one for each
+*       byte value at each position of runs of every length, starting
+*       at aligned and unaligned addresses. The other bytes of a run
+*       are clean but take all other values, high ones included.
+*       Returns the number of mismatches.
+*
+*=================================================================*/
+static int
+BenchCheck( IN const bench_scanner * s )
+{
+    static const size_t offsets[] = { 0, 1, 7, 15, 16, 31 };
+    static char buf[32 + BENCH_MAX_LEN];
+    size_t len, pos, o, i, got, expected;
+    unsigned char clean;
+    char saved;
+    int b, errors = 0;
+
+    for( o = 0; o < sizeof( offsets ) / sizeof( offsets[0] ); o++ ) {
+        char *run = buf + offsets[o];
+
+        for( len = 0; len <= BENCH_MAX_LEN; len++ ) {
+            clean = ( unsigned char )( len * 7 + o );
+            for( i = 0; i < len; i++ ) {
+                while( escape_table[clean] )
+                    clean++;
+                run[i] = ( char )clean++;
+            }
+
+            // pos == len leaves the run clean
+            for( pos = 0; pos <= len; pos++ ) {
+                for( b = 0; b < 256; b++ ) {
+                    saved = run[pos];
+                    if( pos < len )
+                        run[pos] = ( char )b;
+
+                    expected = escape_span_c( run, len );
+                    got = s->span( run, len );
+                    run[pos] = saved;
+                    if( got != expected && errors++ < 10 ) {
+                        printf( "%s: byte 0x%02x at %zu of %zu "
+                                "(offset %zu): span %zu, expected %zu\n",
+                                s->name, b, pos, len, offsets[o], got,
+                                expected );
+                    }
+                }
+            }
+        }
+    }
+
+    return errors;
+}
+
+/*================================================================
+*   BenchEscape
+*       Escapes src into out the way buffer_append_escaped does.
+*       Returns the length written.
+*
+*=================================================================*/
+static size_t
+BenchEscape( IN escape_span_func span,
+             IN const char *src,
+             IN size_t len,
+             OUT char *out )
+{
+    const char *entity;
+    size_t n = 0, run;
+
+    while( len > 0 ) {
+        run = span( src, len );
+        memcpy( out + n, src, run );
+        n += run;
+        if( run == len )
+            break;
+
+        entity = ixmlEscapeEntity( src[run] );
+        memcpy( out + n, entity, strlen( entity ) );
+        n += strlen( entity );
+        src += run + 1;
+        len -= run + 1;
+    }
+
+    return n;
+}
+
+/*================================================================
+*   BenchRun
+*       Escapes the metadata rounds times with a scanner into out and
+*       prints the rate. Returns the length of the output of a round.
+*
+*=================================================================*/
+static size_t
+BenchRun( IN const bench_scanner * s,
+          IN int rounds,
+          OUT char *out )
+{
+    const size_t count = sizeof( bench_metadata ) /
+        sizeof( bench_metadata[0] );
+    size_t lens[sizeof( bench_metadata ) / sizeof( bench_metadata[0] )];
+    size_t in = 0, written = 0, i;
+    double start, elapsed;
+    int r;
+
+    for( i = 0; i < count; i++ ) {
+        lens[i] = strlen( bench_metadata[i] );
+        in += lens[i];
+    }
+
+    start = BenchNow(  );
+    for( r = 0; r < rounds; r++ ) {
+        written = 0;
+        for( i = 0; i < count; i++ ) {
+            written += BenchEscape( s->span, bench_metadata[i], lens[i],
+                                    out + written );
+        }
+        // keep the compiler from dropping the rounds
+        __asm__ __volatile__( "" : : "r"( out ) : "memory" );
+    }
+    elapsed = BenchNow(  ) - start;
+
+    printf( "%-6s %8.1f MB/s of metadata\n", s->name,
+            ( double )in * rounds / elapsed / ( 1024 * 1024 ) );
+
+    return written;
+}
+
+int
+main( int argc,
+      char **argv )
+{
+    static char reference[BENCH_OUT_SIZE], out[BENCH_OUT_SIZE];
+    bench_scanner scanners[3];
+    int count = 0, rounds = BENCH_ROUNDS, errors = 0, i;
+    size_t written, expected = 0;
+
+    if( argc > 2 || ( argc == 2 && ( rounds = atoi( argv[1] ) ) <= 0 ) ) {
+        fprintf( stderr, "usage: %s [rounds]\n", argv[0] );
+        return 1;
+    }
+
+    scanners[count].name = "scalar";
+    scanners[count++].span = escape_span_c;
+#ifdef IXML_ESCAPE_X86
+    __builtin_cpu_init(  );
+    if( __builtin_cpu_supports( "sse2" ) ) {
+        scanners[count].name = "sse2";
+        scanners[count++].span = escape_span_sse2;
+    }
+    if( __builtin_cpu_supports( "avx2" ) ) {
+        scanners[count].name = "avx2";
+        scanners[count++].span = escape_span_avx2;
+    }
+#endif
+
+    for( i = 1; i < count; i++ ) {
+        errors += BenchCheck( &scanners[i] );
+    }
+    if( errors ) {
+        printf( "FAILED: %d mismatches\n", errors );
+        return 1;
+    }
+
+    expected = BenchRun( &scanners[0], rounds, reference );
+    for( i = 1; i < count; i++ ) {
+        written = BenchRun( &scanners[i], rounds, out );
+        if( written != expected || memcmp( out, reference, written ) ) {
+            printf( "FAILED: %s escaped the metadata differently\n",
+                    scanners[i].name );
+            return 1;
+        }
+    }
+
+    return 0;
+}
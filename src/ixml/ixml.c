@@ -41,39 +41,25 @@ static void
 copy_with_escape( INOUT ixml_membuf * buf,
                   IN const char *p )
 {
-    int i;
-    int plen;
+    size_t plen;
+    size_t span;
 
     if( p == NULL )
         return;
 
     plen = strlen( p );
 
-    for( i = 0; i < plen; i++ ) {
-        switch ( p[i] ) {
-            case '<':
-                ixml_membuf_append_str( buf, "&lt;" );
-                break;
-
-            case '>':
-                ixml_membuf_append_str( buf, "&gt;" );
-                break;
-
-            case '&':
-                ixml_membuf_append_str( buf, "&amp;" );
-                break;
-
-            case '\'':
-                ixml_membuf_append_str( buf, "&apos;" );
-                break;
-
-            case '\"':
-                ixml_membuf_append_str( buf, "&quot;" );
-                break;
+    while( plen > 0 ) {
+        // copy the clean run in one go, then the entity for the
+        // character that stopped the scan
+        span = ixmlEscapeSpan( p, plen );
+        ixml_membuf_insert( buf, p, span, buf->length );
+        if( span == plen )
+            break;
 
-            default:
-                ixml_membuf_append( buf, &p[i] );
-        }
+        ixml_membuf_append_str( buf, ixmlEscapeEntity( p[span] ) );
+        p += span + 1;
+        plen -= span + 1;
     }
 }
 
@@ -1911,6 +1911,33 @@ ixmlFreeDOMString(DOMString buf
 		    /** The {\bf DOMString} to free. */
                  );
 
+  /** Scans {\bf src} for characters that must be replaced by an entity
+   *  reference when written as XML character data or attribute value.
+   *  The scan is vectorized on CPUs that support it.
+   *
+   *  @return [size_t] The number of leading bytes of {\bf src} that can be
+   *                   copied verbatim ({\bf len} if none needs escaping).
+   */
+
+EXPORT_SPEC size_t
+ixmlEscapeSpan(const char *src,
+		 /** The text to scan. */
+               size_t len
+		 /** The number of bytes of {\bf src} to scan. */
+              );
+
+  /** Gives the entity reference to be written in place of {\bf c}.
+   *
+   *  @return [const char*] One of {\tt \&amp;}, {\tt \&lt;}, {\tt \&gt;},
+   *                        {\tt \&quot;}, {\tt \&apos;} or {\tt NULL} if
+   *                        {\bf c} can be written as is.
+   */
+
+EXPORT_SPEC const char *
+ixmlEscapeEntity(char c
+		   /** The character to escape. */
+                );
+
 #if defined(__GNUC__)
 #    define ixml_unused __attribute__((unused))
 #else
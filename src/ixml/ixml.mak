@@ -3,6 +3,7 @@ IXML_SRCS =  \
 	ixml/node.c \
 	ixml/ixmlparser.c \
 	ixml/ixmlmembuf.c \
+	ixml/ixmlescape.c \
 	ixml/nodeList.c \
 	ixml/element.c \
 	ixml/attr.c \
@@ -17,8 +18,13 @@ IXML_EXTRADIST = \
 IXML_OBJS = $(IXML_SRCS:.c=.o)
 IXML_LOBJS = $(IXML_SRCS:.c=.lo)
 
+# check and benchmark of the escaping scanners, not part of the library
+IXML_BENCH = ixml/ixml-escape-bench
+IXML_BENCH_SRCS = ixml/IxmlEscapeBench.c
+
 all:
 
 ixml-dist-all:
 	mkdir -p $(DIST)/ixml
-	cp $(IXML_EXTRADIST) $(IXML_SRCS) ixml.mak $(DIST)/ixml
+	cp $(IXML_EXTRADIST) $(IXML_SRCS) $(IXML_BENCH_SRCS) ixml.mak \
+	  $(DIST)/ixml
@@ -0,0 +1,222 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/************************************************************************
+* Purpose: This file implements the XML escaping scanner used when
+* rendering text and attribute values. Clean runs are located a vector
+* register at a time (AVX2 or SSE2 when the CPU provides them, selected
+* at first use) so that callers can copy them in bulk.
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "ixml.h"
+
+#if defined(__GNUC__) && ( __GNUC__ >= 5 ) && \
+    ( defined(__x86_64__) || defined(__i386__) )
+    #define IXML_ESCAPE_X86 1
+    #include <immintrin.h>
+#endif
+
+/*================================================================
+*   escape_table
+*       Non-zero for every character that has to be replaced by an
+*       entity reference: & < > " '
+*
+*=================================================================*/
+static const unsigned char escape_table[256] = {
+    ['&'] = 1,['<'] = 1,['>'] = 1,['\"'] = 1,['\''] = 1
+};
+
+typedef size_t ( *escape_span_func ) ( const char *p,
+                                       size_t len );
+
+static size_t escape_span_init( const char *p,
+                                size_t len );
+
+static escape_span_func escape_span = escape_span_init;
+
+/*================================================================
+*   escape_span_c
+*       Scalar fallback, one byte at a time.
+*
+*=================================================================*/
+static size_t
+escape_span_c( IN const char *p,
+               IN size_t len )
+{
+    size_t i;
+
+    for( i = 0; i < len; i++ ) {
+        if( escape_table[( unsigned char )p[i]] )
+            break;
+    }
+
+    return i;
+}
+
+#ifdef IXML_ESCAPE_X86
+/*================================================================
+*   escape_span_sse2
+*       16 bytes per iteration. '<' (0x3C) and '>' (0x3E) only differ
+*       by bit 1, '&' (0x26) and '\'' (0x27) only by bit 0, so the
+*       five characters are matched with three compares.
+*
+*=================================================================*/
+__attribute__ ( ( target( "sse2" ) ) )
+static size_t
+escape_span_sse2( IN const char *p,
+                  IN size_t len )
+{
+    const __m128i lt_gt = _mm_set1_epi8( '>' );
+    const __m128i amp_apos = _mm_set1_epi8( '\'' );
+    const __m128i quot = _mm_set1_epi8( '\"' );
+    const __m128i bit1 = _mm_set1_epi8( 0x02 );
+    const __m128i bit0 = _mm_set1_epi8( 0x01 );
+    size_t i = 0;
+
+    for( ; i + 16 <= len; i += 16 ) {
+        __m128i v = _mm_loadu_si128( ( const __m128i * )( p + i ) );
+        __m128i m;
+        int mask;
+
+        m = _mm_cmpeq_epi8( _mm_or_si128( v, bit1 ), lt_gt );
+        m = _mm_or_si128( m, _mm_cmpeq_epi8( _mm_or_si128( v, bit0 ),
+                                             amp_apos ) );
+        m = _mm_or_si128( m, _mm_cmpeq_epi8( v, quot ) );
+
+        mask = _mm_movemask_epi8( m );
+        if( mask )
+            return i + __builtin_ctz( mask );
+    }
+
+    return i + escape_span_c( p + i, len - i );
+}
+
+/*================================================================
+*   escape_span_avx2
+*       Same as escape_span_sse2, 32 bytes per iteration.
+*
+*=================================================================*/
+__attribute__ ( ( target( "avx2" ) ) )
+static size_t
+escape_span_avx2( IN const char *p,
+                  IN size_t len )
+{
+    const __m256i lt_gt = _mm256_set1_epi8( '>' );
+    const __m256i amp_apos = _mm256_set1_epi8( '\'' );
+    const __m256i quot = _mm256_set1_epi8( '\"' );
+    const __m256i bit1 = _mm256_set1_epi8( 0x02 );
+    const __m256i bit0 = _mm256_set1_epi8( 0x01 );
+    size_t i = 0;
+
+    // most values are shorter than a vector: leave them to SSE2
+    // before the upper halves are touched
+    if( len < 32 )
+        return escape_span_sse2( p, len );
+
+    for( ; i + 32 <= len; i += 32 ) {
+        __m256i v = _mm256_loadu_si256( ( const __m256i * )( p + i ) );
+        __m256i m;
+        unsigned int mask;
+
+        m = _mm256_cmpeq_epi8( _mm256_or_si256( v, bit1 ), lt_gt );
+        m = _mm256_or_si256( m,
+                             _mm256_cmpeq_epi8( _mm256_or_si256( v, bit0 ),
+                                                amp_apos ) );
+        m = _mm256_or_si256( m, _mm256_cmpeq_epi8( v, quot ) );
+
+        mask = ( unsigned int )_mm256_movemask_epi8( m );
+        if( mask )
+            return i + __builtin_ctz( mask );
+    }
+
+    // the SSE2 scanner is not VEX encoded: leaving the upper halves
+    // dirty would stall it, and every SSE instruction after it
+    _mm256_zeroupper(  );
+    return i + escape_span_sse2( p + i, len - i );
+}
+#endif
+
+/*================================================================
+*   escape_span_init
+*       Picks the best scanner for the running CPU on first use.
+*       Concurrent first calls all store the same pointer.
+*
+*=================================================================*/
+static size_t
+escape_span_init( IN const char *p,
+                  IN size_t len )
+{
+    escape_span_func f = escape_span_c;
+
+#ifdef IXML_ESCAPE_X86
+    __builtin_cpu_init(  );
+    if( __builtin_cpu_supports( "avx2" ) )
+        f = escape_span_avx2;
+    else if( __builtin_cpu_supports( "sse2" ) )
+        f = escape_span_sse2;
+#endif
+
+    escape_span = f;
+    return f( p, len );
+}
+
+/*================================================================
+*   ixmlEscapeSpan
+*       Returns the length of the leading run of src that can be
+*       copied without escaping.
+*
+*=================================================================*/
+size_t
+ixmlEscapeSpan( IN const char *src,
+                IN size_t len )
+{
+    if( src == NULL || len == 0 )
+        return 0;
+
+    return escape_span( src, len );
+}
+
+/*================================================================
+*   ixmlEscapeEntity
+*       Returns the entity reference for c, or NULL if c does not
+*       need escaping.
+*
+*=================================================================*/
+const char *
+ixmlEscapeEntity( IN char c )
+{
+    switch ( c ) {
+        case '<':
+            return "&lt;";
+        case '>':
+            return "&gt;";
+        case '&':
+            return "&amp;";
+        case '\'':
+            return "&apos;";
+        case '\"':
+            return "&quot;";
+        default:
+            return NULL;
+    }
+}
@@ -0,0 +1,469 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Waits for files being written to grow, for the streams following
+ * them. One thread watches them all, through inotify when available.
+ * Files are also polled, with a backoff, as inotify does not see the
+ * writes of other hosts to network file systems.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif /* HAVE_INOTIFY */
+
+#include "live.h"
+#include "minmax.h"
+
+/* stat() interval of a waiting file, doubled each time up to the max */
+#define LIVE_POLL_MIN       50
+#define LIVE_POLL_MAX       1000
+
+#define LIVE_EVENTS_SIZE    4096
+
+typedef struct live_waiter_s {
+  char *path;
+  off_t size;
+  int wd;                       /* inotify watch, -1 if polled only */
+  int64_t deadline;
+  int64_t next_poll;
+  int interval;
+  int changed;                  /* inotify told of a change */
+  /* completion */
+  live_done_t done;
+  void *opaque;
+  int grown;
+  struct live_waiter_s *next;
+} live_waiter_t;
+
+struct live_watch_s {
+  pthread_mutex_t lock;
+  live_waiter_t *waiters;
+  /* waits over, being completed by the thread */
+  live_waiter_t *done;
+  void *calling;                /* opaque of the completion running */
+  pthread_cond_t called;
+  int running;
+  int stop;
+  pthread_t thread;
+  int wake[2];                  /* pipe waking the thread up */
+  int inotify;
+};
+
+/* for live_wait */
+typedef struct live_sync_s {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int grown;
+} live_sync_t;
+
+static int64_t
+live_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* -1 if the file can't be looked at, 1 if larger than size, 0 if not */
+static int
+live_grown (const char *path, off_t size)
+{
+  struct stat st;
+
+  if (stat (path, &st) < 0)
+    return -1;
+
+  return st.st_size > size;
+}
+
+static void
+live_wake (live_watch_t *watch)
+{
+  char c = 0;
+
+  while (write (watch->wake[1], &c, 1) < 0 && errno == EINTR)
+    ;
+}
+
+/* a waiter taken out of the list, with the lock held */
+static void
+live_unwatch (live_watch_t *watch, live_waiter_t *w)
+{
+#ifdef HAVE_INOTIFY
+  live_waiter_t *o;
+
+  if (w->wd < 0)
+    return;
+
+  /* the same file gives the same watch to all its waiters */
+  for (o = watch->waiters; o; o = o->next)
+    if (o->wd == w->wd)
+      return;
+  inotify_rm_watch (watch->inotify, w->wd);
+#else
+  (void) watch;
+  (void) w;
+#endif /* HAVE_INOTIFY */
+}
+
+#ifdef HAVE_INOTIFY
+static void
+live_read_events (live_watch_t *watch)
+{
+  char buf[LIVE_EVENTS_SIZE];
+  struct inotify_event *ev;
+  live_waiter_t *w;
+  ssize_t n, i;
+
+  while ((n = read (watch->inotify, buf, sizeof (buf))) > 0)
+  {
+    pthread_mutex_lock (&watch->lock);
+    for (i = 0; i < n; i += sizeof (struct inotify_event) + ev->len)
+    {
+      ev = (struct inotify_event *) (buf + i);
+      for (w = watch->waiters; w; w = w->next)
+        if (w->wd == ev->wd)
+          w->changed = 1;
+    }
+    pthread_mutex_unlock (&watch->lock);
+  }
+}
+#endif /* HAVE_INOTIFY */
+
+static void *
+live_thread (void *arg)
+{
+  live_watch_t *watch = (live_watch_t *) arg;
+  live_waiter_t *w, **p, *done;
+  struct pollfd fds[2];
+  int64_t now, next;
+  char buf[64];
+  int timeout, res;
+
+  fds[0].fd = watch->wake[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = watch->inotify;
+  fds[1].events = POLLIN;
+
+  pthread_mutex_lock (&watch->lock);
+  while (!watch->stop)
+  {
+    /* sleep until the first poll or deadline */
+    now = live_now ();
+    next = now + LIVE_POLL_MAX;
+    for (w = watch->waiters; w; w = w->next)
+      next = MIN (next, MIN (w->next_poll, w->deadline));
+    timeout = (int) MAX (next - now, 0);
+    pthread_mutex_unlock (&watch->lock);
+
+    if (poll (fds, watch->inotify >= 0 ? 2 : 1, timeout) > 0)
+    {
+      if (fds[0].revents & POLLIN)
+        while (read (watch->wake[0], buf, sizeof (buf)) > 0)
+          ;
+#ifdef HAVE_INOTIFY
+      if (watch->inotify >= 0 && (fds[1].revents & POLLIN))
+        live_read_events (watch);
+#endif /* HAVE_INOTIFY */
+    }
+
+    pthread_mutex_lock (&watch->lock);
+    now = live_now ();
+    done = watch->done;
+    for (p = &watch->waiters; (w = *p); )
+    {
+      res = 0;
+      if (w->changed || now >= w->next_poll)
+      {
+        res = live_grown (w->path, w->size);
+        w->changed = 0;
+        w->next_poll = now + w->interval;
+        w->interval = MIN (w->interval * 2, LIVE_POLL_MAX);
+      }
+
+      if (res == 0 && now < w->deadline)
+      {
+        p = &w->next;
+        continue;
+      }
+
+      /* grown, gone, or not in time */
+      w->grown = (res > 0);
+      *p = w->next;
+      live_unwatch (watch, w);
+      w->next = done;
+      done = w;
+    }
+    watch->done = done;
+
+    /* without the lock: the completion may wait again at once, and
+       live_cancel may take its waiter out meanwhile */
+    while ((w = watch->done))
+    {
+      watch->done = w->next;
+      watch->calling = w->opaque;
+      pthread_mutex_unlock (&watch->lock);
+
+      w->done (w->opaque, w->grown);
+      free (w->path);
+      free (w);
+
+      pthread_mutex_lock (&watch->lock);
+      watch->calling = NULL;
+      pthread_cond_broadcast (&watch->called);
+    }
+  }
+  pthread_mutex_unlock (&watch->lock);
+
+  return NULL;
+}
+
+live_watch_t *
+live_watch_new (void)
+{
+  live_watch_t *watch;
+
+  watch = calloc (1, sizeof (live_watch_t));
+  if (!watch)
+    return NULL;
+
+  if (pipe (watch->wake) < 0)
+  {
+    free (watch);
+    return NULL;
+  }
+  fcntl (watch->wake[0], F_SETFL, O_NONBLOCK);
+  fcntl (watch->wake[1], F_SETFL, O_NONBLOCK);
+
+  watch->inotify = -1;
+#ifdef HAVE_INOTIFY
+  /* polled only if out of inotify instances */
+  watch->inotify = inotify_init ();
+  if (watch->inotify >= 0)
+    fcntl (watch->inotify, F_SETFL, O_NONBLOCK);
+#endif /* HAVE_INOTIFY */
+
+  pthread_mutex_init (&watch->lock, NULL);
+  pthread_cond_init (&watch->called, NULL);
+
+  return watch;
+}
+
+void
+live_watch_free (live_watch_t *watch)
+{
+  live_waiter_t *w;
+
+  if (!watch)
+    return;
+
+  pthread_mutex_lock (&watch->lock);
+  watch->stop = 1;
+  pthread_mutex_unlock (&watch->lock);
+
+  if (watch->running)
+  {
+    live_wake (watch);
+    pthread_join (watch->thread, NULL);
+  }
+
+  while ((w = watch->waiters) || (w = watch->done))
+  {
+    if (w == watch->waiters)
+      watch->waiters = w->next;
+    else
+      watch->done = w->next;
+    w->done (w->opaque, 0);
+    free (w->path);
+    free (w);
+  }
+
+  if (watch->inotify >= 0)
+    close (watch->inotify);
+  close (watch->wake[0]);
+  close (watch->wake[1]);
+  pthread_cond_destroy (&watch->called);
+  pthread_mutex_destroy (&watch->lock);
+  free (watch);
+}
+
+void
+live_cancel (live_watch_t *watch, void *opaque)
+{
+  live_waiter_t *w, **p;
+
+  if (!watch)
+    return;
+
+  pthread_mutex_lock (&watch->lock);
+  for (p = &watch->waiters; (w = *p); )
+  {
+    if (w->opaque != opaque)
+    {
+      p = &w->next;
+      continue;
+    }
+    *p = w->next;
+    live_unwatch (watch, w);
+    free (w->path);
+    free (w);
+  }
+
+  /* over but not completed yet */
+  for (p = &watch->done; (w = *p); )
+  {
+    if (w->opaque != opaque)
+    {
+      p = &w->next;
+      continue;
+    }
+    *p = w->next;
+    free (w->path);
+    free (w);
+  }
+
+  /* completing: the caller is about to free what it was given */
+  while (watch->calling && watch->calling == opaque
+         && !pthread_equal (watch->thread, pthread_self ()))
+    pthread_cond_wait (&watch->called, &watch->lock);
+  pthread_mutex_unlock (&watch->lock);
+}
+
+int
+live_wait_async (live_watch_t *watch, const char *path, off_t size,
+                 int timeout, live_done_t done, void *opaque)
+{
+  live_waiter_t *w;
+  int res;
+
+  if (!watch || !path || !done)
+    return -1;
+
+  w = calloc (1, sizeof (live_waiter_t));
+  if (!w)
+    return -1;
+
+  w->path = strdup (path);
+  w->size = size;
+  w->wd = -1;
+  w->deadline = live_now () + MAX (timeout, 0);
+  w->interval = LIVE_POLL_MIN;
+  w->done = done;
+  w->opaque = opaque;
+
+  pthread_mutex_lock (&watch->lock);
+  if (!w->path || watch->stop)
+    goto error;
+
+#ifdef HAVE_INOTIFY
+  if (watch->inotify >= 0)
+  {
+    w->wd = inotify_add_watch (watch->inotify, path,
+                               IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+                               | IN_DELETE_SELF | IN_MOVE_SELF);
+    /* events make up for most polls */
+    if (w->wd >= 0)
+      w->interval = LIVE_POLL_MAX;
+  }
+#endif /* HAVE_INOTIFY */
+  w->next_poll = live_now () + w->interval;
+
+  /* written to before being watched */
+  res = live_grown (path, size);
+  if (res != 0)
+  {
+    live_unwatch (watch, w);
+    pthread_mutex_unlock (&watch->lock);
+    free (w->path);
+    free (w);
+    return res;
+  }
+
+  if (!watch->running)
+  {
+    if (pthread_create (&watch->thread, NULL, live_thread, watch))
+      goto error;
+    watch->running = 1;
+  }
+
+  w->next = watch->waiters;
+  watch->waiters = w;
+  pthread_mutex_unlock (&watch->lock);
+  live_wake (watch);
+
+  return LIVE_PENDING;
+
+ error:
+  live_unwatch (watch, w);
+  pthread_mutex_unlock (&watch->lock);
+  free (w->path);
+  free (w);
+  return -1;
+}
+
+static void
+live_sync_done (void *opaque, int grown)
+{
+  live_sync_t *sync = (live_sync_t *) opaque;
+
+  pthread_mutex_lock (&sync->lock);
+  sync->grown = grown;
+  pthread_cond_signal (&sync->cond);
+  pthread_mutex_unlock (&sync->lock);
+}
+
+int
+live_wait (live_watch_t *watch, const char *path, off_t size, int timeout)
+{
+  live_sync_t sync;
+  int res;
+
+  pthread_mutex_init (&sync.lock, NULL);
+  pthread_cond_init (&sync.cond, NULL);
+  sync.grown = -1;
+
+  res = live_wait_async (watch, path, size, timeout, live_sync_done, &sync);
+  if (res == LIVE_PENDING)
+  {
+    pthread_mutex_lock (&sync.lock);
+    while (sync.grown < 0)
+      pthread_cond_wait (&sync.cond, &sync.lock);
+    res = sync.grown;
+    pthread_mutex_unlock (&sync.lock);
+  }
+
+  pthread_cond_destroy (&sync.cond);
+  pthread_mutex_destroy (&sync.lock);
+
+  return res;
+}
@@ -0,0 +1,55 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+/* returned by live_wait_async for a wait finishing later */
+#define LIVE_PENDING 0
+
+typedef struct live_watch_s live_watch_t;
+
+/* outcome of a wait left pending, called from the watching thread:
+   1 if the file grew, 0 if not in time */
+typedef void (*live_done_t) (void *opaque, int grown);
+
+live_watch_t *live_watch_new (void);
+/* waits left pending are told the files did not grow */
+void live_watch_free (live_watch_t *watch);
+
+/* wait for the file at path to get larger than size, timeout being in
+   milliseconds: 1 if it did, 0 if not in time, -1 on error */
+int live_wait (live_watch_t *watch, const char *path, off_t size,
+               int timeout);
+
+/* same without waiting: 1 if the file is larger already, LIVE_PENDING
+   if done is to be called once it grows or in timeout, -1 on error */
+int live_wait_async (live_watch_t *watch, const char *path, off_t size,
+                     int timeout, live_done_t done, void *opaque);
+
+/* drop the waits left pending with opaque: their done is not called
+   anymore, nor still running, once this returns */
+void live_cancel (live_watch_t *watch, void *opaque);
+
+#endif /* LIVE_H */
@@ -0,0 +1,258 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * WAV files hold little-endian samples after their RIFF header, while
+ * audio/L16 is big-endian with no header at all. The samples are served
+ * from where they are in the file, byte swapped in the reader's buffer
+ * with the widest vector unit the CPU has.
+ */
+
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_SWAP16_AVX2 1
+#endif
+
+#include "pcmconv.h"
+#include "minmax.h"
+
+#define WAVE_FORMAT_PCM         0x0001
+#define WAVE_FORMAT_EXTENSIBLE  0xfffe
+
+/* chunks looked at before giving up on finding the samples */
+#define WAV_CHUNKS_MAX          32
+
+static ssize_t
+wav_read (int fd, uint8_t *buf, size_t len, off_t offset)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len)
+  {
+    n = pread (fd, buf + done, len - done, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0)
+      break;
+    done += n;
+  }
+
+  return done;
+}
+
+static inline uint32_t
+le32 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint16_t
+le16 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+int
+pcm_conv_probe_wav (int fd, off_t *offset, off_t *length)
+{
+  uint8_t buf[40];
+  struct stat st;
+  off_t pos = 12;
+  uint32_t len;
+  int fmt = 0, i;
+
+  if (!offset || !length)
+    return -1;
+
+  if (wav_read (fd, buf, 12, 0) != 12
+      || memcmp (buf, "RIFF", 4) || memcmp (buf + 8, "WAVE", 4))
+    return -1;
+
+  if (fstat (fd, &st) < 0)
+    return -1;
+
+  for (i = 0; i < WAV_CHUNKS_MAX; i++)
+  {
+    if (wav_read (fd, buf, 8, pos) != 8)
+      return -1;
+    len = le32 (buf + 4);
+
+    if (!memcmp (buf, "fmt ", 4))
+    {
+      if (len < 16 || wav_read (fd, buf, MIN (len, 40), pos + 8) < 16)
+        return -1;
+      /* 16 bits integer samples only, which L16 is */
+      if (le16 (buf) == WAVE_FORMAT_EXTENSIBLE)
+      {
+        if (len < 26 || le16 (buf + 24) != WAVE_FORMAT_PCM)
+          return -1;
+      }
+      else if (le16 (buf) != WAVE_FORMAT_PCM)
+        return -1;
+      if (le16 (buf + 14) != 16)
+        return -1;
+      fmt = 1;
+    }
+    else if (!memcmp (buf, "data", 4))
+    {
+      if (!fmt)
+        return -1;
+      *offset = pos + 8;
+      /* files still being written or past 4 GB have it wrong */
+      *length = st.st_size - *offset;
+      if (len && len != 0xffffffff && len < *length)
+        *length = len;
+      *length &= ~(off_t) 1;
+      return 0;
+    }
+
+    /* chunks are word aligned */
+    pos += 8 + len + (len & 1);
+  }
+
+  return -1;
+}
+
+static void
+swap16_c (uint8_t *p, size_t count)
+{
+  uint8_t b;
+
+  for (; count; count--, p += 2)
+  {
+    b = p[0];
+    p[0] = p[1];
+    p[1] = b;
+  }
+}
+
+#ifdef HAVE_SWAP16_AVX2
+__attribute__ ((target ("avx2")))
+static void
+swap16_avx2 (uint8_t *p, size_t count)
+{
+  const __m256i mask =
+    _mm256_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                      1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  __m256i v0, v1;
+
+  for (; count >= 32; count -= 32, p += 64)
+  {
+    v0 = _mm256_loadu_si256 ((__m256i *) p);
+    v1 = _mm256_loadu_si256 ((__m256i *) (p + 32));
+    _mm256_storeu_si256 ((__m256i *) p, _mm256_shuffle_epi8 (v0, mask));
+    _mm256_storeu_si256 ((__m256i *) (p + 32),
+                         _mm256_shuffle_epi8 (v1, mask));
+  }
+  for (; count >= 16; count -= 16, p += 32)
+  {
+    v0 = _mm256_loadu_si256 ((__m256i *) p);
+    _mm256_storeu_si256 ((__m256i *) p, _mm256_shuffle_epi8 (v0, mask));
+  }
+
+  swap16_c (p, count);
+}
+#endif /* HAVE_SWAP16_AVX2 */
+
+#ifdef __SSE2__
+static void
+swap16_sse2 (uint8_t *p, size_t count)
+{
+  __m128i v;
+
+  for (; count >= 8; count -= 8, p += 16)
+  {
+    v = _mm_loadu_si128 ((__m128i *) p);
+    v = _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_srli_epi16 (v, 8));
+    _mm_storeu_si128 ((__m128i *) p, v);
+  }
+
+  swap16_c (p, count);
+}
+#endif /* __SSE2__ */
+
+static void (*swap16) (uint8_t *p, size_t count);
+
+void
+pcm_conv_swap16 (char *buf, size_t len)
+{
+  /* picked on first use: racing threads pick the same one */
+  if (!swap16)
+  {
+#ifdef __SSE2__
+    swap16 = swap16_sse2;
+#else
+    swap16 = swap16_c;
+#endif
+#ifdef HAVE_SWAP16_AVX2
+    if (__builtin_cpu_supports ("avx2"))
+      swap16 = swap16_avx2;
+#endif
+  }
+
+  swap16 ((uint8_t *) buf, len / 2);
+}
+
+ssize_t
+pcm_conv_read (pcm_conv_read_t read, void *opaque,
+               off_t offset, off_t length,
+               char *buf, size_t len, off_t pos)
+{
+  char sample[2];
+  ssize_t n;
+
+  if (!read || !buf || pos < 0)
+    return -1;
+
+  if (pos >= length || !len)
+    return 0;
+  len = MIN ((off_t) len, length - pos);
+
+  /* samples cut by the read go through a sample of their own */
+  if ((pos & 1) || len < 2)
+  {
+    n = read (opaque, sample, 2, offset + (pos & ~(off_t) 1));
+    if (n < 2)
+      return n < 0 ? -1 : 0;
+    buf[0] = sample[!(pos & 1)];
+    return 1;
+  }
+
+  n = read (opaque, buf, len & ~(size_t) 1, offset + pos);
+  if (n <= 0)
+    return n;
+  n &= ~(ssize_t) 1;
+  pcm_conv_swap16 (buf, n);
+
+  return n;
+}
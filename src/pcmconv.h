@@ -0,0 +1,45 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PCMCONV_H
+#define PCMCONV_H
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+/* reads len bytes of the source file at offset */
+typedef ssize_t (*pcm_conv_read_t) (void *opaque,
+                                    char *buf, size_t len, off_t offset);
+
+/* where the 16 bits little-endian PCM samples of a WAV file are,
+   -1 if it is not one */
+int pcm_conv_probe_wav (int fd, off_t *offset, off_t *length);
+
+/* swap the bytes of the len / 2 samples of buf */
+void pcm_conv_swap16 (char *buf, size_t len);
+
+/* read from pos in the big-endian samples (audio/L16) of the length bytes
+   found at offset in the source, -1 on error, 0 at their end */
+ssize_t pcm_conv_read (pcm_conv_read_t read, void *opaque,
+                       off_t offset, off_t length,
+                       char *buf, size_t len, off_t pos);
+
+#endif /* PCMCONV_H */
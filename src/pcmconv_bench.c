@@ -0,0 +1,154 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Check and benchmark of the byte swapping kernels of the WAV to L16
+ * conversion. The source of the kernels is included so that each one
+ * can be called directly. They must all swap exactly what swap16_c
+ * swaps, for every sample count up to a few vectors, odd ones
+ * included, from every offset within a vector, and leave the bytes
+ * around alone. Their rate is then printed for buffers of the sizes
+ * the web server reads, aligned or not.
+ *
+ *     pcmconv-bench [MB per run]
+ */
+
+#include "pcmconv.c"
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_MB        256
+#define BENCH_MAX_COUNT 200       /* samples checked, past 6 AVX2 vectors */
+#define BENCH_GUARD     64
+
+typedef struct bench_kernel_s {
+  const char *name;
+  void (*swap) (uint8_t *p, size_t count);
+} bench_kernel_t;
+
+static double
+bench_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* compare a kernel with swap16_c, returns the number of mismatches */
+static int
+bench_check (bench_kernel_t *k)
+{
+  static uint8_t ref[BENCH_GUARD + 2 * BENCH_MAX_COUNT + BENCH_GUARD];
+  static uint8_t got[sizeof (ref)];
+  size_t count, offset, i;
+  int errors = 0;
+
+  for (offset = 0; offset < 32; offset++)
+    for (count = 0; count <= BENCH_MAX_COUNT; count++)
+    {
+      for (i = 0; i < sizeof (ref); i++)
+        ref[i] = (uint8_t) (i * 131 + count + offset);
+      memcpy (got, ref, sizeof (ref));
+
+      swap16_c (ref + BENCH_GUARD + offset, count);
+      k->swap (got + BENCH_GUARD + offset, count);
+      if (memcmp (ref, got, sizeof (ref)) && errors++ < 10)
+        printf ("%s: %zu samples at offset %zu differ from swap16_c\n",
+                k->name, count, offset);
+    }
+
+  return errors;
+}
+
+/* swap bytes of buffers of len bytes from offset, printing the rate */
+static void
+bench_run (bench_kernel_t *k, size_t len, size_t offset, size_t total)
+{
+  uint8_t *buf;
+  double start, elapsed;
+  size_t done;
+
+  buf = malloc (len + 64);
+  if (!buf)
+    return;
+  memset (buf, 0x5a, len + 64);
+
+  start = bench_now ();
+  for (done = 0; done < total; done += len)
+  {
+    k->swap (buf + offset, len / 2);
+    /* keep the compiler from dropping the runs */
+    __asm__ __volatile__ ("" : : "r" (buf) : "memory");
+  }
+  elapsed = bench_now () - start;
+
+  printf ("%-6s %7zu bytes, offset %2zu: %7.2f GB/s\n", k->name, len,
+          offset, done / elapsed / 1e9);
+  free (buf);
+}
+
+int
+main (int argc, char **argv)
+{
+  /* a few samples, an odd count, a read and the streamer's half buffer */
+  static const size_t lens[] = { 38, 4094, 65536, 131072 };
+  static const size_t offsets[] = { 0, 1 };
+  bench_kernel_t kernels[3];
+  size_t total, l, o;
+  int i, n = 0, errors = 0, mb = BENCH_MB;
+
+  if (argc > 2 || (argc == 2 && (mb = atoi (argv[1])) <= 0))
+  {
+    fprintf (stderr, "usage: %s [MB per run]\n", argv[0]);
+    return 1;
+  }
+  total = (size_t) mb << 20;
+
+  kernels[n].name = "c";
+  kernels[n++].swap = swap16_c;
+#ifdef __SSE2__
+  kernels[n].name = "sse2";
+  kernels[n++].swap = swap16_sse2;
+#endif
+#ifdef HAVE_SWAP16_AVX2
+  if (__builtin_cpu_supports ("avx2"))
+  {
+    kernels[n].name = "avx2";
+    kernels[n++].swap = swap16_avx2;
+  }
+#endif
+
+  for (i = 1; i < n; i++)
+    errors += bench_check (&kernels[i]);
+  if (errors)
+  {
+    printf ("FAILED: %d mismatches\n", errors);
+    return 1;
+  }
+
+  for (l = 0; l < sizeof (lens) / sizeof (lens[0]); l++)
+    for (o = 0; o < sizeof (offsets) / sizeof (offsets[0]); o++)
+      for (i = 0; i < n; i++)
+        bench_run (&kernels[i], lens[l], offsets[o], total);
+
+  return 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Reads ahead the resources a renderer asked the metadata of, as it
+ * usually plays them right after: the first GET then finds their head
+ * (and the moov box of MP4 files, wherever it is) in the block cache,
+ * or in the page cache without one, instead of waiting for the disk to
+ * seek or spin up. One thread reads for all, the last item asked for
+ * first, no faster than the rate set, so that browsing a large folder
+ * does not keep the disk busy.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "dlna_internals.h"
+#include "minmax.h"
+
+/* items waiting to be read, the oldest dropped first */
+#define PREFETCH_QUEUE      4
+/* seconds before an item is read ahead again */
+#define PREFETCH_COOLDOWN   60
+#define PREFETCH_CHUNK      (256 * 1024)
+
+struct prefetch_s {
+  dlna_t *dlna;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint32_t queue[PREFETCH_QUEUE];  /* oldest first */
+  int queued;
+  int stop;
+  pthread_t thread;
+  char *buf;
+  /* token bucket of the rate limit, used by the thread only */
+  double tokens;
+  struct timespec stamp;
+};
+
+/* wait for the rate limit to allow len bytes: 0, or -1 if stopping */
+static int
+prefetch_throttle (prefetch_t *prefetch, size_t len)
+{
+  size_t rate = prefetch->dlna->prefetch_rate;
+  struct timespec now, until;
+  double wait;
+  int res = 0;
+
+  if (!rate)
+    return 0;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+  prefetch->tokens += (double) rate
+    * ((now.tv_sec - prefetch->stamp.tv_sec)
+       + (now.tv_nsec - prefetch->stamp.tv_nsec) / 1e9);
+  /* a second worth at most, so that idle time does not add up */
+  if (prefetch->tokens > (double) MAX (rate, len))
+    prefetch->tokens = (double) MAX (rate, len);
+  prefetch->stamp = now;
+
+  if (prefetch->tokens < (double) len)
+  {
+    wait = ((double) len - prefetch->tokens) / rate;
+    until.tv_sec = now.tv_sec + (time_t) wait;
+    until.tv_nsec = now.tv_nsec + (long) ((wait - (time_t) wait) * 1e9);
+    if (until.tv_nsec >= 1000000000)
+    {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock (&prefetch->lock);
+    while (!prefetch->stop
+           && pthread_cond_timedwait (&prefetch->cond, &prefetch->lock,
+                                      &until) != ETIMEDOUT)
+      ;
+    res = prefetch->stop ? -1 : 0;
+    pthread_mutex_unlock (&prefetch->lock);
+
+    prefetch->tokens = (double) len;
+    clock_gettime (CLOCK_REALTIME, &prefetch->stamp);
+  }
+
+  prefetch->tokens -= len;
+  return res;
+}
+
+/* read a range of the resource where its GETs will look for it */
+static int
+prefetch_range (prefetch_t *prefetch, vfs_item_t *item, int fd,
+                off_t offset, off_t len)
+{
+  dlna_t *dlna = prefetch->dlna;
+  ssize_t n;
+
+  while (len > 0)
+  {
+    n = MIN (len, PREFETCH_CHUNK);
+    if (prefetch_throttle (prefetch, n) < 0)
+      return -1;
+
+    if (dlna->cache)
+      n = block_cache_read (dlna->cache, item->id, fd,
+                            prefetch->buf, n, offset);
+    else
+      n = pread (fd, prefetch->buf, n, offset);
+    if (n <= 0)
+      return n < 0 && errno != EINTR ? -1 : 0;
+
+    offset += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+static void
+prefetch_item (prefetch_t *prefetch, uint32_t id)
+{
+  dlna_t *dlna = prefetch->dlna;
+  vfs_item_t *item;
+  vfs_attr_t attr;
+  off_t head = dlna->prefetch_head;
+  off_t moov, moov_len, start, end;
+  int fd;
+
+  item = vfs_resource_get (dlna, id);
+  if (!item)
+    return;
+
+  /* a file being written is not cached, its last block growing */
+  fd = -1;
+  if (vfs_resource_get_attr (dlna, item, &attr) == 0
+      && !vfs_resource_is_live (dlna, item, &attr))
+    fd = vfs_resource_open (dlna, item);
+  vfs_resource_close (dlna, item, -1);
+  if (fd < 0)
+    return;
+
+  /* renderers read the moov box first, even at the end of the file */
+  if (prefetch_range (prefetch, item, fd, 0, MIN (head, attr.size)) == 0
+      && item->u.resource.seek_format == SEEK_FORMAT_MP4
+      && seek_mp4_moov (fd, attr.size, &moov, &moov_len) == 0)
+  {
+    start = MAX (moov, head);
+    end = moov + MIN (moov_len, head);
+    if (end > start)
+      prefetch_range (prefetch, item, fd, start, end - start);
+  }
+
+  vfs_resource_close (dlna, item, fd);
+}
+
+static void *
+prefetch_thread (void *arg)
+{
+  prefetch_t *prefetch = (prefetch_t *) arg;
+  uint32_t id;
+
+  pthread_mutex_lock (&prefetch->lock);
+  for (;;)
+  {
+    while (!prefetch->stop && !prefetch->queued)
+      pthread_cond_wait (&prefetch->cond, &prefetch->lock);
+    if (prefetch->stop)
+      break;
+
+    /* the last item asked for is the one likely to be played */
+    id = prefetch->queue[--prefetch->queued];
+    pthread_mutex_unlock (&prefetch->lock);
+
+    prefetch_item (prefetch, id);
+
+    pthread_mutex_lock (&prefetch->lock);
+  }
+  pthread_mutex_unlock (&prefetch->lock);
+
+  return NULL;
+}
+
+prefetch_t *
+prefetch_new (dlna_t *dlna)
+{
+  prefetch_t *prefetch;
+
+  prefetch = calloc (1, sizeof (prefetch_t));
+  if (!prefetch)
+    return NULL;
+
+  prefetch->dlna = dlna;
+  prefetch->buf = malloc (PREFETCH_CHUNK);
+  if (!prefetch->buf)
+  {
+    free (prefetch);
+    return NULL;
+  }
+  pthread_mutex_init (&prefetch->lock, NULL);
+  pthread_cond_init (&prefetch->cond, NULL);
+  clock_gettime (CLOCK_REALTIME, &prefetch->stamp);
+
+  if (pthread_create (&prefetch->thread, NULL, prefetch_thread, prefetch))
+  {
+    pthread_cond_destroy (&prefetch->cond);
+    pthread_mutex_destroy (&prefetch->lock);
+    free (prefetch->buf);
+    free (prefetch);
+    return NULL;
+  }
+
+  return prefetch;
+}
+
+void
+prefetch_free (prefetch_t *prefetch)
+{
+  if (!prefetch)
+    return;
+
+  pthread_mutex_lock (&prefetch->lock);
+  prefetch->stop = 1;
+  pthread_cond_broadcast (&prefetch->cond);
+  pthread_mutex_unlock (&prefetch->lock);
+  pthread_join (prefetch->thread, NULL);
+
+  pthread_cond_destroy (&prefetch->cond);
+  pthread_mutex_destroy (&prefetch->lock);
+  free (prefetch->buf);
+  free (prefetch);
+}
+
+void
+prefetch_resource (dlna_t *dlna, uint32_t id)
+{
+  prefetch_t *prefetch;
+  vfs_item_t *item;
+  time_t now;
+  int i;
+
+  if (!dlna || !dlna->prefetch || !dlna->prefetch_head)
+    return;
+  prefetch = dlna->prefetch;
+
+  /* only what is played from its start is worth it */
+  item = vfs_resource_get (dlna, id);
+  if (!item)
+    return;
+  if (item->u.resource.item->media_class != DLNA_CLASS_AV
+      && item->u.resource.item->media_class != DLNA_CLASS_AUDIO)
+  {
+    vfs_resource_close (dlna, item, -1);
+    return;
+  }
+
+  now = time (NULL);
+  pthread_mutex_lock (&prefetch->lock);
+  if (item->u.resource.prefetched
+      && now - item->u.resource.prefetched < PREFETCH_COOLDOWN)
+  {
+    pthread_mutex_unlock (&prefetch->lock);
+    vfs_resource_close (dlna, item, -1);
+    return;
+  }
+  item->u.resource.prefetched = now;
+
+  if (prefetch->queued == PREFETCH_QUEUE)
+  {
+    /* browsing on: the oldest item is the least likely to be played */
+    prefetch->queued--;
+    for (i = 0; i < prefetch->queued; i++)
+      prefetch->queue[i] = prefetch->queue[i + 1];
+  }
+  prefetch->queue[prefetch->queued++] = id;
+  pthread_cond_signal (&prefetch->cond);
+  pthread_mutex_unlock (&prefetch->lock);
+
+  vfs_resource_close (dlna, item, -1);
+}
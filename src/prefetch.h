@@ -0,0 +1,38 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+typedef struct prefetch_s prefetch_t;
+
+prefetch_t *prefetch_new (dlna_t *dlna);
+/* reads in progress are finished first */
+void prefetch_free (prefetch_t *prefetch);
+
+/* have the head of a resource about to be played read ahead, in the
+   background, unless it was lately */
+void prefetch_resource (dlna_t *dlna, uint32_t id);
+
+#endif /* PREFETCH_H */
@@ -520,6 +520,35 @@ dlna_guess_media_profile (dlna_t *dlna, const char *filename)
   return profile;
 }
 
+dlna_profile_t *
+dlna_profile_ts_variant (dlna_t *dlna, dlna_profile_t *profile, int packet)
+{
+  dlna_registered_profile_t *p;
+  dlna_profile_t *variant;
+  dlna_container_type_t st;
+
+  if (!dlna || !profile)
+    return NULL;
+
+  st = (packet == 188) ? CT_MPEG_TRANSPORT_STREAM
+    : CT_MPEG_TRANSPORT_STREAM_DLNA;
+
+  for (p = dlna->first_profile; p; p = p->next)
+  {
+    if (!p->variant)
+      continue;
+
+    variant = p->variant (profile, st);
+    if (variant)
+    {
+      variant->media_class = p->class;
+      return variant;
+    }
+  }
+
+  return NULL;
+}
+
 static dlna_profile_t *
 upnp_guess_media_profile (dlna_t *dlna,
                           const char *filename, AVFormatContext *ctx)
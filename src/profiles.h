@@ -79,6 +79,9 @@ typedef struct dlna_registered_profile_s {
   dlna_profile_t * (*probe) (AVFormatContext *ctx,
                              dlna_container_type_t st,
                              av_codecs_t *codecs);
+  /* profile of the same media in another container type, if any */
+  dlna_profile_t * (*variant) (dlna_profile_t *profile,
+                               dlna_container_type_t st);
   struct dlna_registered_profile_s *next;
 } dlna_registered_profile_t;
 
@@ -0,0 +1,792 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Time to byte offset tables used to answer TimeSeekRange.dlna.org
+ * requests. MPEG streams are sampled at regular byte intervals for
+ * their clock references and interpolated in between, which keeps the
+ * cost of indexing a long recording bounded. MP4 files are indexed on
+ * the sync samples of their moov box, MP3 files on their frame headers.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "dlna_internals.h"
+#include "seek.h"
+#include "minmax.h"
+
+/* minimal time between two entries, in ms */
+#define SEEK_INDEX_INTERVAL     500
+
+/* MPEG streams: number and size of the samples taken in the file */
+#define SEEK_INDEX_PROBES       1024
+#define SEEK_INDEX_STRIDE_MIN   (1024 * 1024)
+#define SEEK_INDEX_PROBE_SIZE   (64 * 1024)
+#define SEEK_INDEX_PROBE_MAX    (512 * 1024)
+
+/* largest moov box read from MP4 files */
+#define SEEK_INDEX_MOOV_MAX     (64 * 1024 * 1024)
+
+#define SEEK_INDEX_BUF_SIZE     (64 * 1024)
+
+#define MPEG_CLOCK_MASK         ((1LL << 33) - 1)
+
+typedef struct seek_entry_s {
+  off_t offset;
+  uint32_t time;                /* ms from the start */
+} seek_entry_t;
+
+struct seek_index_s {
+  seek_entry_t *entries;
+  int count;
+  int allocated;
+  uint32_t duration;
+  off_t size;
+  int unit;                     /* offsets can be interpolated between
+                                   entries in steps of unit bytes, or
+                                   only entries can be used if 0 */
+};
+
+static ssize_t
+seek_read (int fd, uint8_t *buf, size_t len, off_t offset)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len)
+  {
+    n = pread (fd, buf + done, len - done, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0)
+      break;
+    done += n;
+  }
+
+  return done;
+}
+
+static inline uint32_t
+be32 (const uint8_t *p)
+{
+  return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline uint64_t
+be64 (const uint8_t *p)
+{
+  return ((uint64_t) be32 (p) << 32) | be32 (p + 4);
+}
+
+/* keep times increasing: discontinuities are left out */
+static int
+seek_index_add (seek_index_t *index, uint32_t time, off_t offset)
+{
+  seek_entry_t *entries;
+
+  if (index->count
+      && (time <= index->entries[index->count - 1].time
+          || offset <= index->entries[index->count - 1].offset))
+    return 0;
+
+  if (index->count == index->allocated)
+  {
+    entries = realloc (index->entries,
+                       2 * MAX (index->allocated, 64) * sizeof (seek_entry_t));
+    if (!entries)
+      return -1;
+    index->entries = entries;
+    index->allocated = 2 * MAX (index->allocated, 64);
+  }
+
+  index->entries[index->count].time = time;
+  index->entries[index->count].offset = offset;
+  index->count++;
+
+  return 0;
+}
+
+/***************************************************************************/
+/* MPEG Transport and Program Streams                                      */
+/***************************************************************************/
+
+static int
+ts_packet_size (const uint8_t *buf, size_t len)
+{
+  if (len >= 3 * 188 && buf[0] == 0x47 && buf[188] == 0x47
+      && buf[2 * 188] == 0x47)
+    return 188;
+  if (len >= 3 * 192 && buf[4] == 0x47 && buf[196] == 0x47
+      && buf[4 + 2 * 192] == 0x47)
+    return 192;
+  return 0;
+}
+
+/* first PCR of pid (any PID if negative) in the buffer, which starts
+   anywhere in the stream */
+static int
+ts_find_pcr (const uint8_t *buf, size_t len, int psize, int *pid,
+             int64_t *pcr, size_t *pos)
+{
+  size_t start, i;
+  const uint8_t *p;
+  int hdr = psize - 188;
+
+  for (start = 0; start + 3 * psize <= len; start++)
+    if (buf[start + hdr] == 0x47 && buf[start + hdr + psize] == 0x47
+        && buf[start + hdr + 2 * psize] == 0x47)
+      break;
+
+  for (i = start; i + psize <= len; i += psize)
+  {
+    p = buf + i + hdr;
+    if (p[0] != 0x47)
+      return -1;                /* lost sync */
+    if (*pid >= 0 && (((p[1] & 0x1f) << 8) | p[2]) != *pid)
+      continue;
+    /* adaptation field with a PCR */
+    if (!(p[3] & 0x20) || p[4] < 7 || !(p[5] & 0x10))
+      continue;
+
+    *pid = ((p[1] & 0x1f) << 8) | p[2];
+    *pcr = ((int64_t) p[6] << 25) | (p[7] << 17) | (p[8] << 9)
+      | (p[9] << 1) | (p[10] >> 7);
+    *pos = i;
+    return 0;
+  }
+
+  return -1;
+}
+
+/* first SCR of a pack header in the buffer */
+static int
+ps_find_scr (const uint8_t *buf, size_t len, int psize dlna_unused,
+             int *pid dlna_unused, int64_t *scr, size_t *pos)
+{
+  const uint8_t *p;
+  size_t i;
+
+  for (i = 0; i + 10 <= len; i++)
+  {
+    p = buf + i;
+    if (p[0] || p[1] || p[2] != 0x01 || p[3] != 0xba)
+      continue;
+
+    if ((p[4] & 0xc0) == 0x40)  /* MPEG-2 */
+      *scr = ((int64_t) (p[4] & 0x38) << 27) | ((int64_t) (p[4] & 0x03) << 28)
+        | (p[5] << 20) | ((p[6] & 0xf8) << 12) | ((p[6] & 0x03) << 13)
+        | (p[7] << 5) | (p[8] >> 3);
+    else if ((p[4] & 0xf0) == 0x20) /* MPEG-1 */
+      *scr = ((int64_t) (p[4] & 0x0e) << 29) | (p[5] << 22)
+        | ((p[6] >> 1) << 15) | (p[7] << 7) | (p[8] >> 1);
+    else
+      continue;
+
+    *pos = i;
+    return 0;
+  }
+
+  return -1;
+}
+
+typedef int (*mpeg_find_clock_t) (const uint8_t *buf, size_t len, int psize,
+                                  int *pid, int64_t *clock, size_t *pos);
+
+/* the 90 kHz clock found at or after offset, with where its packet is */
+static int
+mpeg_probe (int fd, uint8_t *buf, off_t offset, off_t size,
+            mpeg_find_clock_t find, int psize, int *pid,
+            int64_t *clock, off_t *pos)
+{
+  size_t len = 0, found;
+  ssize_t n;
+
+  while (len < SEEK_INDEX_PROBE_MAX && offset + (off_t) len < size)
+  {
+    n = seek_read (fd, buf + len, SEEK_INDEX_PROBE_SIZE, offset + len);
+    if (n <= 0)
+      return -1;
+    len += n;
+    if (!find (buf, len, psize, pid, clock, &found))
+    {
+      *pos = offset + found;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+static int
+mpeg_build (seek_index_t *index, int fd, seek_format_t format, off_t size)
+{
+  mpeg_find_clock_t find;
+  uint8_t *buf;
+  off_t stride, offset, pos;
+  int64_t first, clock;
+  int pid = -1;
+  int psize = 0;
+  ssize_t n;
+
+  buf = malloc (SEEK_INDEX_PROBE_MAX);
+  if (!buf)
+    return -1;
+
+  if (format == SEEK_FORMAT_MPEG_TS)
+  {
+    n = seek_read (fd, buf, 3 * 192, 0);
+    psize = ts_packet_size (buf, n > 0 ? n : 0);
+    find = ts_find_pcr;
+    index->unit = psize;
+  }
+  else
+  {
+    find = ps_find_scr;
+    /* decoders find the next pack header on their own */
+    index->unit = 1;
+  }
+
+  if ((format == SEEK_FORMAT_MPEG_TS && !psize)
+      || mpeg_probe (fd, buf, 0, size, find, psize, &pid, &first, &pos) < 0)
+  {
+    free (buf);
+    return -1;
+  }
+
+  /* streams start playing from their beginning, whatever the clock */
+  seek_index_add (index, 0, 0);
+
+  stride = MAX (size / SEEK_INDEX_PROBES, SEEK_INDEX_STRIDE_MIN);
+  for (offset = stride; offset < size; offset += stride)
+  {
+    /* the last sample gives the duration */
+    if (offset + stride >= size)
+      offset = MAX (offset, size - SEEK_INDEX_PROBE_SIZE);
+    if (mpeg_probe (fd, buf, offset, size, find, psize, &pid,
+                    &clock, &pos) < 0)
+      continue;
+    if (psize)
+      pos -= pos % psize;
+    seek_index_add (index, (((clock - first) & MPEG_CLOCK_MASK) / 90), pos);
+  }
+
+  free (buf);
+  return 0;
+}
+
+/***************************************************************************/
+/* MP4                                                                     */
+/***************************************************************************/
+
+typedef struct mp4_box_s {
+  const uint8_t *data;          /* payload */
+  uint64_t size;
+} mp4_box_t;
+
+/* child box of the given type within a payload */
+static int
+mp4_find_box (const uint8_t *data, uint64_t size, const char *type,
+              mp4_box_t *box)
+{
+  uint64_t pos = 0, len, hdr;
+
+  while (pos + 8 <= size)
+  {
+    len = be32 (data + pos);
+    hdr = 8;
+    if (len == 1)
+    {
+      if (pos + 16 > size)
+        return -1;
+      len = be64 (data + pos + 8);
+      hdr = 16;
+    }
+    else if (len == 0)
+      len = size - pos;
+    if (len < hdr || len > size - pos)
+      return -1;
+
+    if (!memcmp (data + pos + 4, type, 4))
+    {
+      box->data = data + pos + hdr;
+      box->size = len - hdr;
+      return 0;
+    }
+    pos += len;
+  }
+
+  return -1;
+}
+
+static int
+mp4_find_path (const uint8_t *data, uint64_t size, const char *path,
+               mp4_box_t *box)
+{
+  mp4_box_t parent = { data, size };
+
+  for (; *path; path += 4)
+  {
+    if (mp4_find_box (parent.data, parent.size, path, box) < 0)
+      return -1;
+    parent = *box;
+  }
+
+  return 0;
+}
+
+/* full box payload holding a table of entries of the given size */
+static int
+mp4_table (const mp4_box_t *box, uint32_t entry, uint32_t skip,
+           const uint8_t **table, uint32_t *count)
+{
+  if (!entry || box->size < 8 + skip)
+    return -1;
+  *count = be32 (box->data + 4 + skip);
+  *table = box->data + 8 + skip;
+  if (*count > (box->size - 8 - skip) / entry)
+    return -1;
+  return 0;
+}
+
+/* the video track, or the first audio one */
+static int
+mp4_find_track (const uint8_t *moov, uint64_t size, mp4_box_t *mdia)
+{
+  mp4_box_t trak, box, hdlr;
+  uint64_t pos = 0;
+  int found = -1;
+
+  while (pos < size && mp4_find_box (moov + pos, size - pos, "trak", &trak) == 0)
+  {
+    pos = trak.data + trak.size - moov;
+    if (mp4_find_box (trak.data, trak.size, "mdia", &box) < 0
+        || mp4_find_box (box.data, box.size, "hdlr", &hdlr) < 0
+        || hdlr.size < 12)
+      continue;
+    if (!memcmp (hdlr.data + 8, "vide", 4))
+    {
+      *mdia = box;
+      return 0;
+    }
+    if (found < 0 && !memcmp (hdlr.data + 8, "soun", 4))
+    {
+      *mdia = box;
+      found = 0;
+    }
+  }
+
+  return found;
+}
+
+static int
+mp4_index_track (seek_index_t *index, const mp4_box_t *mdia)
+{
+  mp4_box_t mdhd, stbl, box;
+  const uint8_t *stts, *stss = NULL, *stsc, *stsz, *stco;
+  uint32_t stts_n, stss_n = 0, stsc_n, stsz_n, stco_n;
+  uint32_t timescale, uniform, co64;
+  uint32_t chunk, in_chunk, per_chunk, stsc_i, stts_i, stts_left, stss_i;
+  uint32_t sample, time, i;
+  uint64_t dts = 0, total = 0;
+  off_t offset;
+
+  if (mp4_find_box (mdia->data, mdia->size, "mdhd", &mdhd) < 0
+      || mdhd.size < 24)
+    return -1;
+  timescale = be32 (mdhd.data + (mdhd.data[0] == 1 ? 20 : 12));
+  if (!timescale)
+    return -1;
+
+  if (mp4_find_path (mdia->data, mdia->size, "minfstbl", &stbl) < 0)
+    return -1;
+
+  if (mp4_find_box (stbl.data, stbl.size, "stts", &box) < 0
+      || mp4_table (&box, 8, 0, &stts, &stts_n) < 0)
+    return -1;
+  /* every sample is a sync sample without stss */
+  if (mp4_find_box (stbl.data, stbl.size, "stss", &box) == 0
+      && mp4_table (&box, 4, 0, &stss, &stss_n) < 0)
+    return -1;
+  if (mp4_find_box (stbl.data, stbl.size, "stsc", &box) < 0
+      || mp4_table (&box, 12, 0, &stsc, &stsc_n) < 0 || !stsc_n)
+    return -1;
+  if (mp4_find_box (stbl.data, stbl.size, "stsz", &box) < 0 || box.size < 12)
+    return -1;
+  /* a constant sample size leaves the table out: only its count is there */
+  uniform = be32 (box.data + 4);
+  if (uniform)
+  {
+    stsz = NULL;
+    stsz_n = be32 (box.data + 8);
+  }
+  else if (mp4_table (&box, 4, 4, &stsz, &stsz_n) < 0)
+    return -1;
+  co64 = mp4_find_box (stbl.data, stbl.size, "stco", &box) < 0;
+  if ((co64 && mp4_find_box (stbl.data, stbl.size, "co64", &box) < 0)
+      || mp4_table (&box, co64 ? 8 : 4, 0, &stco, &stco_n) < 0)
+    return -1;
+
+  /* a constant size count is not bounded by a table: no more samples
+     than stts gives a duration to */
+  for (i = 0; i < stts_n; i++)
+    total += be32 (stts + 8 * i);
+  if (stsz_n > total)
+    stsz_n = (uint32_t) total;
+
+  stsc_i = 0;
+  stts_i = 0;
+  stts_left = stts_n ? be32 (stts) : 0;
+  stss_i = 0;
+  sample = 0;
+
+  for (chunk = 0; chunk < stco_n && sample < stsz_n; chunk++)
+  {
+    /* samples per chunk apply from their first chunk (1-based) on */
+    while (stsc_i + 1 < stsc_n && be32 (stsc + 12 * (stsc_i + 1)) <= chunk + 1)
+      stsc_i++;
+    per_chunk = MIN (be32 (stsc + 12 * stsc_i + 4), stsz_n - sample);
+    offset = co64 ? (off_t) be64 (stco + 8 * chunk) : be32 (stco + 4 * chunk);
+
+    for (in_chunk = 0; in_chunk < per_chunk && sample < stsz_n; in_chunk++)
+    {
+      while (!stts_left && ++stts_i < stts_n)
+        stts_left = be32 (stts + 8 * stts_i);
+
+      if (!stss || (stss_i < stss_n && be32 (stss + 4 * stss_i) == sample + 1))
+      {
+        time = dts * 1000 / timescale;
+        if (!index->count
+            || time >= index->entries[index->count - 1].time
+            + SEEK_INDEX_INTERVAL)
+          seek_index_add (index, time, offset);
+        if (stss)
+          stss_i++;
+      }
+
+      if (stts_i < stts_n)
+      {
+        dts += be32 (stts + 8 * stts_i + 4);
+        stts_left--;
+      }
+      offset += uniform ? uniform : be32 (stsz + 4 * sample);
+      sample++;
+    }
+  }
+
+  index->duration = dts * 1000 / timescale;
+  return index->count ? 0 : -1;
+}
+
+int
+seek_mp4_moov (int fd, off_t size, off_t *offset, off_t *length)
+{
+  uint8_t hdr[16];
+  uint64_t len, hdr_len;
+  off_t pos = 0;
+
+  /* top-level boxes up to moov, wherever it is */
+  for (;;)
+  {
+    if (pos + 8 > size || seek_read (fd, hdr, 16, pos) < 8)
+      return -1;
+    len = be32 (hdr);
+    hdr_len = 8;
+    if (len == 1)
+    {
+      len = be64 (hdr + 8);
+      hdr_len = 16;
+    }
+    else if (len == 0)
+      len = size - pos;
+    if (len < hdr_len)
+      return -1;
+    if (!memcmp (hdr + 4, "moov", 4))
+      break;
+    pos += len;
+  }
+
+  *offset = pos + hdr_len;
+  *length = len - hdr_len;
+  return 0;
+}
+
+static int
+mp4_build (seek_index_t *index, int fd, off_t size)
+{
+  uint8_t *moov;
+  mp4_box_t mdia;
+  off_t pos, len;
+  int res;
+
+  if (seek_mp4_moov (fd, size, &pos, &len) < 0
+      || len > SEEK_INDEX_MOOV_MAX)
+    return -1;
+  moov = malloc (len);
+  if (!moov)
+    return -1;
+  if (seek_read (fd, moov, len, pos) != (ssize_t) len)
+  {
+    free (moov);
+    return -1;
+  }
+
+  res = mp4_find_track (moov, len, &mdia);
+  if (!res)
+    res = mp4_index_track (index, &mdia);
+  free (moov);
+
+  /* only sync samples can be started from */
+  index->unit = 0;
+  return res;
+}
+
+/***************************************************************************/
+/* MP3                                                                     */
+/***************************************************************************/
+
+static const uint16_t mp3_bitrates[2][3][15] = {
+  { /* MPEG-1 */
+    { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+  },
+  { /* MPEG-2 and 2.5 */
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+  },
+};
+
+static const uint16_t mp3_sample_rates[3] = { 44100, 48000, 32000 };
+
+/* length and samples of the frame starting with the header, 0 if it
+   is no (supported) frame header */
+static int
+mp3_frame (const uint8_t *p, int *samples, int *rate)
+{
+  int version, layer, bitrate, lsf;
+
+  if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0)
+    return 0;
+  version = (p[1] >> 3) & 3;    /* 3: MPEG-1, 2: MPEG-2, 0: MPEG-2.5 */
+  layer = 3 - ((p[1] >> 1) & 3); /* 0: layer I ... 2: layer III */
+  if (version == 1 || layer == 3 || (p[2] >> 4) == 0 || (p[2] >> 4) == 15
+      || ((p[2] >> 2) & 3) == 3)
+    return 0;
+
+  lsf = version != 3;
+  bitrate = mp3_bitrates[lsf][layer][p[2] >> 4] * 1000;
+  *rate = mp3_sample_rates[(p[2] >> 2) & 3] >> (version == 3 ? 0 :
+                                                version == 2 ? 1 : 2);
+
+  if (layer == 0)
+  {
+    *samples = 384;
+    return (12 * bitrate / *rate + ((p[2] >> 1) & 1)) * 4;
+  }
+  *samples = (layer == 2 && lsf) ? 576 : 1152;
+  return *samples / 8 * bitrate / *rate + ((p[2] >> 1) & 1);
+}
+
+static int
+mp3_build (seek_index_t *index, int fd, off_t size)
+{
+  uint8_t *buf;
+  off_t pos = 0, buf_pos = 0;
+  ssize_t buf_len = 0;
+  double time = 0;
+  int len, samples, rate;
+
+  buf = malloc (SEEK_INDEX_BUF_SIZE);
+  if (!buf)
+    return -1;
+
+  while (pos + 10 <= size)
+  {
+    if (pos < buf_pos || pos + 10 > buf_pos + buf_len)
+    {
+      buf_pos = pos;
+      buf_len = seek_read (fd, buf, SEEK_INDEX_BUF_SIZE, pos);
+      if (buf_len < 10)
+        break;
+    }
+
+    /* ID3v2 tag, its size is syncsafe */
+    if (!memcmp (buf + (pos - buf_pos), "ID3", 3))
+    {
+      const uint8_t *p = buf + (pos - buf_pos);
+      pos += 10 + ((p[6] & 0x7f) << 21) + ((p[7] & 0x7f) << 14)
+        + ((p[8] & 0x7f) << 7) + (p[9] & 0x7f) + ((p[5] & 0x10) ? 10 : 0);
+      continue;
+    }
+
+    len = mp3_frame (buf + (pos - buf_pos), &samples, &rate);
+    if (!len)
+    {
+      pos++;                    /* resync */
+      continue;
+    }
+
+    if (!index->count || (uint32_t) time >=
+        index->entries[index->count - 1].time + SEEK_INDEX_INTERVAL)
+      seek_index_add (index, (uint32_t) time, pos);
+
+    time += samples * 1000.0 / rate;
+    pos += len;
+  }
+
+  free (buf);
+
+  index->duration = (uint32_t) time;
+  index->unit = 0;
+  return index->count ? 0 : -1;
+}
+
+/***************************************************************************/
+
+seek_format_t
+seek_index_probe (int fd)
+{
+  uint8_t buf[3 * 192];
+  ssize_t len;
+  int samples, rate;
+
+  len = seek_read (fd, buf, sizeof (buf), 0);
+  if (len < 12)
+    return SEEK_FORMAT_NONE;
+
+  if (ts_packet_size (buf, len))
+    return SEEK_FORMAT_MPEG_TS;
+  if (!buf[0] && !buf[1] && buf[2] == 0x01 && buf[3] == 0xba)
+    return SEEK_FORMAT_MPEG_PS;
+  if (!memcmp (buf + 4, "ftyp", 4))
+    return SEEK_FORMAT_MP4;
+  if (!memcmp (buf, "ID3", 3) || mp3_frame (buf, &samples, &rate))
+    return SEEK_FORMAT_MP3;
+
+  return SEEK_FORMAT_NONE;
+}
+
+seek_index_t *
+seek_index_build (int fd, seek_format_t format, off_t size)
+{
+  seek_index_t *index;
+  int res = -1;
+
+  index = calloc (1, sizeof (seek_index_t));
+  if (!index)
+    return NULL;
+  index->size = size;
+
+  switch (format)
+  {
+  case SEEK_FORMAT_MPEG_TS:
+  case SEEK_FORMAT_MPEG_PS:
+    res = mpeg_build (index, fd, format, size);
+    if (!res && index->count)
+      index->duration = index->entries[index->count - 1].time;
+    break;
+  case SEEK_FORMAT_MP4:
+    res = mp4_build (index, fd, size);
+    break;
+  case SEEK_FORMAT_MP3:
+    res = mp3_build (index, fd, size);
+    break;
+  default:
+    break;
+  }
+
+  if (res < 0 || index->count < 2)
+  {
+    seek_index_free (index);
+    return NULL;
+  }
+
+  /* playing from the start sends whatever precedes the first frame too */
+  if (!index->entries[0].time)
+    index->entries[0].offset = 0;
+
+  return index;
+}
+
+void
+seek_index_free (seek_index_t *index)
+{
+  if (!index)
+    return;
+
+  free (index->entries);
+  free (index);
+}
+
+uint32_t
+seek_index_duration (seek_index_t *index)
+{
+  return index ? index->duration : 0;
+}
+
+off_t
+seek_index_lookup (seek_index_t *index, uint32_t time, int end)
+{
+  seek_entry_t *e;
+  int lo, hi, mid;
+  off_t offset;
+
+  if (!index || !index->count)
+    return -1;
+
+  /* last entry at or before time */
+  lo = 0;
+  hi = index->count - 1;
+  while (lo < hi)
+  {
+    mid = (lo + hi + 1) / 2;
+    if (index->entries[mid].time <= time)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  e = &index->entries[lo];
+
+  if (lo + 1 == index->count)
+    return (end || time > index->duration) ? index->size : e->offset;
+
+  if (!index->unit)
+  {
+    /* playing up to time needs the data until the next entry */
+    if (end && e->time < time)
+      e++;
+    return e->offset;
+  }
+
+  offset = e->offset + (e[1].offset - e->offset)
+    * (int64_t) (time - e->time) / (e[1].time - e->time);
+  offset -= (offset - e->offset) % index->unit;
+  if (end && offset < e[1].offset)
+    offset = MIN (offset + index->unit, e[1].offset);
+
+  return offset;
+}
@@ -0,0 +1,54 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef SEEK_H
+#define SEEK_H
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+typedef enum {
+  SEEK_FORMAT_NONE,
+  SEEK_FORMAT_MPEG_TS,          /* 188 or 192 bytes packets, timed by PCR */
+  SEEK_FORMAT_MPEG_PS,          /* packs, timed by SCR */
+  SEEK_FORMAT_MP4,              /* sync samples of the moov box */
+  SEEK_FORMAT_MP3               /* frame headers */
+} seek_format_t;
+
+typedef struct seek_index_s seek_index_t;
+
+/* tell which format the file can be indexed as, from its first bytes */
+seek_format_t seek_index_probe (int fd);
+
+seek_index_t *seek_index_build (int fd, seek_format_t format, off_t size);
+
+/* where the moov box of an MP4 file is, without its header */
+int seek_mp4_moov (int fd, off_t size, off_t *offset, off_t *length);
+void seek_index_free (seek_index_t *index);
+
+/* play time covered by the index, in ms */
+uint32_t seek_index_duration (seek_index_t *index);
+
+/* byte offset to start playing from at time (ms), or, with end set,
+   the offset where playing up to time ends */
+off_t seek_index_lookup (seek_index_t *index, uint32_t time, int end);
+
+#endif /* SEEK_H */
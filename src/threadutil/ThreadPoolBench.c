@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2000-2003 Intel Corporation
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+// * Neither name of Intel Corporation nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// Dispatch microbenchmark of the thread pool: producer threads add
+// empty jobs as fast as the pool takes them, and the rate at which the
+// workers run them is reported, for a range of workers and producers.
+//
+//     threadpool-bench [workers producers [jobs]]
+
+#include "ThreadPool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+
+#define BENCH_JOBS          1000000
+#define BENCH_PRODUCERS_MAX 64
+
+static ThreadPool pool;
+static long jobsDone;
+static int jobsPerProducer;
+
+static void *
+BenchJob( void *arg )
+{
+	__atomic_add_fetch( &jobsDone, 1, __ATOMIC_RELAXED );
+	return arg;
+}
+
+static void *
+BenchProducer( void *arg )
+{
+	ThreadPoolJob job;
+	int i;
+
+	TPJobInit( &job, BenchJob, NULL );
+	TPJobSetPriority( &job, MED_PRIORITY );
+
+	for( i = 0; i < jobsPerProducer; i++ ) {
+		// the pool refuses jobs past its limit: wait for room
+		while( ThreadPoolAdd( &pool, &job, NULL ) != 0 ) {
+			sched_yield();
+		}
+	}
+
+	return arg;
+}
+
+static double
+BenchNow( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/****************************************************************************
+ * Function: BenchRun
+ *
+ *  Description:
+ *      Runs jobs empty jobs through a pool of workers threads, added by
+ *      producers threads at once, and prints the rate they ran at.
+ *  Returns:
+ *      0 on success, nonzero on failure
+ *****************************************************************************/
+static int
+BenchRun( int workers, int producers, int jobs )
+{
+	pthread_t threads[BENCH_PRODUCERS_MAX];
+	ThreadPoolAttr attr;
+	long total;
+	double start, elapsed;
+	int i;
+
+	TPAttrInit( &attr );
+	TPAttrSetMinThreads( &attr, workers );
+	TPAttrSetMaxThreads( &attr, workers );
+	TPAttrSetJobsPerThread( &attr, INT_MAX );
+	TPAttrSetMaxJobsTotal( &attr, INT_MAX );
+	if( ThreadPoolInit( &pool, &attr ) != 0 ) {
+		return -1;
+	}
+
+	jobsDone = 0;
+	jobsPerProducer = jobs / producers;
+	total = ( long )jobsPerProducer * producers;
+
+	start = BenchNow();
+	for( i = 0; i < producers; i++ ) {
+		pthread_create( &threads[i], NULL, BenchProducer, NULL );
+	}
+	for( i = 0; i < producers; i++ ) {
+		pthread_join( threads[i], NULL );
+	}
+	while( __atomic_load_n( &jobsDone, __ATOMIC_RELAXED ) < total ) {
+		sched_yield();
+	}
+	elapsed = BenchNow() - start;
+
+	printf( "%3d workers %3d producers: %8.0f kjobs/s\n",
+		workers, producers, total / elapsed / 1000 );
+
+	ThreadPoolShutdown( &pool );
+
+	return 0;
+}
+
+int
+main( int argc, char **argv )
+{
+	static const int workers[] = { 1, 2, 4, 8, 16 };
+	static const int producers[] = { 1, 4 };
+	int jobs = BENCH_JOBS;
+	unsigned int w, p;
+
+	if( argc == 3 || argc == 4 ) {
+		if( argc == 4 ) {
+			jobs = atoi( argv[3] );
+		}
+		if( atoi( argv[1] ) <= 0 || atoi( argv[2] ) <= 0 ||
+		    atoi( argv[2] ) > BENCH_PRODUCERS_MAX || jobs <= 0 ) {
+			fprintf( stderr, "invalid arguments\n" );
+			return 1;
+		}
+		return BenchRun( atoi( argv[1] ), atoi( argv[2] ), jobs ) != 0;
+	}
+	if( argc != 1 ) {
+		fprintf( stderr, "usage: %s [workers producers [jobs]]\n",
+			argv[0] );
+		return 1;
+	}
+
+	for( p = 0; p < sizeof( producers ) / sizeof( producers[0] ); p++ ) {
+		for( w = 0; w < sizeof( workers ) / sizeof( workers[0] ); w++ ) {
+			if( BenchRun( workers[w], producers[p], jobs ) != 0 ) {
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -14,9 +14,13 @@ THREADUTIL_EXTRADIST = \
 THREADUTIL_OBJS = $(THREADUTIL_SRCS:.c=.o)
 THREADUTIL_LOBJS = $(THREADUTIL_SRCS:.c=.lo)
 
+# dispatch microbenchmark of the thread pool, not part of the library
+THREADUTIL_BENCH = threadutil/threadpool-bench
+THREADUTIL_BENCH_SRCS = threadutil/ThreadPoolBench.c
+
 all:
 
 threadutil-dist-all:
 	mkdir -p $(DIST)/threadutil
 	cp $(THREADUTIL_EXTRADIST) $(THREADUTIL_SRCS) \
-          threadutil.mak $(DIST)/threadutil
+          $(THREADUTIL_BENCH_SRCS) threadutil.mak $(DIST)/threadutil
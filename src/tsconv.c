@@ -0,0 +1,410 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * On the fly conversion between plain 188 bytes MPEG-TS packets and the
+ * 192 bytes packets of DLNA, whose 4 bytes prefix holds an arrival time
+ * stamp on the 27 MHz clock. Stamps are interpolated between the PCRs
+ * surrounding each packet, looking ahead in the file for the next one
+ * when needed. Packets are converted in place in the reader's buffer,
+ * as many at once as it holds: 188 bytes packets are read at its end
+ * and moved down to make room for their prefix, 192 bytes ones are
+ * read at its start and moved down over their prefix.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "dlna_internals.h"
+#include "tsconv.h"
+#include "minmax.h"
+
+/* packets read at once looking for the next PCR, and how far to look */
+#define TS_CONV_SCAN_PACKETS    512
+#define TS_CONV_SCAN_MAX        (8 * 1024 * 1024)
+
+#define PCR_CLOCK               27000000LL
+#define PCR_WRAP                ((1LL << 33) * 300)
+/* larger steps between two PCRs are discontinuities */
+#define PCR_GAP_MAX             (5 * PCR_CLOCK)
+
+#define ATS_MASK                0x3fffffff
+
+typedef struct ts_pcr_s {
+  int64_t packet;
+  int64_t pcr;
+  int valid;
+} ts_pcr_t;
+
+struct ts_conv_s {
+  int in;
+  int out;
+  ts_conv_read_t read;
+  void *opaque;
+  int pid;                      /* carrying the PCR, -1 until found */
+  int64_t rate;                 /* 27 MHz ticks per packet, << 16, used
+                                   where PCRs cannot be interpolated */
+  ts_pcr_t prev;                /* PCRs around the packet being stamped */
+  ts_pcr_t next;
+  int64_t last;                 /* packet stamped last, -2 for none */
+  const uint8_t *win;           /* source packets being converted */
+  int64_t win_first;
+  int win_count;
+  uint8_t *scan;
+  uint8_t packet[192];          /* for reads not on packet boundaries */
+};
+
+int
+ts_conv_probe (int fd)
+{
+  uint8_t buf[3 * 192];
+  size_t len = 0;
+  ssize_t n;
+
+  while (len < sizeof (buf))
+  {
+    n = pread (fd, buf + len, sizeof (buf) - len, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    len += n;
+  }
+
+  if (len >= 3 * 188 && buf[0] == 0x47 && buf[188] == 0x47
+      && buf[2 * 188] == 0x47)
+    return 188;
+  if (len >= 3 * 192 && buf[4] == 0x47 && buf[196] == 0x47
+      && buf[4 + 2 * 192] == 0x47)
+    return 192;
+  return 0;
+}
+
+ts_conv_t *
+ts_conv_new (int in, uint32_t bitrate, ts_conv_read_t read, void *opaque)
+{
+  ts_conv_t *conv;
+
+  if ((in != 188 && in != 192) || !read)
+    return NULL;
+
+  conv = calloc (1, sizeof (ts_conv_t));
+  if (!conv)
+    return NULL;
+
+  conv->in = in;
+  conv->out = TS_CONV_OUT (in);
+  conv->read = read;
+  conv->opaque = opaque;
+  conv->pid = -1;
+  conv->last = -2;
+  if (bitrate)
+    conv->rate = (PCR_CLOCK * 188 << 16) / bitrate;
+
+  return conv;
+}
+
+void
+ts_conv_free (ts_conv_t *conv)
+{
+  if (!conv)
+    return;
+
+  free (conv->scan);
+  free (conv);
+}
+
+off_t
+ts_conv_length (int in, off_t size)
+{
+  return (size / in) * TS_CONV_OUT (in);
+}
+
+off_t
+ts_conv_to_source (int in, off_t pos)
+{
+  return (pos / TS_CONV_OUT (in)) * in;
+}
+
+off_t
+ts_conv_from_source (int in, off_t offset)
+{
+  return (offset / in) * TS_CONV_OUT (in);
+}
+
+static ssize_t
+ts_conv_load (ts_conv_t *conv, uint8_t *buf, size_t len, off_t offset)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len)
+  {
+    n = conv->read (conv->opaque, (char *) buf + done,
+                    len - done, offset + done);
+    if (n < 0)
+      return done ? (ssize_t) done : -1;
+    if (n == 0)
+      break;
+    done += n;
+  }
+
+  return done;
+}
+
+/* PCR of a 188 bytes packet, if it carries the one of the stream */
+static int
+ts_conv_get_pcr (ts_conv_t *conv, const uint8_t *p, int64_t *pcr)
+{
+  int pid;
+
+  if (p[0] != 0x47 || !(p[3] & 0x20) || p[4] < 7 || !(p[5] & 0x10))
+    return -1;
+
+  pid = ((p[1] & 0x1f) << 8) | p[2];
+  if (conv->pid >= 0 && pid != conv->pid)
+    return -1;
+  conv->pid = pid;
+
+  *pcr = (((int64_t) p[6] << 25) | (p[7] << 17) | (p[8] << 9)
+          | (p[9] << 1) | (p[10] >> 7)) * 300
+    + (((p[10] & 0x01) << 8) | p[11]);
+  return 0;
+}
+
+/* first PCR from packet on, in the packets being converted or past them */
+static int
+ts_conv_find_pcr (ts_conv_t *conv, int64_t packet, ts_pcr_t *found)
+{
+  int64_t start = packet;
+  ssize_t len;
+  int i, n;
+
+  found->valid = 0;
+
+  while (packet < conv->win_first + conv->win_count)
+  {
+    if (!ts_conv_get_pcr (conv, conv->win + (packet - conv->win_first) * 188,
+                          &found->pcr))
+      goto found;
+    packet++;
+  }
+
+  if (!conv->scan)
+  {
+    conv->scan = malloc (TS_CONV_SCAN_PACKETS * 188);
+    if (!conv->scan)
+      return -1;
+  }
+
+  while ((packet - start) * 188 < TS_CONV_SCAN_MAX)
+  {
+    len = ts_conv_load (conv, conv->scan,
+                        TS_CONV_SCAN_PACKETS * 188, packet * 188);
+    n = len < 0 ? 0 : len / 188;
+    if (!n)
+      return -1;
+    for (i = 0; i < n; i++, packet++)
+      if (!ts_conv_get_pcr (conv, conv->scan + i * 188, &found->pcr))
+        goto found;
+  }
+
+  return -1;
+
+ found:
+  found->packet = packet;
+  found->valid = 1;
+  return 0;
+}
+
+/* last PCR before packet, only ever looked for in the file */
+static int
+ts_conv_find_prev_pcr (ts_conv_t *conv, int64_t packet, ts_pcr_t *found)
+{
+  int64_t start = packet;
+  ssize_t len;
+  int i, n;
+
+  found->valid = 0;
+
+  if (!conv->scan)
+  {
+    conv->scan = malloc (TS_CONV_SCAN_PACKETS * 188);
+    if (!conv->scan)
+      return -1;
+  }
+
+  while (packet > 0 && (start - packet) * 188 < TS_CONV_SCAN_MAX)
+  {
+    n = MIN (packet, TS_CONV_SCAN_PACKETS);
+    packet -= n;
+    len = ts_conv_load (conv, conv->scan, (size_t) n * 188, packet * 188);
+    if (len < (ssize_t) n * 188)
+      return -1;
+    for (i = n - 1; i >= 0; i--)
+      if (!ts_conv_get_pcr (conv, conv->scan + i * 188, &found->pcr))
+      {
+        found->packet = packet + i;
+        found->valid = 1;
+        return 0;
+      }
+  }
+
+  return -1;
+}
+
+/* clock ticks from prev to next, -1 across a discontinuity */
+static int64_t
+ts_conv_pcr_delta (const ts_pcr_t *prev, const ts_pcr_t *next)
+{
+  int64_t delta = next->pcr - prev->pcr;
+
+  if (delta < 0)
+    delta += PCR_WRAP;
+  if (delta == 0 || delta > PCR_GAP_MAX)
+    return -1;
+  return delta;
+}
+
+static uint32_t
+ts_conv_stamp (ts_conv_t *conv, int64_t packet)
+{
+  int64_t delta = -1;
+  int64_t ats;
+
+  /* after a seek, look for the PCRs around the packet again, so that
+     stamps are the same whatever the reads the stream is served with */
+  if (packet != conv->last + 1)
+  {
+    ts_conv_find_prev_pcr (conv, packet, &conv->prev);
+    ts_conv_find_pcr (conv, packet, &conv->next);
+  }
+  conv->last = packet;
+
+  while (conv->next.valid && packet >= conv->next.packet)
+  {
+    conv->prev = conv->next;
+    ts_conv_find_pcr (conv, conv->prev.packet + 1, &conv->next);
+    /* without a bitrate, the first PCRs give the rate to extrapolate */
+    if (!conv->rate && conv->next.valid
+        && (delta = ts_conv_pcr_delta (&conv->prev, &conv->next)) > 0)
+      conv->rate = (delta << 16) / (conv->next.packet - conv->prev.packet);
+  }
+
+  if (conv->prev.valid && conv->next.valid
+      && (delta = ts_conv_pcr_delta (&conv->prev, &conv->next)) > 0)
+    ats = conv->prev.pcr + delta * (packet - conv->prev.packet)
+      / (conv->next.packet - conv->prev.packet);
+  else if (conv->prev.valid)
+    ats = conv->prev.pcr
+      + (((packet - conv->prev.packet) * conv->rate) >> 16);
+  else if (conv->next.valid)
+    ats = conv->next.pcr
+      - (((conv->next.packet - packet) * conv->rate) >> 16);
+  else
+    ats = (packet * conv->rate) >> 16;
+
+  return (uint32_t) ((uint64_t) ats & ATS_MASK);
+}
+
+/* convert up to count packets from packet on into buf */
+static int
+ts_conv_packets (ts_conv_t *conv, uint8_t *buf, int count, int64_t packet)
+{
+  uint8_t *src, *dst;
+  uint32_t ats;
+  ssize_t len;
+  int i;
+
+  if (conv->in == 192)
+  {
+    len = ts_conv_load (conv, buf, (size_t) count * 192, packet * 192);
+    if (len < 0)
+      return -1;
+    count = len / 192;
+    for (i = 0; i < count; i++)
+      memmove (buf + i * 188, buf + i * 192 + 4, 188);
+    return count;
+  }
+
+  /* packet i is read at 4 * (count - i) bytes past where it goes, so
+     that it is moved before the next ones are overwritten */
+  src = buf + count * 4;
+  len = ts_conv_load (conv, src, (size_t) count * 188, packet * 188);
+  if (len < 0)
+    return -1;
+  count = len / 188;
+
+  conv->win = src;
+  conv->win_first = packet;
+  conv->win_count = count;
+
+  for (i = 0; i < count; i++)
+  {
+    /* looks ahead in the source packets, still in place */
+    ats = ts_conv_stamp (conv, packet + i);
+
+    dst = buf + i * 192;
+    memmove (dst + 4, src + i * 188, 188);
+    dst[0] = (ats >> 24) & 0xff;
+    dst[1] = (ats >> 16) & 0xff;
+    dst[2] = (ats >> 8) & 0xff;
+    dst[3] = ats & 0xff;
+  }
+
+  conv->win = NULL;
+  conv->win_count = 0;
+
+  return count;
+}
+
+ssize_t
+ts_conv_read (ts_conv_t *conv, char *buf, size_t len, off_t pos)
+{
+  size_t size, skip;
+  int64_t packet;
+  int n;
+
+  if (!conv || !buf || pos < 0)
+    return -1;
+
+  size = MAX (conv->in, conv->out);
+  skip = pos % conv->out;
+  packet = pos / conv->out;
+
+  /* partial packets go through a packet of their own */
+  if (skip || len < size)
+  {
+    n = ts_conv_packets (conv, conv->packet, 1, packet);
+    if (n <= 0)
+      return n;
+    len = MIN (len, conv->out - skip);
+    memcpy (buf, conv->packet + skip, len);
+    return len;
+  }
+
+  n = ts_conv_packets (conv, (uint8_t *) buf, len / size, packet);
+  if (n <= 0)
+    return n;
+  return (ssize_t) n * conv->out;
+}
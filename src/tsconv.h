@@ -0,0 +1,53 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef TSCONV_H
+#define TSCONV_H
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+/* packet size a file of in bytes packets is converted to */
+#define TS_CONV_OUT(in) ((in) == 188 ? 192 : 188)
+
+/* reads len bytes of the source file at offset */
+typedef ssize_t (*ts_conv_read_t) (void *opaque,
+                                   char *buf, size_t len, off_t offset);
+
+typedef struct ts_conv_s ts_conv_t;
+
+/* packet size of the MPEG-TS file: 188, 192 or 0 if not a TS */
+int ts_conv_probe (int fd);
+
+/* bitrate (bytes/s) of the file times packets when PCRs are missing */
+ts_conv_t *ts_conv_new (int in, uint32_t bitrate,
+                        ts_conv_read_t read, void *opaque);
+void ts_conv_free (ts_conv_t *conv);
+
+/* read from pos in the converted stream, -1 on error, 0 at its end */
+ssize_t ts_conv_read (ts_conv_t *conv, char *buf, size_t len, off_t pos);
+
+/* size of the converted stream, and offsets between the two */
+off_t ts_conv_length (int in, off_t size);
+off_t ts_conv_to_source (int in, off_t pos);
+off_t ts_conv_from_source (int in, off_t offset);
+
+#endif /* TSCONV_H */
@@ -267,6 +267,13 @@ upnp_init (dlna_t *dlna, dlna_device_type_t type)
 
   dlnaEnableWebserver (TRUE);
 
+  if (dlna->pace_ratio || dlna->pace_max_rate)
+    dlnaSetStreamPacing (dlna->pace_burst, dlna->pace_max_rate);
+  if (dlna->background_share >= 0)
+    dlnaSetBackgroundShare (dlna->background_share);
+  if (dlna->pool_limit)
+    dlnaSetBufferPoolLimit (dlna->pool_limit);
+
   res = dlnaSetVirtualDirCallbacks (&virtual_dir_callbacks, dlna);
   if (res != DLNA_E_SUCCESS)
   {
@@ -0,0 +1,430 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2000-2003 Intel Corporation
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+// * Neither name of Intel Corporation nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// File read benchmark of the streaming engine: concurrent streams read
+// their part of a file half a STREAMER_BUF_SIZE buffer at a time, one
+// read in flight per stream, in the ways the engine reads files: by
+// STREAMER_READ_THREADS reader threads, with readahead then sendfile to
+// /dev/null or with pread, or through an io_uring of STREAMER_URING_DEPTH
+// entries driven by a single thread, as the I/O threads do. Each mode
+// runs with the file in the page cache and with the cache dropped
+// beforehand. Sent to /dev/null, cached pages are not copied at all:
+// only the cold figure of sendfile tells about the engine.
+//
+//     streamer-bench [streams [MB per stream [file]]]
+
+#include "config.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+#ifdef HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#define BENCH_STREAMS       100
+#define BENCH_STREAM_MB     8
+#define BENCH_FILE          "streamer-bench.dat"
+#define BENCH_READ_SIZE     ( STREAMER_BUF_SIZE / 2 )
+
+typedef struct {
+	off_t offset;
+	off_t end;
+	char *buf;
+	int next;           // queue link, -1 for the last one
+} bench_stream;
+
+static int benchFd;
+static int nullFd;
+static int useSendfile;
+static int numStreams;
+static bench_stream *streams;
+
+// streams waiting for a reader thread, first in first out
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;
+static int queueHead;
+static int queueTail;
+static int streamsLeft;
+
+static double
+BenchNow( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+BenchQueue( int i )
+{
+	streams[i].next = -1;
+	if( queueHead < 0 ) {
+		queueHead = i;
+	} else {
+		streams[queueTail].next = i;
+	}
+	queueTail = i;
+}
+
+/****************************************************************************
+ * Function: BenchReader
+ *
+ *  Description:
+ *      Reader thread: takes the stream first in the queue, reads its
+ *      next part and queues it again until it is done.
+ *****************************************************************************/
+static void *
+BenchReader( void *arg )
+{
+	bench_stream *s;
+	off_t offset;
+	ssize_t n;
+	int i;
+
+	pthread_mutex_lock( &queueMutex );
+	while( streamsLeft > 0 ) {
+		if( queueHead < 0 ) {
+			pthread_cond_wait( &queueCond, &queueMutex );
+			continue;
+		}
+		i = queueHead;
+		queueHead = streams[i].next;
+		pthread_mutex_unlock( &queueMutex );
+
+		s = &streams[i];
+		if( useSendfile ) {
+			readahead( benchFd, s->offset, BENCH_READ_SIZE );
+			offset = s->offset;
+			n = sendfile( nullFd, benchFd, &offset, BENCH_READ_SIZE );
+		} else {
+			n = pread( benchFd, s->buf, BENCH_READ_SIZE, s->offset );
+		}
+		if( n <= 0 ) {
+			s->offset = s->end;
+		} else {
+			s->offset += n;
+		}
+
+		pthread_mutex_lock( &queueMutex );
+		if( s->offset < s->end ) {
+			BenchQueue( i );
+			pthread_cond_signal( &queueCond );
+		} else if( --streamsLeft == 0 ) {
+			pthread_cond_broadcast( &queueCond );
+		}
+	}
+	pthread_mutex_unlock( &queueMutex );
+
+	return arg;
+}
+
+static int
+BenchReaders( void )
+{
+	pthread_t threads[STREAMER_READ_THREADS];
+	int i;
+
+	queueHead = -1;
+	streamsLeft = numStreams;
+	for( i = 0; i < numStreams; i++ ) {
+		BenchQueue( i );
+	}
+	for( i = 0; i < STREAMER_READ_THREADS; i++ ) {
+		pthread_create( &threads[i], NULL, BenchReader, NULL );
+	}
+	for( i = 0; i < STREAMER_READ_THREADS; i++ ) {
+		pthread_join( threads[i], NULL );
+	}
+
+	return 0;
+}
+
+static int
+BenchSendfile( void )
+{
+	useSendfile = 1;
+	return BenchReaders();
+}
+
+static int
+BenchPread( void )
+{
+	useSendfile = 0;
+	return BenchReaders();
+}
+
+#ifdef HAVE_IO_URING
+/****************************************************************************
+ * Function: BenchUring
+ *
+ *  Description:
+ *      Reads all the streams through one io_uring: up to its depth of
+ *      reads are in flight, the other streams wait for a completion.
+ *  Returns:
+ *      0 on success, -1 if the ring cannot be set up
+ *****************************************************************************/
+static int
+BenchUring( void )
+{
+	struct io_uring_params p;
+	struct io_uring_sqe *sqes, *sqe;
+	struct io_uring_cqe *cqes, *cqe;
+	unsigned *sqTail, *sqArray, *cqHead, *cqTail;
+	unsigned sqMask, cqMask, tail, head;
+	size_t sqSize, cqSize, sqesSize;
+	char *sqMap, *cqMap;
+	int ring, inFlight = 0, toSubmit = 0, done = 0, ret = -1;
+	bench_stream *s;
+	int i;
+
+	memset( &p, 0, sizeof( p ) );
+	ring = syscall( __NR_io_uring_setup, STREAMER_URING_DEPTH, &p );
+	if( ring < 0 ) {
+		return -1;
+	}
+	sqSize = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+	cqSize = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+	sqesSize = p.sq_entries * sizeof( struct io_uring_sqe );
+	sqMap = mmap( NULL, sqSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING );
+	cqMap = mmap( NULL, cqSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING );
+	sqes = mmap( NULL, sqesSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES );
+	if( sqMap == MAP_FAILED || cqMap == MAP_FAILED || sqes == MAP_FAILED ) {
+		goto done;
+	}
+	sqTail = ( unsigned * )( sqMap + p.sq_off.tail );
+	sqArray = ( unsigned * )( sqMap + p.sq_off.array );
+	sqMask = *( unsigned * )( sqMap + p.sq_off.ring_mask );
+	cqHead = ( unsigned * )( cqMap + p.cq_off.head );
+	cqTail = ( unsigned * )( cqMap + p.cq_off.tail );
+	cqMask = *( unsigned * )( cqMap + p.cq_off.ring_mask );
+	cqes = ( struct io_uring_cqe * )( cqMap + p.cq_off.cqes );
+
+	queueHead = -1;
+	for( i = 0; i < numStreams; i++ ) {
+		BenchQueue( i );
+	}
+
+	while( done < numStreams ) {
+		// queue reads for the waiting streams while there is room
+		tail = *sqTail;
+		while( queueHead >= 0 && inFlight < STREAMER_URING_DEPTH ) {
+			i = queueHead;
+			queueHead = streams[i].next;
+			s = &streams[i];
+			sqe = &sqes[tail & sqMask];
+			memset( sqe, 0, sizeof( *sqe ) );
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = benchFd;
+			sqe->off = s->offset;
+			sqe->addr = ( unsigned long )s->buf;
+			sqe->len = BENCH_READ_SIZE;
+			sqe->user_data = i;
+			sqArray[tail & sqMask] = tail & sqMask;
+			tail++;
+			inFlight++;
+			toSubmit++;
+		}
+		__atomic_store_n( sqTail, tail, __ATOMIC_RELEASE );
+
+		if( syscall( __NR_io_uring_enter, ring, toSubmit, 1,
+			     IORING_ENTER_GETEVENTS, NULL, 0 ) < 0 ) {
+			goto done;
+		}
+		toSubmit = 0;
+
+		head = *cqHead;
+		while( head != __atomic_load_n( cqTail, __ATOMIC_ACQUIRE ) ) {
+			cqe = &cqes[head & cqMask];
+			s = &streams[cqe->user_data];
+			if( cqe->res <= 0 ) {
+				s->offset = s->end;
+			} else {
+				s->offset += cqe->res;
+			}
+			if( s->offset < s->end ) {
+				BenchQueue( ( int )cqe->user_data );
+			} else {
+				done++;
+			}
+			inFlight--;
+			head++;
+		}
+		__atomic_store_n( cqHead, head, __ATOMIC_RELEASE );
+	}
+	ret = 0;
+
+  done:
+	if( sqes != MAP_FAILED ) {
+		munmap( sqes, sqesSize );
+	}
+	if( cqMap != MAP_FAILED ) {
+		munmap( cqMap, cqSize );
+	}
+	if( sqMap != MAP_FAILED ) {
+		munmap( sqMap, sqSize );
+	}
+	close( ring );
+
+	return ret;
+}
+#endif
+
+/****************************************************************************
+ * Function: BenchRun
+ *
+ *  Description:
+ *      Reads the streams once with a mode, the file cached or not, and
+ *      prints the rate.
+ *  Returns:
+ *      0 on success, nonzero on failure
+ *****************************************************************************/
+static int
+BenchRun( const char *name, int ( *mode )( void ), int cold, off_t size )
+{
+	double start, elapsed;
+	int i;
+
+	if( cold ) {
+		posix_fadvise( benchFd, 0, 0, POSIX_FADV_DONTNEED );
+	} else {
+		for( i = 0; i < numStreams; i++ ) {
+			streams[i].offset = ( off_t )i * size;
+		}
+		BenchPread();
+	}
+	for( i = 0; i < numStreams; i++ ) {
+		streams[i].offset = ( off_t )i * size;
+		streams[i].end = streams[i].offset + size;
+	}
+
+	start = BenchNow();
+	if( mode() != 0 ) {
+		printf( "%-8s %-4s: not available\n", name,
+			cold ? "cold" : "warm" );
+		return 0;
+	}
+	elapsed = BenchNow() - start;
+
+	printf( "%-8s %-4s: %3d streams %8.1f MB/s\n", name,
+		cold ? "cold" : "warm", numStreams,
+		( double )size * numStreams / elapsed / ( 1024 * 1024 ) );
+
+	return 0;
+}
+
+int
+main( int argc, char **argv )
+{
+	const char *path = BENCH_FILE;
+	int mb = BENCH_STREAM_MB;
+	off_t size, written;
+	char *block;
+	int i, cold;
+
+	numStreams = BENCH_STREAMS;
+	if( argc > 4 ) {
+		fprintf( stderr, "usage: %s [streams [MB per stream [file]]]\n",
+			argv[0] );
+		return 1;
+	}
+	if( argc > 1 ) {
+		numStreams = atoi( argv[1] );
+	}
+	if( argc > 2 ) {
+		mb = atoi( argv[2] );
+	}
+	if( argc > 3 ) {
+		path = argv[3];
+	}
+	if( numStreams <= 0 || mb <= 0 ) {
+		fprintf( stderr, "invalid arguments\n" );
+		return 1;
+	}
+	size = ( off_t )mb * 1024 * 1024;
+
+	streams = calloc( numStreams, sizeof( bench_stream ) );
+	block = malloc( 1024 * 1024 );
+	if( streams == NULL || block == NULL ) {
+		return 1;
+	}
+	for( i = 0; i < numStreams; i++ ) {
+		if( posix_memalign( ( void ** )&streams[i].buf, 4096,
+				    BENCH_READ_SIZE ) != 0 ) {
+			return 1;
+		}
+	}
+
+	// the file is synced so that its pages can be dropped
+	benchFd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0600 );
+	if( benchFd < 0 ) {
+		perror( path );
+		return 1;
+	}
+	for( i = 0; i < 1024 * 1024; i++ ) {
+		block[i] = ( char )( i * 31 );
+	}
+	for( written = 0; written < size * numStreams;
+	     written += 1024 * 1024 ) {
+		if( write( benchFd, block, 1024 * 1024 ) != 1024 * 1024 ) {
+			perror( path );
+			unlink( path );
+			return 1;
+		}
+	}
+	fsync( benchFd );
+	nullFd = open( "/dev/null", O_WRONLY );
+
+	for( cold = 0; cold < 2; cold++ ) {
+		BenchRun( "sendfile", BenchSendfile, cold, size );
+		BenchRun( "pread", BenchPread, cold, size );
+#ifdef HAVE_IO_URING
+		BenchRun( "io_uring", BenchUring, cold, size );
+#endif
+	}
+
+	close( nullFd );
+	close( benchFd );
+	unlink( path );
+
+	return 0;
+}
@@ -0,0 +1,393 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2000-2003 Intel Corporation 
+// All rights reserved. 
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met: 
+//
+// * Redistributions of source code must retain the above copyright notice, 
+// this list of conditions and the following disclaimer. 
+// * Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution. 
+// * Neither name of Intel Corporation nor the names of its contributors 
+// may be used to endorse or promote products derived from this software 
+// without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+/************************************************************************
+* Purpose: This file contains a bounded pool of page-aligned buffers
+*	reused by the web server for streaming file content, so that each
+*	response does not have to allocate and free its own buffer.
+************************************************************************/
+
+#include "config.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "ithread.h"
+#include "bufpool.h"
+#include "upnpdebug.h"
+
+static const size_t gBufClassSize[] = BUF_POOL_SIZE_CLASSES;
+
+#define BUF_POOL_NUM_CLASSES \
+    ( (int)( sizeof( gBufClassSize ) / sizeof( gBufClassSize[0] ) ) )
+
+// idle buffers of each class, linked through their first bytes
+static char *gBufFreeList[BUF_POOL_NUM_CLASSES];
+
+static ithread_mutex_t gBufPoolMutex;
+static ithread_cond_t gBufPoolCond;
+static size_t gBufPoolMax;
+static size_t gBufPoolAllocated;    // idle + in use
+static size_t gBufPageSize;
+static struct dlnaBufferPoolStats gBufPoolStats;
+static int gBufPoolInit = 0;
+
+/************************************************************************
+*	Function :	BufClassIndex
+*
+*	Parameters :
+*		IN size_t size ;	wanted buffer size
+*
+*	Description :	Find the smallest size class holding size bytes,
+*		or the largest class if none does.
+*
+*	Return : int ;
+*		Index of the size class.
+************************************************************************/
+static int
+BufClassIndex( IN size_t size )
+{
+    int i;
+
+    for( i = 0; i < BUF_POOL_NUM_CLASSES - 1; i++ ) {
+        if( size <= gBufClassSize[i] ) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/************************************************************************
+*	Function :	BufReleaseIdle
+*
+*	Parameters :
+*		IN int keep ;	class whose idle buffers are kept
+*
+*	Description :	Free one idle buffer of another class, largest
+*		first, to make room under the memory cap. Called with the
+*		pool lock held.
+*
+*	Return : int ;
+*		1 if a buffer was freed, 0 if there was none.
+************************************************************************/
+static int
+BufReleaseIdle( IN int keep )
+{
+    int i;
+    char *buf;
+
+    for( i = BUF_POOL_NUM_CLASSES - 1; i >= 0; i-- ) {
+        if( i == keep || gBufFreeList[i] == NULL ) {
+            continue;
+        }
+        buf = gBufFreeList[i];
+        gBufFreeList[i] = *( char ** )buf;
+        gBufPoolAllocated -= gBufClassSize[i];
+        free( buf );
+        return 1;
+    }
+
+    return 0;
+}
+
+/************************************************************************
+*	Function :	BufPoolInit
+*
+*	Parameters :
+*		IN size_t maxMemory ;	upper bound on the memory held by the pool
+*
+*	Description :	Initialize the pool of page-aligned I/O buffers
+*		used by the web server to stream file content.
+*
+*	Return : int ;
+*		DLNA_E_SUCCESS
+*		DLNA_E_OUTOF_MEMORY
+************************************************************************/
+int
+BufPoolInit( IN size_t maxMemory )
+{
+    long page;
+
+    if( gBufPoolInit ) {
+        return DLNA_E_SUCCESS;
+    }
+
+    if( ithread_mutex_init( &gBufPoolMutex, NULL ) != 0 ) {
+        return DLNA_E_OUTOF_MEMORY;
+    }
+    if( ithread_cond_init( &gBufPoolCond, NULL ) != 0 ) {
+        ithread_mutex_destroy( &gBufPoolMutex );
+        return DLNA_E_OUTOF_MEMORY;
+    }
+
+    page = sysconf( _SC_PAGESIZE );
+    gBufPageSize = page > 0 ? ( size_t )page : 4096;
+    gBufPoolMax = maxMemory;
+    gBufPoolAllocated = 0;
+    memset( gBufFreeList, 0, sizeof( gBufFreeList ) );
+    memset( &gBufPoolStats, 0, sizeof( gBufPoolStats ) );
+    gBufPoolInit = 1;
+
+    return DLNA_E_SUCCESS;
+}
+
+/************************************************************************
+*	Function :	BufPoolDestroy
+*
+*	Parameters :	void
+*
+*	Description :	Release all idle buffers. Every buffer handed out
+*		must have been returned before this is called.
+*
+*	Return : void ;
+************************************************************************/
+void
+BufPoolDestroy( void )
+{
+    if( !gBufPoolInit ) {
+        return;
+    }
+
+    dlnaPrintf( DLNA_INFO, HTTP, __FILE__, __LINE__,
+        "Buffer pool: hits %lu allocs %lu waits %lu failures %lu "
+        "peak %lu bytes\n",
+        gBufPoolStats.hits, gBufPoolStats.allocs, gBufPoolStats.waits,
+        gBufPoolStats.failures, (unsigned long)gBufPoolStats.peakUsed );
+
+    ithread_mutex_lock( &gBufPoolMutex );
+    while( BufReleaseIdle( -1 ) ) {
+    }
+    assert( gBufPoolAllocated == 0 );
+    gBufPoolInit = 0;
+    ithread_mutex_unlock( &gBufPoolMutex );
+
+    ithread_cond_destroy( &gBufPoolCond );
+    ithread_mutex_destroy( &gBufPoolMutex );
+}
+
+/************************************************************************
+*	Function :	BufPoolSetLimit
+*
+*	Parameters :
+*		IN size_t maxMemory ;	upper bound on the memory held by the pool
+*
+*	Description :	Change the memory cap. Buffers already allocated
+*		are kept; the new cap applies to later allocations.
+*
+*	Return : void ;
+************************************************************************/
+void
+BufPoolSetLimit( IN size_t maxMemory )
+{
+    if( !gBufPoolInit ) {
+        return;
+    }
+
+    ithread_mutex_lock( &gBufPoolMutex );
+    gBufPoolMax = maxMemory;
+    ithread_cond_broadcast( &gBufPoolCond );
+    ithread_mutex_unlock( &gBufPoolMutex );
+}
+
+/************************************************************************
+*	Function :	BufPoolGet
+*
+*	Parameters :
+*		IN size_t size ;		wanted buffer size
+*		OUT size_t *capacity ;	actual size of the returned buffer
+*
+*	Description :	Get a buffer from the smallest size class holding
+*		size bytes. When the memory cap is reached a smaller class
+*		may be returned, so callers must use capacity rather than
+*		size. If nothing fits, waits up to BUF_POOL_WAIT_TIME seconds
+*		for another stream to return its buffer.
+*
+*	Return : char * ;
+*		Pointer to the buffer, NULL if none became available.
+************************************************************************/
+char *
+BufPoolGet( IN size_t size,
+            OUT size_t *capacity )
+{
+    int want;
+    int i;
+    char *buf = NULL;
+    void *mem;
+    struct timeval now;
+    struct timespec deadline;
+    int waiting = 0;
+    int timedOut = 0;
+
+    if( !gBufPoolInit ) {
+        return NULL;
+    }
+
+    want = BufClassIndex( size );
+
+    ithread_mutex_lock( &gBufPoolMutex );
+
+    for( ;; ) {
+        // reuse an idle buffer of the wanted class
+        if( gBufFreeList[want] != NULL ) {
+            buf = gBufFreeList[want];
+            gBufFreeList[want] = *( char ** )buf;
+            gBufPoolStats.hits++;
+            i = want;
+            break;
+        }
+
+        // room left under the cap, possibly after dropping idle
+        // buffers of other classes
+        while( gBufPoolAllocated + gBufClassSize[want] > gBufPoolMax &&
+               BufReleaseIdle( want ) ) {
+        }
+
+        // allocate the largest class that still fits
+        for( i = want; i >= 0; i-- ) {
+            if( gBufPoolAllocated + gBufClassSize[i] <= gBufPoolMax ) {
+                break;
+            }
+        }
+        if( i >= 0 ) {
+            gBufPoolAllocated += gBufClassSize[i];
+            ithread_mutex_unlock( &gBufPoolMutex );
+            if( posix_memalign( &mem, gBufPageSize, gBufClassSize[i] ) != 0 ) {
+                mem = NULL;
+            }
+            ithread_mutex_lock( &gBufPoolMutex );
+            if( mem == NULL ) {
+                gBufPoolAllocated -= gBufClassSize[i];
+                gBufPoolStats.failures++;
+                break;
+            }
+            buf = ( char * )mem;
+            gBufPoolStats.allocs++;
+            break;
+        }
+
+        // everything is in use: wait for a buffer to come back. Any
+        // buffer may make room, even of another class once idle, so
+        // each one returned is a new try, until the deadline
+        if( timedOut ) {
+            gBufPoolStats.failures++;
+            break;
+        }
+        if( !waiting ) {
+            gBufPoolStats.waits++;
+            gettimeofday( &now, NULL );
+            deadline.tv_sec = now.tv_sec + BUF_POOL_WAIT_TIME;
+            deadline.tv_nsec = now.tv_usec * 1000;
+            waiting = 1;
+        }
+        if( ithread_cond_timedwait( &gBufPoolCond, &gBufPoolMutex,
+                                    &deadline ) == ETIMEDOUT ) {
+            timedOut = 1;
+        }
+    }
+
+    if( buf != NULL ) {
+        *capacity = gBufClassSize[i];
+        gBufPoolStats.inUse += gBufClassSize[i];
+        if( gBufPoolStats.inUse > gBufPoolStats.peakUsed ) {
+            gBufPoolStats.peakUsed = gBufPoolStats.inUse;
+        }
+    }
+
+    ithread_mutex_unlock( &gBufPoolMutex );
+
+    return buf;
+}
+
+/************************************************************************
+*	Function :	BufPoolPut
+*
+*	Parameters :
+*		IN char *buf ;			buffer obtained from BufPoolGet
+*		IN size_t capacity ;	capacity returned by BufPoolGet
+*
+*	Description :	Give a buffer back to the pool.
+*
+*	Return : void ;
+************************************************************************/
+void
+BufPoolPut( IN char *buf,
+            IN size_t capacity )
+{
+    int i;
+
+    if( buf == NULL ) {
+        return;
+    }
+
+    i = BufClassIndex( capacity );
+    assert( gBufClassSize[i] == capacity );
+
+    ithread_mutex_lock( &gBufPoolMutex );
+    gBufPoolStats.inUse -= capacity;
+    if( gBufPoolAllocated > gBufPoolMax ) {
+        // the cap was lowered meanwhile
+        gBufPoolAllocated -= capacity;
+        free( buf );
+    } else {
+        *( char ** )buf = gBufFreeList[i];
+        gBufFreeList[i] = buf;
+    }
+    ithread_cond_broadcast( &gBufPoolCond );
+    ithread_mutex_unlock( &gBufPoolMutex );
+}
+
+/************************************************************************
+*	Function :	BufPoolGetStats
+*
+*	Parameters :
+*		OUT struct dlnaBufferPoolStats *stats ;	filled with a snapshot
+*
+*	Description :	Read the pool counters.
+*
+*	Return : void ;
+************************************************************************/
+void
+BufPoolGetStats( OUT struct dlnaBufferPoolStats *stats )
+{
+    if( !gBufPoolInit ) {
+        memset( stats, 0, sizeof( *stats ) );
+        return;
+    }
+
+    ithread_mutex_lock( &gBufPoolMutex );
+    *stats = gBufPoolStats;
+    stats->allocated = gBufPoolAllocated;
+    stats->maxMemory = gBufPoolMax;
+    ithread_mutex_unlock( &gBufPoolMutex );
+}
@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2000-2003 Intel Corporation 
+// All rights reserved. 
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met: 
+//
+// * Redistributions of source code must retain the above copyright notice, 
+// this list of conditions and the following disclaimer. 
+// * Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution. 
+// * Neither name of Intel Corporation nor the names of its contributors 
+// may be used to endorse or promote products derived from this software 
+// without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef GENLIB_UTIL_BUFPOOL_H
+#define GENLIB_UTIL_BUFPOOL_H
+
+#include <stdlib.h>
+#include "upnp.h"
+
+//--------------------------------------------------
+//////////////// functions /////////////////////////
+//--------------------------------------------------
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/************************************************************************
+*	Function :	BufPoolInit
+*
+*	Parameters :
+*		IN size_t maxMemory ;	upper bound on the memory held by the pool
+*
+*	Description :	Initialize the pool of page-aligned I/O buffers
+*		used by the web server to stream file content.
+*
+*	Return : int ;
+*		DLNA_E_SUCCESS
+*		DLNA_E_OUTOF_MEMORY
+************************************************************************/
+int BufPoolInit( IN size_t maxMemory );
+
+/************************************************************************
+*	Function :	BufPoolDestroy
+*
+*	Parameters :	void
+*
+*	Description :	Release all idle buffers. Every buffer handed out
+*		must have been returned before this is called.
+*
+*	Return : void ;
+************************************************************************/
+void BufPoolDestroy( void );
+
+/************************************************************************
+*	Function :	BufPoolSetLimit
+*
+*	Parameters :
+*		IN size_t maxMemory ;	upper bound on the memory held by the pool
+*
+*	Description :	Change the memory cap. Buffers already allocated
+*		are kept; the new cap applies to later allocations.
+*
+*	Return : void ;
+************************************************************************/
+void BufPoolSetLimit( IN size_t maxMemory );
+
+/************************************************************************
+*	Function :	BufPoolGet
+*
+*	Parameters :
+*		IN size_t size ;		wanted buffer size
+*		OUT size_t *capacity ;	actual size of the returned buffer
+*
+*	Description :	Get a buffer from the smallest size class holding
+*		size bytes. When the memory cap is reached a smaller class
+*		may be returned, so callers must use capacity rather than
+*		size. If nothing fits, waits up to BUF_POOL_WAIT_TIME seconds
+*		for another stream to return its buffer.
+*
+*	Return : char * ;
+*		Pointer to the buffer, NULL if none became available.
+************************************************************************/
+char *BufPoolGet( IN size_t size, OUT size_t *capacity );
+
+/************************************************************************
+*	Function :	BufPoolPut
+*
+*	Parameters :
+*		IN char *buf ;			buffer obtained from BufPoolGet
+*		IN size_t capacity ;	capacity returned by BufPoolGet
+*
+*	Description :	Give a buffer back to the pool.
+*
+*	Return : void ;
+************************************************************************/
+void BufPoolPut( IN char *buf, IN size_t capacity );
+
+/************************************************************************
+*	Function :	BufPoolGetStats
+*
+*	Parameters :
+*		OUT struct dlnaBufferPoolStats *stats ;	filled with a snapshot
+*
+*	Description :	Read the pool counters.
+*
+*	Return : void ;
+************************************************************************/
+void BufPoolGetStats( OUT struct dlnaBufferPoolStats *stats );
+
+#ifdef __cplusplus
+}	// extern "C"
+#endif	// __cplusplus
+
+#endif // GENLIB_UTIL_BUFPOOL_H
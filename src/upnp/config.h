@@ -147,6 +147,129 @@
 #define WEB_SERVER_BUF_SIZE  (1024*1024)
 //@}
 
+/** @name WEB_SERVER_MAX_RANGES
+ * Maximum number of parts the webserver sends in a multipart/byteranges
+ * response, once overlapping and adjacent ranges of the request are
+ * merged. Requests asking for more get the whole file instead. The
+ * default value is 64.
+ */
+//@{
+#define WEB_SERVER_MAX_RANGES  64
+//@}
+
+/** @name KEEP_ALIVE_TIMEOUT
+ * Time, in seconds, the miniserver keeps an idle persistent HTTP
+ * connection open while waiting for the next request. The default
+ * value is 5 seconds.
+ */
+//@{
+#define KEEP_ALIVE_TIMEOUT  5
+//@}
+
+/** @name KEEP_ALIVE_MAX_REQUESTS
+ * Maximum number of requests served on one persistent HTTP connection
+ * before the miniserver closes it. The default value is 100.
+ */
+//@{
+#define KEEP_ALIVE_MAX_REQUESTS  100
+//@}
+
+/** @name BUF_POOL_SIZE_CLASSES
+ * Sizes of the reusable I/O buffers the webserver streams files with,
+ * in increasing order. A request takes the smallest class that holds
+ * it; the largest class should be {\tt WEB_SERVER_BUF_SIZE}.
+ */
+//@{
+#define BUF_POOL_SIZE_CLASSES  { 16*1024, 64*1024, 256*1024, WEB_SERVER_BUF_SIZE }
+//@}
+
+/** @name BUF_POOL_MAX_MEMORY
+ * Upper bound on the memory held by the webserver buffer pool, in use
+ * or idle. Once reached, streams get smaller buffers or wait for one to
+ * be returned. Can be changed at run time with
+ * {\bf dlnaSetBufferPoolLimit}. The default value is 32MB.
+ */
+//@{
+#define BUF_POOL_MAX_MEMORY  (32*1024*1024)
+//@}
+
+/** @name BUF_POOL_WAIT_TIME
+ * Time, in seconds, a stream waits for a buffer when the pool is
+ * exhausted before the request fails. The default value is 5 seconds.
+ */
+//@{
+#define BUF_POOL_WAIT_TIME  5
+//@}
+
+/** @name STREAMER_IO_THREADS
+ * Number of threads of the streaming engine writing file content to
+ * the network. Each one serves any number of streams as their sockets
+ * become writable. The default value is 2.
+ */
+//@{
+#define STREAMER_IO_THREADS  2
+//@}
+
+/** @name STREAMER_BUF_SIZE
+ * Size of the buffer, taken from the webserver buffer pool, that the
+ * streaming engine reads a file through when it cannot use sendfile.
+ * It is split in two halves, one sent while the other is read. The
+ * default value is 256KB.
+ */
+//@{
+#define STREAMER_BUF_SIZE  (256*1024)
+//@}
+
+/** @name STREAMER_READ_THREADS
+ * Number of threads of the streaming engine reading file content
+ * ahead of the network, for all streams. The default value is 4.
+ */
+//@{
+#define STREAMER_READ_THREADS  4
+//@}
+
+/** @name STREAMER_URING_DEPTH
+ * Number of entries of the io_uring submission queue of each I/O thread
+ * of the streaming engine, when built with io_uring support. The I/O
+ * threads then read the files themselves instead of relying on sendfile
+ * and the reader threads, which pays off when the files are not in the
+ * page cache (see streamer-bench, run by make bench). Set to 0 to keep
+ * sendfile. The default value is 64.
+ */
+//@{
+#define STREAMER_URING_DEPTH  64
+//@}
+
+/** @name STREAMER_PACE_BURST
+ * Bytes a paced stream may send at once when it starts, before its
+ * rate limit applies, so that the renderer fills its buffer quickly.
+ * Can be changed at run time with {\bf dlnaSetStreamPacing}. The
+ * default value is 4MB.
+ */
+//@{
+#define STREAMER_PACE_BURST  (4*1024*1024)
+//@}
+
+/** @name STREAMER_PACE_INTERVAL
+ * Time, in milliseconds, a paced stream earns the right to send for
+ * between two writes. Longer intervals mean fewer but larger writes.
+ * The default value is 40 milliseconds.
+ */
+//@{
+#define STREAMER_PACE_INTERVAL  40
+//@}
+
+/** @name STREAMER_BACKGROUND_SHARE
+ * Part of the global rate cap, in percent, that background transfers
+ * (transferMode.dlna.org: Background) are sure to get while other
+ * streams run; they get what these leave too. Can be changed at run
+ * time with {\bf dlnaSetBackgroundShare}. The default value is 10
+ * percent.
+ */
+//@{
+#define STREAMER_BACKGROUND_SHARE  10
+//@}
+
 /** @name AUTO_RENEW_TIME
  * The {\tt AUTO_RENEW_TIME} is the time, in seconds, before a subscription
  * expires that the SDK automatically resubscribes.  The default 
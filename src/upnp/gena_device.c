@@ -1168,10 +1168,11 @@ respond_ok( IN SOCKINFO * info,
     response.size_inc = 30;
     if( http_MakeMessage(
         &response, major, minor,
-        "R" "D" "S" "N" "Xc" "ssc" "scc",
+        "R" "D" "S" "N" "XcA" "ssc" "scc",
         HTTP_OK,
         (off_t)0,
         X_USER_AGENT,
+        info->keepAlive,
         "SID: ", sub->sid,
         timeout_str ) != 0 ) {
         membuffer_destroy( &response );
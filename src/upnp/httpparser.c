@@ -61,7 +61,7 @@ static str_int_entry Http_Method_Table[NUM_HTTP_METHODS] = {
 
 };
 
-#define NUM_HTTP_HEADER_NAMES 33
+#define NUM_HTTP_HEADER_NAMES 36
 str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES] = {
     {"ACCEPT", HDR_ACCEPT},
     {"ACCEPT-CHARSET", HDR_ACCEPT_CHARSET},
@@ -70,6 +70,7 @@ str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES] = {
     {"ACCEPT-RANGES", HDR_ACCEPT_RANGE},
     {"CACHE-CONTROL", HDR_CACHE_CONTROL},
     {"CALLBACK", HDR_CALLBACK},
+    {"CONNECTION", HDR_CONNECTION},
     {"CONTENT-ENCODING", HDR_CONTENT_ENCODING},
     {"CONTENT-LANGUAGE", HDR_CONTENT_LANGUAGE},
     {"CONTENT-LENGTH", HDR_CONTENT_LENGTH},
@@ -93,7 +94,9 @@ str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES] = {
     {"ST", HDR_ST},
     {"TE", HDR_TE},
     {"TIMEOUT", HDR_TIMEOUT},
+    {"TIMESEEKRANGE.DLNA.ORG", HDR_TIMESEEKRANGE},
     {"TRANSFER-ENCODING", HDR_TRANSFER_ENCODING},
+    {"TRANSFERMODE.DLNA.ORG", HDR_TRANSFERMODE},
     {"USER-AGENT", HDR_USER_AGENT},
     {"USN", HDR_USN}
 };
@@ -2389,7 +2392,7 @@ raw_find_str( IN memptr *raw_value,
     c = raw_value->buf[raw_value->length];
 
     // Make it lowercase
-    for (i = 0; raw_value->buf[i]; ++i) {
+    for (i = 0; i < ( int )raw_value->length; ++i) {
         raw_value->buf[i] = tolower(raw_value->buf[i]);
     }
 
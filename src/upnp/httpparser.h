@@ -142,6 +142,9 @@ typedef enum // http_method_t
 #define HDR_IF_RANGE            34
 #define HDR_RANGE               35
 #define HDR_TE                  36
+#define HDR_CONNECTION          37
+#define HDR_TIMESEEKRANGE       38
+#define HDR_TRANSFERMODE        39
 //End_Murari
 
 // status of parsing
@@ -64,6 +64,8 @@
 #include "upnp.h"
 #include "upnpapi.h"
 #include "membuffer.h"
+#include "bufpool.h"
+#include "streamer.h"
 #include "uri.h"
 #include "statcodes.h"
 #include "httpreadwrite.h"
@@ -74,6 +76,9 @@
 const int CHUNK_HEADER_SIZE = 10;
 const int CHUNK_TAIL_SIZE = 10;
 
+// Maximum number of buffers gathered into one write by http_SendMessage
+#define HTTP_SEND_IOV_MAX 16
+
 
 /************************************************************************
  * Function: http_FixUrl
@@ -275,6 +280,367 @@ http_RecvMessage( IN SOCKINFO * info,
 }
 
 
+/************************************************************************
+ * Function: http_RecvPipelinedRequest
+ *
+ * Parameters:
+ *	IN SOCKINFO *info;			Socket information object
+ *	OUT http_parser_t* parser;		HTTP parser object
+ *	IN OUT membuffer* pending;		data already received
+ *	IN OUT int* timeout_secs;		time out
+ *	OUT int* http_error_code;		HTTP error code returned
+ *
+ * Description:
+ *	Like http_RecvMessage for a request, on a connection that may
+ *	carry several of them. Parsing starts with the bytes in pending;
+ *	on success pending is left with whatever was received past the
+ *	end of the request. If that end cannot be told (chunked body),
+ *	keep-alive is cleared in info.
+ *
+ * Returns:
+ *	 DLNA_E_SUCCESS
+ *	 DLNA_E_BAD_HTTPMSG
+ *	 DLNA_E_SOCKET_READ if the peer closed before sending anything
+ *	 or error codes of sock_read; http_error_code is 0 when nothing
+ *	 had been received.
+ ************************************************************************/
+int
+http_RecvPipelinedRequest( IN SOCKINFO * info,
+                           OUT http_parser_t * parser,
+                           IN OUT membuffer * pending,
+                           IN OUT int *timeout_secs,
+                           OUT int *http_error_code )
+{
+    parse_status_t status = PARSE_INCOMPLETE;
+    int num_read;
+    char buf[2 * 1024];
+    const char *last = NULL;    // data appended last
+    size_t last_len = 0;
+    size_t msg_end;
+    size_t extra;
+
+    parser_request_init( parser );
+    *http_error_code = 0;
+
+    if( pending->length > 0 ) {
+        status = parser_append( parser, pending->buf, pending->length );
+        last = pending->buf;
+        last_len = pending->length;
+    }
+
+    while( status == PARSE_INCOMPLETE ) {
+        num_read = sock_read( info, buf, sizeof( buf ), timeout_secs );
+        if( num_read <= 0 ) {
+            membuffer_destroy( pending );
+            if( parser->msg.msg.length > 0 ) {
+                // partial msg
+                *http_error_code = HTTP_BAD_REQUEST;
+            }
+            return num_read == 0 ? DLNA_E_SOCKET_READ : num_read;
+        }
+        status = parser_append( parser, buf, num_read );
+        last = buf;
+        last_len = num_read;
+    }
+
+    if( status != PARSE_SUCCESS ) {
+        membuffer_destroy( pending );
+        *http_error_code = parser->http_error_code;
+        return DLNA_E_BAD_HTTPMSG;
+    }
+
+    dlnaPrintf( DLNA_INFO, HTTP, __FILE__, __LINE__,
+        "<<< (RECVD) <<<\n%s\n-----------------\n",
+        parser->msg.msg.buf );
+    print_http_headers( &parser->msg );
+
+    if( parser->content_length > ( unsigned int )g_maxContentLength ) {
+        membuffer_destroy( pending );
+        *http_error_code = HTTP_REQ_ENTITY_TOO_LARGE;
+        return DLNA_E_OUTOF_BOUNDS;
+    }
+
+    // keep what belongs to the next request; the message ended in the
+    // data appended last, since it was incomplete before
+    if( parser->ent_position == ENTREAD_DETERMINE_READ_METHOD ) {
+        msg_end = parser->entity_start_position;
+    } else if( parser->ent_position == ENTREAD_USING_CLEN ) {
+        msg_end = parser->entity_start_position + parser->content_length;
+    } else {
+        info->keepAlive = FALSE;
+        membuffer_destroy( pending );
+        return 0;
+    }
+
+    extra = parser->msg.msg.length - msg_end;
+    assert( extra <= last_len );
+    if( last == pending->buf ) {
+        membuffer_delete( pending, 0, pending->length - extra );
+    } else if( membuffer_assign( pending, last + last_len - extra,
+                                 extra ) != 0 ) {
+        info->keepAlive = FALSE;
+    }
+
+    return 0;
+}
+
+
+/************************************************************************
+ * Function: http_SendIov
+ *
+ * Parameters:
+ *	IN SOCKINFO *info ;		Socket information object
+ *	IN OUT int * TimeOut ;		time out value
+ *	IN OUT struct iovec *iov ;	pending buffers
+ *	IN OUT int *iovcnt ;		number of pending buffers
+ *
+ * Description:
+ *	Sends all the pending buffers with a single gather write and
+ *	empties the chain. A failed write ends keep-alive on the
+ *	connection.
+ *
+ * Returns:
+ *	0 if everything was sent, -1 otherwise
+ ************************************************************************/
+static int
+http_SendIov( IN SOCKINFO * info,
+              IN OUT int *TimeOut,
+              IN OUT struct iovec *iov,
+              IN OUT int *iovcnt )
+{
+    size_t total = 0;
+    int num_written;
+    int i;
+
+    if( *iovcnt == 0 ) {
+        return 0;
+    }
+
+    for( i = 0; i < *iovcnt; i++ ) {
+        total += iov[i].iov_len;
+    }
+
+    num_written = sock_writev( info, iov, *iovcnt, TimeOut );
+    *iovcnt = 0;
+
+    if( num_written < 0 || ( size_t )num_written != total ) {
+        // the peer cannot tell where this response ends anymore
+        info->keepAlive = FALSE;
+        return -1;
+    }
+
+    return 0;
+}
+
+/************************************************************************
+ * Function: http_SendFile
+ *
+ * Parameters:
+ *	IN SOCKINFO *info ;		Socket information object
+ *	IN OUT int * TimeOut ;		time out value
+ *	IN OUT struct iovec *iov ;	pending buffers (headers)
+ *	IN OUT int *iovcnt ;		number of pending buffers
+ *	IN int fd ;			file descriptor to send from
+ *	IN off_t offset ;		where to start in the file
+ *	IN off_t length ;		number of bytes to send
+ *
+ * Description:
+ *	Sends the pending buffers, then length bytes of fd using
+ *	zero-copy transfers of at most WEB_SERVER_BUF_SIZE bytes each.
+ *
+ * Returns:
+ *	DLNA_E_INVALID_ARGUMENT if fd cannot be used and nothing was
+ *	sent from it, DLNA_E_FILE_READ_ERROR if the file is shorter than
+ *	expected, 0 otherwise (including socket errors, which the caller
+ *	cannot do anything about).
+ ************************************************************************/
+static int
+http_SendFile( IN SOCKINFO * info,
+               IN OUT int *TimeOut,
+               IN OUT struct iovec *iov,
+               IN OUT int *iovcnt,
+               IN int fd,
+               IN off_t offset,
+               IN off_t length )
+{
+    off_t start = offset;
+    size_t n;
+    int num_written;
+
+    if( http_SendIov( info, TimeOut, iov, iovcnt ) != 0 ) {
+        return 0;
+    }
+
+    while( length > 0 ) {
+        n = ( length > WEB_SERVER_BUF_SIZE ) ? WEB_SERVER_BUF_SIZE : length;
+        num_written = sock_sendfile( info, fd, &offset, n, TimeOut );
+        if( num_written == DLNA_E_INVALID_ARGUMENT && offset == start ) {
+            return DLNA_E_INVALID_ARGUMENT;
+        }
+        if( num_written < 0 ) {
+            // Send error nothing we can do.
+            return 0;
+        }
+        if( ( size_t )num_written != n ) {
+            // EOF before the announced length
+            return DLNA_E_FILE_READ_ERROR;
+        }
+        length -= num_written;
+    }
+
+    return 0;
+}
+
+/************************************************************************
+ * Function: http_SendRanges
+ *
+ * Parameters:
+ *	IN SOCKINFO *info ;		Socket information object
+ *	IN OUT int * TimeOut ;		time out value
+ *	IN OUT struct iovec *iov ;	pending buffers (headers)
+ *	IN OUT int *iovcnt ;		number of pending buffers
+ *	IN struct SendInstruction *Instr ; multipart response
+ *	IN void *Fp ;			file, at its start
+ *	IN int fd ;			descriptor of the file, or -1
+ *	IN off_t offset ;		offset of the start of the file in fd
+ *	IN int Data_Buf_Size ;		size of the buffer to copy with
+ *
+ * Description:
+ *	Sends the parts of a multipart/byteranges response one after the
+ *	other, each preceded by its boundary and headers. Parts go out
+ *	with sendfile when fd allows it, or through a buffer of at most
+ *	Data_Buf_Size bytes otherwise.
+ *
+ * Returns:
+ *	DLNA_E_OUTOF_MEMORY
+ *	DLNA_E_FILE_READ_ERROR
+ *	DLNA_E_INTERNAL_ERROR
+ *	0 otherwise (including socket errors)
+ ************************************************************************/
+static int
+http_SendRanges( IN SOCKINFO * info,
+                 IN OUT int *TimeOut,
+                 IN OUT struct iovec *iov,
+                 IN OUT int *iovcnt,
+                 IN struct SendInstruction *Instr,
+                 IN void *Fp,
+                 IN int fd,
+                 IN off_t offset,
+                 IN int Data_Buf_Size )
+{
+    char Part[LINE_SIZE * 2];
+    char *file_buf = NULL;
+    size_t file_buf_size = 0;
+    const char *data;
+    off_t pos = 0;
+    off_t length;
+    int num_read;
+    int n;
+    int len;
+    int i;
+    int RetVal = 0;
+
+    for( i = 0; i <= Instr->RangeCount; i++ ) {
+        // the previous part is out by now, Part can be reused
+        len = MakeRangePartHeader( Part, sizeof( Part ), Instr, i );
+        if( len < 0 ) {
+            RetVal = DLNA_E_INTERNAL_ERROR;
+            goto end;
+        }
+        if( *iovcnt == HTTP_SEND_IOV_MAX &&
+            http_SendIov( info, TimeOut, iov, iovcnt ) != 0 ) {
+            goto end;
+        }
+        iov[*iovcnt].iov_base = Part;
+        iov[*iovcnt].iov_len = len;
+        ( *iovcnt )++;
+
+        if( i == Instr->RangeCount ) {
+            // closing delimiter
+            break;
+        }
+
+        length = Instr->Ranges[i].Length;
+        if( fd >= 0 ) {
+            RetVal = http_SendFile( info, TimeOut, iov, iovcnt, fd,
+                                    offset + Instr->Ranges[i].Offset,
+                                    length );
+            if( RetVal != DLNA_E_INVALID_ARGUMENT ) {
+                if( RetVal != 0 ) {
+                    goto end;
+                }
+                continue;
+            }
+            // not possible for this descriptor, copy instead
+            RetVal = 0;
+            fd = -1;
+        }
+
+        if( !file_buf ) {
+            file_buf = BufPoolGet( Data_Buf_Size, &file_buf_size );
+            if( !file_buf ) {
+                RetVal = DLNA_E_OUTOF_MEMORY;
+                goto end;
+            }
+            if( file_buf_size < ( size_t )Data_Buf_Size ) {
+                Data_Buf_Size = file_buf_size;
+            }
+        }
+
+        // parts are sorted, the file only moves forward
+        if( Instr->Ranges[i].Offset != pos ) {
+            if( Instr->IsVirtualFile ) {
+                n = virtualDirCallback.seek( virtualDirCallback.cookie, Fp,
+                                             Instr->Ranges[i].Offset - pos,
+                                             SEEK_CUR );
+            } else {
+                n = fseeko( Fp, Instr->Ranges[i].Offset - pos, SEEK_CUR );
+            }
+            if( n != 0 ) {
+                RetVal = DLNA_E_FILE_READ_ERROR;
+                goto end;
+            }
+            pos = Instr->Ranges[i].Offset;
+        }
+
+        while( length > 0 ) {
+            n = ( length > Data_Buf_Size ) ? Data_Buf_Size : length;
+            data = file_buf;
+            if( Instr->IsVirtualFile && virtualDirCallback.read_mapped ) {
+                num_read = virtualDirCallback.read_mapped(
+                    virtualDirCallback.cookie, Fp, file_buf, n, &data );
+            } else if( Instr->IsVirtualFile ) {
+                num_read = virtualDirCallback.read(
+                    virtualDirCallback.cookie, Fp, file_buf, n );
+            } else {
+                num_read = fread( file_buf, 1, n, Fp );
+            }
+            if( num_read <= 0 ) {
+                // EOF before the announced length
+                RetVal = DLNA_E_FILE_READ_ERROR;
+                goto end;
+            }
+            pos += num_read;
+            length -= num_read;
+
+            iov[*iovcnt].iov_base = ( char * )data;
+            iov[*iovcnt].iov_len = num_read;
+            ( *iovcnt )++;
+            // Send error nothing we can do.
+            if( http_SendIov( info, TimeOut, iov, iovcnt ) != 0 ) {
+                goto end;
+            }
+        }
+    }
+
+    http_SendIov( info, TimeOut, iov, iovcnt );
+
+end:
+    *iovcnt = 0;
+    BufPoolPut( file_buf, file_buf_size );
+    return RetVal;
+}
+
 /************************************************************************
  * Function: http_SendMessage
  *
@@ -296,6 +662,18 @@ http_RecvMessage( IN SOCKINFO * info,
  *			buf, strlen(buf),	// args for memory buffer
  *			filename );		// arg for file
  *
+ *	Memory buffers are not sent right away: they are chained and go
+ *	out together with the next file block (or at the end) in a single
+ *	gather write. Chunk framing is chained the same way around file
+ *	blocks instead of being copied into the data buffer.
+ *	Files of known length sent without chunk framing go from their
+ *	descriptor to the socket with sendfile when possible (local files,
+ *	or virtual files whose get_fd callback provides a descriptor).
+ *	If the connection has a streamDone callback, the file part is
+ *	handed over to the streaming engine and the function returns as
+ *	soon as it is started, with info->detached set. Multipart
+ *	byte range responses are always sent by the calling thread.
+ *
  * Returns:
  *	DLNA_E_OUTOF_MEMORY
  * 	DLNA_E_FILE_READ_ERROR
@@ -313,16 +691,19 @@ http_SendMessage( IN SOCKINFO * info,
     char *filename = NULL;
     FILE *Fp;
     int num_read;
-    int num_written;
     off_t amount_to_be_read = 0;
     va_list argp;
     char *file_buf = NULL;
-    char *ChunkBuf = NULL;
+    size_t file_buf_size = 0;
+    const char *data = NULL;
     struct SendInstruction *Instr = NULL;
     char Chunk_Header[CHUNK_HEADER_SIZE];
+    struct iovec iov[HTTP_SEND_IOV_MAX];
+    int iovcnt = 0;
+    int fd = -1;
+    off_t offset = 0;
     int RetVal = 0;
 
-    // 10 byte allocated for chunk header.
     int Data_Buf_Size = WEB_SERVER_BUF_SIZE;
 
     va_start( argp, fmt );
@@ -342,37 +723,91 @@ http_SendMessage( IN SOCKINFO * info,
             if( amount_to_be_read < WEB_SERVER_BUF_SIZE ) {
                 Data_Buf_Size = amount_to_be_read;
             }
-
-            ChunkBuf = (char *)malloc(
-                Data_Buf_Size + CHUNK_HEADER_SIZE + CHUNK_TAIL_SIZE);
-            if( !ChunkBuf ) {
-                return DLNA_E_OUTOF_MEMORY;
-            }
-
-            file_buf = ChunkBuf + CHUNK_HEADER_SIZE;
         } else if( c == 'f' ) {
             // file name
             filename = va_arg(argp, char *);
-            if( Instr && Instr->IsVirtualFile ) {
+            if( Instr && Instr->IsVirtualFile && Instr->FileHnd ) {
+                // opened while looking the file up, now owned here
+                Fp = Instr->FileHnd;
+                Instr->FileHnd = NULL;
+            } else if( Instr && Instr->IsVirtualFile ) {
                 Fp = (virtualDirCallback.open)(virtualDirCallback.cookie, filename, DLNA_READ );
             } else  {
                 Fp = fopen( filename, "rb" );
             }
             if( Fp == NULL ) {
-                free( ChunkBuf );
+                va_end( argp );
                 return DLNA_E_FILE_READ_ERROR;
             }
 
             if( Instr && Instr->IsRangeActive && Instr->IsVirtualFile ) {
                 if( virtualDirCallback.seek(virtualDirCallback.cookie, Fp, Instr->RangeOffset,
                                              SEEK_CUR ) != 0 ) {
-                    free( ChunkBuf );
-                    return DLNA_E_FILE_READ_ERROR;
+                    RetVal = DLNA_E_FILE_READ_ERROR;
+                    goto Cleanup_File;
                 }
             } else if( Instr && Instr->IsRangeActive ) {
                 if( fseeko( Fp, Instr->RangeOffset, SEEK_CUR ) != 0 ) {
-                    free( ChunkBuf );
-                    return DLNA_E_FILE_READ_ERROR;
+                    RetVal = DLNA_E_FILE_READ_ERROR;
+                    goto Cleanup_File;
+                }
+            }
+
+            // known length and no chunk framing: try to send straight
+            // from the file descriptor
+            if( Instr && !Instr->IsChunkActive && Instr->ReadSendSize >= 0 ) {
+                if( Instr->IsVirtualFile ) {
+                    if( virtualDirCallback.get_fd ) {
+                        fd = virtualDirCallback.get_fd(virtualDirCallback.cookie, Fp, &offset );
+                    }
+                } else {
+                    fd = fileno( Fp );
+                    offset = ftello( Fp );
+                }
+                if( offset < 0 ) {
+                    fd = -1;
+                }
+            }
+
+            // the streaming engine finishes the response without this
+            // thread when the owner of the connection allows it
+            if( Instr && Instr->RangeCount > 1 ) {
+                RetVal = http_SendRanges( info, TimeOut, iov, &iovcnt,
+                                          Instr, Fp, fd, offset,
+                                          Data_Buf_Size );
+                goto Cleanup_File;
+            }
+
+            if( Instr && info->streamDone &&
+                StreamerSubmit( info, iov, iovcnt, Fp, Instr->IsVirtualFile,
+                                fd, offset, Instr->ReadSendSize,
+                                Instr->IsChunkActive,
+                                Data_Buf_Size,
+                                Instr->PaceRate,
+                                Instr->IsBackground ) == DLNA_E_SUCCESS ) {
+                va_end( argp );
+                return 0;
+            }
+
+            if( fd >= 0 ) {
+                RetVal = http_SendFile( info, TimeOut, iov, &iovcnt,
+                                        fd, offset, amount_to_be_read );
+                if( RetVal != DLNA_E_INVALID_ARGUMENT ) {
+                    goto Cleanup_File;
+                }
+                // not possible for this descriptor, copy instead
+                RetVal = 0;
+            }
+
+            if( amount_to_be_read && !file_buf ) {
+                file_buf = BufPoolGet( Data_Buf_Size, &file_buf_size );
+                if( !file_buf ) {
+                    RetVal = DLNA_E_OUTOF_MEMORY;
+                    goto Cleanup_File;
+                }
+                // the pool may hand out less than asked for under pressure
+                if( file_buf_size < (size_t)Data_Buf_Size ) {
+                    Data_Buf_Size = file_buf_size;
                 }
             }
 
@@ -380,11 +815,18 @@ http_SendMessage( IN SOCKINFO * info,
                 if( Instr ) {
                     int n = (amount_to_be_read >= Data_Buf_Size) ?
                         Data_Buf_Size : amount_to_be_read;
-                    if( Instr->IsVirtualFile ) {
+                    data = file_buf;
+                    if( Instr->IsVirtualFile && virtualDirCallback.read_mapped ) {
+                        num_read = virtualDirCallback.read_mapped(virtualDirCallback.cookie, Fp, file_buf, n, &data );
+                    } else if( Instr->IsVirtualFile ) {
                         num_read = virtualDirCallback.read(virtualDirCallback.cookie, Fp, file_buf, n );
                     } else {
                         num_read = fread( file_buf, 1, n, Fp );
                     }
+                    if( num_read < 0 ) {
+                        RetVal = DLNA_E_FILE_READ_ERROR;
+                        goto Cleanup_File;
+                    }
                     amount_to_be_read = amount_to_be_read - num_read;
                     if( Instr->ReadSendSize < 0 ) {
                         // read until close
@@ -392,65 +834,68 @@ http_SendMessage( IN SOCKINFO * info,
                     }
                 } else {
                     num_read = fread( file_buf, 1, Data_Buf_Size, Fp );
+                    data = file_buf;
                 }
 
                 if( num_read == 0 ) {
                     // EOF so no more to send.
-                    if( Instr && Instr->IsChunkActive ) {
-                        char *str = "0\r\n\r\n";
-                        num_written = sock_write(info, str, strlen(str), TimeOut);
-                    } else {
+                    if( !Instr || !Instr->IsChunkActive ) {
                         RetVal = DLNA_E_FILE_READ_ERROR;
                     }
+                    break;
+                }
+
+                // make room for the chunk framing around the data
+                if( iovcnt > HTTP_SEND_IOV_MAX - 3 &&
+                    http_SendIov( info, TimeOut, iov, &iovcnt ) != 0 ) {
                     goto Cleanup_File;
                 }
-                // Create chunk for the current buffer.
-                if( Instr && Instr->IsChunkActive ) {
-                    // Copy CRLF at the end of the chunk
-                    memcpy( file_buf + num_read, "\r\n", 2 );
 
+                if( Instr && Instr->IsChunkActive ) {
                     // Hex length for the chunk size.
-                    sprintf( Chunk_Header, "%x", num_read );
-
-                    //itoa(num_read,Chunk_Header,16); 
-                    strcat( Chunk_Header, "\r\n" );
-
-                    // Copy the chunk size header 
-                    memcpy( file_buf - strlen( Chunk_Header ),
-                            Chunk_Header, strlen( Chunk_Header ) );
-
-                    // on the top of the buffer.
-                    //file_buf[num_read+strlen(Chunk_Header)] = NULL;
-                    //printf("Sending %s\n",file_buf-strlen(Chunk_Header));
-                    num_written = sock_write(
-                        info, file_buf - strlen( Chunk_Header ),
-                        num_read + strlen( Chunk_Header ) + 2, TimeOut );
-
-                    if( num_written !=
-                        num_read + ( int )strlen( Chunk_Header ) + 2 ) {
-                        // Send error nothing we can do.
-                        goto Cleanup_File;
-                    }
+                    sprintf( Chunk_Header, "%x\r\n", num_read );
+                    iov[iovcnt].iov_base = Chunk_Header;
+                    iov[iovcnt].iov_len = strlen( Chunk_Header );
+                    iovcnt++;
+                    iov[iovcnt].iov_base = ( char * )data;
+                    iov[iovcnt].iov_len = num_read;
+                    iovcnt++;
+                    iov[iovcnt].iov_base = "\r\n";
+                    iov[iovcnt].iov_len = 2;
+                    iovcnt++;
                 } else {
-                    // write data
-                    num_written = sock_write( info, file_buf, num_read, TimeOut );
-                    dlnaPrintf( DLNA_INFO, HTTP, __FILE__, __LINE__,
-                        ">>> (SENT) >>>\n%.*s\n------------\n",
-                        ( int )num_written, file_buf );
-                    // Send error nothing we can do
-                    if( num_written != num_read ) {
-                        goto Cleanup_File;
-                    }
+                    iov[iovcnt].iov_base = ( char * )data;
+                    iov[iovcnt].iov_len = num_read;
+                    iovcnt++;
+                }
+
+                // Send error nothing we can do.
+                if( http_SendIov( info, TimeOut, iov, &iovcnt ) != 0 ) {
+                    goto Cleanup_File;
                 }
             } // while
+
+            // last chunk, along with whatever is still pending
+            if( Instr && Instr->IsChunkActive ) {
+                if( iovcnt == HTTP_SEND_IOV_MAX ) {
+                    http_SendIov( info, TimeOut, iov, &iovcnt );
+                }
+                iov[iovcnt].iov_base = "0\r\n\r\n";
+                iov[iovcnt].iov_len = strlen( "0\r\n\r\n" );
+                iovcnt++;
+            }
+            http_SendIov( info, TimeOut, iov, &iovcnt );
 Cleanup_File:
             va_end( argp );
+            if( RetVal != 0 ) {
+                info->keepAlive = FALSE;
+            }
             if( Instr && Instr->IsVirtualFile ) {
                 virtualDirCallback.close(virtualDirCallback.cookie, Fp );
 	    } else {
                 fclose( Fp );
 	    }
-            free( ChunkBuf );
+            BufPoolPut( file_buf, file_buf_size );
             return RetVal;
 
         } else if( c == 'b' ) {
@@ -458,22 +903,26 @@ Cleanup_File:
             buf = va_arg(argp, char *);
             buf_length = va_arg(argp, size_t);
             if( buf_length > 0 ) {
-                num_written = sock_write( info, buf, buf_length, TimeOut );
                 dlnaPrintf( DLNA_INFO, HTTP, __FILE__, __LINE__,
                     ">>> (SENT) >>>\n"
-		    "%.*s\nbuf_length=%d, num_written=%d\n"
+		    "%.*s\nbuf_length=%d\n"
 		    "------------\n",
-                    (int)buf_length, buf, (int)buf_length, num_written );
-                if( (size_t)num_written != buf_length ) {
+                    (int)buf_length, buf, (int)buf_length );
+                if( iovcnt == HTTP_SEND_IOV_MAX &&
+                    http_SendIov( info, TimeOut, iov, &iovcnt ) != 0 ) {
                     goto end;
-		}
+                }
+                iov[iovcnt].iov_base = buf;
+                iov[iovcnt].iov_len = buf_length;
+                iovcnt++;
             }
         }
     }
 
+    http_SendIov( info, TimeOut, iov, &iovcnt );
+
 end:
     va_end( argp );
-    free( ChunkBuf );
     return 0;
 }
 
@@ -1695,8 +2144,9 @@ http_SendStatusResponse( IN SOCKINFO * info,
 
     ret = http_MakeMessage(
         &membuf, response_major, response_minor,
-        "RSCB",
+        "RSAB",
         http_status_code,  // response start line
+        info->keepAlive,   // connection header
         http_status_code ); // body
     if( ret == 0 ) {
         timeout = HTTP_DEFAULT_TIMEOUT;
@@ -1726,6 +2176,8 @@ http_SendStatusResponse( IN SOCKINFO * info,
  *	in the input parameters.
  *
  * fmt types:
+ *	'A':	arg = int keep_alive        // appends the HTTP CONNECTION:
+ *		header matching keep_alive and major,minor version
  *	'B':	arg = int status_code 
  *		appends content-length, content-type and HTML body
  *		for given code
@@ -1882,6 +2334,19 @@ http_MakeMessage( INOUT membuffer * buf,
             if( membuffer_append( buf, tempbuf, strlen( tempbuf ) ) != 0 ) {
                 goto error_handler;
             }
+        } else if( c == 'A' ) {
+            // connection header for a server response
+            num = ( size_t )va_arg( argp, int );
+            if( http_major_version > 1 ||
+                ( http_major_version == 1 && http_minor_version >= 1 ) ) {
+                temp_str = num ? NULL : "CONNECTION: close\r\n";
+            } else {
+                temp_str = num ? "CONNECTION: Keep-Alive\r\n" : NULL;
+            }
+            if( temp_str != NULL &&
+                membuffer_append_str( buf, temp_str ) != 0 ) {
+                goto error_handler;
+            }
         } else if( c == 'C' ) {
             if( ( http_major_version > 1 ) ||
                 ( http_major_version == 1 && http_minor_version == 1 )
@@ -128,6 +128,36 @@ int http_RecvMessage( IN SOCKINFO *info, OUT http_parser_t* parser,
 		OUT int* http_error_code );
 
 
+/************************************************************************
+ * Function: http_RecvPipelinedRequest
+ *
+ * Parameters:
+ *	IN SOCKINFO *info;			Socket information object
+ *	OUT http_parser_t* parser;		HTTP parser object
+ *	IN OUT membuffer* pending;		data already received
+ *	IN OUT int* timeout_secs;		time out
+ *	OUT int* http_error_code;		HTTP error code returned
+ *
+ * Description:
+ *	Like http_RecvMessage for a request, on a connection that may
+ *	carry several of them. Parsing starts with the bytes in pending;
+ *	on success pending is left with whatever was received past the
+ *	end of the request. If that end cannot be told (chunked body),
+ *	keep-alive is cleared in info.
+ *
+ * Returns:
+ *	 DLNA_E_SUCCESS
+ *	 DLNA_E_BAD_HTTPMSG
+ *	 DLNA_E_SOCKET_READ if the peer closed before sending anything
+ *	 or error codes of sock_read; http_error_code is 0 when nothing
+ *	 had been received.
+ ************************************************************************/
+int http_RecvPipelinedRequest( IN SOCKINFO *info, OUT http_parser_t* parser,
+		IN OUT membuffer* pending,
+		IN OUT int* timeout_secs,
+		OUT int* http_error_code );
+
+
 /************************************************************************
  * Function: http_SendMessage
  *
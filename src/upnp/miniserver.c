@@ -38,10 +38,12 @@
 #ifndef WIN32
 	#include <arpa/inet.h>
 	#include <netinet/in.h>
+	#include <netinet/tcp.h>
 	#include <sys/socket.h>
 	#include <sys/wait.h>
 	#include <unistd.h>
 	#include <sys/time.h>
+	#include <fcntl.h>
 #else /* WIN32 */
 	#include <winsock2.h>
 
@@ -68,12 +70,29 @@
 #include "upnp.h"
 #include "upnpapi.h"
 
+#ifdef __linux__
+	// the miniserver thread runs an epoll reactor instead of select()
+	#define MSERV_USE_EPOLL
+	#include <sys/epoll.h>
+	#include <time.h>
+#endif
+
 #define APPLICATION_LISTENING_PORT 49152
 
+// maximum number of events taken from the reactor at once
+#define MSERV_MAX_EVENTS 64
+
 struct mserv_request_t {
     int connfd;                 // connection handle
     struct in_addr foreign_ip_addr;
     unsigned short foreign_ip_port;
+    int numRequests;            // requests served on the connection
+#ifdef MSERV_USE_EPOLL
+    // set while the connection waits idle in the reactor
+    long long deadline;         // monotonic time (ms) it is closed at
+    struct mserv_request_t *prev;
+    struct mserv_request_t *next;
+#endif
 };
 
 typedef enum { MSERV_IDLE, MSERV_RUNNING, MSERV_STOPPING } MiniServerState;
@@ -87,6 +106,21 @@ static MiniServerCallback gSoapCallback = NULL;
 static MiniServerCallback gGenaCallback = NULL;
 static MiniServerState gMServState = MSERV_IDLE;
 
+#ifdef MSERV_USE_EPOLL
+// reactor of the running miniserver, -1 when it is not running
+static int gMServEpollFd = -1;
+// keep-alive connections waiting for their next request, oldest first
+static struct mserv_request_t *gMServIdleHead = NULL;
+static struct mserv_request_t *gMServIdleTail = NULL;
+static ithread_mutex_t gMServIdleMutex;
+static int gMServIdleMutexInit = FALSE;
+// event tags of the miniserver's own sockets
+static char gMServListenTag;
+static char gMServStopTag;
+static char gMServSsdpTag;
+static char gMServSsdpReqTag;
+#endif
+
 /************************************************************************
  * Function: SetHTTPGetCallback
  *
@@ -241,6 +275,173 @@ free_handle_request_arg( void *args )
     free( request );
 }
 
+/************************************************************************
+ * Function: keep_alive_requested
+ *
+ * Parameters:
+ *	IN http_message_t *hmsg - Request received
+ *
+ * Description:
+ * 	Tell whether the client wants the connection to stay open after
+ *	the response: HTTP/1.1 connections persist unless the request says
+ *	"Connection: close", HTTP/1.0 ones only with "Connection: Keep-Alive".
+ *
+ * Return: int
+ *	TRUE if the connection may be kept open
+ ************************************************************************/
+static int
+keep_alive_requested( IN http_message_t * hmsg )
+{
+    memptr hdr_value;
+
+    if( httpmsg_find_hdr( hmsg, HDR_CONNECTION, &hdr_value ) ) {
+        if( raw_find_str( &hdr_value, "close" ) >= 0 ) {
+            return FALSE;
+        }
+        if( raw_find_str( &hdr_value, "keep-alive" ) >= 0 ) {
+            return TRUE;
+        }
+    }
+
+    return hmsg->major_version > 1 ||
+        ( hmsg->major_version == 1 && hmsg->minor_version >= 1 );
+}
+
+#ifdef MSERV_USE_EPOLL
+/************************************************************************
+ * Function: mserv_now
+ *
+ * Parameters:
+ *	void
+ *
+ * Description:
+ * 	Read the monotonic clock the idle connection deadlines use.
+ *
+ * Return: long long
+ *	Current time in milliseconds
+ ************************************************************************/
+static long long
+mserv_now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( long long )ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/************************************************************************
+ * Function: idle_unlink
+ *
+ * Parameters:
+ *	IN struct mserv_request_t *request - Idle connection
+ *
+ * Description:
+ * 	Take a connection off the idle list and out of the reactor.
+ *	gMServIdleMutex must be held.
+ *
+ * Return: void
+ ************************************************************************/
+static void
+idle_unlink( IN struct mserv_request_t *request )
+{
+    if( request->prev != NULL ) {
+        request->prev->next = request->next;
+    } else {
+        gMServIdleHead = request->next;
+    }
+    if( request->next != NULL ) {
+        request->next->prev = request->prev;
+    } else {
+        gMServIdleTail = request->prev;
+    }
+    request->prev = request->next = NULL;
+
+    epoll_ctl( gMServEpollFd, EPOLL_CTL_DEL, request->connfd, NULL );
+}
+
+/************************************************************************
+ * Function: park_connection
+ *
+ * Parameters:
+ *	IN struct mserv_request_t *request - Connection with no request
+ *		pending
+ *
+ * Description:
+ * 	Hand a keep-alive connection back to the reactor until the client
+ *	sends its next request, so that no worker thread blocks on it.
+ *	The connection is closed by the reactor when it stays idle for
+ *	KEEP_ALIVE_TIMEOUT seconds.
+ *
+ * Return: int
+ *	0 if the reactor took the connection, -1 if the caller must close it
+ ************************************************************************/
+static int
+park_connection( IN struct mserv_request_t *request )
+{
+    struct epoll_event ev;
+    int ret = -1;
+
+    ithread_mutex_lock( &gMServIdleMutex );
+
+    if( gMServEpollFd >= 0 ) {
+        // every connection gets the same timeout, so appending keeps
+        // the list sorted by deadline
+        request->deadline = mserv_now() + KEEP_ALIVE_TIMEOUT * 1000;
+        request->next = NULL;
+        request->prev = gMServIdleTail;
+        if( gMServIdleTail != NULL ) {
+            gMServIdleTail->next = request;
+        } else {
+            gMServIdleHead = request;
+        }
+        gMServIdleTail = request;
+
+        memset( &ev, 0, sizeof( ev ) );
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+        ev.data.ptr = request;
+        if( epoll_ctl( gMServEpollFd, EPOLL_CTL_ADD, request->connfd,
+                       &ev ) == 0 ) {
+            ret = 0;
+        } else {
+            idle_unlink( request );
+        }
+    }
+
+    ithread_mutex_unlock( &gMServIdleMutex );
+
+    return ret;
+}
+
+/************************************************************************
+ * Function: stream_done
+ *
+ * Parameters:
+ *	IN void *args - Connection the streaming engine is done with
+ *	IN int keepAlive - TRUE if the connection may be reused
+ *
+ * Description:
+ * 	Take back a connection whose response was finished by the
+ *	streaming engine: park it until the next request, or close it.
+ *
+ * Return: void
+ ************************************************************************/
+static void
+stream_done( IN void *args,
+             IN int keepAlive )
+{
+    struct mserv_request_t *request = ( struct mserv_request_t * )args;
+
+    if( keepAlive && park_connection( request ) == 0 ) {
+        return;
+    }
+
+    dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
+        "miniserver %d: COMPLETE after %d request(s)\n", request->connfd,
+        request->numRequests );
+    free_handle_request_arg( request );
+}
+#endif /* MSERV_USE_EPOLL */
+
 /************************************************************************
  * Function: handle_request
  *
@@ -248,7 +449,13 @@ free_handle_request_arg( void *args )
  *	void *args - Request Message to be handled
  *
  * Description:
- * 	Receive the request and dispatch it for handling
+ * 	Receive the requests of a connection and dispatch them for
+ *	handling, one after the other. The connection stays open as long
+ *	as the client asks for it, up to KEEP_ALIVE_MAX_REQUESTS requests
+ *	and KEEP_ALIVE_TIMEOUT seconds of idle time; pipelined requests
+ *	are answered in order. Where the reactor is available, a connection
+ *	with nothing left to read is parked there instead of holding the
+ *	thread, and file responses are handed over to the streaming engine.
  *
  * Return: void
  ************************************************************************/
@@ -258,59 +465,150 @@ handle_request( void *args )
     SOCKINFO info;
     int http_error_code;
     int ret_code;
-    int major = 1;
-    int minor = 1;
+    int major;
+    int minor;
     http_parser_t parser;
     http_message_t *hmsg = NULL;
     int timeout = HTTP_DEFAULT_TIMEOUT;
+    int on = 1;
+    membuffer pending;
     struct mserv_request_t *request = ( struct mserv_request_t * )args;
     int connfd = request->connfd;
 
-    dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
-        "miniserver %d: READING\n", connfd );
     //parser_request_init( &parser ); ////LEAK_FIX_MK
     hmsg = &parser.msg;
 
     if( sock_init_with_ip( &info, connfd, request->foreign_ip_addr,
                            request->foreign_ip_port ) != DLNA_E_SUCCESS ) {
         free( request );
-        httpmsg_destroy( hmsg );
         return;
     }
-    // read
-    ret_code = http_RecvMessage( &info, &parser, HTTPMETHOD_UNKNOWN,
-                                 &timeout, &http_error_code );
-    if( ret_code != 0 ) {
-        goto error_handler;
-    }
 
-    dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
-        "miniserver %d: PROCESSING...\n", connfd );
-    // dispatch
-    http_error_code = dispatch_request( &info, &parser );
-    if( http_error_code != 0 ) {
-        goto error_handler;
-    }
+    membuffer_init( &pending );
 
-    http_error_code = 0;
+    // responses going out in several writes (headers, then the file)
+    // must not wait for the ACK of the previous one
+    setsockopt( connfd, IPPROTO_TCP, TCP_NODELAY, ( char * )&on,
+                sizeof( on ) );
 
-  error_handler:
-    if( http_error_code > 0 ) {
-        if( hmsg ) {
-            major = hmsg->major_version;
-            minor = hmsg->minor_version;
+    do {
+        dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
+            "miniserver %d: READING\n", connfd );
+        major = 1;
+        minor = 1;
+        info.keepAlive = TRUE;
+
+        // read
+        ret_code = http_RecvPipelinedRequest( &info, &parser, &pending,
+                                              &timeout, &http_error_code );
+        if( ret_code != 0 ) {
+            // a client going quiet between requests is no error
+            info.keepAlive = FALSE;
+            goto error_handler;
+        }
+
+        request->numRequests++;
+        info.keepAlive = info.keepAlive &&
+            request->numRequests < KEEP_ALIVE_MAX_REQUESTS &&
+            keep_alive_requested( hmsg );
+
+        dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
+            "miniserver %d: PROCESSING...\n", connfd );
+#ifdef MSERV_USE_EPOLL
+        // a file response may be finished by the streaming engine,
+        // unless more requests are already waiting behind this one
+        if( pending.length == 0 ) {
+            info.streamDone = stream_done;
+            info.streamArg = request;
+        }
+#endif
+        // dispatch
+        http_error_code = dispatch_request( &info, &parser );
+#ifdef MSERV_USE_EPOLL
+        if( info.detached ) {
+            dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
+                "miniserver %d: STREAMING\n", connfd );
+            httpmsg_destroy( hmsg );
+            membuffer_destroy( &pending );
+            return;
+        }
+        info.streamDone = NULL;
+        info.streamArg = NULL;
+#endif
+        if( http_error_code != 0 ) {
+            info.keepAlive = FALSE;
+            goto error_handler;
+        }
+
+        http_error_code = 0;
+
+      error_handler:
+        if( http_error_code > 0 ) {
+            if( hmsg ) {
+                major = hmsg->major_version;
+                minor = hmsg->minor_version;
+            }
+            handle_error( &info, http_error_code, major, minor );
+        }
+
+        httpmsg_destroy( hmsg );
+        timeout = KEEP_ALIVE_TIMEOUT;
+
+#ifdef MSERV_USE_EPOLL
+        // nothing pipelined: wait for the next request in the reactor
+        if( info.keepAlive && pending.length == 0 ) {
+            break;
         }
-        handle_error( &info, http_error_code, major, minor );
+#endif
+    } while( info.keepAlive );
+
+#ifdef MSERV_USE_EPOLL
+    if( info.keepAlive && park_connection( request ) == 0 ) {
+        dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
+            "miniserver %d: IDLE\n", connfd );
+        membuffer_destroy( &pending );
+        return;
     }
+#endif
 
     dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
-        "miniserver %d: COMPLETE\n", connfd );
+        "miniserver %d: COMPLETE after %d request(s)\n", connfd,
+        request->numRequests );
+    membuffer_destroy( &pending );
     sock_destroy( &info, SD_BOTH ); //should shutdown completely
 
-    httpmsg_destroy( hmsg );
     free( request );
 }
 
+/************************************************************************
+ * Function: schedule_connection
+ *
+ * Parameters:
+ *	IN struct mserv_request_t *request - Connection with a request to
+ *		read
+ *
+ * Description:
+ * 	Add a job handling the requests of a connection to the thread
+ *	pool. The connection is closed if the job cannot be added.
+ *
+ * Return: void
+ ************************************************************************/
+static void
+schedule_connection( IN struct mserv_request_t *request )
+{
+    ThreadPoolJob job;
+
+    TPJobInit( &job, ( start_routine ) handle_request, ( void * )request );
+    TPJobSetFreeFunction( &job, free_handle_request_arg );
+    TPJobSetPriority( &job, MED_PRIORITY );
+
+    if( ThreadPoolAdd( &gMiniServerThreadPool, &job, NULL ) != 0 ) {
+        dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
+            "mserv %d: cannot schedule request\n", request->connfd );
+        free_handle_request_arg( request );
+    }
+}
+
 /************************************************************************
  * Function: schedule_request_job
  *
@@ -329,15 +627,14 @@ schedule_request_job( IN int connfd,
                       IN struct sockaddr_in *clientAddr )
 {
     struct mserv_request_t *request;
-    ThreadPoolJob job;
 
     request =
         ( struct mserv_request_t * )
-        malloc( sizeof( struct mserv_request_t ) );
+        calloc( 1, sizeof( struct mserv_request_t ) );
     if( request == NULL ) {
         dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
             "mserv %d: out of memory\n", connfd );
-        shutdown( request->connfd, SD_BOTH );
+        shutdown( connfd, SD_BOTH );
         dlnaCloseSocket( connfd );
         return;
     }
@@ -346,37 +643,294 @@ schedule_request_job( IN int connfd,
     request->foreign_ip_addr = clientAddr->sin_addr;
     request->foreign_ip_port = ntohs( clientAddr->sin_port );
 
-    TPJobInit( &job, ( start_routine ) handle_request, ( void * )request );
-    TPJobSetFreeFunction( &job, free_handle_request_arg );
-    TPJobSetPriority( &job, MED_PRIORITY );
+    schedule_connection( request );
+}
 
-    if( ThreadPoolAdd( &gMiniServerThreadPool, &job, NULL ) != 0 ) {
+/************************************************************************
+ * Function: read_stop_socket
+ *
+ * Parameters:
+ *	IN SOCKET miniServStopSock - Socket StopMiniServer() writes to
+ *
+ * Description:
+ * 	Read a datagram from the stop socket and tell whether it asks
+ *	the miniserver to shut down.
+ *
+ * Return: int
+ *	TRUE if the miniserver must stop
+ ************************************************************************/
+static int
+read_stop_socket( IN SOCKET miniServStopSock )
+{
+    struct sockaddr_in clientAddr;
+    socklen_t clientLen;
+    int byteReceived;
+    char requestBuf[256];
+
+    clientLen = sizeof( struct sockaddr_in );
+    memset( ( char * )&clientAddr, 0, sizeof( struct sockaddr_in ) );
+    byteReceived =
+        recvfrom( miniServStopSock, requestBuf, 25, 0,
+                  ( struct sockaddr * )&clientAddr, &clientLen );
+    if( byteReceived > 0 ) {
+        requestBuf[byteReceived] = '\0';
         dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
-            "mserv %d: cannot schedule request\n", connfd );
-            free( request );
-        shutdown( connfd, SD_BOTH );
-        dlnaCloseSocket( connfd );
+            "Received response !!!  %s From host %s \n",
+            requestBuf, inet_ntoa( clientAddr.sin_addr ) );
+        dlnaPrintf( DLNA_PACKET, MSERV, __FILE__, __LINE__,
+            "Received multicast packet: \n %s\n", requestBuf );
+        if( NULL != strstr( requestBuf, "ShutDown" ) ) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+#ifdef MSERV_USE_EPOLL
+/************************************************************************
+ * Function: expire_idle_connections
+ *
+ * Parameters:
+ *	void
+ *
+ * Description:
+ * 	Close the parked connections whose keep-alive timeout is over.
+ *
+ * Return: int
+ *	Milliseconds until the next deadline. Connections parked later
+ *	expire later, so with none idle the reactor may sleep a whole
+ *	KEEP_ALIVE_TIMEOUT before it has to look again.
+ ************************************************************************/
+static int
+expire_idle_connections( void )
+{
+    struct mserv_request_t *request;
+    long long now = mserv_now();
+    int timeout = KEEP_ALIVE_TIMEOUT * 1000;
+
+    ithread_mutex_lock( &gMServIdleMutex );
+
+    while( ( request = gMServIdleHead ) != NULL ) {
+        if( request->deadline > now ) {
+            timeout = ( int )( request->deadline - now );
+            break;
+        }
+        idle_unlink( request );
+        dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
+            "miniserver %d: COMPLETE after %d request(s)\n",
+            request->connfd, request->numRequests );
+        free_handle_request_arg( request );
+    }
+
+    ithread_mutex_unlock( &gMServIdleMutex );
+
+    return timeout;
+}
+
+/************************************************************************
+ * Function: resume_connection
+ *
+ * Parameters:
+ *	IN struct mserv_request_t *request - Parked connection
+ *	IN unsigned int events - Events the reactor reported for it
+ *
+ * Description:
+ * 	Take a parked connection out of the reactor once the client has
+ *	sent something and schedule a job reading it. A connection the
+ *	reactor reported as broken is closed right away.
+ *
+ * Return: void
+ ************************************************************************/
+static void
+resume_connection( IN struct mserv_request_t *request,
+                   IN unsigned int events )
+{
+    ithread_mutex_lock( &gMServIdleMutex );
+    idle_unlink( request );
+    ithread_mutex_unlock( &gMServIdleMutex );
+
+    if( events & ( EPOLLERR | EPOLLHUP ) ) {
+        free_handle_request_arg( request );
         return;
     }
 
+    schedule_connection( request );
 }
 
 /************************************************************************
- * Function: RunMiniServer
+ * Function: accept_connections
+ *
+ * Parameters:
+ *	IN SOCKET miniServSock - Non blocking listening socket
+ *
+ * Description:
+ * 	Accept every connection waiting on the listening socket, the
+ *	reactor only reports it again when new ones arrive.
+ *
+ * Return: void
+ ************************************************************************/
+static void
+accept_connections( IN SOCKET miniServSock )
+{
+    struct sockaddr_in clientAddr;
+    socklen_t clientLen;
+    SOCKET connectHnd;
+
+    while( TRUE ) {
+        clientLen = sizeof( struct sockaddr_in );
+        connectHnd = accept( miniServSock,
+            ( struct sockaddr * )&clientAddr, &clientLen );
+        if( connectHnd == DLNA_INVALID_SOCKET ) {
+            if( errno == EINTR || errno == ECONNABORTED ) {
+                continue;
+            }
+            if( errno != EAGAIN && errno != EWOULDBLOCK ) {
+                dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
+                    "miniserver: Error in accepting connection\n" );
+            }
+            return;
+        }
+        schedule_request_job( connectHnd, &clientAddr );
+    }
+}
+
+/************************************************************************
+ * Function: RunMiniServerEpoll
  *
  * Parameters:
  *	MiniServerSockArray *miniSock - Socket Array
  *
  * Description:
- * 	Function runs the miniserver. The MiniServer accepts a 
- *	new request and schedules a thread to handle the new request.
- *	Checks for socket state and invokes appropriate read and shutdown 
- *	actions for the Miniserver and SSDP sockets 
+ * 	Run the miniserver around an epoll reactor. Beside the listening,
+ *	stop and SSDP sockets, the reactor watches the idle keep-alive
+ *	connections and closes them when their timeout is over; with no
+ *	fd_set involved, the number of connections is not bounded by
+ *	FD_SETSIZE.
+ *
+ * Return: int
+ *	0 once the miniserver was asked to stop, -1 if the reactor could
+ *	not be set up
+ ************************************************************************/
+static int
+RunMiniServerEpoll( MiniServerSockArray * miniSock )
+{
+    struct epoll_event ev;
+    struct epoll_event events[MSERV_MAX_EVENTS];
+    struct mserv_request_t *request;
+    void *tag;
+    int epfd;
+    int numEvents;
+    int i;
+    int stop = FALSE;
+
+    epfd = epoll_create( MSERV_MAX_EVENTS );
+    if( epfd < 0 ) {
+        return -1;
+    }
+    fcntl( epfd, F_SETFD, FD_CLOEXEC );
+
+    memset( &ev, 0, sizeof( ev ) );
+    ev.events = EPOLLIN;
+    ev.data.ptr = &gMServStopTag;
+    if( epoll_ctl( epfd, EPOLL_CTL_ADD, miniSock->miniServerStopSock,
+                   &ev ) != 0 ) {
+        goto error_handler;
+    }
+    ev.data.ptr = &gMServSsdpTag;
+    if( epoll_ctl( epfd, EPOLL_CTL_ADD, miniSock->ssdpSock, &ev ) != 0 ) {
+        goto error_handler;
+    }
+#ifdef INCLUDE_CLIENT_APIS
+    ev.data.ptr = &gMServSsdpReqTag;
+    if( epoll_ctl( epfd, EPOLL_CTL_ADD, miniSock->ssdpReqSock,
+                   &ev ) != 0 ) {
+        goto error_handler;
+    }
+#endif
+    // edge triggered: accept_connections() drains the backlog
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &gMServListenTag;
+    if( fcntl( miniSock->miniServerSock, F_SETFL,
+               fcntl( miniSock->miniServerSock, F_GETFL ) | O_NONBLOCK )
+        != 0 ||
+        epoll_ctl( epfd, EPOLL_CTL_ADD, miniSock->miniServerSock,
+                   &ev ) != 0 ) {
+        goto error_handler;
+    }
+
+    ithread_mutex_lock( &gMServIdleMutex );
+    gMServEpollFd = epfd;
+    ithread_mutex_unlock( &gMServIdleMutex );
+
+    gMServState = MSERV_RUNNING;
+    while( !stop ) {
+        numEvents = epoll_wait( epfd, events, MSERV_MAX_EVENTS,
+                                expire_idle_connections() );
+        if( numEvents < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            dlnaPrintf( DLNA_CRITICAL, SSDP, __FILE__, __LINE__,
+                "Error in epoll_wait call!\n" );
+            isleep( 1 );
+            continue;
+        }
+
+        for( i = 0; i < numEvents; i++ ) {
+            tag = events[i].data.ptr;
+            if( tag == &gMServListenTag ) {
+                accept_connections( miniSock->miniServerSock );
+            } else if( tag == &gMServSsdpTag ) {
+                readFromSSDPSocket( miniSock->ssdpSock );
+#ifdef INCLUDE_CLIENT_APIS
+            } else if( tag == &gMServSsdpReqTag ) {
+                readFromSSDPSocket( miniSock->ssdpReqSock );
+#endif
+            } else if( tag == &gMServStopTag ) {
+                stop = read_stop_socket( miniSock->miniServerStopSock );
+            } else {
+                resume_connection( ( struct mserv_request_t * )tag,
+                                   events[i].events );
+            }
+        }
+    }
+
+    // close the connections left idle, none can be parked from now on
+    ithread_mutex_lock( &gMServIdleMutex );
+    while( ( request = gMServIdleHead ) != NULL ) {
+        idle_unlink( request );
+        free_handle_request_arg( request );
+    }
+    gMServEpollFd = -1;
+    ithread_mutex_unlock( &gMServIdleMutex );
+
+    close( epfd );
+    return 0;
+
+  error_handler:
+    dlnaPrintf( DLNA_CRITICAL, MSERV, __FILE__, __LINE__,
+        "miniserver: cannot set up epoll, using select\n" );
+    close( epfd );
+    return -1;
+}
+#endif /* MSERV_USE_EPOLL */
+
+/************************************************************************
+ * Function: RunMiniServerSelect
+ *
+ * Parameters:
+ *	MiniServerSockArray *miniSock - Socket Array
+ *
+ * Description:
+ * 	Run the miniserver around select(), where no better event
+ *	mechanism is available. Every accepted connection is handled by
+ *	a worker thread from start to end.
  *
  * Return: void
  ************************************************************************/
 static void
-RunMiniServer( MiniServerSockArray * miniSock )
+RunMiniServerSelect( MiniServerSockArray * miniSock )
 {
     struct sockaddr_in clientAddr;
     socklen_t clientLen;
@@ -391,8 +945,6 @@ RunMiniServer( MiniServerSockArray * miniSock )
     fd_set expSet;
     fd_set rdSet;
     int maxMiniSock;
-    int byteReceived;
-    char requestBuf[256];
 
     maxMiniSock = max( miniServSock, miniServStopSock) ;
     maxMiniSock = max( maxMiniSock, (SOCKET)(ssdpSock) );
@@ -443,38 +995,45 @@ RunMiniServer( MiniServerSockArray * miniSock )
                     readFromSSDPSocket( ssdpSock );
             }
             if( FD_ISSET( miniServStopSock, &rdSet ) ) {
-                clientLen = sizeof( struct sockaddr_in );
-                memset( ( char * )&clientAddr, 0,
-                        sizeof( struct sockaddr_in ) );
-                byteReceived =
-                    recvfrom( miniServStopSock, requestBuf, 25, 0,
-                              ( struct sockaddr * )&clientAddr,
-                              &clientLen );
-                if( byteReceived > 0 ) {
-                    requestBuf[byteReceived] = '\0';
-                    dlnaPrintf( DLNA_INFO, MSERV, __FILE__, __LINE__,
-                        "Received response !!!  %s From host %s \n",
-                        requestBuf, inet_ntoa( clientAddr.sin_addr ) );
-                    dlnaPrintf( DLNA_PACKET, MSERV, __FILE__, __LINE__,
-                        "Received multicast packet: \n %s\n",
-                        requestBuf );
-                    if( NULL != strstr( requestBuf, "ShutDown" ) ) {
-                        break;
-		    }
+                if( read_stop_socket( miniServStopSock ) ) {
+                    break;
                 }
             }
         }
     }
+}
 
-    shutdown( miniServSock, SD_BOTH );
-    dlnaCloseSocket( miniServSock );
-    shutdown( miniServStopSock, SD_BOTH );
-    dlnaCloseSocket( miniServStopSock );
-    shutdown( ssdpSock, SD_BOTH );
-    dlnaCloseSocket( ssdpSock );
+/************************************************************************
+ * Function: RunMiniServer
+ *
+ * Parameters:
+ *	MiniServerSockArray *miniSock - Socket Array
+ *
+ * Description:
+ * 	Function runs the miniserver. The MiniServer accepts a 
+ *	new request and schedules a thread to handle the new request.
+ *	Checks for socket state and invokes appropriate read and shutdown 
+ *	actions for the Miniserver and SSDP sockets 
+ *
+ * Return: void
+ ************************************************************************/
+static void
+RunMiniServer( MiniServerSockArray * miniSock )
+{
+#ifdef MSERV_USE_EPOLL
+    if( RunMiniServerEpoll( miniSock ) != 0 )
+#endif
+        RunMiniServerSelect( miniSock );
+
+    shutdown( miniSock->miniServerSock, SD_BOTH );
+    dlnaCloseSocket( miniSock->miniServerSock );
+    shutdown( miniSock->miniServerStopSock, SD_BOTH );
+    dlnaCloseSocket( miniSock->miniServerStopSock );
+    shutdown( miniSock->ssdpSock, SD_BOTH );
+    dlnaCloseSocket( miniSock->ssdpSock );
 #ifdef INCLUDE_CLIENT_APIS
-    shutdown( ssdpReqSock, SD_BOTH );
-    dlnaCloseSocket( ssdpReqSock );
+    shutdown( miniSock->ssdpReqSock, SD_BOTH );
+    dlnaCloseSocket( miniSock->ssdpReqSock );
 #endif
 
     free( miniSock );
@@ -718,6 +1277,13 @@ StartMiniServer( unsigned short listen_port )
         return DLNA_E_INTERNAL_ERROR;   // miniserver running
     }
 
+#ifdef MSERV_USE_EPOLL
+    if( !gMServIdleMutexInit ) {
+        ithread_mutex_init( &gMServIdleMutex, NULL );
+        gMServIdleMutexInit = TRUE;
+    }
+#endif
+
     miniSocket =
         ( MiniServerSockArray * ) malloc( sizeof( MiniServerSockArray ) );
     if( miniSocket == NULL )
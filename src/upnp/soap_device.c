@@ -230,12 +230,13 @@ send_error_response( IN SOCKINFO * info,
     membuffer_init( &headers );
     if (http_MakeMessage(
         &headers, major, minor,
-        "RNsDsSXcc" "sssss",
+        "RNsDsSXcAc" "sssss",
         500,
         content_length,
         ContentTypeHeader,
         "EXT:\r\n",
         X_USER_AGENT,
+        info->keepAlive,
         start_body, err_code_str, mid_body, err_msg,
         end_body ) != 0 ) {
         membuffer_destroy( &headers );
@@ -297,12 +298,13 @@ send_var_query_response( IN SOCKINFO * info,
     
     if (http_MakeMessage(
         &response, major, minor,
-        "RNsDsSXcc" "sss",
+        "RNsDsSXcAc" "sss",
         HTTP_OK,
         content_length,
         ContentTypeHeader,
         "EXT:\r\n",
         X_USER_AGENT,
+        info->keepAlive,
         start_body, var_value, end_body ) != 0 ) {
         membuffer_destroy( &response );
         return;                 // out of mem
@@ -721,12 +723,13 @@ send_action_response( IN SOCKINFO * info,
     // make headers
     if (http_MakeMessage(
         &headers, major, minor,
-        "RNsDsSXcc",
+        "RNsDsSXcAc",
         HTTP_OK,   // status code
         content_length,
         ContentTypeHeader,
         "EXT:\r\n",
-        X_USER_AGENT) != 0 ) {
+        X_USER_AGENT,
+        info->keepAlive) != 0 ) {
         goto error_handler;
     }
 
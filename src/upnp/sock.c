@@ -47,12 +47,20 @@
  #include <sys/types.h>
  #include <sys/socket.h>
  #include <sys/time.h>
+ #include <sys/uio.h>
+ #include <poll.h>
  #include <unistd.h>
 #else
  #include <winsock2.h>
 #endif
 #include "unixutil.h"
 
+#ifdef __linux__
+ #include <pthread.h>
+ #include <signal.h>
+ #include <sys/sendfile.h>
+#endif
+
 #ifndef MSG_NOSIGNAL
  #define MSG_NOSIGNAL 0
 #endif
@@ -158,47 +166,44 @@ sock_destroy( INOUT SOCKINFO * info,
 }
 
 /************************************************************************
-*	Function :	sock_read_write
+*	Function :	sock_wait
 *
 *	Parameters :
 *		IN SOCKINFO *info ;	Socket Information Object
-*		OUT char* buffer ;	Buffer to get data to or send data from 
-*		IN size_t bufsize ;	Size of the buffer
 *	    IN int *timeoutSecs ;	timeout value
-*		IN xboolean bRead ;	Boolean value specifying read or write option
+*		IN xboolean bRead ;	Wait for readability or writability
 *
-*	Description :	Receives or sends data. Also returns the time taken
-*		to receive or send data.
+*	Description :	Waits until the socket is ready for the requested
+*		operation or the timeout expires.
 *
 *	Return :int ;
-*		numBytes - On Success, no of bytes received or sent		
+*		DLNA_E_SUCCESS - socket is ready
 *		DLNA_E_TIMEDOUT - Timeout
 *		DLNA_E_SOCKET_ERROR - Error on socket calls
 *
 *	Note :
 ************************************************************************/
 static int
-sock_read_write( IN SOCKINFO * info,
-                 OUT char *buffer,
-                 IN size_t bufsize,
-                 IN int *timeoutSecs,
-                 IN xboolean bRead )
+sock_wait( IN SOCKINFO * info,
+           IN int *timeoutSecs,
+           IN xboolean bRead )
 {
     int retCode;
+#ifdef WIN32
     fd_set readSet;
     fd_set writeSet;
     struct timeval timeout;
-    int numBytes;
-    time_t start_time = time( NULL );
+#else
+    // poll() has no FD_SETSIZE limit on the descriptor value
+    struct pollfd pfd;
+#endif
     int sockfd = info->socket;
-    long bytes_sent = 0,
-      byte_left = 0,
-      num_written;
 
     if( *timeoutSecs < 0 ) {
         return DLNA_E_TIMEDOUT;
     }
 
+#ifdef WIN32
     FD_ZERO( &readSet );
     FD_ZERO( &writeSet );
     if( bRead ) {
@@ -209,8 +214,13 @@ sock_read_write( IN SOCKINFO * info,
 
     timeout.tv_sec = *timeoutSecs;
     timeout.tv_usec = 0;
+#else
+    pfd.fd = sockfd;
+    pfd.events = bRead ? POLLIN : POLLOUT;
+#endif
 
     while( TRUE ) {
+#ifdef WIN32
         if( *timeoutSecs == 0 ) {
             retCode =
                 select( sockfd + 1, &readSet, &writeSet, NULL, NULL );
@@ -218,6 +228,10 @@ sock_read_write( IN SOCKINFO * info,
             retCode =
                 select( sockfd + 1, &readSet, &writeSet, NULL, &timeout );
         }
+#else
+        retCode = poll( &pfd, 1,
+                        *timeoutSecs == 0 ? -1 : *timeoutSecs * 1000 );
+#endif
 
         if( retCode == 0 ) {
             return DLNA_E_TIMEDOUT;
@@ -231,6 +245,62 @@ sock_read_write( IN SOCKINFO * info,
         }
     }
 
+    return DLNA_E_SUCCESS;
+}
+
+/************************************************************************
+*	Function :	sock_read_write
+*
+*	Parameters :
+*		IN SOCKINFO *info ;	Socket Information Object
+*		OUT char* buffer ;	Buffer to get data to or send data from 
+*		IN size_t bufsize ;	Size of the buffer
+*	    IN int *timeoutSecs ;	timeout value
+*		IN xboolean bRead ;	Boolean value specifying read or write option
+*
+*	Description :	Receives or sends data. Also returns the time taken
+*		to receive or send data.
+*
+*	Return :int ;
+*		numBytes - On Success, no of bytes received or sent		
+*		DLNA_E_TIMEDOUT - Timeout
+*		DLNA_E_SOCKET_ERROR - Error on socket calls
+*
+*	Note :
+************************************************************************/
+static int
+sock_read_write( IN SOCKINFO * info,
+                 OUT char *buffer,
+                 IN size_t bufsize,
+                 IN int *timeoutSecs,
+                 IN xboolean bRead )
+{
+    int retCode;
+    int numBytes;
+    time_t start_time = time( NULL );
+    int sockfd = info->socket;
+    long bytes_sent = 0,
+      byte_left = 0,
+      num_written;
+
+#ifdef MSG_DONTWAIT
+    if( bRead ) {
+        // the data is usually there already: try before waiting for it
+        numBytes = recv( sockfd, buffer, bufsize, MSG_DONTWAIT );
+        if( numBytes >= 0 ) {
+            return numBytes;
+        }
+        if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) {
+            return DLNA_E_SOCKET_ERROR;
+        }
+    }
+#endif
+
+    retCode = sock_wait( info, timeoutSecs, bRead );
+    if( retCode != DLNA_E_SUCCESS ) {
+        return retCode;
+    }
+
 #ifdef SO_NOSIGPIPE
     {
 	int old;
@@ -332,3 +402,189 @@ sock_write( IN SOCKINFO * info,
 {
     return sock_read_write( info, buffer, bufsize, timeoutSecs, FALSE );
 }
+
+/************************************************************************
+*	Function :	sock_writev
+*
+*	Parameters :
+*		IN SOCKINFO *info ;	Socket Information Object
+*		INOUT struct iovec *iov ;	Buffers to send data from
+*		IN int iovcnt ;	Number of buffers
+*	    IN int *timeoutSecs ;	timeout value
+*
+*	Description :	Sends a chain of buffers with as few system calls
+*		as possible (gather write). Partial writes are resumed from
+*		where they stopped, which modifies the iov array.
+*
+*	Return : int;
+*		numBytes - On Success, no of bytes sent
+*		DLNA_E_TIMEDOUT - Timeout
+*		DLNA_E_SOCKET_ERROR - Error on socket calls
+*
+*	Note :
+************************************************************************/
+int
+sock_writev( IN SOCKINFO * info,
+             INOUT struct iovec *iov,
+             IN int iovcnt,
+             INOUT int *timeoutSecs )
+{
+    int retCode;
+    time_t start_time = time( NULL );
+    int sockfd = info->socket;
+    struct msghdr msg;
+    long bytes_sent = 0;
+    ssize_t num_written;
+
+    retCode = sock_wait( info, timeoutSecs, FALSE );
+    if( retCode != DLNA_E_SUCCESS ) {
+        return retCode;
+    }
+
+#ifdef SO_NOSIGPIPE
+    {
+	int old;
+	int set = 1;
+	socklen_t olen = sizeof(old);
+	getsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &old, &olen);
+	setsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &set, sizeof(set));
+#endif
+
+    memset( &msg, 0, sizeof( msg ) );
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    while( msg.msg_iovlen > 0 ) {
+        num_written = sendmsg( sockfd, &msg, MSG_DONTROUTE|MSG_NOSIGNAL );
+        if( num_written == -1 ) {
+            if( errno == EINTR )
+                continue;
+#ifdef SO_NOSIGPIPE
+	    setsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &old, olen);
+#endif
+            return DLNA_E_SOCKET_ERROR;
+        }
+        bytes_sent += num_written;
+
+        // skip the buffers that went out entirely
+        while( msg.msg_iovlen > 0 &&
+               ( size_t )num_written >= msg.msg_iov->iov_len ) {
+            num_written -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        // and resume the partially sent one
+        if( msg.msg_iovlen > 0 ) {
+            msg.msg_iov->iov_base = ( char * )msg.msg_iov->iov_base +
+                num_written;
+            msg.msg_iov->iov_len -= num_written;
+        }
+    }
+
+#ifdef SO_NOSIGPIPE
+	setsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &old, olen);
+    }
+#endif
+
+    // subtract time used for writing
+    if( *timeoutSecs != 0 ) {
+        *timeoutSecs -= time( NULL ) - start_time;
+    }
+
+    return bytes_sent;
+}
+
+/************************************************************************
+*	Function :	sock_sendfile
+*
+*	Parameters :
+*		IN SOCKINFO *info ;	Socket Information Object
+*		IN int fd ;	File descriptor to send data from
+*		INOUT off_t *offset ;	File offset to start from, updated
+*		IN size_t count ;	Number of bytes to send
+*	    IN int *timeoutSecs ;	timeout value
+*
+*	Description :	Sends file data straight from the page cache to the
+*		socket, without copying it through user space. SIGPIPE is
+*		blocked for the calling thread while sending, as sendfile()
+*		has no MSG_NOSIGNAL equivalent.
+*
+*	Return : int;
+*		numBytes - On Success, no of bytes sent (less than count if
+*			the file got shorter)
+*		DLNA_E_INVALID_ARGUMENT - fd cannot be used with sendfile,
+*			nothing was sent and the caller should read/write instead
+*		DLNA_E_TIMEDOUT - Timeout
+*		DLNA_E_SOCKET_ERROR - Error on socket calls
+*
+*	Note :
+************************************************************************/
+int
+sock_sendfile( IN SOCKINFO * info,
+               IN int fd,
+               INOUT off_t *offset,
+               IN size_t count,
+               INOUT int *timeoutSecs )
+{
+#ifdef __linux__
+    int retCode;
+    time_t start_time = time( NULL );
+    int sockfd = info->socket;
+    sigset_t pipe_set;
+    sigset_t old_set;
+    xboolean got_epipe = FALSE;
+    long bytes_sent = 0;
+    ssize_t num_written;
+
+    retCode = sock_wait( info, timeoutSecs, FALSE );
+    if( retCode != DLNA_E_SUCCESS ) {
+        return retCode;
+    }
+
+    sigemptyset( &pipe_set );
+    sigaddset( &pipe_set, SIGPIPE );
+    pthread_sigmask( SIG_BLOCK, &pipe_set, &old_set );
+
+    retCode = DLNA_E_SUCCESS;
+    while( ( size_t )bytes_sent < count ) {
+        num_written = sendfile( sockfd, fd, offset, count - bytes_sent );
+        if( num_written == -1 ) {
+            if( errno == EINTR )
+                continue;
+            if( bytes_sent == 0 && ( errno == EINVAL || errno == ENOSYS ) )
+                retCode = DLNA_E_INVALID_ARGUMENT;
+            else
+                retCode = DLNA_E_SOCKET_ERROR;
+            got_epipe = ( errno == EPIPE );
+            break;
+        }
+        if( num_written == 0 ) {
+            // file got shorter
+            break;
+        }
+        bytes_sent += num_written;
+    }
+
+    // discard the SIGPIPE raised on our behalf before unblocking it
+    if( got_epipe && !sigismember( &old_set, SIGPIPE ) ) {
+        struct timespec zero = { 0, 0 };
+
+        while( sigtimedwait( &pipe_set, NULL, &zero ) == -1 &&
+               errno == EINTR ) ;
+    }
+    pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+
+    if( retCode != DLNA_E_SUCCESS ) {
+        return retCode;
+    }
+
+    // subtract time used for writing
+    if( *timeoutSecs != 0 ) {
+        *timeoutSecs -= time( NULL ) - start_time;
+    }
+
+    return bytes_sent;
+#else
+    return DLNA_E_INVALID_ARGUMENT;
+#endif
+}
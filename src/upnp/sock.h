@@ -36,6 +36,7 @@
 
 #ifndef WIN32
  #include <netinet/in.h>
+ #include <sys/uio.h>
 #endif
 
 //Following variable is not defined under winsock.h
@@ -53,7 +54,19 @@ typedef struct
     // the following two fields are filled only in incoming requests;
     struct in_addr foreign_ip_addr;
     unsigned short foreign_ip_port;
-    
+
+    // TRUE if the connection stays open once the response is sent;
+    // set by the miniserver, cleared by anything that breaks framing
+    int keepAlive;
+
+    // set by the owner of the connection when the streaming engine may
+    // finish a response; streamDone( streamArg, keepAlive ) hands the
+    // connection back once the engine is done with it
+    void ( *streamDone )( void *arg, int keepAlive );
+    void *streamArg;
+    // TRUE once the streaming engine took the connection over
+    int detached;
+
 } SOCKINFO;
 
 #ifdef __cplusplus
@@ -143,6 +156,52 @@ int sock_read( IN SOCKINFO *info, OUT char* buffer, IN size_t bufsize,
 int sock_write( IN SOCKINFO *info, IN char* buffer, IN size_t bufsize,
 		    		 INOUT int *timeoutSecs );
 
+/************************************************************************
+*	Function :	sock_writev
+*
+*	Parameters :
+*		IN SOCKINFO *info ;	Socket Information Object
+*		INOUT struct iovec *iov ;	Buffers to send data from
+*		IN int iovcnt ;	Number of buffers
+*	    IN int *timeoutSecs ;	timeout value
+*
+*	Description :	Writes a chain of buffers on the socket in sockinfo
+*		using gather I/O. The iov array is modified on partial writes.
+*
+*	Return : int;
+*		numBytes - On Success, no of bytes sent
+*		DLNA_E_TIMEDOUT - Timeout
+*		DLNA_E_SOCKET_ERROR - Error on socket calls
+*
+*	Note :
+************************************************************************/
+int sock_writev( IN SOCKINFO *info, INOUT struct iovec *iov, IN int iovcnt,
+		    		 INOUT int *timeoutSecs );
+
+/************************************************************************
+*	Function :	sock_sendfile
+*
+*	Parameters :
+*		IN SOCKINFO *info ;	Socket Information Object
+*		IN int fd ;	File descriptor to send data from
+*		INOUT off_t *offset ;	File offset to start from, updated
+*		IN size_t count ;	Number of bytes to send
+*	    IN int *timeoutSecs ;	timeout value
+*
+*	Description :	Sends file data on the socket in sockinfo without
+*		copying it through user space (zero-copy).
+*
+*	Return : int;
+*		numBytes - On Success, no of bytes sent
+*		DLNA_E_INVALID_ARGUMENT - zero-copy is not possible for fd
+*		DLNA_E_TIMEDOUT - Timeout
+*		DLNA_E_SOCKET_ERROR - Error on socket calls
+*
+*	Note :
+************************************************************************/
+int sock_sendfile( IN SOCKINFO *info, IN int fd, INOUT off_t *offset,
+		    		 IN size_t count, INOUT int *timeoutSecs );
+
 /************************************************************************
 *	Function :	sock_destroy
 *
@@ -0,0 +1,2125 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2000-2003 Intel Corporation 
+// All rights reserved. 
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met: 
+//
+// * Redistributions of source code must retain the above copyright notice, 
+// this list of conditions and the following disclaimer. 
+// * Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution. 
+// * Neither name of Intel Corporation nor the names of its contributors 
+// may be used to endorse or promote products derived from this software 
+// without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+/************************************************************************
+* Purpose: This file contains the streaming engine: responses carrying
+*	file content are handed over to it once their headers are ready,
+*	so that a stream costs memory rather than a miniserver thread for
+*	as long as it lasts. A few I/O threads write to the sockets of all
+*	the streams as they become writable, while the files are read
+*	ahead of them by a few reader threads. Built with io_uring, the
+*	I/O threads read the files themselves, through a ring each.
+*	Streams can be paced: a token bucket per stream keeps it to its
+*	rate, and a global cap is shared fairly between the streams.
+*	Background transfers come second: their reads wait behind the
+*	others at a lower I/O priority, and they only get a set part of the
+*	cap while other streams run.
+************************************************************************/
+
+#include "config.h"
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ithread.h"
+#include "ThreadPool.h"
+#include "bufpool.h"
+#include "streamer.h"
+#include "upnpapi.h"
+#include "upnpdebug.h"
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <time.h>
+
+#ifdef HAVE_IO_URING
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#endif
+
+// maximum number of events taken from an I/O thread's epoll at once
+#define STREAMER_MAX_EVENTS 64
+
+// room for the hexadecimal size line of a chunk
+#define STREAMER_CHUNK_HEADER_SIZE 16
+
+// registered buffer slots of a ring: the streams beyond read into
+// buffers that are not registered
+#define STREAMER_URING_BUFFERS 256
+
+// smallest write of a paced stream, whatever its rate
+#define STREAMER_PACE_MIN_QUANTUM 4096
+
+// I/O priority of the reads of background transfers: lowest level of
+// the best-effort class, for the calling thread
+#define STREAMER_IOPRIO_WHO_THREAD 1
+#define STREAMER_IOPRIO_BACKGROUND ( ( 2 << 13 ) | 7 )
+
+// DSCP of background transfers: CS1, "lower effort"
+#define STREAMER_TOS_BACKGROUND 0x20
+
+// how the files streamed from a descriptor are read
+typedef enum {
+    STREAMER_FILE_SENDFILE,     // sendfile, read ahead by reader threads
+    STREAMER_FILE_PREAD,        // pread into buffers by reader threads
+    STREAMER_FILE_URING         // io_uring reads into buffers
+} streamer_file_mode;
+
+typedef enum {
+    STREAM_SRC_SENDFILE,        // descriptor, sent with sendfile
+    STREAM_SRC_FD,              // descriptor, read into the buffers
+    STREAM_SRC_HANDLE           // virtual dir or FILE * handle
+} stream_source;
+
+typedef enum {
+    STREAM_BUF_EMPTY,
+    STREAM_BUF_FILLING,
+    STREAM_BUF_FULL
+} stream_buf_state;
+
+typedef enum {
+    STREAM_ASYNC_NONE,
+    STREAM_ASYNC_PENDING,       // read_async returned DLNA_E_PENDING
+    STREAM_ASYNC_DONE           // completed, to be accounted for
+} stream_async_state;
+
+// one half of the read buffer of a stream
+typedef struct {
+    char *data;
+    const char *start;          // where the bytes read are: data, or
+                                // memory the file handle keeps
+    size_t capacity;
+    size_t length;
+    stream_buf_state state;
+} stream_buf;
+
+#ifdef HAVE_IO_URING
+// io_uring of an I/O thread. Only that thread queues and reaps reads;
+// the buffer slots are shared under gStreamerMutex.
+typedef struct {
+    int fd;
+    void *sqMap;
+    size_t sqMapSize;
+    void *cqMap;
+    size_t cqMapSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+    unsigned queued;            // reads not submitted yet
+    unsigned active;            // reads queued or in progress
+    struct stream_session *deferHead;   // reads waiting for room
+    struct stream_session *deferTail;
+    int *freeSlots;             // registered buffer slots not in use
+    int numFree;
+} stream_ring;
+#endif
+
+// an I/O thread
+typedef struct {
+    int epfd;
+    int wakeFd;                 // eventfd telling the thread to stop
+#ifdef HAVE_IO_URING
+    stream_ring ring;
+#endif
+    // paced streams waiting for their bucket to refill, first to wake
+    // up first
+    struct stream_session *paceHead;
+} stream_loop;
+
+typedef struct stream_session {
+    SOCKINFO info;              // connection, owned until streamDone
+    int sockFlags;              // file status flags to restore
+    int sockTos;                // IP_TOS to restore, -1 if unchanged
+    stream_loop *loop;          // I/O thread serving the stream
+
+    // protects the fields below shared with the reader threads
+    ithread_mutex_t mutex;
+
+    char *head;                 // headers, sent first
+    void *fileHnd;
+    int isVirtual;
+    stream_source source;
+
+    // sendfile source: descriptor, next offset, end of the range and
+    // end of the part already read ahead. A descriptor read into the
+    // buffers reads at offset.
+    int fd;
+    off_t offset;
+    off_t end;
+    off_t primed;
+
+    // buffered sources: bytes left to read (-1 until EOF), two buffers
+    // filled and sent in turn
+    off_t remaining;
+    stream_buf bufs[2];
+    char *bufMem;
+    size_t bufMemSize;
+    int fillIdx;
+    int sendIdx;
+    int chunked;
+    int trailerQueued;
+
+    // segment being written
+    struct iovec out[3];
+    int outIdx;
+    int outCnt;
+    int outIsBuf;               // TRUE if out holds bufs[sendIdx]
+    char chunkHeader[STREAMER_CHUNK_HEADER_SIZE];
+
+    int background;             // yields to the other streams
+    int eof;                    // nothing more to read
+    int failed;                 // the response cannot be completed
+    int jobPending;             // a reader thread works for the stream
+    int waiting;                // the I/O thread waits for that job
+
+    // read left pending by the application, under gStreamerMutex
+    stream_async_state asyncState;
+    int asyncResult;
+
+    // pacing: rate asked for (bytes/s, 0 for none) and rate granted
+    // within the global cap (0 for no limit), set under gStreamerMutex.
+    // The bucket itself is only used by the I/O thread.
+    size_t paceRate;
+    size_t paceShare;
+    int paceSettled;
+    double paceTokens;
+    long long paceStamp;        // last refill, in ns
+    long long paceWake;         // end of the wait for tokens, in ns
+    struct stream_session *paceNext;
+
+#ifdef HAVE_IO_URING
+    int slot;                   // registered buffer slot, or -1
+    struct stream_session *deferNext;
+#endif
+
+    struct stream_session *prev;
+    struct stream_session *next;
+} stream_session;
+
+static ThreadPool gStreamerThreadPool;
+static stream_loop gStreamerLoops[STREAMER_IO_THREADS];
+static int gStreamerRunning = FALSE;
+static int gStreamerNextLoop = 0;
+static streamer_file_mode gStreamerFileMode = STREAMER_FILE_SENDFILE;
+
+// streams in progress, for shutdown; also guards gStreamerRunning.
+// Taken after the mutex of a stream when both are needed.
+static ithread_mutex_t gStreamerMutex;
+static int gStreamerMutexInit = FALSE;
+static stream_session *gStreamerSessions = NULL;
+
+// pacing settings, under gStreamerMutex: initial burst of a paced
+// stream and cap on the rate of all streams (bytes/s, 0 for none)
+static size_t gStreamerPaceBurst = STREAMER_PACE_BURST;
+static size_t gStreamerPaceMax = 0;
+// part of the cap, in percent, kept for the background transfers
+static unsigned int gStreamerBackgroundShare = STREAMER_BACKGROUND_SHARE;
+
+static void StreamerRead( void *arg );
+static void StreamerSend( stream_session *s );
+
+/************************************************************************
+*	Function :	StreamerArm
+*
+*	Parameters :
+*		IN stream_session *s ;	stream to wake up
+*
+*	Description :	Have the I/O thread of the stream called again once
+*		its socket is writable. Events are one-shot, so a stream is
+*		only ever handled by one thread at a time.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerArm( IN stream_session *s )
+{
+    struct epoll_event ev;
+
+    memset( &ev, 0, sizeof( ev ) );
+    ev.events = EPOLLOUT | EPOLLONESHOT;
+    ev.data.ptr = s;
+    epoll_ctl( s->loop->epfd, EPOLL_CTL_MOD, s->info.socket, &ev );
+}
+
+/************************************************************************
+*	Function :	StreamerNow
+*
+*	Parameters :	void
+*
+*	Description :	Monotonic time, for pacing.
+*
+*	Return : long long ;
+*		the time in ns
+************************************************************************/
+static long long
+StreamerNow( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( long long )ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/************************************************************************
+*	Function :	StreamerShareClass
+*
+*	Parameters :
+*		IN int background ;	class of the streams to share between
+*		IN size_t budget ;	rate to share, in bytes/s
+*
+*	Description :	Split a rate between the streams of a class, with
+*		gStreamerMutex held: streams asking for less than an equal
+*		share get what they ask for, and the others split the rest
+*		equally (max-min fairness).
+*
+*	Return : size_t ;
+*		the part of the budget no stream of the class takes.
+************************************************************************/
+static size_t
+StreamerShareClass( IN int background,
+                    IN size_t budget )
+{
+    stream_session *s;
+    size_t left = budget;
+    size_t fair = 0;
+    int unsettled = 0;
+    int settled;
+
+    for( s = gStreamerSessions; s != NULL; s = s->next ) {
+        if( s->background == background ) {
+            s->paceSettled = FALSE;
+            unsettled++;
+        }
+    }
+
+    // the streams that ask for less than their share leave the rest
+    // to the others, until no stream does
+    do {
+        settled = FALSE;
+        fair = ( unsettled > 0 ) ? left / unsettled : 0;
+        for( s = gStreamerSessions; s != NULL && unsettled > 0;
+             s = s->next ) {
+            if( s->background == background && !s->paceSettled &&
+                s->paceRate > 0 && s->paceRate <= fair ) {
+                __atomic_store_n( &s->paceShare, s->paceRate,
+                                  __ATOMIC_RELAXED );
+                s->paceSettled = TRUE;
+                left -= s->paceRate;
+                unsettled--;
+                settled = TRUE;
+            }
+        }
+    } while( settled );
+
+    if( unsettled == 0 ) {
+        return left;
+    }
+    for( s = gStreamerSessions; s != NULL; s = s->next ) {
+        if( s->background == background && !s->paceSettled ) {
+            __atomic_store_n( &s->paceShare, fair > 0 ? fair : 1,
+                              __ATOMIC_RELAXED );
+        }
+    }
+
+    return 0;
+}
+
+/************************************************************************
+*	Function :	StreamerShareBandwidth
+*
+*	Parameters :	void
+*
+*	Description :	Split the global rate cap between the streams, with
+*		gStreamerMutex held. While both run, the background transfers
+*		get gStreamerBackgroundShare percent of the cap and what the
+*		other streams leave; each class is shared fairly. Called
+*		whenever streams come or go.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerShareBandwidth( void )
+{
+    stream_session *s;
+    size_t reserved = 0;
+    int streams = 0;
+    int background = 0;
+
+    if( gStreamerPaceMax == 0 ) {
+        for( s = gStreamerSessions; s != NULL; s = s->next ) {
+            __atomic_store_n( &s->paceShare, s->paceRate,
+                              __ATOMIC_RELAXED );
+        }
+        return;
+    }
+
+    for( s = gStreamerSessions; s != NULL; s = s->next ) {
+        if( s->background ) {
+            background++;
+        } else {
+            streams++;
+        }
+    }
+    if( background > 0 ) {
+        reserved = ( streams == 0 ) ? gStreamerPaceMax :
+            gStreamerPaceMax / 100 * gStreamerBackgroundShare +
+            gStreamerPaceMax % 100 * gStreamerBackgroundShare / 100;
+    }
+
+    reserved += StreamerShareClass( FALSE, gStreamerPaceMax - reserved );
+    StreamerShareClass( TRUE, reserved );
+}
+
+/************************************************************************
+*	Function :	StreamerIoPriority
+*
+*	Parameters :
+*		IN int prio ;	I/O priority for the calling thread
+*
+*	Description :	Change the I/O priority of the calling thread, for
+*		the reads of background transfers.
+*
+*	Return : int ;
+*		the previous priority, to restore, or -1 if it is unchanged.
+************************************************************************/
+static int
+StreamerIoPriority( IN int prio )
+{
+#ifdef SYS_ioprio_set
+    int old = syscall( SYS_ioprio_get, STREAMER_IOPRIO_WHO_THREAD, 0 );
+
+    if( old < 0 || old == prio ||
+        syscall( SYS_ioprio_set, STREAMER_IOPRIO_WHO_THREAD, 0,
+                 prio ) != 0 ) {
+        return -1;
+    }
+    return old;
+#else
+    return -1;
+#endif
+}
+
+/************************************************************************
+*	Function :	StreamerPaceAllow
+*
+*	Parameters :
+*		IN stream_session *s ;	stream about to write
+*
+*	Description :	Refill the token bucket of the stream for the time
+*		elapsed. The stream waits for STREAMER_PACE_INTERVAL worth of
+*		its rate between writes; the bucket holds twice that, past the
+*		initial burst, so that waking up late loses nothing.
+*
+*	Return : size_t ;
+*		bytes the stream may write now, SIZE_MAX if it is not paced,
+*		0 if it has to wait for tokens.
+************************************************************************/
+static size_t
+StreamerPaceAllow( IN stream_session *s )
+{
+    size_t rate = __atomic_load_n( &s->paceShare, __ATOMIC_RELAXED );
+    long long now;
+    double quantum;
+
+    if( rate == 0 ) {
+        return SIZE_MAX;
+    }
+
+    now = StreamerNow();
+    quantum = ( double )rate * STREAMER_PACE_INTERVAL / 1000;
+    if( quantum < STREAMER_PACE_MIN_QUANTUM ) {
+        quantum = STREAMER_PACE_MIN_QUANTUM;
+    }
+    // what is left of the initial burst is not capped
+    if( s->paceTokens < 2 * quantum ) {
+        s->paceTokens += ( double )rate * ( now - s->paceStamp ) / 1e9;
+        if( s->paceTokens > 2 * quantum ) {
+            s->paceTokens = 2 * quantum;
+        }
+    }
+    s->paceStamp = now;
+
+    // not worth a write yet: wait for a full quantum
+    if( s->paceTokens < quantum / 2 ) {
+        s->paceWake = now +
+            ( long long )( ( quantum - s->paceTokens ) * 1e9 / rate );
+        return 0;
+    }
+
+    return ( size_t )s->paceTokens;
+}
+
+/************************************************************************
+*	Function :	StreamerPaceUse
+*
+*	Parameters :
+*		IN stream_session *s ;	stream that wrote
+*		IN size_t n ;			bytes written
+*
+*	Description :	Take what a paced stream wrote from its bucket.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerPaceUse( IN stream_session *s,
+                 IN size_t n )
+{
+    if( __atomic_load_n( &s->paceShare, __ATOMIC_RELAXED ) > 0 ) {
+        s->paceTokens -= n;
+    }
+}
+
+/************************************************************************
+*	Function :	StreamerPaceSleep
+*
+*	Parameters :
+*		IN stream_session *s ;	stream out of tokens
+*
+*	Description :	Set the stream aside until s->paceWake: its I/O
+*		thread sends on for it then.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerPaceSleep( IN stream_session *s )
+{
+    stream_session **p = &s->loop->paceHead;
+
+    while( *p != NULL && ( *p )->paceWake <= s->paceWake ) {
+        p = &( *p )->paceNext;
+    }
+    s->paceNext = *p;
+    *p = s;
+}
+
+#ifdef HAVE_IO_URING
+
+/************************************************************************
+*	Function :	StreamerRingClose
+*
+*	Parameters :
+*		INOUT stream_ring *r ;	ring, set up or not
+*
+*	Description :	Release a ring and its mappings.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerRingClose( INOUT stream_ring *r )
+{
+    if( r->sqes != NULL ) {
+        munmap( r->sqes, r->sqesSize );
+    }
+    if( r->cqMap != NULL && r->cqMap != r->sqMap ) {
+        munmap( r->cqMap, r->cqMapSize );
+    }
+    if( r->sqMap != NULL ) {
+        munmap( r->sqMap, r->sqMapSize );
+    }
+    if( r->fd >= 0 ) {
+        close( r->fd );
+    }
+    free( r->freeSlots );
+    memset( r, 0, sizeof( *r ) );
+    r->fd = -1;
+}
+
+/************************************************************************
+*	Function :	StreamerRingSetup
+*
+*	Parameters :
+*		OUT stream_ring *r ;	ring to set up
+*
+*	Description :	Create an io_uring of STREAMER_URING_DEPTH entries
+*		and map its queues. A sparse table of STREAMER_URING_BUFFERS
+*		buffers is registered too where the kernel allows it; reads
+*		go to unregistered buffers otherwise.
+*
+*	Return : int ;
+*		0 on success, -1 if io_uring is not available.
+************************************************************************/
+static int
+StreamerRingSetup( OUT stream_ring *r )
+{
+    struct io_uring_params p;
+    void *map;
+#ifdef IORING_RSRC_REGISTER_SPARSE
+    struct io_uring_rsrc_register reg;
+    int i;
+#endif
+
+    memset( r, 0, sizeof( *r ) );
+    memset( &p, 0, sizeof( p ) );
+    r->fd = syscall( __NR_io_uring_setup, STREAMER_URING_DEPTH, &p );
+    if( r->fd < 0 ) {
+        r->fd = -1;
+        return -1;
+    }
+
+    r->sqMapSize = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+    r->cqMapSize = p.cq_off.cqes +
+        p.cq_entries * sizeof( struct io_uring_cqe );
+    if( ( p.features & IORING_FEAT_SINGLE_MMAP ) &&
+        r->cqMapSize > r->sqMapSize ) {
+        r->sqMapSize = r->cqMapSize;
+    }
+
+    map = mmap( NULL, r->sqMapSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING );
+    if( map == MAP_FAILED ) {
+        goto error_handler;
+    }
+    r->sqMap = map;
+    if( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        r->cqMap = r->sqMap;
+    } else {
+        map = mmap( NULL, r->cqMapSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING );
+        if( map == MAP_FAILED ) {
+            goto error_handler;
+        }
+        r->cqMap = map;
+    }
+    r->sqesSize = p.sq_entries * sizeof( struct io_uring_sqe );
+    map = mmap( NULL, r->sqesSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES );
+    if( map == MAP_FAILED ) {
+        goto error_handler;
+    }
+    r->sqes = ( struct io_uring_sqe * )map;
+
+    r->sqHead = ( unsigned * )( ( char * )r->sqMap + p.sq_off.head );
+    r->sqTail = ( unsigned * )( ( char * )r->sqMap + p.sq_off.tail );
+    r->sqArray = ( unsigned * )( ( char * )r->sqMap + p.sq_off.array );
+    r->sqMask = *( unsigned * )( ( char * )r->sqMap + p.sq_off.ring_mask );
+    r->sqEntries = p.sq_entries;
+    r->cqHead = ( unsigned * )( ( char * )r->cqMap + p.cq_off.head );
+    r->cqTail = ( unsigned * )( ( char * )r->cqMap + p.cq_off.tail );
+    r->cqMask = *( unsigned * )( ( char * )r->cqMap + p.cq_off.ring_mask );
+    r->cqes = ( struct io_uring_cqe * )( ( char * )r->cqMap +
+                                         p.cq_off.cqes );
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+    memset( &reg, 0, sizeof( reg ) );
+    reg.nr = STREAMER_URING_BUFFERS;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    if( syscall( __NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS2,
+                 &reg, sizeof( reg ) ) == 0 ) {
+        r->freeSlots = ( int * )malloc( STREAMER_URING_BUFFERS *
+                                        sizeof( int ) );
+        if( r->freeSlots != NULL ) {
+            for( i = 0; i < STREAMER_URING_BUFFERS; i++ ) {
+                r->freeSlots[i] = STREAMER_URING_BUFFERS - 1 - i;
+            }
+            r->numFree = STREAMER_URING_BUFFERS;
+        }
+    }
+#endif
+
+    return 0;
+
+  error_handler:
+    StreamerRingClose( r );
+    return -1;
+}
+
+/************************************************************************
+*	Function :	StreamerRingSetBuffer
+*
+*	Parameters :
+*		IN stream_ring *r ;	ring
+*		IN int slot ;		registered buffer slot
+*		IN void *data ;		buffer, NULL to empty the slot
+*		IN size_t size ;	size of the buffer
+*
+*	Description :	Register a buffer in a slot of the ring, pinning
+*		its pages once instead of at every read.
+*
+*	Return : int ;
+*		0 on success, -1 on error.
+************************************************************************/
+static int
+StreamerRingSetBuffer( IN stream_ring *r,
+                       IN int slot,
+                       IN void *data,
+                       IN size_t size )
+{
+#ifdef IORING_RSRC_REGISTER_SPARSE
+    struct io_uring_rsrc_update2 up;
+    struct iovec iov;
+
+    iov.iov_base = data;
+    iov.iov_len = size;
+    memset( &up, 0, sizeof( up ) );
+    up.offset = slot;
+    up.data = ( uintptr_t ) & iov;
+    up.nr = 1;
+    return syscall( __NR_io_uring_register, r->fd,
+                    IORING_REGISTER_BUFFERS_UPDATE, &up,
+                    sizeof( up ) ) == 1 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+/************************************************************************
+*	Function :	StreamerRingAttach
+*
+*	Parameters :
+*		IN stream_session *s ;	stream read through the ring
+*
+*	Description :	Register the buffer of a stream in a free slot of
+*		the ring of its I/O thread, if any.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerRingAttach( IN stream_session *s )
+{
+    stream_ring *r = &s->loop->ring;
+
+    ithread_mutex_lock( &gStreamerMutex );
+    if( r->numFree > 0 ) {
+        s->slot = r->freeSlots[--r->numFree];
+    }
+    ithread_mutex_unlock( &gStreamerMutex );
+
+    if( s->slot >= 0 &&
+        StreamerRingSetBuffer( r, s->slot, s->bufMem,
+                               s->bufMemSize ) != 0 ) {
+        // out of locked memory, most likely
+        ithread_mutex_lock( &gStreamerMutex );
+        r->freeSlots[r->numFree++] = s->slot;
+        ithread_mutex_unlock( &gStreamerMutex );
+        s->slot = -1;
+    }
+}
+
+/************************************************************************
+*	Function :	StreamerRingDetach
+*
+*	Parameters :
+*		IN stream_session *s ;	stream no read is in progress for
+*
+*	Description :	Unregister the buffer of a stream and free its slot.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerRingDetach( IN stream_session *s )
+{
+    stream_ring *r = &s->loop->ring;
+
+    if( s->slot < 0 ) {
+        return;
+    }
+    StreamerRingSetBuffer( r, s->slot, NULL, 0 );
+    ithread_mutex_lock( &gStreamerMutex );
+    r->freeSlots[r->numFree++] = s->slot;
+    ithread_mutex_unlock( &gStreamerMutex );
+    s->slot = -1;
+}
+
+/************************************************************************
+*	Function :	StreamerRingQueue
+*
+*	Parameters :
+*		IN stream_session *s ;	stream, with its mutex held, whose
+*								next buffer is to be filled
+*
+*	Description :	Queue the read of the next buffer of a stream on
+*		the ring of its I/O thread, which must be the calling thread.
+*		The read is submitted with the others of the same round of
+*		events; it waits for a completion if STREAMER_URING_DEPTH reads
+*		are already in progress.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerRingQueue( IN stream_session *s )
+{
+    stream_ring *r = &s->loop->ring;
+    stream_buf *b = &s->bufs[s->fillIdx];
+    struct io_uring_sqe *sqe;
+    unsigned tail = *r->sqTail;
+    unsigned idx;
+    size_t n;
+
+    if( r->active >= r->sqEntries ||
+        tail - __atomic_load_n( r->sqHead, __ATOMIC_ACQUIRE ) >=
+        r->sqEntries ) {
+        s->deferNext = NULL;
+        if( r->deferTail != NULL ) {
+            r->deferTail->deferNext = s;
+        } else {
+            r->deferHead = s;
+        }
+        r->deferTail = s;
+        return;
+    }
+
+    n = b->capacity;
+    if( ( off_t ) n > s->remaining ) {
+        n = s->remaining;
+    }
+
+    idx = tail & r->sqMask;
+    sqe = &r->sqes[idx];
+    memset( sqe, 0, sizeof( *sqe ) );
+    if( s->slot >= 0 ) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = s->slot;
+    } else {
+        sqe->opcode = IORING_OP_READ;
+    }
+    sqe->fd = s->fd;
+    sqe->off = s->offset;
+    if( s->background ) {
+        sqe->ioprio = STREAMER_IOPRIO_BACKGROUND;
+    }
+    sqe->addr = ( uintptr_t ) b->data;
+    sqe->len = n;
+    sqe->user_data = ( uintptr_t ) s;
+    r->sqArray[idx] = idx;
+    __atomic_store_n( r->sqTail, tail + 1, __ATOMIC_RELEASE );
+
+    r->queued++;
+    r->active++;
+}
+
+/************************************************************************
+*	Function :	StreamerRingSubmit
+*
+*	Parameters :
+*		IN stream_ring *r ;	ring of the calling I/O thread
+*
+*	Description :	Submit the reads queued on a ring, in one system
+*		call. What the kernel does not take now is retried at the next
+*		round.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerRingSubmit( IN stream_ring *r )
+{
+    int ret;
+
+    while( r->queued > 0 ) {
+        ret = syscall( __NR_io_uring_enter, r->fd, r->queued, 0, 0,
+                       NULL, 0 );
+        if( ret < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( ret <= 0 ) {
+            break;
+        }
+        r->queued -= ret;
+    }
+}
+
+#endif /* HAVE_IO_URING */
+
+/************************************************************************
+*	Function :	StreamerKick
+*
+*	Parameters :
+*		IN stream_session *s ;	stream, with its mutex held
+*
+*	Description :	Start reading the next part of the file in a reader
+*		thread, or on the ring of the I/O thread, when there is room
+*		for it: an empty buffer, or less than half of the read-ahead
+*		window left ahead of sendfile.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerKick( IN stream_session *s )
+{
+    ThreadPoolJob job;
+
+    if( s->jobPending || s->eof || s->failed ) {
+        return;
+    }
+
+    if( s->source == STREAM_SRC_SENDFILE ) {
+        if( s->primed >= s->end ||
+            s->primed - s->offset > WEB_SERVER_BUF_SIZE / 2 ) {
+            return;
+        }
+    } else if( s->bufs[s->fillIdx].state != STREAM_BUF_EMPTY ) {
+        return;
+    } else {
+        s->bufs[s->fillIdx].state = STREAM_BUF_FILLING;
+    }
+
+#ifdef HAVE_IO_URING
+    if( s->source == STREAM_SRC_FD &&
+        gStreamerFileMode == STREAMER_FILE_URING ) {
+        s->jobPending = TRUE;
+        StreamerRingQueue( s );
+        return;
+    }
+#endif
+
+    TPJobInit( &job, ( start_routine ) StreamerRead, s );
+    // background reads wait for the others
+    TPJobSetPriority( &job, s->background ? LOW_PRIORITY : MED_PRIORITY );
+    // the pool must not be given jobs once it is shutting down
+    ithread_mutex_lock( &gStreamerMutex );
+    if( !gStreamerRunning ||
+        ThreadPoolAdd( &gStreamerThreadPool, &job, NULL ) != 0 ) {
+        s->failed = TRUE;
+    } else {
+        s->jobPending = TRUE;
+    }
+    ithread_mutex_unlock( &gStreamerMutex );
+}
+
+/************************************************************************
+*	Function :	StreamerFinish
+*
+*	Parameters :
+*		IN stream_session *s ;	stream no thread works for anymore
+*
+*	Description :	Release the stream and hand its connection back to
+*		its owner, reusable only if the response went out entirely.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerFinish( IN stream_session *s )
+{
+    int keepAlive = s->info.keepAlive && !s->failed;
+
+    epoll_ctl( s->loop->epfd, EPOLL_CTL_DEL, s->info.socket, NULL );
+    fcntl( s->info.socket, F_SETFL, s->sockFlags );
+    if( s->sockTos >= 0 ) {
+        setsockopt( s->info.socket, IPPROTO_IP, IP_TOS, &s->sockTos,
+                    sizeof( s->sockTos ) );
+    }
+
+    if( s->isVirtual ) {
+        virtualDirCallback.close( virtualDirCallback.cookie, s->fileHnd );
+    } else {
+        fclose( ( FILE * ) s->fileHnd );
+    }
+#ifdef HAVE_IO_URING
+    StreamerRingDetach( s );
+#endif
+    BufPoolPut( s->bufMem, s->bufMemSize );
+
+    ithread_mutex_lock( &gStreamerMutex );
+    if( s->prev != NULL ) {
+        s->prev->next = s->next;
+    } else {
+        gStreamerSessions = s->next;
+    }
+    if( s->next != NULL ) {
+        s->next->prev = s->prev;
+    }
+    StreamerShareBandwidth();
+    ithread_mutex_unlock( &gStreamerMutex );
+
+    dlnaPrintf( DLNA_INFO, HTTP, __FILE__, __LINE__,
+        "streamer %d: %s\n", s->info.socket,
+        s->failed ? "aborted" : "complete" );
+
+    s->info.streamDone( s->info.streamArg, keepAlive );
+
+    ithread_mutex_destroy( &s->mutex );
+    free( s->head );
+    free( s );
+}
+
+/************************************************************************
+*	Function :	StreamerReadDone
+*
+*	Parameters :
+*		IN stream_session *s ;	stream, with its mutex held
+*		IN off_t from ;			for sendfile, where the read ahead
+*								started
+*		IN size_t n ;			bytes asked for
+*		IN int num_read ;		result of the read into the buffer
+*								being filled
+*		IN const char *data ;	where the bytes read are
+*
+*	Description :	Account for a read that completed, and read on if
+*		the I/O thread is busy sending.
+*
+*	Return : int ;
+*		TRUE if the I/O thread waits for that read and must be woken.
+************************************************************************/
+static int
+StreamerReadDone( IN stream_session *s,
+                  IN off_t from,
+                  IN size_t n,
+                  IN int num_read,
+                  IN const char *data )
+{
+    stream_buf *b = &s->bufs[s->fillIdx];
+
+    if( s->source == STREAM_SRC_SENDFILE ) {
+        s->primed = from + n;
+    } else if( num_read < 0 ) {
+        b->state = STREAM_BUF_EMPTY;
+        s->failed = TRUE;
+    } else if( num_read == 0 ) {
+        // a file shorter than announced cannot complete the response
+        b->state = STREAM_BUF_EMPTY;
+        s->eof = TRUE;
+        if( s->remaining > 0 ) {
+            s->failed = TRUE;
+        }
+    } else {
+        b->start = data;
+        b->length = num_read;
+        b->state = STREAM_BUF_FULL;
+        s->fillIdx ^= 1;
+        if( s->source == STREAM_SRC_FD ) {
+            s->offset += num_read;
+        }
+        if( s->remaining >= 0 ) {
+            s->remaining -= num_read;
+            if( s->remaining == 0 ) {
+                s->eof = TRUE;
+            }
+        }
+    }
+    s->jobPending = FALSE;
+    if( s->waiting ) {
+        s->waiting = FALSE;
+        return TRUE;
+    }
+    // the I/O thread is still sending: read on meanwhile
+    StreamerKick( s );
+    return FALSE;
+}
+
+/************************************************************************
+*	Function :	StreamerRead
+*
+*	Parameters :
+*		IN void *arg ;	stream to read for
+*
+*	Description :	Reader thread job: fill the next buffer of the
+*		stream, or for sendfile have the next window of the file read
+*		into the page cache, so that the I/O threads never wait for
+*		the disk.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerRead( IN void *arg )
+{
+    stream_session *s = ( stream_session * ) arg;
+    stream_buf *b = NULL;
+    const char *data = NULL;
+    off_t from = 0;
+    size_t n;
+    int num_read = 0;
+    int resumed;
+    int wake;
+    int prio = -1;
+
+    // a read the application completed only has to be accounted for
+    ithread_mutex_lock( &gStreamerMutex );
+    resumed = ( s->asyncState == STREAM_ASYNC_DONE );
+    if( resumed ) {
+        num_read = s->asyncResult;
+        s->asyncState = STREAM_ASYNC_NONE;
+    }
+    ithread_mutex_unlock( &gStreamerMutex );
+
+    ithread_mutex_lock( &s->mutex );
+    if( s->source == STREAM_SRC_SENDFILE ) {
+        from = s->primed;
+        n = ( s->end - from > WEB_SERVER_BUF_SIZE ) ?
+            WEB_SERVER_BUF_SIZE : ( size_t )( s->end - from );
+    } else {
+        b = &s->bufs[s->fillIdx];
+        data = b->data;
+        from = s->offset;
+        n = b->capacity;
+        if( s->remaining >= 0 && ( off_t ) n > s->remaining ) {
+            n = s->remaining;
+        }
+    }
+    ithread_mutex_unlock( &s->mutex );
+
+    // the disk serves the other streams first
+    if( s->background && !resumed ) {
+        prio = StreamerIoPriority( STREAMER_IOPRIO_BACKGROUND );
+    }
+
+    if( resumed ) {
+        // read in the buffer being filled
+    } else if( s->source == STREAM_SRC_SENDFILE ) {
+        readahead( s->fd, from, n );
+    } else if( s->source == STREAM_SRC_FD ) {
+        do {
+            num_read = pread( s->fd, b->data, n, from );
+        } while( num_read < 0 && errno == EINTR );
+    } else if( s->isVirtual && virtualDirCallback.read_async ) {
+        // published first: the read may complete before returning
+        ithread_mutex_lock( &gStreamerMutex );
+        s->asyncState = STREAM_ASYNC_PENDING;
+        ithread_mutex_unlock( &gStreamerMutex );
+        num_read = virtualDirCallback.read_async( virtualDirCallback.cookie,
+                                                  s->fileHnd, b->data, n,
+                                                  &data );
+        if( num_read == DLNA_E_PENDING ) {
+            // StreamerReadComplete takes over, the stream may even be
+            // gone by now
+            if( prio >= 0 ) {
+                StreamerIoPriority( prio );
+            }
+            return;
+        }
+        ithread_mutex_lock( &gStreamerMutex );
+        s->asyncState = STREAM_ASYNC_NONE;
+        ithread_mutex_unlock( &gStreamerMutex );
+    } else if( s->isVirtual && virtualDirCallback.read_mapped ) {
+        num_read = virtualDirCallback.read_mapped( virtualDirCallback.cookie,
+                                                   s->fileHnd, b->data, n,
+                                                   &data );
+    } else if( s->isVirtual ) {
+        num_read = virtualDirCallback.read( virtualDirCallback.cookie,
+                                            s->fileHnd, b->data, n );
+    } else {
+        num_read = fread( b->data, 1, n, ( FILE * ) s->fileHnd );
+    }
+    if( prio >= 0 ) {
+        StreamerIoPriority( prio );
+    }
+
+    ithread_mutex_lock( &s->mutex );
+    wake = StreamerReadDone( s, from, n, num_read, data );
+    ithread_mutex_unlock( &s->mutex );
+
+    if( wake ) {
+        if( s->failed ) {
+            StreamerFinish( s );
+        } else {
+            StreamerArm( s );
+        }
+    }
+}
+
+/************************************************************************
+*	Function :	StreamerWriteOut
+*
+*	Parameters :
+*		IN stream_session *s ;	stream
+*		INOUT size_t *limit ;	bytes that may be written, decreased
+*								by the bytes written
+*
+*	Description :	Write as much as possible of the current segment
+*		without blocking, up to limit.
+*
+*	Return : int ;
+*		0 if the segment went out entirely, 1 if limit was reached
+*		first, -1 if the socket is full (EAGAIN), -2 on error.
+************************************************************************/
+static int
+StreamerWriteOut( IN stream_session *s,
+                  INOUT size_t *limit )
+{
+    struct msghdr msg;
+    struct iovec iov[3];
+    ssize_t num_written;
+    size_t room;
+    int i;
+
+    while( s->outCnt > 0 ) {
+        if( *limit == 0 ) {
+            return 1;
+        }
+        // the part of the segment within the limit
+        room = *limit;
+        memset( &msg, 0, sizeof( msg ) );
+        msg.msg_iov = iov;
+        for( i = 0; i < s->outCnt && room > 0; i++ ) {
+            iov[i] = s->out[s->outIdx + i];
+            if( iov[i].iov_len > room ) {
+                iov[i].iov_len = room;
+            }
+            room -= iov[i].iov_len;
+        }
+        msg.msg_iovlen = i;
+        num_written = sendmsg( s->info.socket, &msg, MSG_NOSIGNAL );
+        if( num_written == -1 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            return ( errno == EAGAIN || errno == EWOULDBLOCK ) ? -1 : -2;
+        }
+        *limit -= num_written;
+
+        // skip the buffers that went out entirely
+        while( s->outCnt > 0 &&
+               ( size_t )num_written >= s->out[s->outIdx].iov_len ) {
+            num_written -= s->out[s->outIdx].iov_len;
+            s->outIdx++;
+            s->outCnt--;
+        }
+        // and resume the partially sent one
+        if( s->outCnt > 0 ) {
+            s->out[s->outIdx].iov_base =
+                ( char * )s->out[s->outIdx].iov_base + num_written;
+            s->out[s->outIdx].iov_len -= num_written;
+        }
+    }
+
+    return 0;
+}
+
+/************************************************************************
+*	Function :	StreamerSend
+*
+*	Parameters :
+*		IN stream_session *s ;	stream whose socket became writable
+*
+*	Description :	Advance a stream as far as its socket and its read
+*		ahead allow: headers, then the file through sendfile or the
+*		read buffers (with chunk framing if needed), then the last
+*		chunk. Returns once the socket is full, the next part of the
+*		file is not read yet, or the response is complete.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerSend( IN stream_session *s )
+{
+    stream_buf *b;
+    ssize_t num_written;
+    size_t allowed;
+    size_t left;
+    size_t n;
+    int ret;
+
+    while( !s->failed ) {
+        if( s->outCnt > 0 ) {
+            allowed = StreamerPaceAllow( s );
+            if( allowed == 0 ) {
+                StreamerPaceSleep( s );
+                return;
+            }
+            left = allowed;
+            ret = StreamerWriteOut( s, &left );
+            StreamerPaceUse( s, allowed - left );
+            if( ret == 1 ) {
+                continue;
+            }
+            if( ret == -1 ) {
+                StreamerArm( s );
+                return;
+            }
+            if( ret == -2 ) {
+                s->failed = TRUE;
+                break;
+            }
+            if( s->outIsBuf ) {
+                ithread_mutex_lock( &s->mutex );
+                s->bufs[s->sendIdx].state = STREAM_BUF_EMPTY;
+                s->sendIdx ^= 1;
+                s->outIsBuf = FALSE;
+                StreamerKick( s );
+                ithread_mutex_unlock( &s->mutex );
+            }
+            continue;
+        }
+
+        if( s->source == STREAM_SRC_SENDFILE ) {
+            if( s->offset >= s->end ) {
+                break;
+            }
+            ithread_mutex_lock( &s->mutex );
+            StreamerKick( s );
+            if( s->offset >= s->primed ) {
+                // wait for the read ahead, unless it failed to start
+                if( s->jobPending ) {
+                    s->waiting = TRUE;
+                    ithread_mutex_unlock( &s->mutex );
+                    return;
+                }
+                ithread_mutex_unlock( &s->mutex );
+                continue;
+            }
+            n = s->primed - s->offset;
+            ithread_mutex_unlock( &s->mutex );
+
+            allowed = StreamerPaceAllow( s );
+            if( allowed == 0 ) {
+                StreamerPaceSleep( s );
+                return;
+            }
+            if( n > allowed ) {
+                n = allowed;
+            }
+            num_written = sendfile( s->info.socket, s->fd, &s->offset, n );
+            if( num_written > 0 ) {
+                StreamerPaceUse( s, num_written );
+            }
+            if( num_written == -1 ) {
+                if( errno == EINTR ) {
+                    continue;
+                }
+                if( errno == EAGAIN ) {
+                    StreamerArm( s );
+                    return;
+                }
+                s->failed = TRUE;
+            } else if( num_written == 0 ) {
+                // file got shorter
+                s->failed = TRUE;
+            }
+            continue;
+        }
+
+        ithread_mutex_lock( &s->mutex );
+        b = &s->bufs[s->sendIdx];
+        if( b->state == STREAM_BUF_FULL ) {
+            s->outIdx = 0;
+            s->outCnt = 0;
+            if( s->chunked ) {
+                sprintf( s->chunkHeader, "%x\r\n", ( unsigned )b->length );
+                s->out[s->outCnt].iov_base = s->chunkHeader;
+                s->out[s->outCnt].iov_len = strlen( s->chunkHeader );
+                s->outCnt++;
+            }
+            s->out[s->outCnt].iov_base = ( char * )b->start;
+            s->out[s->outCnt].iov_len = b->length;
+            s->outCnt++;
+            if( s->chunked ) {
+                s->out[s->outCnt].iov_base = "\r\n";
+                s->out[s->outCnt].iov_len = 2;
+                s->outCnt++;
+            }
+            s->outIsBuf = TRUE;
+            ithread_mutex_unlock( &s->mutex );
+            continue;
+        }
+        StreamerKick( s );
+        if( s->jobPending ) {
+            s->waiting = TRUE;
+            ithread_mutex_unlock( &s->mutex );
+            return;
+        }
+        ithread_mutex_unlock( &s->mutex );
+
+        if( s->failed ) {
+            break;
+        }
+        if( s->chunked && !s->trailerQueued ) {
+            s->out[0].iov_base = "0\r\n\r\n";
+            s->out[0].iov_len = strlen( "0\r\n\r\n" );
+            s->outIdx = 0;
+            s->outCnt = 1;
+            s->trailerQueued = TRUE;
+            continue;
+        }
+        // all sent
+        break;
+    }
+
+    ithread_mutex_lock( &s->mutex );
+    if( s->jobPending ) {
+        // the reader thread ends the stream when it is done
+        s->waiting = TRUE;
+        ithread_mutex_unlock( &s->mutex );
+        return;
+    }
+    ithread_mutex_unlock( &s->mutex );
+
+    StreamerFinish( s );
+}
+
+#ifdef HAVE_IO_URING
+
+/************************************************************************
+*	Function :	StreamerRingReap
+*
+*	Parameters :
+*		IN stream_ring *r ;	ring of the calling I/O thread
+*
+*	Description :	Complete the reads the ring is done with, sending
+*		on for the streams that were waiting for them, and queue the
+*		reads that were waiting for room.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerRingReap( IN stream_ring *r )
+{
+    struct io_uring_cqe *cqe;
+    stream_session *s;
+    unsigned head = *r->cqHead;
+    int num_read;
+    int wake;
+
+    while( head != __atomic_load_n( r->cqTail, __ATOMIC_ACQUIRE ) ) {
+        cqe = &r->cqes[head & r->cqMask];
+        s = ( stream_session * ) ( uintptr_t ) cqe->user_data;
+        num_read = cqe->res;
+        __atomic_store_n( r->cqHead, ++head, __ATOMIC_RELEASE );
+        r->active--;
+
+        ithread_mutex_lock( &s->mutex );
+        wake = StreamerReadDone( s, 0, 0, num_read,
+                                 s->bufs[s->fillIdx].data );
+        ithread_mutex_unlock( &s->mutex );
+        if( wake ) {
+            StreamerSend( s );
+        }
+
+        while( r->deferHead != NULL && r->active < r->sqEntries ) {
+            s = r->deferHead;
+            r->deferHead = s->deferNext;
+            if( r->deferHead == NULL ) {
+                r->deferTail = NULL;
+            }
+            ithread_mutex_lock( &s->mutex );
+            StreamerRingQueue( s );
+            ithread_mutex_unlock( &s->mutex );
+        }
+    }
+}
+
+/************************************************************************
+*	Function :	StreamerRingDrain
+*
+*	Parameters :
+*		IN stream_ring *r ;	ring no thread uses anymore
+*
+*	Description :	Wait for the reads in progress on a ring, so that
+*		their buffers can be released. The reads not submitted yet
+*		are dropped.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerRingDrain( IN stream_ring *r )
+{
+    stream_session *s;
+    unsigned head = *r->cqHead;
+
+    while( r->active > r->queued ) {
+        if( head == __atomic_load_n( r->cqTail, __ATOMIC_ACQUIRE ) ) {
+            if( syscall( __NR_io_uring_enter, r->fd, 0, 1,
+                         IORING_ENTER_GETEVENTS, NULL, 0 ) < 0 &&
+                errno != EINTR ) {
+                break;
+            }
+            continue;
+        }
+        s = ( stream_session * ) ( uintptr_t )
+            r->cqes[head & r->cqMask].user_data;
+        s->jobPending = FALSE;
+        __atomic_store_n( r->cqHead, ++head, __ATOMIC_RELEASE );
+        r->active--;
+    }
+}
+
+#endif /* HAVE_IO_URING */
+
+/************************************************************************
+*	Function :	StreamerLoop
+*
+*	Parameters :
+*		IN void *arg ;	I/O thread
+*
+*	Description :	Main loop of an I/O thread, run as a persistent job
+*		of the engine's thread pool until StreamerShutdown.
+*
+*	Return : void ;
+************************************************************************/
+static void
+StreamerLoop( IN void *arg )
+{
+    stream_loop *loop = ( stream_loop * ) arg;
+    struct epoll_event events[STREAMER_MAX_EVENTS];
+    sigset_t pipe_set;
+    sigset_t old_set;
+    struct timespec zero = { 0, 0 };
+    stream_session *s;
+    long long now;
+    int timeout = -1;
+    int wait;
+    int numEvents;
+    int i;
+
+    // sendfile has no MSG_NOSIGNAL: keep the SIGPIPE of a closed
+    // connection from reaching the application
+    sigemptyset( &pipe_set );
+    sigaddset( &pipe_set, SIGPIPE );
+    pthread_sigmask( SIG_BLOCK, &pipe_set, &old_set );
+
+    while( TRUE ) {
+#ifdef HAVE_IO_URING
+        // the reads queued by the last round of events, at once
+        if( loop->ring.queued > 0 ) {
+            StreamerRingSubmit( &loop->ring );
+        }
+        // retry soon what the kernel could not take
+        timeout = ( loop->ring.queued > 0 ) ? 10 : -1;
+#else
+        timeout = -1;
+#endif
+        // and wake up for the first paced stream due
+        if( loop->paceHead != NULL ) {
+            now = StreamerNow();
+            wait = ( loop->paceHead->paceWake <= now ) ? 0 :
+                ( int )( ( loop->paceHead->paceWake - now + 999999 ) /
+                         1000000 );
+            if( timeout < 0 || wait < timeout ) {
+                timeout = wait;
+            }
+        }
+        numEvents = epoll_wait( loop->epfd, events, STREAMER_MAX_EVENTS,
+                                timeout );
+        if( numEvents < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            dlnaPrintf( DLNA_CRITICAL, HTTP, __FILE__, __LINE__,
+                "Error in epoll_wait call!\n" );
+            isleep( 1 );
+            continue;
+        }
+
+        for( i = 0; i < numEvents; i++ ) {
+            if( events[i].data.ptr == loop ) {
+                goto exit_function;
+            }
+#ifdef HAVE_IO_URING
+            if( events[i].data.ptr == &loop->ring ) {
+                StreamerRingReap( &loop->ring );
+                continue;
+            }
+#endif
+            StreamerSend( ( stream_session * ) events[i].data.ptr );
+        }
+
+        now = StreamerNow();
+        while( loop->paceHead != NULL && loop->paceHead->paceWake <= now ) {
+            s = loop->paceHead;
+            loop->paceHead = s->paceNext;
+            StreamerSend( s );
+        }
+    }
+
+  exit_function:
+    if( !sigismember( &old_set, SIGPIPE ) ) {
+        while( sigtimedwait( &pipe_set, NULL, &zero ) > 0 ||
+               errno == EINTR ) ;
+    }
+    pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+}
+
+/************************************************************************
+*	Function :	StreamerInit
+*
+*	Parameters :	void
+*
+*	Description :	Start the streaming engine: STREAMER_IO_THREADS
+*		threads writing to the sockets of the streams as they become
+*		writable, and STREAMER_READ_THREADS threads reading the files
+*		ahead of them. Only available where epoll is. Built with
+*		io_uring, the files with a descriptor are read through a ring
+*		per I/O thread instead of sent with sendfile, or by the reader
+*		threads with pread if the kernel has no io_uring.
+*
+*	Return : int ;
+*		DLNA_E_SUCCESS
+*		DLNA_E_INIT_FAILED - no engine on this system, or it could
+*			not be started
+************************************************************************/
+int
+StreamerInit( void )
+{
+    ThreadPoolAttr attr;
+    ThreadPoolJob job;
+    struct epoll_event ev;
+    int i;
+
+    if( gStreamerRunning ) {
+        return DLNA_E_SUCCESS;
+    }
+
+    for( i = 0; i < STREAMER_IO_THREADS; i++ ) {
+        gStreamerLoops[i].epfd = -1;
+        gStreamerLoops[i].wakeFd = -1;
+        gStreamerLoops[i].paceHead = NULL;
+#ifdef HAVE_IO_URING
+        gStreamerLoops[i].ring.fd = -1;
+#endif
+    }
+
+#ifdef HAVE_IO_URING
+    gStreamerFileMode = ( STREAMER_URING_DEPTH > 0 ) ?
+        STREAMER_FILE_URING : STREAMER_FILE_SENDFILE;
+    if( gStreamerFileMode == STREAMER_FILE_URING ) {
+        for( i = 0; i < STREAMER_IO_THREADS; i++ ) {
+            if( StreamerRingSetup( &gStreamerLoops[i].ring ) != 0 ) {
+                break;
+            }
+        }
+        if( i < STREAMER_IO_THREADS ) {
+            while( i-- > 0 ) {
+                StreamerRingClose( &gStreamerLoops[i].ring );
+            }
+            gStreamerFileMode = STREAMER_FILE_PREAD;
+            dlnaPrintf( DLNA_INFO, HTTP, __FILE__, __LINE__,
+                "streamer: no io_uring, files read with pread\n" );
+        }
+    }
+#endif
+
+    TPAttrInit( &attr );
+    TPAttrSetMaxThreads( &attr,
+                         STREAMER_IO_THREADS + STREAMER_READ_THREADS );
+    TPAttrSetMinThreads( &attr, STREAMER_IO_THREADS + 1 );
+    TPAttrSetJobsPerThread( &attr, JOBS_PER_THREAD );
+    TPAttrSetIdleTime( &attr, THREAD_IDLE_TIME );
+    // one read job at most per stream
+    TPAttrSetMaxJobsTotal( &attr, INT_MAX );
+    if( ThreadPoolInit( &gStreamerThreadPool, &attr ) != 0 ) {
+        return DLNA_E_INIT_FAILED;
+    }
+
+    // kept once created: late callers may still check gStreamerRunning
+    if( !gStreamerMutexInit ) {
+        ithread_mutex_init( &gStreamerMutex, NULL );
+        gStreamerMutexInit = TRUE;
+    }
+
+    for( i = 0; i < STREAMER_IO_THREADS; i++ ) {
+        stream_loop *loop = &gStreamerLoops[i];
+
+        loop->epfd = epoll_create( STREAMER_MAX_EVENTS );
+        loop->wakeFd = eventfd( 0, 0 );
+        if( loop->epfd < 0 || loop->wakeFd < 0 ) {
+            goto error_handler;
+        }
+        fcntl( loop->epfd, F_SETFD, FD_CLOEXEC );
+        fcntl( loop->wakeFd, F_SETFD, FD_CLOEXEC );
+
+        memset( &ev, 0, sizeof( ev ) );
+        ev.events = EPOLLIN;
+        ev.data.ptr = loop;
+        if( epoll_ctl( loop->epfd, EPOLL_CTL_ADD, loop->wakeFd, &ev ) != 0 ) {
+            goto error_handler;
+        }
+#ifdef HAVE_IO_URING
+        // readable once reads complete
+        if( loop->ring.fd >= 0 ) {
+            ev.data.ptr = &loop->ring;
+            if( epoll_ctl( loop->epfd, EPOLL_CTL_ADD, loop->ring.fd,
+                           &ev ) != 0 ) {
+                goto error_handler;
+            }
+        }
+#endif
+
+        TPJobInit( &job, ( start_routine ) StreamerLoop, loop );
+        TPJobSetPriority( &job, MED_PRIORITY );
+        if( ThreadPoolAddPersistent( &gStreamerThreadPool, &job,
+                                     NULL ) != 0 ) {
+            goto error_handler;
+        }
+    }
+
+    gStreamerRunning = TRUE;
+    return DLNA_E_SUCCESS;
+
+  error_handler:
+    for( i = 0; i < STREAMER_IO_THREADS; i++ ) {
+        if( gStreamerLoops[i].wakeFd >= 0 ) {
+            eventfd_write( gStreamerLoops[i].wakeFd, 1 );
+        }
+    }
+    ThreadPoolShutdown( &gStreamerThreadPool );
+    for( i = 0; i < STREAMER_IO_THREADS; i++ ) {
+        if( gStreamerLoops[i].epfd >= 0 ) {
+            close( gStreamerLoops[i].epfd );
+        }
+        if( gStreamerLoops[i].wakeFd >= 0 ) {
+            close( gStreamerLoops[i].wakeFd );
+        }
+#ifdef HAVE_IO_URING
+        StreamerRingClose( &gStreamerLoops[i].ring );
+#endif
+    }
+
+    return DLNA_E_INIT_FAILED;
+}
+
+/************************************************************************
+*	Function :	StreamerShutdown
+*
+*	Parameters :	void
+*
+*	Description :	Stop the streaming engine. The streams still running
+*		are aborted and their connections handed back as not
+*		reusable.
+*
+*	Return : void ;
+************************************************************************/
+void
+StreamerShutdown( void )
+{
+    int i;
+
+    if( !gStreamerRunning ) {
+        return;
+    }
+
+    ithread_mutex_lock( &gStreamerMutex );
+    gStreamerRunning = FALSE;
+    ithread_mutex_unlock( &gStreamerMutex );
+
+    for( i = 0; i < STREAMER_IO_THREADS; i++ ) {
+        eventfd_write( gStreamerLoops[i].wakeFd, 1 );
+    }
+    // waits for the I/O threads and the reads in progress; the reads
+    // not started are dropped
+    ThreadPoolShutdown( &gStreamerThreadPool );
+#ifdef HAVE_IO_URING
+    for( i = 0; i < STREAMER_IO_THREADS; i++ ) {
+        StreamerRingDrain( &gStreamerLoops[i].ring );
+    }
+#endif
+
+    // no thread is left to run the remaining streams
+    while( gStreamerSessions != NULL ) {
+        gStreamerSessions->failed = TRUE;
+        StreamerFinish( gStreamerSessions );
+    }
+
+    for( i = 0; i < STREAMER_IO_THREADS; i++ ) {
+        close( gStreamerLoops[i].epfd );
+        close( gStreamerLoops[i].wakeFd );
+#ifdef HAVE_IO_URING
+        StreamerRingClose( &gStreamerLoops[i].ring );
+#endif
+    }
+}
+
+/************************************************************************
+*	Function :	StreamerSubmit
+*
+*	Parameters :
+*		INOUT SOCKINFO *info ;	connection, with streamDone set
+*		IN struct iovec *head ;	buffers to send first (headers)
+*		IN int headCnt ;		number of buffers in head
+*		IN void *fileHnd ;		open file, positioned where to start
+*		IN int isVirtual ;		TRUE if fileHnd is a virtual dir handle,
+*								FALSE if it is a FILE *
+*		IN int fd ;				descriptor to read from, -1 to read
+*								through fileHnd
+*		IN off_t offset ;		where to start in fd
+*		IN off_t length ;		bytes to send, -1 to send until EOF
+*		IN int chunked ;		TRUE to use chunked transfer coding
+*		IN size_t bufSize ;		size wanted for the read buffer, at most
+*								STREAMER_BUF_SIZE
+*		IN size_t rate ;		rate to pace the stream at, in bytes/s,
+*								0 to send as fast as possible
+*		IN int background ;		TRUE for a background transfer, which
+*								yields the disk and the bandwidth to
+*								the other streams
+*
+*	Description :	Hand the rest of a response over to the streaming
+*		engine. On success the engine owns fileHnd and the connection,
+*		info->detached is set, and info->streamDone is called once
+*		the response is complete (or failed). The head buffers are
+*		copied and may be released as soon as this returns.
+*
+*	Return : int ;
+*		DLNA_E_SUCCESS
+*		DLNA_E_INTERNAL_ERROR - engine not running
+*		DLNA_E_OUTOF_MEMORY
+*		Nothing was sent and the caller still owns fileHnd on error.
+************************************************************************/
+int
+StreamerSubmit( INOUT SOCKINFO *info,
+                IN struct iovec *head,
+                IN int headCnt,
+                IN void *fileHnd,
+                IN int isVirtual,
+                IN int fd,
+                IN off_t offset,
+                IN off_t length,
+                IN int chunked,
+                IN size_t bufSize,
+                IN size_t rate,
+                IN int background )
+{
+    stream_session *s;
+    struct epoll_event ev;
+    socklen_t tosLength = sizeof( int );
+    int tos = STREAMER_TOS_BACKGROUND;
+    struct stat st;
+    size_t headLength = 0;
+    int i;
+
+    if( !gStreamerRunning || info->streamDone == NULL ) {
+        return DLNA_E_INTERNAL_ERROR;
+    }
+
+    s = ( stream_session * ) calloc( 1, sizeof( stream_session ) );
+    if( s == NULL ) {
+        return DLNA_E_OUTOF_MEMORY;
+    }
+
+    for( i = 0; i < headCnt; i++ ) {
+        headLength += head[i].iov_len;
+    }
+    if( headLength > 0 ) {
+        s->head = ( char * ) malloc( headLength );
+        if( s->head == NULL ) {
+            free( s );
+            return DLNA_E_OUTOF_MEMORY;
+        }
+        headLength = 0;
+        for( i = 0; i < headCnt; i++ ) {
+            memcpy( s->head + headLength, head[i].iov_base,
+                    head[i].iov_len );
+            headLength += head[i].iov_len;
+        }
+        s->out[0].iov_base = s->head;
+        s->out[0].iov_len = headLength;
+        s->outCnt = 1;
+    }
+
+    // sendfile is only sure to work from regular files, and the reads
+    // from the descriptor need a known length
+    if( fd >= 0 && ( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) ||
+                     length < 0 ) ) {
+        fd = -1;
+    }
+    if( fd < 0 ) {
+        s->source = STREAM_SRC_HANDLE;
+    } else if( gStreamerFileMode == STREAMER_FILE_SENDFILE ) {
+        s->source = STREAM_SRC_SENDFILE;
+    } else {
+        s->source = STREAM_SRC_FD;
+    }
+#ifdef HAVE_IO_URING
+    s->slot = -1;
+#endif
+
+    if( s->source != STREAM_SRC_SENDFILE ) {
+        // one pool buffer, split in two halves read and sent in turn
+        if( bufSize > STREAMER_BUF_SIZE ) {
+            bufSize = STREAMER_BUF_SIZE;
+        }
+        s->bufMem = BufPoolGet( bufSize, &s->bufMemSize );
+        if( s->bufMem == NULL ) {
+            free( s->head );
+            free( s );
+            return DLNA_E_OUTOF_MEMORY;
+        }
+        s->bufs[0].data = s->bufMem;
+        s->bufs[0].capacity = s->bufMemSize / 2;
+        s->bufs[1].data = s->bufMem + s->bufs[0].capacity;
+        s->bufs[1].capacity = s->bufMemSize - s->bufs[0].capacity;
+    }
+
+    s->info = *info;
+    s->fileHnd = fileHnd;
+    s->isVirtual = isVirtual;
+    s->fd = fd;
+    s->offset = offset;
+    s->end = offset + length;
+    s->primed = offset;
+    s->remaining = length;
+    s->chunked = chunked;
+    s->eof = ( length == 0 );
+    s->background = background;
+    s->paceRate = rate;
+    s->paceStamp = StreamerNow();
+    ithread_mutex_init( &s->mutex, NULL );
+
+    s->sockFlags = fcntl( info->socket, F_GETFL );
+    if( s->sockFlags == -1 ||
+        fcntl( info->socket, F_SETFL, s->sockFlags | O_NONBLOCK ) == -1 ) {
+        goto error_handler;
+    }
+    // and the network, where it looks at DSCP
+    s->sockTos = -1;
+    if( background &&
+        getsockopt( info->socket, IPPROTO_IP, IP_TOS, &s->sockTos,
+                    &tosLength ) == 0 &&
+        setsockopt( info->socket, IPPROTO_IP, IP_TOS, &tos,
+                    sizeof( tos ) ) != 0 ) {
+        s->sockTos = -1;
+    }
+
+    ithread_mutex_lock( &gStreamerMutex );
+    s->loop = &gStreamerLoops[gStreamerNextLoop];
+    // registered disarmed: StreamerArm() starts the stream
+    memset( &ev, 0, sizeof( ev ) );
+    ev.events = EPOLLONESHOT;
+    ev.data.ptr = s;
+    if( !gStreamerRunning ||
+        epoll_ctl( s->loop->epfd, EPOLL_CTL_ADD, info->socket, &ev ) != 0 ) {
+        ithread_mutex_unlock( &gStreamerMutex );
+        fcntl( info->socket, F_SETFL, s->sockFlags );
+        if( s->sockTos >= 0 ) {
+            setsockopt( info->socket, IPPROTO_IP, IP_TOS, &s->sockTos,
+                        sizeof( s->sockTos ) );
+        }
+        goto error_handler;
+    }
+    gStreamerNextLoop = ( gStreamerNextLoop + 1 ) % STREAMER_IO_THREADS;
+    s->next = gStreamerSessions;
+    if( gStreamerSessions != NULL ) {
+        gStreamerSessions->prev = s;
+    }
+    gStreamerSessions = s;
+    s->paceTokens = gStreamerPaceBurst;
+    StreamerShareBandwidth();
+    ithread_mutex_unlock( &gStreamerMutex );
+
+    info->detached = TRUE;
+    dlnaPrintf( DLNA_INFO, HTTP, __FILE__, __LINE__,
+        "streamer %d: started\n", info->socket );
+
+#ifdef HAVE_IO_URING
+    if( s->source == STREAM_SRC_FD &&
+        gStreamerFileMode == STREAMER_FILE_URING ) {
+        // only the I/O thread queues on its ring: it starts reading
+        // once the headers are out
+        StreamerRingAttach( s );
+        StreamerArm( s );
+        return DLNA_E_SUCCESS;
+    }
+#endif
+
+    // start reading right away, the headers go out meanwhile
+    ithread_mutex_lock( &s->mutex );
+    StreamerKick( s );
+    ithread_mutex_unlock( &s->mutex );
+    StreamerArm( s );
+
+    return DLNA_E_SUCCESS;
+
+  error_handler:
+    ithread_mutex_destroy( &s->mutex );
+    BufPoolPut( s->bufMem, s->bufMemSize );
+    free( s->head );
+    free( s );
+    return DLNA_E_INTERNAL_ERROR;
+}
+
+/************************************************************************
+*	Function :	StreamerReadComplete
+*
+*	Parameters :
+*		IN void *fileHnd ;	virtual dir handle of the stream
+*		IN int result ;		result of the read
+*
+*	Description :	Finish the read left pending by the read_async
+*		callback on fileHnd: a reader thread accounts for it and sends
+*		on, as for a read it made itself.
+*
+*	Return : int ;
+*		DLNA_E_SUCCESS
+*		DLNA_E_NOT_FOUND - no read pending on fileHnd
+************************************************************************/
+int
+StreamerReadComplete( IN void *fileHnd,
+                      IN int result )
+{
+    stream_session *s;
+    ThreadPoolJob job;
+
+    ithread_mutex_lock( &gStreamerMutex );
+    for( s = gStreamerSessions; s != NULL; s = s->next ) {
+        if( s->isVirtual && s->fileHnd == fileHnd &&
+            s->asyncState == STREAM_ASYNC_PENDING ) {
+            break;
+        }
+    }
+    // once shutting down, the stream is aborted along with the others
+    if( s == NULL || !gStreamerRunning ) {
+        ithread_mutex_unlock( &gStreamerMutex );
+        return DLNA_E_NOT_FOUND;
+    }
+
+    s->asyncResult = result;
+    s->asyncState = STREAM_ASYNC_DONE;
+    TPJobInit( &job, ( start_routine ) StreamerRead, s );
+    TPJobSetPriority( &job, s->background ? LOW_PRIORITY : MED_PRIORITY );
+    if( ThreadPoolAdd( &gStreamerThreadPool, &job, NULL ) != 0 ) {
+        // no thread available: account for it in the caller's
+        ithread_mutex_unlock( &gStreamerMutex );
+        StreamerRead( s );
+        return DLNA_E_SUCCESS;
+    }
+    ithread_mutex_unlock( &gStreamerMutex );
+
+    return DLNA_E_SUCCESS;
+}
+
+/************************************************************************
+*	Function :	StreamerSetPacing
+*
+*	Parameters :
+*		IN size_t burst ;	bytes a paced stream may send at once when
+*							it starts
+*		IN size_t maxRate ;	cap on the rate of all streams together, in
+*							bytes/s, 0 for none
+*
+*	Description :	Change the pacing settings. The cap is shared again
+*		between the streams in progress right away, the burst only
+*		applies to the streams to come.
+*
+*	Return : void ;
+************************************************************************/
+void
+StreamerSetPacing( IN size_t burst,
+                   IN size_t maxRate )
+{
+    if( !gStreamerMutexInit ) {
+        gStreamerPaceBurst = burst;
+        gStreamerPaceMax = maxRate;
+        return;
+    }
+
+    ithread_mutex_lock( &gStreamerMutex );
+    gStreamerPaceBurst = burst;
+    gStreamerPaceMax = maxRate;
+    StreamerShareBandwidth();
+    ithread_mutex_unlock( &gStreamerMutex );
+}
+
+/************************************************************************
+*	Function :	StreamerSetBackgroundShare
+*
+*	Parameters :
+*		IN unsigned int percent ;	part of the global cap kept for the
+*									background transfers
+*
+*	Description :	Change the part of the global rate cap the
+*		background transfers are sure to get while other streams run,
+*		and share the cap again between the streams in progress.
+*
+*	Return : void ;
+************************************************************************/
+void
+StreamerSetBackgroundShare( IN unsigned int percent )
+{
+    if( percent > 100 ) {
+        percent = 100;
+    }
+
+    if( !gStreamerMutexInit ) {
+        gStreamerBackgroundShare = percent;
+        return;
+    }
+
+    ithread_mutex_lock( &gStreamerMutex );
+    gStreamerBackgroundShare = percent;
+    StreamerShareBandwidth();
+    ithread_mutex_unlock( &gStreamerMutex );
+}
+
+#else /* __linux__ */
+
+int
+StreamerInit( void )
+{
+    return DLNA_E_INIT_FAILED;
+}
+
+void
+StreamerShutdown( void )
+{
+}
+
+int
+StreamerSubmit( INOUT SOCKINFO *info,
+                IN struct iovec *head,
+                IN int headCnt,
+                IN void *fileHnd,
+                IN int isVirtual,
+                IN int fd,
+                IN off_t offset,
+                IN off_t length,
+                IN int chunked,
+                IN size_t bufSize,
+                IN size_t rate,
+                IN int background )
+{
+    return DLNA_E_INTERNAL_ERROR;
+}
+
+int
+StreamerReadComplete( IN void *fileHnd,
+                      IN int result )
+{
+    return DLNA_E_NOT_FOUND;
+}
+
+void
+StreamerSetPacing( IN size_t burst,
+                   IN size_t maxRate )
+{
+}
+
+void
+StreamerSetBackgroundShare( IN unsigned int percent )
+{
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2000-2003 Intel Corporation 
+// All rights reserved. 
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met: 
+//
+// * Redistributions of source code must retain the above copyright notice, 
+// this list of conditions and the following disclaimer. 
+// * Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution. 
+// * Neither name of Intel Corporation nor the names of its contributors 
+// may be used to endorse or promote products derived from this software 
+// without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef GENLIB_NET_HTTP_STREAMER_H
+#define GENLIB_NET_HTTP_STREAMER_H
+
+#include <sys/types.h>
+#include "sock.h"
+
+//--------------------------------------------------
+//////////////// functions /////////////////////////
+//--------------------------------------------------
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/************************************************************************
+*	Function :	StreamerInit
+*
+*	Parameters :	void
+*
+*	Description :	Start the streaming engine: STREAMER_IO_THREADS
+*		threads writing to the sockets of the streams as they become
+*		writable, and STREAMER_READ_THREADS threads reading the files
+*		ahead of them. Only available where epoll is.
+*
+*	Return : int ;
+*		DLNA_E_SUCCESS
+*		DLNA_E_INIT_FAILED - no engine on this system, or it could
+*			not be started
+************************************************************************/
+int StreamerInit( void );
+
+/************************************************************************
+*	Function :	StreamerShutdown
+*
+*	Parameters :	void
+*
+*	Description :	Stop the streaming engine. The streams still running
+*		are aborted and their connections handed back as not
+*		reusable.
+*
+*	Return : void ;
+************************************************************************/
+void StreamerShutdown( void );
+
+/************************************************************************
+*	Function :	StreamerSubmit
+*
+*	Parameters :
+*		INOUT SOCKINFO *info ;	connection, with streamDone set
+*		IN struct iovec *head ;	buffers to send first (headers)
+*		IN int headCnt ;		number of buffers in head
+*		IN void *fileHnd ;		open file, positioned where to start
+*		IN int isVirtual ;		TRUE if fileHnd is a virtual dir handle,
+*								FALSE if it is a FILE *
+*		IN int fd ;				descriptor to read from, -1 to read
+*								through fileHnd
+*		IN off_t offset ;		where to start in fd
+*		IN off_t length ;		bytes to send, -1 to send until EOF
+*		IN int chunked ;		TRUE to use chunked transfer coding
+*		IN size_t bufSize ;		size wanted for the read buffer, at most
+*								STREAMER_BUF_SIZE
+*		IN size_t rate ;		rate to pace the stream at, in bytes/s,
+*								0 to send as fast as possible
+*		IN int background ;		TRUE for a background transfer, which
+*								yields the disk and the bandwidth to
+*								the other streams
+*
+*	Description :	Hand the rest of a response over to the streaming
+*		engine. On success the engine owns fileHnd and the connection,
+*		info->detached is set, and info->streamDone is called once
+*		the response is complete (or failed). The head buffers are
+*		copied and may be released as soon as this returns.
+*
+*	Return : int ;
+*		DLNA_E_SUCCESS
+*		DLNA_E_INTERNAL_ERROR - engine not running
+*		DLNA_E_OUTOF_MEMORY
+*		Nothing was sent and the caller still owns fileHnd on error.
+************************************************************************/
+int StreamerSubmit( INOUT SOCKINFO *info,
+                    IN struct iovec *head,
+                    IN int headCnt,
+                    IN void *fileHnd,
+                    IN int isVirtual,
+                    IN int fd,
+                    IN off_t offset,
+                    IN off_t length,
+                    IN int chunked,
+                    IN size_t bufSize,
+                    IN size_t rate,
+                    IN int background );
+
+/************************************************************************
+*	Function :	StreamerReadComplete
+*
+*	Parameters :
+*		IN void *fileHnd ;	virtual dir handle of the stream
+*		IN int result ;		result of the read
+*
+*	Description :	Finish the read left pending by the read_async
+*		callback on fileHnd, and resume its stream.
+*
+*	Return : int ;
+*		DLNA_E_SUCCESS
+*		DLNA_E_NOT_FOUND - no read pending on fileHnd
+************************************************************************/
+int StreamerReadComplete( IN void *fileHnd,
+                          IN int result );
+
+/************************************************************************
+*	Function :	StreamerSetPacing
+*
+*	Parameters :
+*		IN size_t burst ;	bytes a paced stream may send at once when
+*							it starts
+*		IN size_t maxRate ;	cap on the rate of all streams together, in
+*							bytes/s, 0 for none
+*
+*	Description :	Change the pacing settings. The cap is shared again
+*		between the streams in progress right away, the burst only
+*		applies to the streams to come.
+*
+*	Return : void ;
+************************************************************************/
+void StreamerSetPacing( IN size_t burst,
+                        IN size_t maxRate );
+
+/************************************************************************
+*	Function :	StreamerSetBackgroundShare
+*
+*	Parameters :
+*		IN unsigned int percent ;	part of the global cap kept for the
+*									background transfers
+*
+*	Description :	Change the part of the global rate cap the
+*		background transfers are sure to get while other streams run.
+*		They also get what the other streams leave, and the whole cap
+*		when they are alone. Applies to the streams in progress right
+*		away.
+*
+*	Return : void ;
+************************************************************************/
+void StreamerSetBackgroundShare( IN unsigned int percent );
+
+#ifdef __cplusplus
+}	// extern "C"
+#endif	// __cplusplus
+
+#endif // GENLIB_NET_HTTP_STREAMER_H
@@ -403,6 +403,15 @@
 #define DLNA_E_CANCELED         -210
 /*! @} */
 
+/** @name DLNA_E_PENDING [-211]
+ *  {\tt DLNA_E_PENDING} is returned by a virtual directory callback to
+ *  signify that the operation goes on after the callback returned and
+ *  is completed later.
+ */
+/*! @{ */
+#define DLNA_E_PENDING          -211
+/*! @} */
+
 #define DLNA_E_EVENT_PROTOCOL         -300
 
 /** @name DLNA_E_SUBSCRIBE_UNACCEPTED [-301]
@@ -933,6 +942,18 @@ struct File_Info
    
   DOMString content_type;
 
+  /** The rate, in bytes per second, to pace the sending of the file
+   *  at, or 0 to send it as fast as the network allows. The web server
+   *  sets it to 0 before asking for the information. */
+  size_t pace_rate;
+
+  /** If the file is still being written, contains a non-zero value: 
+   *  {\bf file_length} is then only what there is so far. The file is
+   *  sent up to the end reads find, chunked to HTTP/1.1 clients, and
+   *  ranges are answered within what there is. The web server sets it
+   *  to 0 before asking for the information. */
+  int is_growing;
+
 };
 
 /* The type of handle returned by the web server for open requests. */
@@ -1037,6 +1058,86 @@ struct dlnaVirtualDirCallbacks
      IN dlnaWebFileHandle fileHnd   /** The handle of the file to close. */
      );
 
+   /** Optional. Called by the web server after {\bf open} and {\bf seek}
+    *  to find out whether the file content can be sent straight from a
+    *  file descriptor (zero-copy). It should return the descriptor and
+    *  store the current file position in {\bf offset}, or return -1 if
+    *  the data has to go through {\bf read}. The descriptor stays owned
+    *  by the file handle and is released by {\bf close}.
+    */
+   int (*get_fd) (
+     IN void *cookie,
+     IN dlnaWebFileHandle fileHnd,  /** The handle of the open file. */
+     OUT off_t *offset              /** The current position in the file. */
+     );
+
+   /** Optional. Called by the web server instead of {\bf get_info} and
+    *  {\bf open} for a GET request, so that the file is resolved and
+    *  opened once. It should fill {\bf info} like {\bf get_info} and
+    *  return a handle like {\bf open} in {\tt DLNA_READ} mode. When it
+    *  returns {\tt NULL}, nothing is allocated in {\bf info} and the web
+    *  server goes through {\bf get_info} and {\bf open} as usual, which
+    *  is also how directories and errors are reported.
+    */
+   dlnaWebFileHandle (*open_info) (
+     IN void *cookie,
+     IN const char *filename,       /** The name of the file to open. */
+     OUT struct File_Info *info     /** Pointer to a structure to store the 
+                                        information on the file. */
+     );
+
+   /** Optional. Called by the web server instead of {\bf read}. It
+    *  behaves like {\bf read}, except that it may leave {\bf buf} alone
+    *  and point {\bf data} at the content in memory it keeps until the
+    *  file is closed, saving a copy. {\bf data} is set to where the bytes
+    *  read are in either case.
+    */
+   int (*read_mapped) (
+     IN void *cookie,
+     IN dlnaWebFileHandle fileHnd,  /** The handle of the file to read. */
+     IN char *buf,                  /** A buffer the data may be read in. */
+     IN size_t buflen,              /** The size of the buffer (i.e. the 
+                                        number of bytes to read). */
+     OUT const char **data          /** Where the bytes read are. */
+     );
+
+   /** Optional. Called by the streaming engine instead of
+    *  {\bf read_mapped}, which it otherwise behaves like. It may also
+    *  return {\tt DLNA_E_PENDING} to finish the read later, from any
+    *  thread, with {\bf dlnaWebFileReadComplete}; the data is then read
+    *  in {\bf buf}, which stays reserved until then. The stream is set
+    *  aside meanwhile and no thread waits for the read. A handle has one
+    *  read pending at most. Closing the handle cancels the read, and
+    *  {\bf buf} must not be written to once {\bf close} returns.
+    */
+   int (*read_async) (
+     IN void *cookie,
+     IN dlnaWebFileHandle fileHnd,  /** The handle of the file to read. */
+     IN char *buf,                  /** A buffer the data may be read in. */
+     IN size_t buflen,              /** The size of the buffer (i.e. the 
+                                        number of bytes to read). */
+     OUT const char **data          /** Where the bytes read are. */
+     );
+
+   /** Optional. Called by the web server to answer a request with a
+    *  {\tt TimeSeekRange.dlna.org} header. It should store the bytes to
+    *  send to play the file from {\bf start} to {\bf end} (both in ms,
+    *  {\bf end} is -1 to play until the end) in {\bf first} and
+    *  {\bf last}, and the play time of the whole file in
+    *  {\bf duration}, then return 0. It returns -1 if the file cannot
+    *  be seeked in by time, which the web server answers with 406 Not
+    *  Acceptable, as it does without the callback.
+    */
+   int (*get_time_range) (
+     IN void *cookie,
+     IN const char *filename,       /** The name of the file. */
+     IN long start,                 /** Where to start playing, in ms. */
+     IN long end,                   /** Where to stop playing, in ms. */
+     OUT off_t *first,              /** The first byte to send. */
+     OUT off_t *last,               /** The last byte to send. */
+     OUT long *duration             /** The play time of the file, in ms. */
+     );
+
 };
 
 typedef struct virtual_Dir_List
@@ -1045,6 +1146,36 @@ typedef struct virtual_Dir_List
     char dirName[NAME_SIZE];
 } virtualDirList;
 
+/** The {\bf dlnaBufferPoolStats} structure reports the activity of the
+ *  buffer pool the web server streams file content with.
+ */
+struct dlnaBufferPoolStats
+{
+  /** Requests served with an idle buffer. */
+  unsigned long hits;
+
+  /** Buffers newly allocated. */
+  unsigned long allocs;
+
+  /** Requests that had to wait for a buffer to be returned. */
+  unsigned long waits;
+
+  /** Requests that got no buffer at all. */
+  unsigned long failures;
+
+  /** Bytes currently handed out to streams. */
+  size_t inUse;
+
+  /** Highest value {\bf inUse} has reached. */
+  size_t peakUsed;
+
+  /** Bytes held by the pool, in use or idle. */
+  size_t allocated;
+
+  /** Current memory cap of the pool. */
+  size_t maxMemory;
+};
+
 /** All callback functions share the same prototype, documented below.
  *  Note that any memory passed to the callback function
  *  is valid only during the callback and should be copied if it
@@ -2740,6 +2871,100 @@ EXPORT_SPEC int dlnaRemoveVirtualDir(
 
 EXPORT_SPEC void dlnaRemoveAllVirtualDirs( );
 
+/** {\bf dlnaSetBufferPoolLimit} sets the maximum amount of memory the web
+ *  server may hold in buffers for streaming files. The default is
+ *  {\tt BUF_POOL_MAX_MEMORY}.
+ *
+ *  @return [int] An integer representing one of the following:
+ *    \begin{itemize}
+ *       \item {\tt DLNA_E_SUCCESS}: The operation completed successfully.
+ *       \item {\tt DLNA_E_FINISH}: The SDK is not initialized.
+ *    \end{itemize}
+ */
+
+EXPORT_SPEC int dlnaSetBufferPoolLimit(
+    IN size_t maxMemory /** Memory cap of the buffer pool, in bytes. */
+    );
+
+/** {\bf dlnaSetStreamPacing} sets how the web server paces the files
+ *  it streams. A file is paced when {\bf get_info} gives it a
+ *  {\tt pace_rate}: its stream may first send {\bf burst} bytes at
+ *  once, then no faster than that rate. {\bf maxRate} caps the rate
+ *  of all streams together, shared fairly between them: streams asking
+ *  for less than an equal share get what they ask for, and the others
+ *  split the rest. The defaults are {\tt STREAMER_PACE_BURST} and no
+ *  cap. Only the streaming engine paces streams.
+ *
+ *  @return [int] An integer representing one of the following:
+ *    \begin{itemize}
+ *       \item {\tt DLNA_E_SUCCESS}: The operation completed successfully.
+ *       \item {\tt DLNA_E_FINISH}: The SDK is not initialized.
+ *    \end{itemize}
+ */
+
+EXPORT_SPEC int dlnaSetStreamPacing(
+    IN size_t burst,    /** Bytes a paced stream may send at once when it
+                            starts. */
+    IN size_t maxRate   /** Cap on the rate of all streams, in bytes per
+                            second, 0 for none. */
+    );
+
+/** {\bf dlnaSetBackgroundShare} sets the part of the {\bf maxRate}
+ *  cap of {\bf dlnaSetStreamPacing} that background transfers, asked
+ *  for with {\tt transferMode.dlna.org: Background}, are sure to get
+ *  while other streams run. They get what the other streams leave too,
+ *  and the whole cap when alone. Whatever the cap, their reads wait
+ *  behind those of the other streams, at a lower I/O priority. The
+ *  default is {\tt STREAMER_BACKGROUND_SHARE}. Only the streaming
+ *  engine tells background transfers apart.
+ *
+ *  @return [int] An integer representing one of the following:
+ *    \begin{itemize}
+ *       \item {\tt DLNA_E_SUCCESS}: The operation completed successfully.
+ *       \item {\tt DLNA_E_FINISH}: The SDK is not initialized.
+ *    \end{itemize}
+ */
+
+EXPORT_SPEC int dlnaSetBackgroundShare(
+    IN unsigned int percent /** Part of the cap, in percent, kept for
+                                background transfers. */
+    );
+
+/** {\bf dlnaGetBufferPoolStats} returns the counters of the web server
+ *  buffer pool.
+ *
+ *  @return [int] An integer representing one of the following:
+ *    \begin{itemize}
+ *       \item {\tt DLNA_E_SUCCESS}: The operation completed successfully.
+ *       \item {\tt DLNA_E_INVALID_ARGUMENT}: {\bf stats} is not a valid
+ *               pointer.
+ *       \item {\tt DLNA_E_FINISH}: The SDK is not initialized.
+ *    \end{itemize}
+ */
+
+EXPORT_SPEC int dlnaGetBufferPoolStats(
+    OUT struct dlnaBufferPoolStats *stats /** Filled with the counters. */
+    );
+
+/** {\bf dlnaWebFileReadComplete} finishes a read the {\bf read_async}
+ *  virtual directory callback left pending, and resumes the stream it
+ *  was made for.
+ *
+ *  @return [int] An integer representing one of the following:
+ *    \begin{itemize}
+ *       \item {\tt DLNA_E_SUCCESS}: The operation completed successfully.
+ *       \item {\tt DLNA_E_NOT_FOUND}: No read is pending on
+ *               {\bf fileHnd}, or the stream was aborted.
+ *    \end{itemize}
+ */
+
+EXPORT_SPEC int dlnaWebFileReadComplete(
+    IN dlnaWebFileHandle fileHnd, /** The handle given to {\bf read_async}. */
+    IN int result                 /** What {\bf read} would have returned:
+                                      bytes read, 0 at end of file, or a
+                                      negative value on error. */
+    );
+
 EXPORT_SPEC void dlnaFree(
     IN void *item /* The item to free. */
     );
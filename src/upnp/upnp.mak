@@ -15,6 +15,8 @@ UPNP_SRCS += \
 	upnp/miniserver.c \
 	upnp/service_table.c \
 	upnp/membuffer.c \
+	upnp/bufpool.c \
+	upnp/streamer.c \
 	upnp/strintmap.c \
 	upnp/upnp_timeout.c \
 	upnp/util.c \
@@ -63,6 +65,8 @@ UPNP_EXTRADIST = \
 	upnp/httpreadwrite.h \
 	upnp/md5.h \
 	upnp/membuffer.h \
+	upnp/bufpool.h \
+	upnp/streamer.h \
 	upnp/miniserver.h \
 	upnp/netall.h \
 	upnp/parsetools.h \
@@ -92,8 +96,13 @@ UPNP_EXTRADIST = \
 UPNP_OBJS = $(UPNP_SRCS:.c=.o)
 UPNP_LOBJS = $(UPNP_SRCS:.c=.lo)
 
+# file read benchmark of the streaming engine, not part of the library
+UPNP_BENCH = upnp/streamer-bench
+UPNP_BENCH_SRCS = upnp/StreamerBench.c
+
 all:
 
 upnp-dist-all:
 	mkdir -p $(DIST)/upnp
-	cp $(UPNP_EXTRADIST) $(UPNP_SRCS) upnp.mak $(DIST)/upnp
+	cp $(UPNP_EXTRADIST) $(UPNP_SRCS) $(UPNP_BENCH_SRCS) upnp.mak \
+	  $(DIST)/upnp
@@ -66,6 +66,8 @@
 #include "soaplib.h"
 #include "ThreadPool.h"
 #include "membuffer.h"
+#include "bufpool.h"
+#include "streamer.h"
 
 #include "httpreadwrite.h"
 
@@ -245,6 +247,10 @@ int dlnaInit( IN const char *HostIP,
     InitHandleList();
     HandleUnlock();
 
+    if( BufPoolInit( BUF_POOL_MAX_MEMORY ) != DLNA_E_SUCCESS ) {
+        return DLNA_E_INIT_FAILED;
+    }
+
     TPAttrInit( &attr );
     TPAttrSetMaxThreads( &attr, MAX_THREADS );
     TPAttrSetMinThreads( &attr, MIN_THREADS );
@@ -272,6 +278,12 @@ int dlnaInit( IN const char *HostIP,
         return DLNA_E_INIT_FAILED;
     }
 
+    // without it, responses are sent by the miniserver threads
+    if( StreamerInit() != DLNA_E_SUCCESS ) {
+        dlnaPrintf( DLNA_INFO, API, __FILE__, __LINE__,
+            "Streaming engine not available\n" );
+    }
+
     dlnaSdkInit = 1;
 #if EXCLUDE_SOAP == 0
     SetSoapCallback( soap_device_callback );
@@ -431,6 +443,7 @@ dlnaFinish()
 
     TimerThreadShutdown( &gTimerThread );
     StopMiniServer();
+    StreamerShutdown();
 
 #if EXCLUDE_WEB_SERVER == 0
     web_server_destroy();
@@ -440,6 +453,8 @@ dlnaFinish()
     ThreadPoolShutdown(&gRecvThreadPool);
     ThreadPoolShutdown(&gSendThreadPool);
 
+    BufPoolDestroy();
+
     PrintThreadPoolStats(&gSendThreadPool, __FILE__, __LINE__, "Send Thread Pool");
     PrintThreadPoolStats(&gRecvThreadPool, __FILE__, __LINE__, "Recv Thread Pool");
     PrintThreadPoolStats(&gMiniServerThreadPool, __FILE__, __LINE__, "MiniServer Thread Pool");
@@ -4192,6 +4207,11 @@ dlnaSetVirtualDirCallbacks( IN struct dlnaVirtualDirCallbacks *callbacks, IN voi
     pCallback->read = callbacks->read;
     pCallback->write = callbacks->write;
     pCallback->seek = callbacks->seek;
+    pCallback->get_fd = callbacks->get_fd;
+    pCallback->open_info = callbacks->open_info;
+    pCallback->read_mapped = callbacks->read_mapped;
+    pCallback->read_async = callbacks->read_async;
+    pCallback->get_time_range = callbacks->get_time_range;
 
     return DLNA_E_SUCCESS;
 }
@@ -4303,4 +4323,141 @@ dlnaSetMaxContentLength (
 
 }
 
+/**************************************************************************
+ * Function: dlnaSetBufferPoolLimit
+ *
+ * Parameters:
+ *	IN size_t maxMemory: Memory cap of the buffer pool, in bytes
+ *
+ * Description:
+ *	Sets the maximum amount of memory the web server may hold in
+ *	buffers for streaming files. Streams get smaller buffers, or wait
+ *	for one, once the cap is reached.
+ *
+ * Return Values: int
+ *	DLNA_E_SUCCESS: The operation completed successfully.
+ *	DLNA_E_FINISH: The SDK is not initialized.
+ ***************************************************************************/
+int
+dlnaSetBufferPoolLimit( IN size_t maxMemory )
+{
+    if( dlnaSdkInit != 1 ) {
+        return DLNA_E_FINISH;
+    }
+
+    BufPoolSetLimit( maxMemory );
+
+    return DLNA_E_SUCCESS;
+}
+
+/**************************************************************************
+ * Function: dlnaSetStreamPacing
+ *
+ * Parameters:
+ *	IN size_t burst: Bytes a paced stream may send at once when it starts
+ *	IN size_t maxRate: Cap on the rate of all streams, in bytes per
+ *		second, 0 for none
+ *
+ * Description:
+ *	Sets how the streaming engine paces the files given a pace_rate by
+ *	the get_info virtual directory callback, and caps the rate of all
+ *	streams together.
+ *
+ * Return Values: int
+ *	DLNA_E_SUCCESS: The operation completed successfully.
+ *	DLNA_E_FINISH: The SDK is not initialized.
+ ***************************************************************************/
+int
+dlnaSetStreamPacing( IN size_t burst,
+                     IN size_t maxRate )
+{
+    if( dlnaSdkInit != 1 ) {
+        return DLNA_E_FINISH;
+    }
+
+    StreamerSetPacing( burst, maxRate );
+
+    return DLNA_E_SUCCESS;
+}
+
+/**************************************************************************
+ * Function: dlnaSetBackgroundShare
+ *
+ * Parameters:
+ *	IN unsigned int percent: Part of the global rate cap, in percent,
+ *		kept for background transfers
+ *
+ * Description:
+ *	Sets the part of the global rate cap background transfers are sure
+ *	to get while other streams run.
+ *
+ * Return Values: int
+ *	DLNA_E_SUCCESS: The operation completed successfully.
+ *	DLNA_E_FINISH: The SDK is not initialized.
+ ***************************************************************************/
+int
+dlnaSetBackgroundShare( IN unsigned int percent )
+{
+    if( dlnaSdkInit != 1 ) {
+        return DLNA_E_FINISH;
+    }
+
+    StreamerSetBackgroundShare( percent );
+
+    return DLNA_E_SUCCESS;
+}
+
+/**************************************************************************
+ * Function: dlnaGetBufferPoolStats
+ *
+ * Parameters:
+ *	OUT struct dlnaBufferPoolStats *stats: Filled with the counters
+ *
+ * Description:
+ *	Returns hits, waits, failures and memory usage of the web server
+ *	buffer pool.
+ *
+ * Return Values: int
+ *	DLNA_E_SUCCESS: The operation completed successfully.
+ *	DLNA_E_INVALID_ARGUMENT: stats is not a valid pointer.
+ *	DLNA_E_FINISH: The SDK is not initialized.
+ ***************************************************************************/
+int
+dlnaGetBufferPoolStats( OUT struct dlnaBufferPoolStats *stats )
+{
+    if( dlnaSdkInit != 1 ) {
+        return DLNA_E_FINISH;
+    }
+
+    if( stats == NULL ) {
+        return DLNA_E_INVALID_ARGUMENT;
+    }
+
+    BufPoolGetStats( stats );
+
+    return DLNA_E_SUCCESS;
+}
+
+/**************************************************************************
+ * Function: dlnaWebFileReadComplete
+ *
+ * Parameters:
+ *	IN dlnaWebFileHandle fileHnd: Handle the read was made on
+ *	IN int result: Bytes read, 0 at end of file, negative on error
+ *
+ * Description:
+ *	Finishes a read the read_async virtual directory callback left
+ *	pending.
+ *
+ * Return Values: int
+ *	DLNA_E_SUCCESS: The operation completed successfully.
+ *	DLNA_E_NOT_FOUND: No read is pending on fileHnd.
+ ***************************************************************************/
+int
+dlnaWebFileReadComplete( IN dlnaWebFileHandle fileHnd,
+                         IN int result )
+{
+    return StreamerReadComplete( fileHnd, result );
+}
+
 /*********************** END OF FILE dlnaapi.c :) ************************/
@@ -36,6 +36,7 @@
 
 #include "config.h"
 #include <assert.h>
+#include <limits.h>
 #include <fcntl.h>
 #ifndef DLNA_USE_BCBPP
 #ifndef DLNA_USE_MSVCPP
@@ -111,7 +112,7 @@ static const char *gMediaTypes[] = {
 
 // general
 #define NUM_MEDIA_TYPES       69
-#define NUM_HTTP_HEADER_NAMES 33
+#define NUM_HTTP_HEADER_NAMES 36
 
 // sorted by file extension; must have 'NUM_MEDIA_TYPES' extensions
 static const char *gEncodedMediaTypes =
@@ -922,6 +923,29 @@ GetNextRange( char **SrcRangeStr,
     return 1;
 }
 
+/************************************************************************
+ * Function: CompareRanges
+ *
+ * Parameters:
+ *	const void *A, *B ; struct SendRange objects
+ *
+ * Description: qsort callback ordering ranges by offset
+ *
+ * Returns: int
+ ************************************************************************/
+static int
+CompareRanges( const void *A,
+               const void *B )
+{
+    const struct SendRange *RA = A;
+    const struct SendRange *RB = B;
+
+    if( RA->Offset != RB->Offset ) {
+        return RA->Offset < RB->Offset ? -1 : 1;
+    }
+    return 0;
+}
+
 /************************************************************************
  * Function: CreateHTTPRangeResponseHeader
  *
@@ -932,7 +956,10 @@ GetNextRange( char **SrcRangeStr,
  *		where the range operations will be stored
  *
  * Description: Fills in the Offset, read size and contents to send out
- *	as an HTTP Range Response
+ *	as an HTTP Range Response. Unsatisfiable ranges of a set are
+ *	dropped, the others are sorted and the ones overlapping or
+ *	following each other merged. If several are left, they are stored
+ *	in Instr->Ranges to be sent as a multipart/byteranges response.
  *
  * Returns:
  *	HTTP_BAD_REQUEST
@@ -950,9 +977,22 @@ CreateHTTPRangeResponseHeader( char *ByteRangeSpecifier,
       LastByte;
     char *RangeInput,
      *Ptr;
+    struct SendRange *Ranges = NULL;
+    struct SendRange *Tmp;
+    off_t End;
+    int Count = 0;
+    int Size = 0;
+    int Len;
+    int Specs = 0;
+    int FromStart = 0;
+    int i;
 
     Instr->IsRangeActive = 1;
     Instr->ReadSendSize = FileLength;
+    // in case the request has several Range headers
+    free( Instr->Ranges );
+    Instr->Ranges = NULL;
+    Instr->RangeCount = 0;
 
     if( !ByteRangeSpecifier )
         return HTTP_BAD_REQUEST;
@@ -977,60 +1017,454 @@ CreateHTTPRangeResponseHeader( char *ByteRangeSpecifier,
         return HTTP_REQUEST_RANGE_NOT_SATISFIABLE;
     }
 
-    if( GetNextRange( &Ptr, &FirstByte, &LastByte ) != -1 ) {
-
-        if( FileLength < FirstByte ) {
+    while( Ptr != NULL ) {
+        if( GetNextRange( &Ptr, &FirstByte, &LastByte ) == -1 ) {
+            free( Ranges );
             free( RangeInput );
             return HTTP_REQUEST_RANGE_NOT_SATISFIABLE;
         }
+        Specs++;
+        FromStart = ( FirstByte == 0 && LastByte == -1 );
 
-        if( FirstByte >= 0 && LastByte >= 0 && LastByte >= FirstByte ) {
+        // turn the range into the first and last byte it covers
+        if( FirstByte >= 0 && LastByte >= FirstByte ) {
+            if( FirstByte >= FileLength ) {
+                continue;
+            }
             if( LastByte >= FileLength )
                 LastByte = FileLength - 1;
-
-            Instr->RangeOffset = FirstByte;
-            Instr->ReadSendSize = LastByte - FirstByte + 1;
-            sprintf( Instr->RangeHeader,
-                "CONTENT-RANGE: bytes %"PRId64"-%"PRId64"/%"PRId64"\r\n",
-                (int64_t)FirstByte,
-                (int64_t)LastByte,
-                (int64_t)FileLength );   //Data between two range.
         } else if( FirstByte >= 0 && LastByte == -1
                    && FirstByte < FileLength ) {
-            Instr->RangeOffset = FirstByte;
-            Instr->ReadSendSize = FileLength - FirstByte;
-            sprintf( Instr->RangeHeader,
-                     "CONTENT-RANGE: bytes %"PRId64"-%"PRId64"/%"PRId64"\r\n",
-                     (int64_t)FirstByte,
-                     (int64_t)(FileLength - 1),
-                     (int64_t)FileLength );
-        } else if( FirstByte == -1 && LastByte > 0 ) {
+            LastByte = FileLength - 1;
+        } else if( FirstByte == -1 && LastByte > 0 && FileLength > 0 ) {
             if( LastByte >= FileLength ) {
-                Instr->RangeOffset = 0;
-                Instr->ReadSendSize = FileLength;
-                sprintf( Instr->RangeHeader,
-                         "CONTENT-RANGE: bytes 0-%"PRId64"/%"PRId64"\r\n",
-                         (int64_t)(FileLength - 1),
-                         (int64_t)FileLength );
+                FirstByte = 0;
             } else {
-                Instr->RangeOffset = FileLength - LastByte;
-                Instr->ReadSendSize = LastByte;
-                sprintf( Instr->RangeHeader,
-                         "CONTENT-RANGE: bytes %"PRId64"-%"PRId64"/%"PRId64"\r\n",
-                         (int64_t)(FileLength - LastByte + 1),
-                         (int64_t)FileLength,
-                         (int64_t)FileLength );
+                FirstByte = FileLength - LastByte;
             }
+            LastByte = FileLength - 1;
         } else {
-            free( RangeInput );
-            return HTTP_REQUEST_RANGE_NOT_SATISFIABLE;
+            continue;
+        }
+
+        if( Count == Size ) {
+            Size = Size ? 2 * Size : 4;
+            Tmp = realloc( Ranges, Size * sizeof( struct SendRange ) );
+            if( !Tmp ) {
+                free( Ranges );
+                free( RangeInput );
+                return DLNA_E_OUTOF_MEMORY;
+            }
+            Ranges = Tmp;
+        }
+        Ranges[Count].Offset = FirstByte;
+        Ranges[Count].Length = LastByte - FirstByte + 1;
+        Count++;
+    }
+    free( RangeInput );
+
+    // the whole of a growing file goes on as it grows, not up to where
+    // it is now
+    if( Instr->IsGrowing && Specs == 1 && FromStart ) {
+        free( Ranges );
+        Instr->IsRangeActive = 0;
+        return HTTP_OK;
+    }
+
+    if( Count == 0 ) {
+        return HTTP_REQUEST_RANGE_NOT_SATISFIABLE;
+    }
+
+    // a single part for ranges overlapping or next to each other
+    qsort( Ranges, Count, sizeof( struct SendRange ), CompareRanges );
+    for( Size = 0, i = 1; i < Count; i++ ) {
+        if( Ranges[i].Offset <= Ranges[Size].Offset + Ranges[Size].Length ) {
+            End = Ranges[i].Offset + Ranges[i].Length;
+            if( End > Ranges[Size].Offset + Ranges[Size].Length ) {
+                Ranges[Size].Length = End - Ranges[Size].Offset;
+            }
+        } else {
+            Ranges[++Size] = Ranges[i];
+        }
+    }
+    Count = Size + 1;
+
+    if( Count == 1 ) {
+        Instr->RangeOffset = Ranges[0].Offset;
+        Instr->ReadSendSize = Ranges[0].Length;
+        Len = sprintf( Instr->RangeHeader,
+            "CONTENT-RANGE: bytes %"PRId64"-%"PRId64"/",
+            (int64_t)Ranges[0].Offset,
+            (int64_t)(Ranges[0].Offset + Ranges[0].Length - 1) );
+        // no total length yet for a growing file
+        if( Instr->IsGrowing ) {
+            strcpy( Instr->RangeHeader + Len, "*\r\n" );
+        } else {
+            sprintf( Instr->RangeHeader + Len, "%"PRId64"\r\n",
+                     (int64_t)FileLength );
         }
+        free( Ranges );
+    } else if( Count > WEB_SERVER_MAX_RANGES ) {
+        // not worth that many parts, send the whole file
+        Instr->IsRangeActive = 0;
+        free( Ranges );
     } else {
-        free( RangeInput );
+        // the parts are sent from the start of the file, each with its
+        // own Content-Range
+        Instr->RangeOffset = 0;
+        Instr->RangeHeader[0] = '\0';
+        Instr->RangeCount = Count;
+        Instr->Ranges = Ranges;
+        Instr->RangeTotal = FileLength;
+    }
+
+    return HTTP_OK;
+}
+
+/************************************************************************
+ * Function: MakeRangePartHeader
+ *
+ * Parameters:
+ *	OUT char *Buf ; where to write the part header
+ *	IN size_t Size ; size of Buf
+ *	IN struct SendInstruction *Instr ; multipart response
+ *	IN int Part ; index of the part, RangeCount for the closing
+ *		delimiter
+ *
+ * Description: Formats the boundary and headers sent before a part of a
+ *	multipart/byteranges response, or the delimiter ending it.
+ *
+ * Returns:
+ *	length of the header, -1 if it does not fit in Buf
+ ************************************************************************/
+int
+MakeRangePartHeader( OUT char *Buf,
+                     IN size_t Size,
+                     IN struct SendInstruction *Instr,
+                     IN int Part )
+{
+    int Len;
+
+    if( Part == Instr->RangeCount ) {
+        Len = snprintf( Buf, Size, "\r\n--%s--\r\n",
+                        Instr->RangeBoundary );
+    } else if( Instr->IsGrowing ) {
+        Len = snprintf( Buf, Size,
+            "\r\n--%s\r\n"
+            "CONTENT-TYPE: %s\r\n"
+            "CONTENT-RANGE: bytes %"PRId64"-%"PRId64"/*\r\n\r\n",
+            Instr->RangeBoundary,
+            Instr->RangeType,
+            (int64_t)Instr->Ranges[Part].Offset,
+            (int64_t)(Instr->Ranges[Part].Offset +
+                      Instr->Ranges[Part].Length - 1) );
+    } else {
+        Len = snprintf( Buf, Size,
+            "\r\n--%s\r\n"
+            "CONTENT-TYPE: %s\r\n"
+            "CONTENT-RANGE: bytes %"PRId64"-%"PRId64"/%"PRId64"\r\n\r\n",
+            Instr->RangeBoundary,
+            Instr->RangeType,
+            (int64_t)Instr->Ranges[Part].Offset,
+            (int64_t)(Instr->Ranges[Part].Offset +
+                      Instr->Ranges[Part].Length - 1),
+            (int64_t)Instr->RangeTotal );
+    }
+
+    if( Len < 0 || ( size_t )Len >= Size ) {
+        return -1;
+    }
+    return Len;
+}
+
+/************************************************************************
+ * Function: CreateMultipartResponse
+ *
+ * Parameters:
+ *	INOUT struct SendInstruction *Instr ; multipart response
+ *	INOUT DOMString *ContentType ; type of the file, replaced with the
+ *		type of the response
+ *
+ * Description: Picks the boundary of a multipart/byteranges response,
+ *	sets the content type of its parts and computes its length.
+ *
+ * Returns:
+ *	HTTP_OK
+ *	DLNA_E_OUTOF_MEMORY
+ *	HTTP_INTERNAL_SERVER_ERROR if the part headers do not fit
+ ************************************************************************/
+static int
+CreateMultipartResponse( INOUT struct SendInstruction *Instr,
+                         INOUT DOMString *ContentType )
+{
+    static unsigned int Serial = 0;
+    char Part[LINE_SIZE * 2];
+    char Type[64];
+    off_t Length = 0;
+    int Len;
+    int i;
+
+    // only has to differ from what the parts hold
+    sprintf( Instr->RangeBoundary, "%08lx%08x",
+             ( unsigned long )time( NULL ) & 0xffffffffUL, ++Serial );
+    sprintf( Type, "multipart/byteranges; boundary=%s",
+             Instr->RangeBoundary );
+
+    Instr->RangeType = *ContentType;
+    *ContentType = ixmlCloneDOMString( Type );
+    if( *ContentType == NULL ) {
+        return DLNA_E_OUTOF_MEMORY;
+    }
+
+    for( i = 0; i <= Instr->RangeCount; i++ ) {
+        Len = MakeRangePartHeader( Part, sizeof( Part ), Instr, i );
+        if( Len < 0 ) {
+            return HTTP_INTERNAL_SERVER_ERROR;
+        }
+        Length += Len;
+        if( i < Instr->RangeCount ) {
+            Length += Instr->Ranges[i].Length;
+        }
+    }
+
+    // the length is known, no need for chunks
+    Instr->IsChunkActive = 0;
+    Instr->ReadSendSize = Length;
+
+    return HTTP_OK;
+}
+
+/************************************************************************
+ * Function: GetNptTime
+ *
+ * Parameters:
+ *	INOUT char ** Src ; string holding the time, moved past it
+ *	OUT long * Time ; the time in ms
+ *
+ * Description: Parses a normal play time, given either in seconds
+ *	(npt-sec) or as hours, minutes and seconds (npt-hhmmss), both with
+ *	optional fractions of a second.
+ *
+ * Returns: int
+ *	0 on success, -1 if there is no time to parse
+ ************************************************************************/
+static int
+GetNptTime( INOUT char **Src,
+            OUT long *Time )
+{
+    char *Ptr = *Src;
+    long Value = 0;
+    long Seconds = 0;
+    long Scale = 1000;
+    int Fields = 0;
+
+    while( isspace( *Ptr ) ) {
+        Ptr++;
+    }
+    if( !isdigit( *Ptr ) ) {
+        return -1;
+    }
+
+    for( ;; ) {
+        Value = 0;
+        while( isdigit( *Ptr ) ) {
+            Value = Value * 10 + ( *Ptr++ - '0' );
+            if( Value > LONG_MAX / 3600000 ) {
+                return -1;
+            }
+        }
+        Seconds = Seconds * 60 + Value;
+        if( *Ptr != ':' ) {
+            break;
+        }
+        // hours and minutes are followed by two digit fields
+        if( ++Fields > 2 || !isdigit( Ptr[1] ) || !isdigit( Ptr[2] ) ) {
+            return -1;
+        }
+        Ptr++;
+    }
+
+    *Time = Seconds * 1000;
+    if( *Ptr == '.' ) {
+        for( Ptr++; isdigit( *Ptr ); Ptr++ ) {
+            Scale /= 10;
+            *Time += ( *Ptr - '0' ) * Scale;
+        }
+    }
+
+    *Src = Ptr;
+    return 0;
+}
+
+/************************************************************************
+ * Function: FormatNptTime
+ *
+ * Parameters:
+ *	OUT char * Buf ; where the time is written
+ *	long Time ; the time in ms
+ *
+ * Description: Writes a normal play time as hours, minutes and seconds.
+ *
+ * Returns: int
+ *	the length of the time written
+ ************************************************************************/
+static int
+FormatNptTime( OUT char *Buf,
+               long Time )
+{
+    return sprintf( Buf, "%ld:%02ld:%02ld.%03ld",
+                    Time / 3600000, Time / 60000 % 60,
+                    Time / 1000 % 60, Time % 1000 );
+}
+
+/************************************************************************
+ * Function: CreateHTTPTimeSeekResponseHeader
+ *
+ * Parameters:
+ *	char * TimeSeekSpecifier ; value of the TimeSeekRange.dlna.org
+ *		header
+ *	const char * Filename ; virtual file requested, NULL for a file
+ *		of the document root
+ *	off_t FileLength ; Length of the file
+ *	OUT struct SendInstruction * Instr ; SendInstruction object
+ *		where the range operations will be stored
+ *
+ * Description: Turns a time range into the byte range to send, through
+ *	the get_time_range virtual directory callback, and fills in the
+ *	TimeSeekRange.dlna.org header of the response.
+ *
+ * Returns:
+ *	HTTP_BAD_REQUEST
+ *	HTTP_NOT_ACCEPTABLE
+ *	HTTP_REQUEST_RANGE_NOT_SATISFIABLE
+ *	HTTP_OK
+ ************************************************************************/
+static int
+CreateHTTPTimeSeekResponseHeader( char *TimeSeekSpecifier,
+                                  const char *Filename,
+                                  off_t FileLength,
+                                  OUT struct SendInstruction *Instr )
+{
+    char *Ptr;
+    long Start;
+    long End = -1;
+    long Duration;
+    off_t FirstByte,
+      LastByte;
+    int Len;
+
+    // a byte range and a time range cannot be asked for together
+    if( Instr->IsRangeActive ) {
+        return HTTP_BAD_REQUEST;
+    }
+
+    Ptr = StrStr( TimeSeekSpecifier, "npt" );
+    if( Ptr == NULL || ( Ptr = strchr( Ptr, '=' ) ) == NULL ) {
+        return HTTP_BAD_REQUEST;
+    }
+    Ptr++;
+    if( GetNptTime( &Ptr, &Start ) != 0 ) {
+        return HTTP_BAD_REQUEST;
+    }
+    while( isspace( *Ptr ) ) {
+        Ptr++;
+    }
+    if( *Ptr++ != '-' ) {
+        return HTTP_BAD_REQUEST;
+    }
+    if( GetNptTime( &Ptr, &End ) == 0 && End <= Start ) {
+        return HTTP_BAD_REQUEST;
+    }
+
+    if( Filename == NULL || virtualDirCallback.get_time_range == NULL ||
+        FileLength <= 0 ||
+        virtualDirCallback.get_time_range( virtualDirCallback.cookie,
+                                           Filename, Start, End,
+                                           &FirstByte, &LastByte,
+                                           &Duration ) != 0 ) {
+        return HTTP_NOT_ACCEPTABLE;
+    }
+
+    if( Start >= Duration || FirstByte < 0 || FirstByte >= FileLength ) {
         return HTTP_REQUEST_RANGE_NOT_SATISFIABLE;
     }
+    if( End < 0 || End > Duration ) {
+        End = Duration;
+    }
+    if( LastByte < FirstByte || LastByte >= FileLength ) {
+        LastByte = FileLength - 1;
+    }
+
+    Instr->IsRangeActive = 1;
+    Instr->IsTimeSeek = 1;
+    Instr->RangeOffset = FirstByte;
+    Instr->ReadSendSize = LastByte - FirstByte + 1;
+
+    Len = sprintf( Instr->RangeHeader, "TIMESEEKRANGE.DLNA.ORG: npt=" );
+    Len += FormatNptTime( Instr->RangeHeader + Len, Start );
+    Instr->RangeHeader[Len++] = '-';
+    Len += FormatNptTime( Instr->RangeHeader + Len, End );
+    Instr->RangeHeader[Len++] = '/';
+    Len += FormatNptTime( Instr->RangeHeader + Len, Duration );
+    sprintf( Instr->RangeHeader + Len,
+             " bytes=%"PRId64"-%"PRId64"/%"PRId64"\r\n",
+             (int64_t)FirstByte,
+             (int64_t)LastByte,
+             (int64_t)FileLength );
+
+    return HTTP_OK;
+}
+
+/************************************************************************
+ * Function: CreateTransferModeHeader
+ *
+ * Parameters:
+ *	char * TransferMode ; value of the transferMode.dlna.org header
+ *	OUT struct SendInstruction * Instr ; SendInstruction object
+ *		where the transfer mode is stored
+ *
+ * Description: Takes note of the transfer mode the client asked for and
+ *	echoes it in the response. A background transfer is not paced to
+ *	the bitrate, and is sent after the streams: see StreamerSubmit.
+ *
+ * Returns:
+ *	HTTP_BAD_REQUEST
+ *	HTTP_OK
+ ************************************************************************/
+static int
+CreateTransferModeHeader( char *TransferMode,
+                          OUT struct SendInstruction *Instr )
+{
+    static const char *Modes[] = { "Streaming", "Interactive",
+        "Background"
+    };
+    char *End;
+    size_t i;
+
+    while( isspace( *TransferMode ) ) {
+        TransferMode++;
+    }
+    End = TransferMode + strlen( TransferMode );
+    while( End > TransferMode && isspace( End[-1] ) ) {
+        *--End = '\0';
+    }
+
+    for( i = 0; i < sizeof( Modes ) / sizeof( Modes[0] ); i++ ) {
+        if( strcasecmp( TransferMode, Modes[i] ) == 0 ) {
+            break;
+        }
+    }
+    if( i == sizeof( Modes ) / sizeof( Modes[0] ) ) {
+        return HTTP_BAD_REQUEST;
+    }
+
+    Instr->IsBackground = ( i == 2 );
+    if( Instr->IsBackground ) {
+        Instr->PaceRate = 0;
+    }
+    sprintf( Instr->TransferModeHeader, "TRANSFERMODE.DLNA.ORG: %s\r\n",
+             Modes[i] );
 
-    free( RangeInput );
     return HTTP_OK;
 }
 
@@ -1041,6 +1475,8 @@ CreateHTTPRangeResponseHeader( char *ByteRangeSpecifier,
  *	IN http_message_t * Req ;  HTTP Request message
  *	OUT struct SendInstruction * RespInstr ; Send Instruction object to
  *		data for the response
+ *	const char * Filename ; virtual file requested, NULL for a file
+ *		of the document root
  *	int FileSize ;	Size of the file containing the request document
  *
  * Description: Get header id from the request parameter and take
@@ -1049,6 +1485,7 @@ CreateHTTPRangeResponseHeader( char *ByteRangeSpecifier,
  *
  * Returns:
  *	HTTP_BAD_REQUEST
+ *	HTTP_NOT_ACCEPTABLE
  *	DLNA_E_OUTOF_MEMORY
  *	HTTP_REQUEST_RANGE_NOT_SATISFIABLE
  *	HTTP_OK
@@ -1056,6 +1493,7 @@ CreateHTTPRangeResponseHeader( char *ByteRangeSpecifier,
 int
 CheckOtherHTTPHeaders( IN http_message_t * Req,
                        OUT struct SendInstruction *RespInstr,
+                       const char *Filename,
                        off_t FileSize )
 {
     http_header_t *header;
@@ -1110,6 +1548,10 @@ CheckOtherHTTPHeaders( IN http_message_t * Req,
                     }
 
                 case HDR_RANGE:
+                    if( RespInstr->IsTimeSeek ) {
+                        free( TmpBuf );
+                        return HTTP_BAD_REQUEST;
+                    }
                     if( ( RetCode = CreateHTTPRangeResponseHeader( TmpBuf,
                                                                    FileSize,
                                                                    RespInstr ) )
@@ -1118,6 +1560,26 @@ CheckOtherHTTPHeaders( IN http_message_t * Req,
                         return RetCode;
                     }
                     break;
+
+                case HDR_TIMESEEKRANGE:
+                    if( ( RetCode =
+                          CreateHTTPTimeSeekResponseHeader( TmpBuf, Filename,
+                                                            FileSize,
+                                                            RespInstr ) )
+                        != HTTP_OK ) {
+                        free( TmpBuf );
+                        return RetCode;
+                    }
+                    break;
+
+                case HDR_TRANSFERMODE:
+                    if( ( RetCode = CreateTransferModeHeader( TmpBuf,
+                                                              RespInstr ) )
+                        != HTTP_OK ) {
+                        free( TmpBuf );
+                        return RetCode;
+                    }
+                    break;
                 default:
                     /*
                        TODO 
@@ -1177,6 +1639,8 @@ CheckOtherHTTPHeaders( IN http_message_t * Req,
  *		request document,
  *	OUT struct SendInstruction * RespInstr ; Send Instruction object
  *		where the response is set up.
+ *	INOUT int *keepAlive ; TRUE if the connection may stay open after
+ *		the response; cleared when the body has no known length.
  *
  * Description: Processes the request and returns the result in the OUT
  *	parameters
@@ -1193,7 +1657,8 @@ process_request( IN http_message_t * req,
                  OUT membuffer * headers,
                  OUT membuffer * filename,
                  OUT struct xml_alias_t *alias,
-                 OUT struct SendInstruction *RespInstr )
+                 OUT struct SendInstruction *RespInstr,
+                 INOUT int *keepAlive )
 {
     int code;
     int err_code;
@@ -1221,6 +1686,8 @@ process_request( IN http_message_t * req,
     // init
     request_doc = NULL;
     finfo.content_type = NULL;
+    finfo.pace_rate = 0;
+    finfo.is_growing = 0;
     alias_grabbed = FALSE;
     err_code = HTTP_INTERNAL_SERVER_ERROR;  // default error
     using_virtual_dir = FALSE;
@@ -1280,9 +1747,18 @@ process_request( IN http_message_t * req,
 
     if( using_virtual_dir ) {
         if( req->method != HTTPMETHOD_POST ) {
-            // get file info
             pVirtualDirCallback = &virtualDirCallback;
-            if( pVirtualDirCallback->get_info(virtualDirCallback.cookie, filename->buf, &finfo ) !=
+            // resolve and open the file at once when possible; the send
+            // path then reuses the handle
+            if( pVirtualDirCallback->open_info &&
+                req->method != HTTPMETHOD_HEAD ) {
+                RespInstr->FileHnd =
+                    pVirtualDirCallback->open_info( virtualDirCallback.cookie,
+                                                    filename->buf, &finfo );
+            }
+            // get file info
+            if( RespInstr->FileHnd == NULL &&
+                pVirtualDirCallback->get_info(virtualDirCallback.cookie, filename->buf, &finfo ) !=
                 0 ) {
                 err_code = HTTP_NOT_FOUND;
                 goto error_handler;
@@ -1373,16 +1849,41 @@ process_request( IN http_message_t * req,
     }
 
     RespInstr->ReadSendSize = finfo.file_length;
+    RespInstr->PaceRate = finfo.pace_rate;
+    RespInstr->IsGrowing = finfo.is_growing;
 
     // Check other header field.
     if( ( err_code =
           CheckOtherHTTPHeaders( req, RespInstr,
+                                 using_virtual_dir ? filename->buf : NULL,
                                  finfo.file_length ) ) != HTTP_OK ) {
         goto error_handler;
     }
 
+    if( RespInstr->RangeCount > 1 &&
+        ( err_code = CreateMultipartResponse( RespInstr,
+                                              &finfo.content_type ) )
+        != HTTP_OK ) {
+        goto error_handler;
+    }
+
+    // a growing file is sent up to where reads end, in chunks if the
+    // client takes them
+    if( RespInstr->IsGrowing && !RespInstr->IsRangeActive ) {
+        RespInstr->ReadSendSize = -1;
+        if( resp_major == 1 && resp_minor >= 1 ) {
+            RespInstr->IsChunkActive = 1;
+        }
+    }
+
+    // without a length the end of the body is the end of the connection
+    if( RespInstr->ReadSendSize < 0 && !RespInstr->IsChunkActive ) {
+        *keepAlive = FALSE;
+    }
+
     if( req->method == HTTPMETHOD_POST ) {
         *rtype = RESP_POST;
+        *keepAlive = FALSE;
         err_code = DLNA_E_SUCCESS;
         goto error_handler;
     }
@@ -1392,13 +1893,15 @@ process_request( IN http_message_t * req,
         // Transfer-Encoding: chunked
         if (http_MakeMessage(
             headers, resp_major, resp_minor,
-            "R" "T" "GKD" "s" "tcS" "XcCc",
-            HTTP_PARTIAL_CONTENT, // status code
+            "R" "T" "GKD" "s" "s" "tcS" "XcAc",
+            RespInstr->IsTimeSeek ? HTTP_OK : HTTP_PARTIAL_CONTENT,
             finfo.content_type,   // content type
             RespInstr,            // range info
+            RespInstr->TransferModeHeader,
             "LAST-MODIFIED: ",
 	    &finfo.last_modified,
-            X_USER_AGENT) != 0 ) {
+            X_USER_AGENT,
+            *keepAlive) != 0 ) {
             goto error_handler;
         }
     } else if( RespInstr->IsRangeActive && !RespInstr->IsChunkActive ) {
@@ -1407,14 +1910,17 @@ process_request( IN http_message_t * req,
         // Transfer-Encoding: chunked
         if (http_MakeMessage(
             headers, resp_major, resp_minor,
-            "R" "N" "T" "GD" "s" "tcS" "XcCc",
-            HTTP_PARTIAL_CONTENT,     // status code
+            "R" "N" "T" "GD" "s" "s" "tcS" "XcAc",
+            // a time seek answers with the whole resource's status
+            RespInstr->IsTimeSeek ? HTTP_OK : HTTP_PARTIAL_CONTENT,
             RespInstr->ReadSendSize,  // content length
             finfo.content_type,       // content type
             RespInstr,                // range info
+            RespInstr->TransferModeHeader,
             "LAST-MODIFIED: ",
 	    &finfo.last_modified,
-            X_USER_AGENT) != 0 ) {
+            X_USER_AGENT,
+            *keepAlive) != 0 ) {
             goto error_handler;
         }
 
@@ -1423,12 +1929,14 @@ process_request( IN http_message_t * req,
         // Transfer-Encoding: chunked
         if (http_MakeMessage(
             headers, resp_major, resp_minor,
-            "RK" "TD" "s" "tcS" "XcCc",
+            "RK" "TD" "s" "s" "tcS" "XcAc",
             HTTP_OK,            // status code
             finfo.content_type, // content type
+            RespInstr->TransferModeHeader,
             "LAST-MODIFIED: ",
 	    &finfo.last_modified,
-            X_USER_AGENT) != 0 ) {
+            X_USER_AGENT,
+            *keepAlive) != 0 ) {
             goto error_handler;
         }
 
@@ -1438,13 +1946,15 @@ process_request( IN http_message_t * req,
             // Transfer-Encoding: chunked
             if (http_MakeMessage(
                 headers, resp_major, resp_minor,
-                "R" "N" "TD" "s" "tcS" "XcCc",
+                "R" "N" "TD" "s" "s" "tcS" "XcAc",
                 HTTP_OK,                 // status code
                 RespInstr->ReadSendSize, // content length
                 finfo.content_type,      // content type
+                RespInstr->TransferModeHeader,
                 "LAST-MODIFIED: ",
 		&finfo.last_modified,
-                X_USER_AGENT) != 0 ) {
+                X_USER_AGENT,
+                *keepAlive) != 0 ) {
                 goto error_handler;
             }
         } else {
@@ -1452,12 +1962,14 @@ process_request( IN http_message_t * req,
             // Transfer-Encoding: chunked
             if (http_MakeMessage(
                 headers, resp_major, resp_minor,
-                "R" "TD" "s" "tcS" "XcCc",
+                "R" "TD" "s" "s" "tcS" "XcAc",
                 HTTP_OK,            // status code
                 finfo.content_type, // content type
+                RespInstr->TransferModeHeader,
                 "LAST-MODIFIED: ",
 		&finfo.last_modified,
-                X_USER_AGENT) != 0 ) {
+                X_USER_AGENT,
+                *keepAlive) != 0 ) {
                 goto error_handler;
             }
         }
@@ -1689,6 +2201,15 @@ web_server_callback( IN http_parser_t * parser,
     RespInstr.IsChunkActive = 0;
     RespInstr.IsRangeActive = 0;
     RespInstr.IsTrailers = 0;
+    RespInstr.IsTimeSeek = 0;
+    RespInstr.FileHnd = NULL;
+    RespInstr.PaceRate = 0;
+    RespInstr.RangeCount = 0;
+    RespInstr.Ranges = NULL;
+    RespInstr.RangeType = NULL;
+    RespInstr.IsGrowing = 0;
+    RespInstr.IsBackground = 0;
+    RespInstr.TransferModeHeader[0] = '\0';
     // init
     membuffer_init( &headers );
     membuffer_init( &filename );
@@ -1697,7 +2218,7 @@ web_server_callback( IN http_parser_t * parser,
     //the type of request.
     ret =
         process_request( req, &rtype, &headers, &filename, &xmldoc,
-                         &RespInstr );
+                         &RespInstr, &info->keepAlive );
     if( ret != DLNA_E_SUCCESS ) {
         // send error code
         http_SendStatusResponse( info, ret, req->major_version,
@@ -1757,6 +2278,14 @@ web_server_callback( IN http_parser_t * parser,
         }
     }
 
+    // handle opened with the file info but not sent from
+    if( RespInstr.FileHnd != NULL ) {
+        virtualDirCallback.close( virtualDirCallback.cookie,
+                                  RespInstr.FileHnd );
+    }
+    free( RespInstr.Ranges );
+    ixmlFreeDOMString( RespInstr.RangeType );
+
     dlnaPrintf( DLNA_INFO, HTTP, __FILE__, __LINE__,
         "webserver: request processed...\n" );
 
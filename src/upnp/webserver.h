@@ -41,16 +41,35 @@ extern "C" {
 #endif
 
 
+// One part of a multipart/byteranges response.
+struct SendRange
+{
+   off_t Offset;
+   off_t Length;
+};
+
 struct SendInstruction
 {
    int  IsVirtualFile;
    int  IsChunkActive;
    int  IsRangeActive;
    int  IsTrailers;
+   int  IsTimeSeek;    // Range given by TimeSeekRange.dlna.org.
    char RangeHeader[200];
    off_t RangeOffset;
    off_t ReadSendSize;  // Read from local source and send on the network.
    long RecvWriteSize; // Recv from the network and write into local file.
+   void *FileHnd;      // Virtual file opened along with its info, if any.
+   size_t PaceRate;    // Rate to send the file at, 0 for no pacing.
+   int RangeCount;     // Parts of a multipart/byteranges response, if > 1.
+   struct SendRange *Ranges;   // Sorted and disjoint.
+   char *RangeType;    // Content type of the parts.
+   off_t RangeTotal;   // Length of the whole file.
+   int IsGrowing;      // File still written to, of unknown total length.
+   int IsBackground;   // transferMode.dlna.org: Background, sent after
+                       // the streams.
+   char TransferModeHeader[48];    // Echoed transferMode.dlna.org, if any.
+   char RangeBoundary[24];
 
    //Later few more member could be added depending on the requirement.
 };
@@ -141,6 +160,25 @@ int web_server_set_root_dir( IN const char* root_dir );
 ************************************************************************/
 void web_server_callback( IN http_parser_t *parser, IN http_message_t* req, INOUT SOCKINFO *info );
 
+/************************************************************************
+* Function: MakeRangePartHeader
+*
+* Parameters:
+*	OUT char *Buf ; where to write the part header
+*	IN size_t Size ; size of Buf
+*	IN struct SendInstruction *Instr ; multipart response
+*	IN int Part ; index of the part, RangeCount for the closing
+*		delimiter
+*
+* Description: Formats the boundary and headers sent before a part of a
+*	multipart/byteranges response, or the delimiter ending it.
+*
+* Returns:
+*	length of the header, -1 if it does not fit in Buf
+************************************************************************/
+int MakeRangePartHeader( OUT char *Buf, IN size_t Size,
+		IN struct SendInstruction *Instr, IN int Part );
+
 
 #ifdef __cplusplus
 } // extern C
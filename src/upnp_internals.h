@@ -33,6 +33,8 @@
 #define DLNA_MAX_CONTENT_LENGTH 4096
 #define VIRTUAL_DIR "/web"
 #define SERVICES_VIRTUAL_DIR "/services"
+/* URL extension of MPEG-TS resources converted to the other packet size */
+#define TS_CONV_URL_EXT(in) ((in) == 188 ? ".m2ts" : ".ts")
 #define XBOX_MODEL_NAME "Windows Media Connect Compatible"
 
 struct dlnaVirtualDirCallbacks virtual_dir_callbacks;
@@ -21,18 +21,391 @@
 
 #include <stdlib.h>
 #include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "upnp_internals.h"
 
 #define STARTING_ENTRY_ID_XBOX360 100000
 
+/* resources kept open while no HTTP handle uses them */
+#define VFS_FD_CACHE_MAX 32
+
+/* seconds the attributes of a resource are trusted without stat() */
+#define VFS_ATTR_TTL 2
+
+static void
+vfs_fd_unlink (dlna_t *dlna, vfs_item_t *item)
+{
+  if (item->u.resource.fd_prev)
+    item->u.resource.fd_prev->u.resource.fd_next = item->u.resource.fd_next;
+  else
+    dlna->vfs_fd_first = item->u.resource.fd_next;
+  if (item->u.resource.fd_next)
+    item->u.resource.fd_next->u.resource.fd_prev = item->u.resource.fd_prev;
+  else
+    dlna->vfs_fd_last = item->u.resource.fd_prev;
+  item->u.resource.fd_prev = NULL;
+  item->u.resource.fd_next = NULL;
+}
+
+static void
+vfs_fd_link (dlna_t *dlna, vfs_item_t *item)
+{
+  item->u.resource.fd_prev = NULL;
+  item->u.resource.fd_next = dlna->vfs_fd_first;
+  if (dlna->vfs_fd_first)
+    dlna->vfs_fd_first->u.resource.fd_prev = item;
+  else
+    dlna->vfs_fd_last = item;
+  dlna->vfs_fd_first = item;
+}
+
+static void
+vfs_fd_close (dlna_t *dlna, vfs_item_t *item)
+{
+  vfs_fd_unlink (dlna, item);
+  close (item->u.resource.fd);
+  item->u.resource.fd = -1;
+  item->u.resource.fd_stale = 0;
+  dlna->vfs_fd_count--;
+}
+
+/* close the least recently used descriptors nobody reads from */
+static void
+vfs_fd_trim (dlna_t *dlna)
+{
+  vfs_item_t *item, *prev;
+
+  for (item = dlna->vfs_fd_last;
+       item && dlna->vfs_fd_count > VFS_FD_CACHE_MAX; item = prev)
+  {
+    prev = item->u.resource.fd_prev;
+    if (!item->u.resource.fd_refs)
+      vfs_fd_close (dlna, item);
+  }
+}
+
+/* what a resource reads from, once nobody does anymore */
+static void
+vfs_resource_free (vfs_item_t *item)
+{
+  seek_index_free (item->u.resource.seek);
+  item->u.resource.seek = NULL;
+  if (item->u.resource.item)
+    dlna_item_free (item->u.resource.item);
+  item->u.resource.item = NULL;
+  if (item->u.resource.fullpath)
+    free (item->u.resource.fullpath);
+  item->u.resource.fullpath = NULL;
+  if (item->u.resource.url)
+    free (item->u.resource.url);
+  item->u.resource.url = NULL;
+}
+
+/* fd is -1 for a resource only held */
+void
+vfs_resource_close (dlna_t *dlna, vfs_item_t *item, int fd)
+{
+  int unused;
+
+  if (!dlna || !item)
+    return;
+
+  pthread_mutex_lock (&dlna->vfs_fd_lock);
+  if (fd >= 0 && fd == item->u.resource.fd)
+  {
+    item->u.resource.fd_refs--;
+    if (!item->u.resource.fd_refs)
+    {
+      if (item->u.resource.fd_stale)
+        vfs_fd_close (dlna, item);
+      else
+        vfs_fd_trim (dlna);
+    }
+    fd = -1;
+  }
+  item->u.resource.users--;
+  unused = item->u.resource.removed && !item->u.resource.users;
+  pthread_mutex_unlock (&dlna->vfs_fd_lock);
+
+  if (fd >= 0)
+    close (fd);
+  /* the last reader of a removed resource */
+  if (unused)
+    vfs_resource_free (item);
+}
+
+/* keep a resource from being freed until vfs_resource_close */
+int
+vfs_resource_hold (dlna_t *dlna, vfs_item_t *item)
+{
+  if (!dlna || !item || item->type != DLNA_RESOURCE)
+    return -1;
+
+  pthread_mutex_lock (&dlna->vfs_fd_lock);
+  if (item->u.resource.removed || !item->u.resource.fullpath)
+  {
+    pthread_mutex_unlock (&dlna->vfs_fd_lock);
+    return -1;
+  }
+  item->u.resource.users++;
+  pthread_mutex_unlock (&dlna->vfs_fd_lock);
+
+  return 0;
+}
+
+/* look a resource up and hold it at once, so that it cannot be freed in
+   between: NULL if there is none or it is being removed */
+vfs_item_t *
+vfs_resource_get (dlna_t *dlna, uint32_t id)
+{
+  vfs_item_t *item = NULL;
+
+  if (!dlna)
+    return NULL;
+
+  pthread_mutex_lock (&dlna->vfs_lock);
+  HASH_FIND_INT (dlna->vfs_root, &id, item);
+  if (item && vfs_resource_hold (dlna, item) < 0)
+    item = NULL;
+  pthread_mutex_unlock (&dlna->vfs_lock);
+
+  return item;
+}
+
+int
+vfs_resource_open (dlna_t *dlna, vfs_item_t *item)
+{
+  struct stat st;
+  int fd;
+
+  if (vfs_resource_hold (dlna, item) < 0)
+    return -1;
+
+  pthread_mutex_lock (&dlna->vfs_fd_lock);
+  if (item->u.resource.fd >= 0 && !item->u.resource.fd_stale)
+  {
+    item->u.resource.fd_refs++;
+    vfs_fd_unlink (dlna, item);
+    vfs_fd_link (dlna, item);
+    fd = item->u.resource.fd;
+    pthread_mutex_unlock (&dlna->vfs_fd_lock);
+    return fd;
+  }
+  pthread_mutex_unlock (&dlna->vfs_fd_lock);
+
+  fd = open (item->u.resource.fullpath, O_RDONLY);
+  if (fd >= 0 && fstat (fd, &st) < 0)
+  {
+    close (fd);
+    fd = -1;
+  }
+  if (fd < 0)
+  {
+    vfs_resource_close (dlna, item, -1);
+    return -1;
+  }
+
+  /* shared from now on, unless the replaced file is still being read
+     or another reader opened it meanwhile */
+  pthread_mutex_lock (&dlna->vfs_fd_lock);
+  if (item->u.resource.fd < 0 && !item->u.resource.removed)
+  {
+    item->u.resource.fd = fd;
+    item->u.resource.fd_refs = 1;
+    item->u.resource.fd_stale = 0;
+    item->u.resource.fd_dev = st.st_dev;
+    item->u.resource.fd_ino = st.st_ino;
+    vfs_fd_link (dlna, item);
+    dlna->vfs_fd_count++;
+    vfs_fd_trim (dlna);
+  }
+  pthread_mutex_unlock (&dlna->vfs_fd_lock);
+
+  return fd;
+}
+
+/* forget what was read from a file that changed, with vfs_fd_lock held */
+static void
+vfs_resource_check (dlna_t *dlna, vfs_item_t *item, struct stat *st)
+{
+  if (item->u.resource.fd >= 0 && !item->u.resource.fd_stale
+      && (item->u.resource.fd_dev != st->st_dev
+          || item->u.resource.fd_ino != st->st_ino))
+  {
+    /* the path now names another file */
+    if (item->u.resource.fd_refs)
+      item->u.resource.fd_stale = 1;
+    else
+      vfs_fd_close (dlna, item);
+    block_cache_invalidate (dlna->cache, item->id);
+  }
+  else if (item->u.resource.attr_expires
+           && (item->u.resource.attr.size != st->st_size
+               || item->u.resource.attr.mtime != st->st_mtime))
+    block_cache_invalidate (dlna->cache, item->id);
+}
+
+static time_t
+vfs_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+int
+vfs_resource_get_attr (dlna_t *dlna, vfs_item_t *item, vfs_attr_t *attr)
+{
+  struct stat st;
+  time_t now;
+
+  if (!dlna || !item || !attr || item->type != DLNA_RESOURCE
+      || !item->u.resource.fullpath)
+    return -1;
+
+  now = vfs_now ();
+  pthread_mutex_lock (&dlna->vfs_fd_lock);
+  if (now < item->u.resource.attr_expires)
+  {
+    *attr = item->u.resource.attr;
+    pthread_mutex_unlock (&dlna->vfs_fd_lock);
+    return 0;
+  }
+  pthread_mutex_unlock (&dlna->vfs_fd_lock);
+
+  if (stat (item->u.resource.fullpath, &st) < 0)
+    return -1;
+
+  attr->readable = 1;
+  if (access (item->u.resource.fullpath, R_OK) < 0)
+  {
+    if (errno != EACCES)
+      return -1;
+    attr->readable = 0;
+  }
+  attr->size = st.st_size;
+  attr->mtime = st.st_mtime;
+  attr->directory = S_ISDIR (st.st_mode);
+
+  pthread_mutex_lock (&dlna->vfs_fd_lock);
+  vfs_resource_check (dlna, item, &st);
+  item->u.resource.attr = *attr;
+  /* not the size it had when added, for files being written */
+  item->u.resource.size = st.st_size;
+  item->u.resource.attr_expires = now + VFS_ATTR_TTL;
+  /* a file being written is looked at again each time */
+  if (vfs_resource_is_live (dlna, item, attr))
+    item->u.resource.attr_expires = now;
+  pthread_mutex_unlock (&dlna->vfs_fd_lock);
+
+  return 0;
+}
+
+/* index of the file as it currently is, with vfs_seek_lock held */
+static seek_index_t *
+vfs_seek_index (dlna_t *dlna, vfs_item_t *item)
+{
+  vfs_attr_t attr;
+  int fd;
+
+  if (vfs_resource_get_attr (dlna, item, &attr) < 0)
+    return NULL;
+
+  /* files that cannot be indexed are only tried again once changed */
+  if (item->u.resource.seek_built
+      && item->u.resource.seek_size == attr.size
+      && item->u.resource.seek_mtime == attr.mtime)
+    return item->u.resource.seek;
+
+  seek_index_free (item->u.resource.seek);
+  item->u.resource.seek = NULL;
+
+  /* a descriptor of its own: the shared one may be for a replaced file */
+  fd = open (item->u.resource.fullpath, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  item->u.resource.seek =
+    seek_index_build (fd, item->u.resource.seek_format, attr.size);
+  close (fd);
+
+  item->u.resource.seek_built = 1;
+  item->u.resource.seek_size = attr.size;
+  item->u.resource.seek_mtime = attr.mtime;
+  if (!item->u.resource.seek)
+    dlna_log (dlna, DLNA_MSG_WARNING,
+              "Cannot index '%s' for time seek\n", item->u.resource.fullpath);
+
+  return item->u.resource.seek;
+}
+
+int
+vfs_resource_time_seek (dlna_t *dlna, vfs_item_t *item,
+                        uint32_t start, int64_t end,
+                        off_t *first, off_t *last, uint32_t *duration)
+{
+  seek_index_t *index;
+
+  if (!dlna || !item || item->type != DLNA_RESOURCE
+      || item->u.resource.seek_format == SEEK_FORMAT_NONE
+      || !first || !last || !duration)
+    return -1;
+
+  pthread_mutex_lock (&dlna->vfs_seek_lock);
+  index = vfs_seek_index (dlna, item);
+  if (!index)
+  {
+    pthread_mutex_unlock (&dlna->vfs_seek_lock);
+    return -1;
+  }
+
+  *duration = seek_index_duration (index);
+  *first = seek_index_lookup (index, start, 0);
+  *last = seek_index_lookup (index, end < 0 ? UINT32_MAX : end, 1) - 1;
+  pthread_mutex_unlock (&dlna->vfs_seek_lock);
+
+  return 0;
+}
+
+int
+vfs_resource_is_live (dlna_t *dlna, vfs_item_t *item, vfs_attr_t *attr)
+{
+  if (!dlna || !item || !attr || !dlna->live_timeout
+      || item->type != DLNA_RESOURCE)
+    return 0;
+
+  /* L16 samples are not the file's bytes, nor do they follow its size */
+  if (item->u.resource.pcm_length)
+    return 0;
+
+  return attr->mtime + (time_t) dlna->live_timeout > time (NULL);
+}
+
+dlna_org_operation_t
+vfs_resource_operations (vfs_item_t *item)
+{
+  if (item && item->type == DLNA_RESOURCE
+      && item->u.resource.seek_format != SEEK_FORMAT_NONE)
+    return DLNA_ORG_OPERATION_RANGE | DLNA_ORG_OPERATION_TIMESEEK;
+
+  return DLNA_ORG_OPERATION_RANGE;
+}
+
 void
 vfs_item_free (dlna_t *dlna, vfs_item_t *item)
 {
+  int unused;
+
   if (!dlna || !dlna->vfs_root || !item)
     return;
 
+  pthread_mutex_lock (&dlna->vfs_lock);
   HASH_DEL (dlna->vfs_root, item);
+  pthread_mutex_unlock (&dlna->vfs_lock);
   
   if (item->title)
     free (item->title);
@@ -40,12 +413,19 @@ vfs_item_free (dlna_t *dlna, vfs_item_t *item)
   switch (item->type)
   {
   case DLNA_RESOURCE:
-    if (item->u.resource.item)
-      dlna_item_free (item->u.resource.item);
-    if (item->u.resource.fullpath)
-      free (item->u.resource.fullpath);
-    if (item->u.resource.url)
-      free (item->u.resource.url);
+    /* its ID may be given to another resource */
+    block_cache_invalidate (dlna->cache, item->id);
+    pthread_mutex_lock (&dlna->vfs_fd_lock);
+    if (item->u.resource.fd_refs)
+      item->u.resource.fd_stale = 1;
+    else if (item->u.resource.fd >= 0)
+      vfs_fd_close (dlna, item);
+    /* held by nobody from now on: freed here or by its last reader */
+    item->u.resource.removed = 1;
+    unused = !item->u.resource.users;
+    pthread_mutex_unlock (&dlna->vfs_fd_lock);
+    if (unused)
+      vfs_resource_free (item);
     break;
   case DLNA_CONTAINER:
   {
@@ -61,6 +441,7 @@ vfs_item_free (dlna_t *dlna, vfs_item_t *item)
   dlna->vfs_items--;
 }
 
+/* with vfs_lock held */
 static dlna_status_code_t
 vfs_is_id_registered (dlna_t *dlna, uint32_t id)
 {
@@ -74,6 +455,7 @@ vfs_is_id_registered (dlna_t *dlna, uint32_t id)
   return item ? DLNA_ST_OK : DLNA_ST_ERROR;
 }
 
+/* with vfs_lock held */
 static uint32_t
 vfs_provide_next_id (dlna_t *dlna)
 {
@@ -101,7 +483,9 @@ vfs_get_item_by_id (dlna_t *dlna, uint32_t id)
   if (!dlna || !dlna->vfs_root)
     return NULL;
 
+  pthread_mutex_lock (&dlna->vfs_lock);
   HASH_FIND_INT (dlna->vfs_root, &id, item);
+  pthread_mutex_unlock (&dlna->vfs_lock);
 
   return item;
 }
@@ -114,11 +498,13 @@ vfs_get_item_by_name (dlna_t *dlna, char *name)
   if (!dlna || !dlna->vfs_root)
     return NULL;
   
+  pthread_mutex_lock (&dlna->vfs_lock);
   for (item = dlna->vfs_root; item; item = item->hh.next)
     if (!strcmp (item->title, name))
-      return item;
+      break;
+  pthread_mutex_unlock (&dlna->vfs_lock);
 
-  return NULL;
+  return item;
 }
 
 static int
@@ -172,12 +558,14 @@ dlna_vfs_add_container (dlna_t *dlna, char *name,
   item->type = DLNA_CONTAINER;
   
   /* is requested 'object_id' available ? */
+  pthread_mutex_lock (&dlna->vfs_lock);
   if (object_id == 0 || vfs_is_id_registered (dlna, object_id) == DLNA_ST_OK)
     item->id = vfs_provide_next_id (dlna);
   else
     item->id = object_id;
 
   HASH_ADD_INT (dlna->vfs_root, id, item);
+  pthread_mutex_unlock (&dlna->vfs_lock);
   
   dlna_log (dlna, DLNA_MSG_INFO,
             "New container id (asked for #%d, granted #%d)\n",
@@ -212,6 +600,7 @@ dlna_vfs_add_resource (dlna_t *dlna, char *name,
                        char *fullpath, off_t size, uint32_t container_id)
 {
   vfs_item_t *item, *parent;
+  int fd;
   
   if (!dlna || !name || !fullpath)
     return 0;
@@ -225,29 +614,52 @@ dlna_vfs_add_resource (dlna_t *dlna, char *name,
   item = calloc (1, sizeof (vfs_item_t));
 
   item->type = DLNA_RESOURCE;
+  item->u.resource.fd = -1;
   
-  item->id = vfs_provide_next_id (dlna);
-  item->title = strdup (name);
-
   item->u.resource.item = dlna_item_new (dlna, fullpath);
   item->u.resource.cnv = DLNA_ORG_CONVERSION_NONE;
 
-  HASH_ADD_INT (dlna->vfs_root, id, item);
-  
   if (!item->u.resource.item)
   {
     dlna_log (dlna, DLNA_MSG_WARNING,
               "Specified resource is not DLNA compliant. "
               "Transcoding is needed (but not yet supported)\n");
-    vfs_item_free (dlna, item);
+    free (item);
     return 0;
   }
 
-  dlna_log (dlna, DLNA_MSG_INFO, "New resource id #%d (%s)\n",
-            item->id, item->title);
+  item->title = strdup (name);
   item->u.resource.fullpath = strdup (fullpath);
   item->u.resource.size = size;
-  item->u.resource.fd = -1;
+
+  /* indexed for time seek on first use only */
+  fd = open (fullpath, O_RDONLY);
+  if (fd >= 0)
+  {
+    item->u.resource.seek_format = seek_index_probe (fd);
+    /* renderers may only take either TS packet size */
+    if (item->u.resource.seek_format == SEEK_FORMAT_MPEG_TS)
+      item->u.resource.ts_packet = ts_conv_probe (fd);
+    if (item->u.resource.ts_packet)
+      item->u.resource.ts_profile =
+        dlna_profile_ts_variant (dlna, item->u.resource.item->profile,
+                                 TS_CONV_OUT (item->u.resource.ts_packet));
+    /* LPCM is big-endian with no header, unlike WAV */
+    if (!strncmp (item->u.resource.item->profile->id, "LPCM", 4)
+        && pcm_conv_probe_wav (fd, &item->u.resource.pcm_offset,
+                               &item->u.resource.pcm_length) < 0)
+      item->u.resource.pcm_length = 0;
+    close (fd);
+  }
+
+  /* only looked up once complete */
+  pthread_mutex_lock (&dlna->vfs_lock);
+  item->id = vfs_provide_next_id (dlna);
+  HASH_ADD_INT (dlna->vfs_root, id, item);
+  pthread_mutex_unlock (&dlna->vfs_lock);
+
+  dlna_log (dlna, DLNA_MSG_INFO, "New resource id #%d (%s)\n",
+            item->id, item->title);
   
   /* determine parent */
   parent = vfs_get_item_by_id (dlna, container_id);
@@ -0,0 +1,330 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Loopback load check of the ContentDirectory Browse action: local
+ * clients page through a container the way a control point lists a
+ * large folder, with a new connection for each request, on persistent
+ * connections, and with requests pipelined on them. Every response is
+ * checked for the page asked, and the rate of each way is reported.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "dlna.h"
+#include "upnp.h"
+#include "config.h"
+
+#define CHECK_CONTROL_URL "/services/cds_control"
+#define CHECK_CHILDREN    1000
+#define CHECK_PAGE        50
+#define CHECK_CLIENTS     4
+#define CHECK_REQUESTS    2000                   /* per client and way */
+#define CHECK_DEPTH       10                     /* pipelined requests */
+#define CHECK_BUF_SIZE    (64 * 1024)
+
+#define CHECK_BROWSE \
+  "<?xml version=\"1.0\"?>" \
+  "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" " \
+  "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">" \
+  "<s:Body><u:Browse " \
+  "xmlns:u=\"urn:schemas-upnp-org:service:ContentDirectory:1\">" \
+  "<ObjectID>0</ObjectID>" \
+  "<BrowseFlag>BrowseDirectChildren</BrowseFlag>" \
+  "<Filter>*</Filter>" \
+  "<StartingIndex>%d</StartingIndex>" \
+  "<RequestedCount>%d</RequestedCount>" \
+  "<SortCriteria></SortCriteria>" \
+  "</u:Browse></s:Body></s:Envelope>"
+
+typedef enum {
+  CHECK_CLOSE,                  /* a connection per request */
+  CHECK_KEEP_ALIVE,             /* one request at a time */
+  CHECK_PIPELINED               /* CHECK_DEPTH requests at a time */
+} check_way_t;
+
+typedef struct check_client_s {
+  unsigned short port;
+  check_way_t way;
+  pthread_t thread;
+  int done;                     /* requests answered right */
+  int failed;
+  char buf[CHECK_BUF_SIZE];     /* responses received */
+  int len;
+} check_client_t;
+
+static double
+check_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+check_connect (unsigned short port)
+{
+  struct sockaddr_in addr;
+  int sock, one = 1;
+
+  sock = socket (AF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    return -1;
+  setsockopt (sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (port);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (connect (sock, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+  {
+    close (sock);
+    return -1;
+  }
+
+  return sock;
+}
+
+/* append the request for the page of number n to buf */
+static int
+check_request (check_client_t *c, char *buf, int n, int last)
+{
+  char body[1024];
+  int len;
+
+  len = snprintf (body, sizeof (body), CHECK_BROWSE,
+                  (n % (CHECK_CHILDREN / CHECK_PAGE)) * CHECK_PAGE,
+                  CHECK_PAGE);
+
+  return sprintf (buf,
+                  "POST " CHECK_CONTROL_URL " HTTP/1.1\r\n"
+                  "Host: 127.0.0.1:%u\r\n"
+                  "Content-Type: text/xml; charset=\"utf-8\"\r\n"
+                  "Content-Length: %d\r\n"
+                  "SOAPACTION: \"urn:schemas-upnp-org:service:"
+                  "ContentDirectory:1#Browse\"\r\n"
+                  "%s\r\n%s",
+                  c->port, len, last ? "Connection: close\r\n" : "", body);
+}
+
+/* read the next response and check it carries a full page */
+static int
+check_response (check_client_t *c, int sock)
+{
+  char *end, *length, tag[64];
+  int head, body;
+  ssize_t n;
+
+  for (;;)
+  {
+    c->buf[c->len] = '\0';
+    end = strstr (c->buf, "\r\n\r\n");
+    if (end)
+    {
+      head = end + 4 - c->buf;
+      length = strcasestr (c->buf, "\r\nContent-Length:");
+      if (!length || length > end)
+        return -1;
+      body = atoi (length + strlen ("\r\nContent-Length:"));
+      if (head + body <= c->len)
+        break;
+    }
+    if (c->len == CHECK_BUF_SIZE - 1)
+      return -1;
+    n = read (sock, c->buf + c->len, CHECK_BUF_SIZE - 1 - c->len);
+    if (n <= 0)
+      return -1;
+    c->len += n;
+  }
+
+  snprintf (tag, sizeof (tag),
+            "<NumberReturned>%d</NumberReturned>", CHECK_PAGE);
+  c->buf[head + body - 1] = '\0';
+  if (strncmp (c->buf, "HTTP/1.1 200 ", 13)
+      || !strstr (c->buf + head, tag))
+    return -1;
+
+  /* keep what follows, the start of the next response */
+  c->len -= head + body;
+  memmove (c->buf, c->buf + head + body, c->len);
+
+  return 0;
+}
+
+/* page through the container, CHECK_REQUESTS times, in one way */
+static void *
+check_client (void *arg)
+{
+  check_client_t *c = (check_client_t *) arg;
+  char req[CHECK_DEPTH * 2048];
+  int sock = -1, sent = 0, served = 0, depth, i, len;
+
+  depth = (c->way == CHECK_PIPELINED) ? CHECK_DEPTH : 1;
+
+  while (sent < CHECK_REQUESTS)
+  {
+    /* the server ends a connection after KEEP_ALIVE_MAX_REQUESTS */
+    if (sock < 0 || served == KEEP_ALIVE_MAX_REQUESTS)
+    {
+      if (sock >= 0)
+        close (sock);
+      sock = check_connect (c->port);
+      if (sock < 0)
+        break;
+      served = 0;
+      c->len = 0;
+    }
+
+    for (i = 0, len = 0; i < depth && sent + i < CHECK_REQUESTS
+           && served + i < KEEP_ALIVE_MAX_REQUESTS; i++)
+      len += check_request (c, req + len, sent + i,
+                            c->way == CHECK_CLOSE
+                            || served + i + 1 == KEEP_ALIVE_MAX_REQUESTS);
+    if (write (sock, req, len) != len)
+      break;
+
+    depth = i;
+    for (i = 0; i < depth; i++)
+    {
+      if (check_response (c, sock) < 0)
+        c->failed++;
+      else
+        c->done++;
+    }
+    sent += depth;
+    served += depth;
+    depth = (c->way == CHECK_PIPELINED) ? CHECK_DEPTH : 1;
+
+    if (c->way == CHECK_CLOSE)
+    {
+      close (sock);
+      sock = -1;
+    }
+  }
+
+  if (sock >= 0)
+    close (sock);
+  c->failed += CHECK_REQUESTS - c->done - c->failed;
+
+  return NULL;
+}
+
+static int
+check_way (unsigned short port, check_way_t way, const char *name)
+{
+  check_client_t *clients;
+  double start, elapsed;
+  int i, done = 0, failed = 0;
+
+  clients = calloc (CHECK_CLIENTS, sizeof (check_client_t));
+  if (!clients)
+    return -1;
+
+  start = check_now ();
+  for (i = 0; i < CHECK_CLIENTS; i++)
+  {
+    clients[i].port = port;
+    clients[i].way = way;
+    pthread_create (&clients[i].thread, NULL, check_client, &clients[i]);
+  }
+  for (i = 0; i < CHECK_CLIENTS; i++)
+  {
+    pthread_join (clients[i].thread, NULL);
+    done += clients[i].done;
+    failed += clients[i].failed;
+  }
+  elapsed = check_now () - start;
+  free (clients);
+
+  printf ("%-24s %d clients: %6.0f Browse/s", name, CHECK_CLIENTS,
+          done / elapsed);
+  if (failed)
+    printf (", %d of %d failed", failed, CHECK_CLIENTS * CHECK_REQUESTS);
+  printf ("\n");
+
+  return failed ? -1 : 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  dlna_t *dlna;
+  char name[32];
+  unsigned short port;
+  int i, res = 0;
+
+  if (argc > 1)
+  {
+    printf ("usage: %s\n", argv[0]);
+    return -1;
+  }
+
+  /* a connection the server closes fails the requests, not the check */
+  signal (SIGPIPE, SIG_IGN);
+
+  dlna = dlna_init ();
+  dlna_set_verbosity (dlna, DLNA_MSG_NONE);
+  dlna_set_interface (dlna, "lo");
+  if (dlna_dms_init (dlna) != DLNA_ST_OK)
+  {
+    printf ("cannot start the media server\n");
+    dlna_uninit (dlna);
+    return -1;
+  }
+  port = dlnaGetServerPort ();
+
+  for (i = 0; i < CHECK_CHILDREN; i++)
+  {
+    sprintf (name, "Folder %04d", i);
+    if (!dlna_vfs_add_container (dlna, name, 0, 0))
+    {
+      printf ("cannot add %s\n", name);
+      res = -1;
+      goto end;
+    }
+  }
+
+  if (check_way (port, CHECK_CLOSE, "connection per request") < 0)
+    res = -1;
+  if (check_way (port, CHECK_KEEP_ALIVE, "keep-alive") < 0)
+    res = -1;
+  if (check_way (port, CHECK_PIPELINED, "pipelined") < 0)
+    res = -1;
+
+ end:
+  dlna_dms_uninit (dlna);
+  dlna_uninit (dlna);
+
+  printf ("%s\n", res ? "FAILED" : "OK");
+
+  return res;
+}
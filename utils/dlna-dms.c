@@ -84,11 +84,14 @@ add_dir (dlna_t *dlna, char *dir, uint32_t id)
 static void
 display_usage (char *name)
 {
-  printf ("Usage: %s [-u|d|x] [-c directory] [[-c directory]...]\n", name);
+  printf ("Usage: %s [-u|d|x] [-l seconds] [-p MB] "
+          "[-c directory] [[-c directory]...]\n", name);
   printf ("Options:\n");
   printf (" -c\tContent directory to be shared\n");
   printf (" -d\tStart in strict DLNA compliant mode\n");
   printf (" -h\tDisplay help\n");
+  printf (" -l\tFollow files written to within the given seconds\n");
+  printf (" -p\tRead ahead the given megabytes of the items browsed\n");
   printf (" -u\tStart in pervasive UPnP A/V compliant mode\n");
   printf (" -x\tStart in hackish XboX 360 UPnP A/V compliant mode\n");
 }
@@ -102,11 +105,15 @@ main (int argc, char **argv)
   int c, index;
   char *content_dir = NULL;
   struct stat st;
-  char short_options[] = "c:dhux";
+  unsigned int live = 0;
+  size_t prefetch = 0;
+  char short_options[] = "c:dhl:p:ux";
   struct option long_options [] = {
     {"content", required_argument, 0, 'c' },
     {"dlna", no_argument, 0, 'd' },
     {"help", no_argument, 0, 'h' },
+    {"live", required_argument, 0, 'l' },
+    {"prefetch", required_argument, 0, 'p' },
     {"upnp", no_argument, 0, 'u' },
     {"xbox", no_argument, 0, 'x' },
     {0, 0, 0, 0 }
@@ -155,6 +162,14 @@ main (int argc, char **argv)
       printf ("Running in strict DLNA compliant mode ...\n");
       break;
 
+    case 'l':
+      live = atoi (optarg);
+      break;
+
+    case 'p':
+      prefetch = (size_t) atoi (optarg) << 20;
+      break;
+
     case 'u':
       cap = DLNA_CAPABILITY_UPNP_AV;
       printf ("Running in pervasive UPnP A/V compliant mode ...\n");
@@ -182,6 +197,9 @@ main (int argc, char **argv)
   dlna_set_verbosity (dlna, DLNA_MSG_INFO);
   dlna_set_capability_mode (dlna, cap);
   dlna_set_extension_check (dlna, 1);
+  dlna_set_live_timeout (dlna, live);
+  /* no faster than four heads a second */
+  dlna_set_prefetch (dlna, prefetch, 4 * prefetch);
   dlna_register_all_media_profiles (dlna);
 
   /* define NIC to be used */
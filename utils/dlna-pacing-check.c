@@ -0,0 +1,337 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Loopback check of the stream pacing of the web server: files served
+ * from memory at a given pace rate are read by local clients, which
+ * check the rate they get past the initial burst and how far the data
+ * arrives from the schedule that rate sets.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "upnp.h"
+
+#define CHECK_DIR         "/pacing"
+#define CHECK_RATE        (1000 * 1000)          /* bytes/s of a file */
+#define CHECK_BURST       (256 * 1024)
+#define CHECK_SECONDS     3                      /* paced, after the burst */
+#define CHECK_LENGTH      (CHECK_BURST + CHECK_RATE * CHECK_SECONDS)
+#define CHECK_STREAMS_MAX 4
+
+/* tolerance on the rate, in percent, and on the lateness or advance of
+   the data on its schedule, in ms */
+#define CHECK_RATE_TOLERANCE   5
+#define CHECK_JITTER_TOLERANCE 100
+
+typedef struct check_file_s {
+  off_t pos;
+} check_file_t;
+
+typedef struct check_stream_s {
+  unsigned short port;
+  pthread_t thread;
+  double expected;              /* rate the schedule is set by */
+  double rate;                  /* measured past the burst */
+  double jitter;                /* furthest from the schedule, in s */
+  off_t received;
+} check_stream_t;
+
+static int
+check_get_info (void *cookie, const char *filename, struct File_Info *info)
+{
+  (void) cookie;
+
+  if (strncmp (filename, CHECK_DIR "/", strlen (CHECK_DIR "/")))
+    return -1;
+
+  info->file_length = CHECK_LENGTH;
+  info->last_modified = 0;
+  info->is_directory = 0;
+  info->is_readable = 1;
+  info->content_type = ixmlCloneDOMString ("application/octet-stream");
+  info->pace_rate = CHECK_RATE;
+
+  return 0;
+}
+
+static dlnaWebFileHandle
+check_open (void *cookie, const char *filename, enum dlnaOpenFileMode mode)
+{
+  (void) cookie;
+  (void) filename;
+
+  if (mode != DLNA_READ)
+    return NULL;
+
+  return calloc (1, sizeof (check_file_t));
+}
+
+static int
+check_read (void *cookie, dlnaWebFileHandle fh, char *buf, size_t buflen)
+{
+  check_file_t *f = (check_file_t *) fh;
+  size_t len;
+
+  (void) cookie;
+
+  len = CHECK_LENGTH - f->pos;
+  if (len > buflen)
+    len = buflen;
+  memset (buf, 'p', len);
+  f->pos += len;
+
+  return len;
+}
+
+static int
+check_write (void *cookie, dlnaWebFileHandle fh, char *buf, size_t buflen)
+{
+  (void) cookie;
+  (void) fh;
+  (void) buf;
+  (void) buflen;
+
+  return -1;
+}
+
+static int
+check_seek (void *cookie, dlnaWebFileHandle fh, off_t offset, int origin)
+{
+  check_file_t *f = (check_file_t *) fh;
+
+  (void) cookie;
+
+  if (origin == SEEK_CUR)
+    offset += f->pos;
+  else if (origin == SEEK_END)
+    offset += CHECK_LENGTH;
+  if (offset < 0 || offset > CHECK_LENGTH)
+    return -1;
+  f->pos = offset;
+
+  return 0;
+}
+
+static int
+check_close (void *cookie, dlnaWebFileHandle fh)
+{
+  (void) cookie;
+
+  free (fh);
+  return 0;
+}
+
+static struct dlnaVirtualDirCallbacks check_callbacks = {
+  NULL,
+  check_get_info,
+  check_open,
+  check_read,
+  check_write,
+  check_seek,
+  check_close,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+static double
+check_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* read a file as a renderer would, timing what arrives past the burst */
+static void *
+check_stream (void *arg)
+{
+  check_stream_t *s = (check_stream_t *) arg;
+  struct sockaddr_in addr;
+  char buf[16 * 1024], *body;
+  double start = 0, now = 0, late;
+  off_t paced = 0;
+  ssize_t n;
+  int sock, rcvbuf = 16 * 1024;
+
+  sock = socket (AF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    return NULL;
+  /* a small receive buffer, so that arrival follows sending */
+  setsockopt (sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof (rcvbuf));
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (s->port);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (connect (sock, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+    goto end;
+
+  n = snprintf (buf, sizeof (buf),
+                "GET " CHECK_DIR "/file HTTP/1.1\r\n"
+                "Host: 127.0.0.1:%u\r\n\r\n", s->port);
+  if (write (sock, buf, n) != n)
+    goto end;
+
+  /* the headers, and whatever of the body came with them */
+  n = 0;
+  for (;;)
+  {
+    ssize_t r = read (sock, buf + n, sizeof (buf) - 1 - n);
+    if (r <= 0)
+      goto end;
+    n += r;
+    buf[n] = '\0';
+    body = strstr (buf, "\r\n\r\n");
+    if (body)
+      break;
+    if (n == sizeof (buf) - 1)
+      goto end;
+  }
+  s->received = n - (body + 4 - buf);
+
+  while ((n = read (sock, buf, sizeof (buf))) > 0)
+  {
+    now = check_now ();
+    s->received += n;
+    if (s->received <= CHECK_BURST)
+      continue;
+
+    /* the schedule starts with the first byte past the burst */
+    if (!start)
+    {
+      start = now;
+      paced = s->received - CHECK_BURST;
+      continue;
+    }
+
+    late = now - start
+      - (double) (s->received - CHECK_BURST - paced) / s->expected;
+    if (late < 0)
+      late = -late;
+    if (late > s->jitter)
+      s->jitter = late;
+  }
+
+  if (start && now > start)
+    s->rate = (s->received - CHECK_BURST - paced) / (now - start);
+
+ end:
+  close (sock);
+  return NULL;
+}
+
+/* run n streams at once, each expected to get rate bytes/s */
+static int
+check_streams (unsigned short port, int n, double rate)
+{
+  check_stream_t streams[CHECK_STREAMS_MAX];
+  int i, res = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    memset (&streams[i], 0, sizeof (check_stream_t));
+    streams[i].port = port;
+    streams[i].expected = rate;
+    pthread_create (&streams[i].thread, NULL, check_stream, &streams[i]);
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    check_stream_t *s = &streams[i];
+    double error;
+
+    pthread_join (s->thread, NULL);
+    error = 100 * (s->rate - rate) / rate;
+    printf ("%d stream(s), #%d: %.0f bytes/s for %.0f expected (%+.1f%%), "
+            "%.0f ms off schedule at most\n",
+            n, i, s->rate, rate, error, 1000 * s->jitter);
+
+    if (s->received != CHECK_LENGTH)
+    {
+      printf ("  received %lld bytes out of %d\n",
+              (long long) s->received, CHECK_LENGTH);
+      res = -1;
+    }
+    else if (error > CHECK_RATE_TOLERANCE || error < -CHECK_RATE_TOLERANCE
+             || 1000 * s->jitter > CHECK_JITTER_TOLERANCE)
+      res = -1;
+  }
+
+  return res;
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned short port;
+  int res = 0;
+
+  if (argc > 1)
+  {
+    printf ("usage: %s\n", argv[0]);
+    return -1;
+  }
+
+  if (dlnaInit ("127.0.0.1", 0) != DLNA_E_SUCCESS)
+  {
+    printf ("cannot start the web server\n");
+    return -1;
+  }
+
+  port = dlnaGetServerPort ();
+  if (dlnaEnableWebserver (TRUE) != DLNA_E_SUCCESS
+      || dlnaSetVirtualDirCallbacks (&check_callbacks, NULL) != DLNA_E_SUCCESS
+      || dlnaAddVirtualDir (CHECK_DIR) != DLNA_E_SUCCESS)
+  {
+    printf ("cannot serve " CHECK_DIR "\n");
+    dlnaFinish ();
+    return -1;
+  }
+
+  /* alone, a stream gets its pace rate */
+  dlnaSetStreamPacing (CHECK_BURST, 0);
+  if (check_streams (port, 1, CHECK_RATE) < 0)
+    res = -1;
+
+  /* under a cap below what they ask for, streams share it evenly */
+  dlnaSetStreamPacing (CHECK_BURST, CHECK_RATE * 3 / 2);
+  if (check_streams (port, 2, CHECK_RATE * 3 / 4) < 0)
+    res = -1;
+
+  dlnaFinish ();
+
+  printf ("%s\n", res ? "FAILED" : "OK");
+
+  return res;
+}
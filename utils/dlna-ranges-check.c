@@ -0,0 +1,585 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Loopback check of the byte range responses of the web server: sets
+ * of ranges, overlapping, next to each other, out of order, from the
+ * end of the file or past it, and more of them than the server sends
+ * as parts, are asked of a file sent with sendfile and of one copied
+ * through read. The parts are checked against the ranges merged the
+ * way the server is expected to merge them, and byte for byte against
+ * the file.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "upnp.h"
+#include "config.h"
+
+#define CHECK_DIR        "/ranges"
+#define CHECK_SENDFILE   CHECK_DIR "/sendfile"
+#define CHECK_COPY       CHECK_DIR "/copy"
+#define CHECK_LENGTH     (1024 * 1024 + 17)
+#define CHECK_SPEC_SIZE  4096
+#define CHECK_RANGES_MAX 128
+#define CHECK_MULTIPART  "\r\nContent-Type: multipart/byteranges; boundary="
+
+typedef struct check_file_s {
+  int copy;                     /* no descriptor, read instead */
+  off_t pos;
+} check_file_t;
+
+typedef struct check_range_s {
+  off_t first;
+  off_t last;
+} check_range_t;
+
+typedef struct check_response_s {
+  int status;
+  char *head;                   /* headers, NUL terminated */
+  char *body;
+  size_t body_len;
+  char *data;                   /* whole response */
+} check_response_t;
+
+static int check_fd = -1;
+static unsigned char *check_content;
+static int check_reads[2];      /* read calls, sendfile file and copy one */
+
+static int
+check_get_info (void *cookie, const char *filename, struct File_Info *info)
+{
+  (void) cookie;
+
+  if (strcmp (filename, CHECK_SENDFILE) && strcmp (filename, CHECK_COPY))
+    return -1;
+
+  info->file_length = CHECK_LENGTH;
+  info->last_modified = 0;
+  info->is_directory = 0;
+  info->is_readable = 1;
+  info->content_type = ixmlCloneDOMString ("application/octet-stream");
+
+  return 0;
+}
+
+static dlnaWebFileHandle
+check_open (void *cookie, const char *filename, enum dlnaOpenFileMode mode)
+{
+  check_file_t *f;
+
+  (void) cookie;
+
+  if (mode != DLNA_READ)
+    return NULL;
+
+  f = calloc (1, sizeof (check_file_t));
+  if (f)
+    f->copy = !strcmp (filename, CHECK_COPY);
+
+  return f;
+}
+
+static int
+check_read (void *cookie, dlnaWebFileHandle fh, char *buf, size_t buflen)
+{
+  check_file_t *f = (check_file_t *) fh;
+  ssize_t n;
+
+  (void) cookie;
+
+  __sync_fetch_and_add (&check_reads[f->copy], 1);
+  n = pread (check_fd, buf, buflen, f->pos);
+  if (n > 0)
+    f->pos += n;
+
+  return n;
+}
+
+static int
+check_write (void *cookie, dlnaWebFileHandle fh, char *buf, size_t buflen)
+{
+  (void) cookie;
+  (void) fh;
+  (void) buf;
+  (void) buflen;
+
+  return -1;
+}
+
+static int
+check_seek (void *cookie, dlnaWebFileHandle fh, off_t offset, int origin)
+{
+  check_file_t *f = (check_file_t *) fh;
+
+  (void) cookie;
+
+  if (origin == SEEK_CUR)
+    offset += f->pos;
+  else if (origin == SEEK_END)
+    offset += CHECK_LENGTH;
+  if (offset < 0 || offset > CHECK_LENGTH)
+    return -1;
+  f->pos = offset;
+
+  return 0;
+}
+
+static int
+check_close (void *cookie, dlnaWebFileHandle fh)
+{
+  (void) cookie;
+
+  free (fh);
+  return 0;
+}
+
+static int
+check_get_fd (void *cookie, dlnaWebFileHandle fh, off_t *offset)
+{
+  check_file_t *f = (check_file_t *) fh;
+
+  (void) cookie;
+
+  if (f->copy)
+    return -1;
+
+  *offset = f->pos;
+  return check_fd;
+}
+
+static struct dlnaVirtualDirCallbacks check_callbacks = {
+  NULL,
+  check_get_info,
+  check_open,
+  check_read,
+  check_write,
+  check_seek,
+  check_close,
+  check_get_fd,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+static int
+check_compare_ranges (const void *a, const void *b)
+{
+  const check_range_t *ra = a;
+  const check_range_t *rb = b;
+
+  if (ra->first != rb->first)
+    return ra->first < rb->first ? -1 : 1;
+  return 0;
+}
+
+/* the ranges of spec the response should hold: satisfiable ones
+   sorted, merged when they overlap or follow each other */
+static int
+check_expected (const char *spec, check_range_t *ranges)
+{
+  const char *p = spec + strlen ("bytes=");
+  long long first, last;
+  int n = 0, i, count;
+
+  while (*p)
+  {
+    if (*p == '-')
+    {
+      last = strtoll (p + 1, (char **) &p, 10);
+      first = last >= CHECK_LENGTH ? 0 : CHECK_LENGTH - last;
+      last = CHECK_LENGTH - 1;
+    }
+    else
+    {
+      first = strtoll (p, (char **) &p, 10);
+      p++;
+      if (*p == ',' || !*p)
+        last = CHECK_LENGTH - 1;
+      else
+        last = strtoll (p, (char **) &p, 10);
+    }
+    if (*p == ',')
+      p++;
+
+    if (first >= CHECK_LENGTH)
+      continue;
+    if (last >= CHECK_LENGTH)
+      last = CHECK_LENGTH - 1;
+    ranges[n].first = first;
+    ranges[n].last = last;
+    n++;
+  }
+
+  qsort (ranges, n, sizeof (check_range_t), check_compare_ranges);
+  for (count = 0, i = 1; i < n; i++)
+  {
+    if (ranges[i].first <= ranges[count].last + 1)
+    {
+      if (ranges[i].last > ranges[count].last)
+        ranges[count].last = ranges[i].last;
+    }
+    else
+      ranges[++count] = ranges[i];
+  }
+
+  return n ? count + 1 : 0;
+}
+
+static void
+check_response_free (check_response_t *r)
+{
+  free (r->data);
+  memset (r, 0, sizeof (check_response_t));
+}
+
+/* GET path with the Range header spec, the whole response read */
+static int
+check_get (unsigned short port, const char *path, const char *spec,
+           check_response_t *r)
+{
+  struct sockaddr_in addr;
+  char req[CHECK_SPEC_SIZE + 256], *end, *length;
+  size_t size = 0, len = 0;
+  ssize_t n;
+  int sock, res = -1;
+
+  memset (r, 0, sizeof (check_response_t));
+
+  sock = socket (AF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    return -1;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (port);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (connect (sock, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+    goto end;
+
+  n = snprintf (req, sizeof (req),
+                "GET %s HTTP/1.1\r\n"
+                "Host: 127.0.0.1:%u\r\n"
+                "Range: %s\r\n"
+                "Connection: close\r\n\r\n", path, port, spec);
+  if (write (sock, req, n) != n)
+    goto end;
+
+  for (;;)
+  {
+    if (len + 1 >= size)
+    {
+      size = size ? 2 * size : 64 * 1024;
+      end = realloc (r->data, size);
+      if (!end)
+        goto end;
+      r->data = end;
+    }
+    n = read (sock, r->data + len, size - 1 - len);
+    if (n < 0)
+      goto end;
+    if (n == 0)
+      break;
+    len += n;
+  }
+  if (!r->data)
+    goto end;
+  r->data[len] = '\0';
+
+  end = strstr (r->data, "\r\n\r\n");
+  if (!end || sscanf (r->data, "HTTP/1.1 %d", &r->status) != 1)
+    goto end;
+  *end = '\0';
+  r->head = r->data;
+  r->body = end + 4;
+  r->body_len = len - (r->body - r->data);
+
+  /* the whole body must have come before the connection closed */
+  length = strcasestr (r->head, "\r\nContent-Length:");
+  if (length && strtoull (length + strlen ("\r\nContent-Length:"), NULL, 10)
+      != r->body_len)
+    goto end;
+  res = 0;
+
+ end:
+  close (sock);
+  return res;
+}
+
+/* check the part holding range, at p; returns where the next part
+   starts, or NULL */
+static const char *
+check_part (const char *p, const char *end, const char *boundary,
+            const check_range_t *range)
+{
+  char delimiter[128];
+  const char *head_end, *content_range;
+  long long first, last, total;
+  size_t len;
+
+  len = snprintf (delimiter, sizeof (delimiter), "\r\n--%s\r\n", boundary);
+  if ((size_t) (end - p) < len || memcmp (p, delimiter, len))
+    return NULL;
+  p += len;
+
+  head_end = strstr (p, "\r\n\r\n");
+  content_range = strcasestr (p, "Content-Range: bytes ");
+  if (!head_end || !content_range || content_range > head_end
+      || sscanf (content_range + strlen ("Content-Range: bytes "),
+                 "%lld-%lld/%lld",
+                 &first, &last, &total) != 3)
+    return NULL;
+  if (first != range->first || last != range->last || total != CHECK_LENGTH)
+    return NULL;
+
+  p = head_end + 4;
+  len = last - first + 1;
+  if ((size_t) (end - p) < len || memcmp (p, check_content + first, len))
+    return NULL;
+
+  return p + len;
+}
+
+/* check the response to spec of one file against the expected ranges */
+static int
+check_ranges (unsigned short port, const char *path, const char *name,
+              const char *spec)
+{
+  check_range_t ranges[CHECK_RANGES_MAX];
+  check_response_t r;
+  const char *p, *end, *header;
+  char boundary[128], closing[160];
+  long long first, last, total;
+  int count, i, res = -1;
+
+  count = check_expected (spec, ranges);
+
+  if (check_get (port, path, spec, &r) < 0)
+  {
+    printf ("%s, %s: no complete response\n", name, path);
+    check_response_free (&r);
+    return -1;
+  }
+
+  if (count == 0)
+  {
+    /* nothing of the file asked */
+    if (r.status == 416)
+      res = 0;
+  }
+  else if (count > WEB_SERVER_MAX_RANGES)
+  {
+    /* too many parts, the whole file instead */
+    if (r.status == 200 && r.body_len == CHECK_LENGTH
+        && !memcmp (r.body, check_content, CHECK_LENGTH))
+      res = 0;
+  }
+  else if (count == 1)
+  {
+    header = strcasestr (r.head, "\r\nContent-Range: bytes ");
+    if (r.status == 206 && header
+        && sscanf (header + strlen ("\r\nContent-Range: bytes "),
+                   "%lld-%lld/%lld", &first, &last, &total) == 3
+        && first == ranges[0].first && last == ranges[0].last
+        && total == CHECK_LENGTH
+        && r.body_len == (size_t) (last - first + 1)
+        && !memcmp (r.body, check_content + first, r.body_len))
+      res = 0;
+  }
+  else
+  {
+    header = strcasestr (r.head, CHECK_MULTIPART);
+    if (r.status == 206 && header
+        && sscanf (header + strlen (CHECK_MULTIPART), "%100[^\r\n ;]",
+                   boundary) == 1)
+    {
+      p = r.body;
+      end = r.body + r.body_len;
+      for (i = 0; p && i < count; i++)
+        p = check_part (p, end, boundary, &ranges[i]);
+      snprintf (closing, sizeof (closing), "\r\n--%s--\r\n", boundary);
+      if (p && (size_t) (end - p) == strlen (closing)
+          && !memcmp (p, closing, strlen (closing)))
+        res = 0;
+    }
+  }
+
+  printf ("%-28s %-18s %3d range(s): %d, %s\n", name, path, count,
+          r.status, res ? "FAILED" : "ok");
+  check_response_free (&r);
+
+  return res;
+}
+
+/* n disjoint ranges of 10 bytes spread over the file */
+static void
+check_spec_spread (char *spec, int n)
+{
+  int len, i;
+
+  len = sprintf (spec, "bytes=");
+  for (i = 0; i < n; i++)
+    len += sprintf (spec + len, "%s%d-%d", i ? "," : "",
+                    i * 8000 + 3, i * 8000 + 12);
+}
+
+/* n ranges next to or over each other, merged into two parts */
+static void
+check_spec_merged (char *spec, int n)
+{
+  int len, i;
+
+  len = sprintf (spec, "bytes=");
+  for (i = 0; i < n / 2; i++)
+    len += sprintf (spec + len, "%s%d-%d", i ? "," : "", i * 100,
+                    i * 100 + 99 + (i % 3) * 20);
+  for (i = 0; i < n - n / 2; i++)
+    len += sprintf (spec + len, ",%d-%d", 600000 - i * 50,
+                    600000 - i * 50 + 49);
+}
+
+static int
+check_create_file (void)
+{
+  char path[] = "/tmp/dlna-ranges-check.XXXXXX";
+  size_t i;
+
+  check_content = malloc (CHECK_LENGTH);
+  if (!check_content)
+    return -1;
+  /* no period a part could line up with by mistake */
+  for (i = 0; i < CHECK_LENGTH; i++)
+    check_content[i] = (unsigned char) (i * 7 + i / 251 + i / 65521);
+
+  check_fd = mkstemp (path);
+  if (check_fd < 0)
+    return -1;
+  unlink (path);
+
+  if (write (check_fd, check_content, CHECK_LENGTH) != CHECK_LENGTH)
+    return -1;
+
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  static const char *paths[] = { CHECK_SENDFILE, CHECK_COPY };
+  static char spec[5][CHECK_SPEC_SIZE];
+  const char *names[13], *specs[13];
+  unsigned short port;
+  int i, j, n = 0, res = 0;
+
+  if (argc > 1)
+  {
+    printf ("usage: %s\n", argv[0]);
+    return -1;
+  }
+
+  signal (SIGPIPE, SIG_IGN);
+
+  if (check_create_file () < 0)
+  {
+    printf ("cannot create the file to serve\n");
+    return -1;
+  }
+
+  names[n] = "two ranges";
+  specs[n++] = "bytes=0-99,1000-1999";
+  names[n] = "out of order";
+  specs[n++] = "bytes=5000-5099,100-199,3000-3009";
+  names[n] = "overlapping";
+  specs[n++] = "bytes=0-499,250-999,4000-4099";
+  names[n] = "next to each other";
+  specs[n++] = "bytes=0-99,100-199,200-299";
+  names[n] = "contained";
+  specs[n++] = "bytes=1000-1999,1200-1299,3000-3000";
+  names[n] = "suffix";
+  specs[n++] = "bytes=0-9,-100";
+  names[n] = "large parts";
+  specs[n++] = "bytes=1-300000,500000-900000";
+  names[n] = "unsatisfiable dropped";
+  specs[n++] = "bytes=0-9,2000000-2000010,2000020-";
+
+  /* from the end of the file, and up to it */
+  sprintf (spec[0], "bytes=-%d,%d-%d,%d-", 1000, CHECK_LENGTH - 500,
+           CHECK_LENGTH - 400, CHECK_LENGTH - 10000);
+  names[n] = "suffix overlapping";
+  specs[n++] = spec[0];
+  sprintf (spec[1], "bytes=10-19,%d-", CHECK_LENGTH - 10);
+  names[n] = "open-ended";
+  specs[n++] = spec[1];
+
+  check_spec_spread (spec[2], WEB_SERVER_MAX_RANGES);
+  names[n] = "WEB_SERVER_MAX_RANGES parts";
+  specs[n++] = spec[2];
+  check_spec_spread (spec[3], WEB_SERVER_MAX_RANGES + 1);
+  names[n] = "one part too many";
+  specs[n++] = spec[3];
+  check_spec_merged (spec[4], 2 * WEB_SERVER_MAX_RANGES);
+  names[n] = "many merged into two";
+  specs[n++] = spec[4];
+
+  if (dlnaInit ("127.0.0.1", 0) != DLNA_E_SUCCESS)
+  {
+    printf ("cannot start the web server\n");
+    return -1;
+  }
+
+  port = dlnaGetServerPort ();
+  if (dlnaEnableWebserver (TRUE) != DLNA_E_SUCCESS
+      || dlnaSetVirtualDirCallbacks (&check_callbacks, NULL) != DLNA_E_SUCCESS
+      || dlnaAddVirtualDir (CHECK_DIR) != DLNA_E_SUCCESS)
+  {
+    printf ("cannot serve " CHECK_DIR "\n");
+    dlnaFinish ();
+    return -1;
+  }
+
+  for (j = 0; j < 2; j++)
+    for (i = 0; i < n; i++)
+      if (check_ranges (port, paths[j], names[i], specs[i]) < 0)
+        res = -1;
+
+  /* the parts of the file with a descriptor never went through read */
+  printf ("read calls: %d for %s, %d for %s\n",
+          check_reads[0], CHECK_SENDFILE, check_reads[1], CHECK_COPY);
+  if (check_reads[0] || !check_reads[1])
+    res = -1;
+
+  dlnaFinish ();
+  close (check_fd);
+  free (check_content);
+
+  printf ("%s\n", res ? "FAILED" : "OK");
+
+  return res;
+}
@@ -0,0 +1,659 @@
+/*
+ * libdlna: reference DLNA standards implementation.
+ * Copyright (C) 2007-2008 Benjamin Zores <ben@geexbox.org>
+ *
+ * This file is part of libdlna.
+ *
+ * libdlna is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libdlna is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libdlna; if not, write to the Free Software
+ * Foundation, Inc, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Loopback benchmark of concurrent streams from slow storage: WAV
+ * files written in a directory are shared and played by local clients
+ * at their bitrate, each from its own file, out of a cold page cache.
+ * The clients keep a few seconds of buffer the way renderers do, and
+ * report how long playback would have stalled waiting for data.
+ *
+ * The time renderers take to start playing is then measured the way
+ * they start: the metadata of an item is browsed, and its first second
+ * asked for a moment later, without and with the head of the items
+ * browsed read ahead.
+ *
+ * Run as root, the process first moves into a cgroup limiting reads
+ * from the disk of the directory to what a spinning disk does, so that
+ * seeks between the streams cost what they cost there. Otherwise the
+ * storage is used as it is.
+ *
+ *     dlna-stream-bench [directory]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "dlna.h"
+#include "upnp.h"
+
+#define BENCH_CGROUP      "dlna-stream-bench"
+#define BENCH_IOPS        120                    /* a 7200 rpm disk */
+#define BENCH_BPS         (120 * 1000 * 1000)
+#define BENCH_RATE        (48000 * 2 * 2)        /* bytes/s, 48 kHz stereo */
+#define BENCH_SECONDS     10                     /* played by each stream */
+#define BENCH_PREBUFFER   1                      /* s before playing */
+#define BENCH_BUFFER      3                      /* s a client reads ahead */
+#define BENCH_LENGTH      (BENCH_RATE * (BENCH_SECONDS + BENCH_BUFFER))
+#define BENCH_STREAMS_MAX 64
+#define BENCH_STARTS      16                     /* items started */
+#define BENCH_THINK       200                    /* ms from browse to GET */
+#define BENCH_HEAD        (1024 * 1024)          /* read ahead when browsed */
+
+#define BENCH_CONTROL_URL "/services/cds_control"
+#define BENCH_BROWSE \
+  "<?xml version=\"1.0\"?>" \
+  "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" " \
+  "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">" \
+  "<s:Body><u:Browse " \
+  "xmlns:u=\"urn:schemas-upnp-org:service:ContentDirectory:1\">" \
+  "<ObjectID>%u</ObjectID>" \
+  "<BrowseFlag>BrowseMetadata</BrowseFlag>" \
+  "<Filter>*</Filter>" \
+  "<StartingIndex>0</StartingIndex>" \
+  "<RequestedCount>0</RequestedCount>" \
+  "<SortCriteria></SortCriteria>" \
+  "</u:Browse></s:Body></s:Envelope>"
+
+typedef struct bench_stream_s {
+  unsigned short port;
+  uint32_t id;
+  pthread_t thread;
+  double start;
+  off_t received;
+  double late;                  /* furthest data came after playback */
+} bench_stream_t;
+
+static double
+bench_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+bench_write_file (const char *path, const char *text)
+{
+  int fd, res;
+
+  fd = open (path, O_WRONLY);
+  if (fd < 0)
+    return -1;
+  res = write (fd, text, strlen (text)) == (ssize_t) strlen (text) ? 0 : -1;
+  close (fd);
+
+  return res;
+}
+
+/* the whole disk a file system is on, throttles do not apply to
+   partitions */
+static dev_t
+bench_disk (dev_t dev)
+{
+  char path[64];
+  unsigned int major, minor;
+  FILE *f;
+
+  snprintf (path, sizeof (path), "/sys/dev/block/%u:%u/../dev",
+            major (dev), minor (dev));
+  f = fopen (path, "r");
+  if (!f)
+    return dev;
+  if (fscanf (f, "%u:%u", &major, &minor) == 2)
+    dev = makedev (major, minor);
+  fclose (f);
+
+  return dev;
+}
+
+/* kernel readahead of the disk of a directory, in kB, -1 if unknown */
+static int
+bench_readahead (const char *dir)
+{
+  char path[96];
+  struct stat st;
+  dev_t disk;
+  int kb = -1;
+  FILE *f;
+
+  if (stat (dir, &st) < 0 || !major (st.st_dev))
+    return -1;
+  disk = bench_disk (st.st_dev);
+
+  snprintf (path, sizeof (path), "/sys/dev/block/%u:%u/queue/read_ahead_kb",
+            major (disk), minor (disk));
+  f = fopen (path, "r");
+  if (!f)
+    return -1;
+  if (fscanf (f, "%d", &kb) != 1)
+    kb = -1;
+  fclose (f);
+
+  return kb;
+}
+
+/* move the process into a cgroup limiting reads from the disk, with
+   cgroup v2 or the blkio controller of v1: the cgroup path or NULL */
+static char *
+bench_throttle (const char *dir)
+{
+  static char cgroup[256];
+  char path[320], limit[128];
+  struct stat st;
+  dev_t disk;
+
+  if (stat (dir, &st) < 0 || !major (st.st_dev))
+    return NULL;
+  disk = bench_disk (st.st_dev);
+
+  if (!access ("/sys/fs/cgroup/cgroup.controllers", F_OK))
+  {
+    snprintf (cgroup, sizeof (cgroup), "/sys/fs/cgroup/" BENCH_CGROUP);
+    bench_write_file ("/sys/fs/cgroup/cgroup.subtree_control", "+io");
+    if (mkdir (cgroup, 0755) < 0 && access (cgroup, F_OK))
+      return NULL;
+    snprintf (path, sizeof (path), "%s/io.max", cgroup);
+    snprintf (limit, sizeof (limit), "%u:%u riops=%d rbps=%d",
+              major (disk), minor (disk), BENCH_IOPS, BENCH_BPS);
+    if (bench_write_file (path, limit) < 0)
+      goto err;
+  }
+  else
+  {
+    snprintf (cgroup, sizeof (cgroup), "/sys/fs/cgroup/blkio/" BENCH_CGROUP);
+    if (mkdir (cgroup, 0755) < 0 && access (cgroup, F_OK))
+      return NULL;
+    snprintf (path, sizeof (path), "%s/blkio.throttle.read_iops_device",
+              cgroup);
+    snprintf (limit, sizeof (limit), "%u:%u %d",
+              major (disk), minor (disk), BENCH_IOPS);
+    if (bench_write_file (path, limit) < 0)
+      goto err;
+    snprintf (path, sizeof (path), "%s/blkio.throttle.read_bps_device",
+              cgroup);
+    snprintf (limit, sizeof (limit), "%u:%u %d",
+              major (disk), minor (disk), BENCH_BPS);
+    if (bench_write_file (path, limit) < 0)
+      goto err;
+  }
+
+  snprintf (path, sizeof (path), "%s/cgroup.procs", cgroup);
+  snprintf (limit, sizeof (limit), "%d", (int) getpid ());
+  if (bench_write_file (path, limit) < 0)
+    goto err;
+
+  return cgroup;
+
+ err:
+  rmdir (cgroup);
+  return NULL;
+}
+
+/* read requests the disk was sent from the cgroup */
+static long
+bench_disk_reads (const char *cgroup)
+{
+  char path[320], line[256], *p;
+  long reads = 0;
+  FILE *f;
+
+  snprintf (path, sizeof (path), "%s/io.stat", cgroup);
+  f = fopen (path, "r");
+  if (f)
+  {
+    while (fgets (line, sizeof (line), f))
+      if ((p = strstr (line, " rios=")))
+        reads += atol (p + strlen (" rios="));
+    fclose (f);
+    return reads;
+  }
+
+  snprintf (path, sizeof (path), "%s/blkio.throttle.io_serviced", cgroup);
+  f = fopen (path, "r");
+  if (!f)
+    return -1;
+  while (fgets (line, sizeof (line), f))
+    if ((p = strstr (line, " Read ")))
+      reads += atol (p + strlen (" Read "));
+  fclose (f);
+
+  return reads;
+}
+
+static void
+bench_unthrottle (const char *cgroup)
+{
+  char path[320], pid[32];
+
+  /* back to the parent, which has to be left for the cgroup to go */
+  snprintf (path, sizeof (path), "%s/../cgroup.procs", cgroup);
+  snprintf (pid, sizeof (pid), "%d", (int) getpid ());
+  bench_write_file (path, pid);
+  rmdir (cgroup);
+}
+
+/* 16-bit stereo samples, served converted to L16 through read() */
+static int
+bench_create_wav (const char *path)
+{
+  unsigned char header[44] = {
+    'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+    'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 2, 0,
+    0x80, 0xbb, 0, 0, 0x00, 0xee, 0x02, 0, 4, 0, 16, 0,
+    'd', 'a', 't', 'a', 0, 0, 0, 0
+  };
+  char buf[64 * 1024];
+  uint32_t len = BENCH_LENGTH;
+  off_t done;
+  size_t i;
+  int fd;
+
+  for (i = 0; i < 4; i++)
+  {
+    header[4 + i] = ((len + 36) >> (8 * i)) & 0xff;
+    header[40 + i] = (len >> (8 * i)) & 0xff;
+  }
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = (char) (i * 7 + (i >> 9));
+
+  fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return -1;
+  if (write (fd, header, sizeof (header)) != sizeof (header))
+    goto err;
+  for (done = 0; done < BENCH_LENGTH; done += sizeof (buf))
+    if (write (fd, buf, sizeof (buf)) != sizeof (buf))
+      goto err;
+  if (ftruncate (fd, sizeof (header) + BENCH_LENGTH) < 0 || fsync (fd) < 0)
+    goto err;
+  close (fd);
+
+  return 0;
+
+ err:
+  close (fd);
+  return -1;
+}
+
+/* drop a file from the page cache, it was synced when written */
+static void
+bench_evict (const char *path)
+{
+  int fd;
+
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return;
+  posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+  close (fd);
+}
+
+static int
+bench_connect (unsigned short port)
+{
+  struct sockaddr_in addr;
+  int sock;
+
+  sock = socket (AF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    return -1;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (port);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (connect (sock, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+  {
+    close (sock);
+    return -1;
+  }
+
+  return sock;
+}
+
+/* send a request and read the head of the response, with what follows
+   of the body in buf: its length, or -1 if not a 200 */
+static int
+bench_request (int sock, const char *req, int len, char *buf, int size)
+{
+  char *body;
+  ssize_t n;
+
+  if (write (sock, req, len) != len)
+    return -1;
+
+  for (len = 0;;)
+  {
+    n = read (sock, buf + len, size - 1 - len);
+    if (n <= 0)
+      return -1;
+    len += n;
+    buf[len] = '\0';
+    body = strstr (buf, "\r\n\r\n");
+    if (body)
+      break;
+    if (len == size - 1)
+      return -1;
+  }
+  if (strncmp (buf, "HTTP/1.1 200 ", 13))
+    return -1;
+
+  len -= body + 4 - buf;
+  memmove (buf, body + 4, len);
+
+  return len;
+}
+
+/* play the stream's file: data is read when the client buffer has
+   room, and arrives late when playback has already reached it */
+static void *
+bench_play (void *arg)
+{
+  bench_stream_t *s = (bench_stream_t *) arg;
+  char buf[16 * 1024];
+  double played, wait, late;
+  int sock, len;
+  ssize_t n;
+
+  sock = bench_connect (s->port);
+  if (sock < 0)
+    return NULL;
+
+  len = snprintf (buf, sizeof (buf),
+                  "GET /web/%u HTTP/1.1\r\nHost: 127.0.0.1:%u\r\n"
+                  "Connection: close\r\n\r\n", s->id, s->port);
+  s->start = bench_now ();
+  len = bench_request (sock, buf, len, buf, sizeof (buf));
+  if (len < 0)
+    goto end;
+  s->received = len;
+
+  for (;;)
+  {
+    played = bench_now () - s->start - BENCH_PREBUFFER;
+
+    /* a full buffer waits for playback to make room */
+    wait = (double) s->received / BENCH_RATE - played - BENCH_BUFFER;
+    if (wait > 0)
+    {
+      usleep ((useconds_t) (wait * 1e6));
+      continue;
+    }
+
+    n = read (sock, buf, sizeof (buf));
+    if (n <= 0)
+      break;
+
+    late = bench_now () - s->start - BENCH_PREBUFFER
+      - (double) s->received / BENCH_RATE;
+    if (late > s->late)
+      s->late = late;
+    s->received += n;
+  }
+
+ end:
+  close (sock);
+  return NULL;
+}
+
+static int
+bench_streams (unsigned short port, uint32_t *ids, char **paths, int count,
+               const char *cgroup)
+{
+  bench_stream_t *streams;
+  double start, elapsed, late = 0;
+  off_t received = 0;
+  long reads = 0;
+  int i, stalled = 0, failed = 0;
+
+  for (i = 0; i < count; i++)
+    bench_evict (paths[i]);
+
+  streams = calloc (count, sizeof (bench_stream_t));
+  if (!streams)
+    return -1;
+
+  if (cgroup)
+    reads = bench_disk_reads (cgroup);
+  start = bench_now ();
+  for (i = 0; i < count; i++)
+  {
+    streams[i].port = port;
+    streams[i].id = ids[i];
+    pthread_create (&streams[i].thread, NULL, bench_play, &streams[i]);
+  }
+  for (i = 0; i < count; i++)
+  {
+    pthread_join (streams[i].thread, NULL);
+    received += streams[i].received;
+    if (streams[i].received != BENCH_LENGTH)
+      failed++;
+    if (streams[i].late > 0)
+      stalled++;
+    if (streams[i].late > late)
+      late = streams[i].late;
+  }
+  elapsed = bench_now () - start;
+  free (streams);
+
+  printf ("%3d streams: %6.1f MB/s, %2d stalled, up to %5.2f s",
+          count, received / elapsed / 1e6, stalled, late);
+  if (cgroup && reads >= 0)
+    printf (", %ld disk reads", bench_disk_reads (cgroup) - reads);
+  if (failed)
+    printf (", %d cut short", failed);
+  printf ("\n");
+
+  return failed ? -1 : 0;
+}
+
+/* the metadata of an item, browsed by a renderer about to play it */
+static int
+bench_browse (unsigned short port, uint32_t id)
+{
+  char body[1024], req[2048], buf[16 * 1024];
+  int sock, len, res;
+
+  sock = bench_connect (port);
+  if (sock < 0)
+    return -1;
+
+  len = snprintf (body, sizeof (body), BENCH_BROWSE, id);
+  len = snprintf (req, sizeof (req),
+                  "POST " BENCH_CONTROL_URL " HTTP/1.1\r\n"
+                  "Host: 127.0.0.1:%u\r\n"
+                  "Content-Type: text/xml; charset=\"utf-8\"\r\n"
+                  "Content-Length: %d\r\n"
+                  "SOAPACTION: \"urn:schemas-upnp-org:service:"
+                  "ContentDirectory:1#Browse\"\r\n"
+                  "Connection: close\r\n\r\n%s", port, len, body);
+  res = bench_request (sock, req, len, buf, sizeof (buf)) < 0 ? -1 : 0;
+  close (sock);
+
+  return res;
+}
+
+static int
+bench_compare_times (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* time from the GET of items just browsed to their first second */
+static int
+bench_starts (dlna_t *dlna, uint32_t *ids, char **paths, int prefetch)
+{
+  unsigned short port = dlnaGetServerPort ();
+  double times[BENCH_STARTS], start;
+  char buf[16 * 1024];
+  off_t received;
+  int i, sock, len, failed = 0;
+  ssize_t n;
+
+  dlna_set_prefetch (dlna, prefetch ? BENCH_HEAD : 0, 4 * BENCH_HEAD);
+
+  for (i = 0; i < BENCH_STARTS; i++)
+  {
+    times[i] = 0;
+    bench_evict (paths[i]);
+    if (bench_browse (port, ids[i]) < 0)
+    {
+      failed++;
+      continue;
+    }
+    usleep (BENCH_THINK * 1000);
+
+    sock = bench_connect (port);
+    if (sock < 0)
+    {
+      failed++;
+      continue;
+    }
+    len = snprintf (buf, sizeof (buf),
+                    "GET /web/%u HTTP/1.1\r\nHost: 127.0.0.1:%u\r\n"
+                    "Connection: close\r\n\r\n", ids[i], port);
+    start = bench_now ();
+    received = bench_request (sock, buf, len, buf, sizeof (buf));
+    while (received >= 0 && received < BENCH_RATE * BENCH_PREBUFFER)
+    {
+      n = read (sock, buf, sizeof (buf));
+      if (n <= 0)
+        received = -1;
+      else
+        received += n;
+    }
+    times[i] = bench_now () - start;
+    close (sock);
+    if (received < 0)
+      failed++;
+  }
+
+  qsort (times, BENCH_STARTS, sizeof (double), bench_compare_times);
+  printf ("start after browsing, prefetch %-3s: %6.1f ms median, "
+          "%6.1f ms worst", prefetch ? "on" : "off",
+          times[BENCH_STARTS / 2] * 1000, times[BENCH_STARTS - 1] * 1000);
+  if (failed)
+    printf (", %d of %d failed", failed, BENCH_STARTS);
+  printf ("\n");
+
+  return failed ? -1 : 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  static const int counts[] = { 8, 32, BENCH_STREAMS_MAX };
+  uint32_t ids[BENCH_STREAMS_MAX];
+  char *paths[BENCH_STREAMS_MAX];
+  const char *dir = ".";
+  char *cgroup = NULL;
+  char name[32];
+  dlna_t *dlna;
+  size_t i;
+  int res = 0;
+
+  if (argc > 2)
+  {
+    printf ("usage: %s [directory]\n", argv[0]);
+    return -1;
+  }
+  if (argc == 2)
+    dir = argv[1];
+
+  signal (SIGPIPE, SIG_IGN);
+
+  dlna = dlna_init ();
+  dlna_set_verbosity (dlna, DLNA_MSG_NONE);
+  dlna_set_extension_check (dlna, 1);
+  dlna_register_all_media_profiles (dlna);
+  dlna_set_interface (dlna, "lo");
+  if (dlna_dms_init (dlna) != DLNA_ST_OK)
+  {
+    printf ("cannot start the media server\n");
+    dlna_uninit (dlna);
+    return -1;
+  }
+
+  memset (paths, 0, sizeof (paths));
+  for (i = 0; i < BENCH_STREAMS_MAX; i++)
+  {
+    paths[i] = malloc (strlen (dir) + 64);
+    sprintf (paths[i], "%s/dlna-stream-bench-%02zu.wav", dir, i);
+    sprintf (name, "Stream %02zu", i);
+    if (bench_create_wav (paths[i]) < 0
+        || !(ids[i] = dlna_vfs_add_resource (dlna, name, paths[i],
+                                             44 + BENCH_LENGTH, 0)))
+    {
+      printf ("cannot share %s\n", paths[i]);
+      res = -1;
+      goto end;
+    }
+  }
+
+  cgroup = bench_throttle (dir);
+  if (cgroup)
+    printf ("reads throttled to %d IOPS and %d MB/s in %s\n",
+            BENCH_IOPS, BENCH_BPS / 1000000, cgroup);
+  else
+    printf ("storage not throttled, needs root and the io controller\n");
+  printf ("%d s of %d kB/s per stream, %d s buffered ahead, "
+          "kernel readahead %d kB\n", BENCH_SECONDS, BENCH_RATE / 1000,
+          BENCH_BUFFER, bench_readahead (dir));
+
+  for (i = 0; i < sizeof (counts) / sizeof (counts[0]); i++)
+    if (bench_streams (dlnaGetServerPort (), ids, paths, counts[i],
+                       cgroup) < 0)
+      res = -1;
+  if (bench_starts (dlna, ids, paths, 0) < 0
+      || bench_starts (dlna, ids, paths, 1) < 0)
+    res = -1;
+
+  if (cgroup)
+    bench_unthrottle (cgroup);
+
+ end:
+  dlna_dms_uninit (dlna);
+  dlna_uninit (dlna);
+  for (i = 0; i < BENCH_STREAMS_MAX; i++)
+    if (paths[i])
+    {
+      unlink (paths[i]);
+      free (paths[i]);
+    }
+
+  return res;
+}